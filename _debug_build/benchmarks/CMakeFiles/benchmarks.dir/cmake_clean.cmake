@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/benchmarks"
+  "../bin/benchmarks.pdb"
+  "CMakeFiles/benchmarks.dir/main.cpp.o"
+  "CMakeFiles/benchmarks.dir/main.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/benchmarks.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
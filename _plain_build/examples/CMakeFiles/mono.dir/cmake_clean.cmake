@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/mono"
+  "../bin/mono.pdb"
+  "CMakeFiles/mono.dir/mono.cpp.o"
+  "CMakeFiles/mono.dir/mono.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/mono.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/stereo"
+  "../bin/stereo.pdb"
+  "CMakeFiles/stereo.dir/stereo.cpp.o"
+  "CMakeFiles/stereo.dir/stereo.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/stereo.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/unittests"
+  "../bin/unittests.pdb"
+  "CMakeFiles/unittests.dir/main.cpp.o"
+  "CMakeFiles/unittests.dir/main.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/unittests.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
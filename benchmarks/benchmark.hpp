@@ -0,0 +1,298 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-FileContributor: Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+#ifndef BUILD_TYPE
+    #define BUILD_TYPE "unknown"
+#endif
+
+
+//----------------------------------------------------------------------------------------
+/// @brief  Minimal benchmarking harness, in the spirit of Google Benchmark
+///
+/// Each benchmark is a function looping on `State::keepRunning()`, which runs it until
+/// a minimum duration is reached. The results are written either as a table or as JSON
+/// (using the same layout than Google Benchmark, so the same tools can process them).
+//----------------------------------------------------------------------------------------
+namespace bench {
+
+    typedef std::chrono::steady_clock steady_clock_t;
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  State of a running benchmark
+    //------------------------------------------------------------------------------------
+    class State
+    {
+    public:
+        State(double minimum_time)
+        : _minimum_time(minimum_time)
+        {
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Indicates if another iteration must be performed
+        //--------------------------------------------------------------------------------
+        inline bool keepRunning()
+        {
+            steady_clock_t::time_point now = steady_clock_t::now();
+
+            if (!_started)
+            {
+                _started = true;
+                _start = now;
+                return true;
+            }
+
+            ++_iterations;
+
+            if ((std::chrono::duration<double>(now - _start).count() + _elapsed) < _minimum_time)
+                return true;
+
+            _elapsed += std::chrono::duration<double>(now - _start).count();
+            return false;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Exclude the following code from the measures (until `resumeTiming()`)
+        //--------------------------------------------------------------------------------
+        inline void pauseTiming()
+        {
+            _elapsed += std::chrono::duration<double>(steady_clock_t::now() - _start).count();
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Resume the measures after a call to `pauseTiming()`
+        //--------------------------------------------------------------------------------
+        inline void resumeTiming()
+        {
+            _start = steady_clock_t::now();
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Marks the benchmark as failed
+        //--------------------------------------------------------------------------------
+        inline void skip(const std::string& message)
+        {
+            _error = message;
+        }
+
+        inline void setItemsProcessed(uint64_t nb_items)
+        {
+            _nb_items = nb_items;
+        }
+
+        inline void setCounter(const std::string& name, double value)
+        {
+            _counters[name] = value;
+        }
+
+        inline uint64_t iterations() const
+        {
+            return _iterations;
+        }
+
+        inline double elapsed() const
+        {
+            return _elapsed;
+        }
+
+        inline uint64_t itemsProcessed() const
+        {
+            return _nb_items;
+        }
+
+        inline const std::string& error() const
+        {
+            return _error;
+        }
+
+        inline const std::map<std::string, double>& counters() const
+        {
+            return _counters;
+        }
+
+
+    private:
+        double _minimum_time;
+
+        bool _started = false;
+        steady_clock_t::time_point _start;
+        double _elapsed = 0.0;
+        uint64_t _iterations = 0;
+
+        uint64_t _nb_items = 0;
+        std::map<std::string, double> _counters;
+        std::string _error;
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Holds the list of benchmarks, run them and output the results
+    //------------------------------------------------------------------------------------
+    class Runner
+    {
+    public:
+        typedef std::function<void(State&)> function_t;
+
+
+        inline void add(const std::string& name, const function_t& function)
+        {
+            _benchmarks.push_back({ name, function });
+        }
+
+        inline void setJsonOutput(bool enabled)
+        {
+            _json = enabled;
+        }
+
+        inline void setFilter(const std::string& filter)
+        {
+            _filter = filter;
+        }
+
+        inline void setMinimumTime(double seconds)
+        {
+            _minimum_time = seconds;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Run all the benchmarks matching the filter
+        //--------------------------------------------------------------------------------
+        void run(std::ostream& output)
+        {
+            if (_json)
+            {
+                output << "{" << std::endl;
+                output << "  \"context\": {" << std::endl;
+                output << "    \"library\": \"knm_synthesizer\"," << std::endl;
+                output << "    \"num_cpus\": " << std::thread::hardware_concurrency() << "," << std::endl;
+                output << "    \"library_build_type\": \"" << BUILD_TYPE << "\"" << std::endl;
+                output << "  }," << std::endl;
+                output << "  \"benchmarks\": [";
+            }
+            else
+            {
+                char line[200];
+                snprintf(line, sizeof(line), "%-45s %15s %12s %15s", "Benchmark", "Time (ns)",
+                         "Iterations", "Items/s");
+                output << line << std::endl;
+                output << std::string(90, '-') << std::endl;
+            }
+
+            bool first = true;
+
+            for (const auto& benchmark : _benchmarks)
+            {
+                if (!_filter.empty() && (benchmark.name.find(_filter) == std::string::npos))
+                    continue;
+
+                State state(_minimum_time);
+                benchmark.function(state);
+
+                if (_json)
+                    writeJson(output, benchmark.name, state, first);
+                else
+                    writeLine(output, benchmark.name, state);
+
+                first = false;
+            }
+
+            if (_json)
+            {
+                output << std::endl << "  ]" << std::endl;
+                output << "}" << std::endl;
+            }
+        }
+
+
+    private:
+        void writeLine(std::ostream& output, const std::string& name, const State& state)
+        {
+            char line[200];
+
+            if (!state.error().empty())
+            {
+                snprintf(line, sizeof(line), "%-45s ERROR: %s", name.c_str(),
+                         state.error().c_str());
+                output << line << std::endl;
+                return;
+            }
+
+            double time = (state.iterations() > 0 ? state.elapsed() * 1e9 / state.iterations() : 0.0);
+            double items = (state.elapsed() > 0.0 ? state.itemsProcessed() / state.elapsed() : 0.0);
+
+            snprintf(line, sizeof(line), "%-45s %15.1f %12llu %15.4g", name.c_str(), time,
+                     (unsigned long long) state.iterations(), items);
+            output << line;
+
+            for (const auto& counter : state.counters())
+                output << " " << counter.first << "=" << counter.second;
+
+            output << std::endl;
+        }
+
+        //--------------------------------------------------------------------------------
+
+        void writeJson(
+            std::ostream& output, const std::string& name, const State& state, bool first
+        )
+        {
+            output << (first ? "" : ",") << std::endl;
+            output << "    {" << std::endl;
+            output << "      \"name\": \"" << name << "\"," << std::endl;
+            output << "      \"run_type\": \"iteration\"," << std::endl;
+
+            if (!state.error().empty())
+            {
+                output << "      \"error_occurred\": true," << std::endl;
+                output << "      \"error_message\": \"" << state.error() << "\"" << std::endl;
+                output << "    }";
+                return;
+            }
+
+            double time = (state.iterations() > 0 ? state.elapsed() * 1e9 / state.iterations() : 0.0);
+            double items = (state.elapsed() > 0.0 ? state.itemsProcessed() / state.elapsed() : 0.0);
+
+            output << "      \"iterations\": " << state.iterations() << "," << std::endl;
+            output << "      \"real_time\": " << time << "," << std::endl;
+            output << "      \"time_unit\": \"ns\"," << std::endl;
+
+            for (const auto& counter : state.counters())
+                output << "      \"" << counter.first << "\": " << counter.second << "," << std::endl;
+
+            output << "      \"items_per_second\": " << items << std::endl;
+            output << "    }";
+        }
+
+
+    private:
+        struct benchmark_t
+        {
+            std::string name;
+            function_t function;
+        };
+
+        std::vector<benchmark_t> _benchmarks;
+
+        bool _json = false;
+        std::string _filter;
+        double _minimum_time = 0.5;
+    };
+}
@@ -0,0 +1,523 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-FileContributor: Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+*/
+
+#define KNM_SYNTHESIZER_IMPLEMENTATION
+#include <knm_synthesizer.hpp>
+
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+#ifdef __linux__
+    #include <fstream>
+    #include <unistd.h>
+#endif
+
+using namespace knm::synth;
+
+
+#ifndef DATA_DIR
+    #define DATA_DIR ""
+#endif
+
+
+/********************************** HELPER FUNCTIONS ***********************************/
+
+// Current resident memory of the process, in kilobytes (negative if unknown)
+static double resident_memory_kb()
+{
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+
+    size_t size = 0;
+    size_t resident = 0;
+    if (!(statm >> size >> resident))
+        return -1.0;
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024.0);
+#else
+    return -1.0;
+#endif
+}
+
+//-----------------------------------------------------------------------
+
+// Resident memory used by the objects created by 'load', in kilobytes (negative if
+// unknown). The objects must be kept alive by 'load' until it returns.
+template<typename LOAD>
+static double loaded_memory_kb(LOAD load)
+{
+    double before = resident_memory_kb();
+    if (before < 0.0)
+        return -1.0;
+
+    double after = load();
+    if (after < 0.0)
+        return -1.0;
+
+    return std::max(after - before, 0.0);
+}
+
+//-----------------------------------------------------------------------
+
+// Presses 'nb_voices' keys, alternating the mono and the stereo presets
+static void press_keys(Synthesizer& synthesizer, size_t nb_voices)
+{
+    synthesizer.reset();
+    synthesizer.configureChannel(0, 0, 0);
+    synthesizer.configureChannel(1, 0, 1);
+
+    for (size_t i = 0; i < nb_voices; ++i)
+        synthesizer.noteOn(i % 2, 30 + (i / 2) % 70, 100);
+}
+
+
+/************************************* SYNTHESIZER *************************************/
+
+static void register_render_benchmarks(bench::Runner& runner, const std::string& path)
+{
+    const size_t NB_SAMPLES = 4096;
+
+    struct configuration_t
+    {
+        bool stereo;
+        uint16_t block_size;
+        size_t nb_voices;
+        bool fast_math;
+    };
+
+    std::vector<configuration_t> configurations;
+
+    for (bool stereo : { false, true })
+    {
+        for (uint16_t block_size : { 16, 64, 256 })
+        {
+            for (size_t nb_voices : { 16, 64, 256 })
+                configurations.push_back({ stereo, block_size, nb_voices, false });
+        }
+    }
+
+    configurations.push_back({ true, 64, 256, true });
+
+    for (const auto& configuration : configurations)
+    {
+        const bool stereo = configuration.stereo;
+        const uint16_t block_size = configuration.block_size;
+        const size_t nb_voices = configuration.nb_voices;
+        const bool fast_math = configuration.fast_math;
+
+        std::string name = std::string("render/") + (stereo ? "stereo" : "mono") +
+                           "/block:" + std::to_string(block_size) +
+                           "/voices:" + std::to_string(nb_voices) +
+                           (fast_math ? "/fast_math" : "");
+
+        runner.add(name, [=](bench::State& state)
+        {
+            SynthesizerSettings settings(44100);
+            settings.setBlockSize(block_size);
+            settings.setMaximumPolyphony(nb_voices);
+            settings.enableFastMath(fast_math);
+
+            Synthesizer synthesizer(settings);
+            if (!synthesizer.loadSoundFont(path))
+            {
+                state.skip("Failed to load the SoundFont file");
+                return;
+            }
+
+            std::vector<float> left(NB_SAMPLES);
+            std::vector<float> right(NB_SAMPLES);
+
+            press_keys(synthesizer, nb_voices);
+
+            while (state.keepRunning())
+            {
+                // Keep the requested number of voices alive
+                if (synthesizer.nbActiveVoices() < nb_voices)
+                {
+                    state.pauseTiming();
+                    press_keys(synthesizer, nb_voices);
+                    state.resumeTiming();
+                }
+
+                if (stereo)
+                    synthesizer.render(left.data(), right.data(), NB_SAMPLES);
+                else
+                    synthesizer.render(left.data(), NB_SAMPLES);
+            }
+
+            state.setItemsProcessed(state.iterations() * NB_SAMPLES);
+            state.setCounter("active_voices", synthesizer.nbActiveVoices());
+        });
+    }
+}
+
+//-----------------------------------------------------------------------
+
+static void register_note_on_benchmarks(bench::Runner& runner, const std::string& path)
+{
+    for (bool stealing : { false, true })
+    {
+        std::string name = std::string("noteOn/") + (stealing ? "stealing" : "free_voices");
+
+        runner.add(name, [=](bench::State& state)
+        {
+            SynthesizerSettings settings(44100);
+            Synthesizer synthesizer(settings);
+            if (!synthesizer.loadSoundFont(path))
+            {
+                state.skip("Failed to load the SoundFont file");
+                return;
+            }
+
+            const size_t polyphony = settings.maximumPolyphony();
+
+            // With stealing, all the voices are always in use. Without, the voices
+            // are released before running out of them.
+            press_keys(synthesizer, stealing ? polyphony : 0);
+
+            uint32_t i = 0;
+            while (state.keepRunning())
+            {
+                if (!stealing && (synthesizer.nbActiveVoices() >= polyphony - 2))
+                {
+                    state.pauseTiming();
+                    press_keys(synthesizer, 0);
+                    state.resumeTiming();
+                }
+
+                synthesizer.noteOn(i % 2, 30 + (i / 2) % 70, 100);
+                ++i;
+            }
+
+            state.setItemsProcessed(state.iterations());
+        });
+    }
+}
+
+//-----------------------------------------------------------------------
+
+static void register_load_benchmarks(bench::Runner& runner, const std::string& path)
+{
+    for (auto mode : { knm::sf::LOAD_MODE_FLOAT, knm::sf::LOAD_MODE_MEMORY_MAPPED })
+    {
+        std::string name = std::string("loadSoundFont/") +
+                           (mode == knm::sf::LOAD_MODE_FLOAT ? "float" : "memory_mapped");
+
+        runner.add(name, [=](bench::State& state)
+        {
+            // Measured before the loop, on a separate object, so the memory freed by the
+            // iterations (and then reused by the next ones) doesn't hide the real usage
+            double memory = loaded_memory_kb([&]()
+            {
+                knm::sf::SoundFont soundfont;
+                if (!soundfont.load(std::filesystem::path(path), mode))
+                    return -1.0;
+
+                return resident_memory_kb();
+            });
+
+            SynthesizerSettings settings(44100);
+            Synthesizer synthesizer(settings);
+
+            while (state.keepRunning())
+            {
+                if (!synthesizer.loadSoundFont(std::filesystem::path(path), mode))
+                {
+                    state.skip("Failed to load the SoundFont file");
+                    return;
+                }
+            }
+
+            state.setItemsProcessed(state.iterations());
+
+            if (memory >= 0.0)
+                state.setCounter("memory_kb", memory);
+        });
+    }
+
+    for (bool float_samples : { true, false })
+    {
+        for (auto mode : { knm::sf::LOAD_MODE_FLOAT, knm::sf::LOAD_MODE_MEMORY_MAPPED })
+        {
+            std::string name = std::string("loadCache/") +
+                               (float_samples ? "float_samples/" : "int_samples/") +
+                               (mode == knm::sf::LOAD_MODE_FLOAT ? "float" : "memory_mapped");
+
+            runner.add(name, [=](bench::State& state)
+            {
+                std::filesystem::path cache_path =
+                    std::filesystem::temp_directory_path() / "knm_synthesizer_benchmark.cache";
+
+                knm::sf::SoundFont original;
+                if (!original.load(std::filesystem::path(path), knm::sf::LOAD_MODE_MEMORY_MAPPED) ||
+                    !original.saveCache(cache_path, float_samples))
+                {
+                    state.skip("Failed to create the cache file");
+                    return;
+                }
+
+                double memory = loaded_memory_kb([&]()
+                {
+                    knm::sf::SoundFont soundfont;
+                    if (!soundfont.loadCache(cache_path, mode))
+                        return -1.0;
+
+                    return resident_memory_kb();
+                });
+
+                while (state.keepRunning())
+                {
+                    knm::sf::SoundFont soundfont;
+                    if (!soundfont.loadCache(cache_path, mode))
+                    {
+                        state.skip("Failed to load the cache file");
+                        return;
+                    }
+                }
+
+                std::filesystem::remove(cache_path);
+
+                state.setItemsProcessed(state.iterations());
+
+                if (memory >= 0.0)
+                    state.setCounter("memory_kb", memory);
+            });
+        }
+    }
+}
+
+
+/*************************************** KERNELS ***************************************/
+
+static void register_kernel_benchmarks(bench::Runner& runner)
+{
+    const size_t BLOCK_SIZE = 64;
+
+    const char* INTERPOLATION_NAMES[] = { "nearest", "linear", "cubic", "sinc" };
+
+    for (int i = 0; i < 4; ++i)
+    {
+        interpolation_mode_t mode = static_cast<interpolation_mode_t>(i);
+
+        runner.add(std::string("Sampler::process/") + INTERPOLATION_NAMES[i],
+                   [=](bench::State& state)
+        {
+            // One second of a looped sine wave, played a bit higher than recorded
+            const size_t SIZE = 44100;
+            std::vector<float> sine(SIZE + 46, 0.0f);
+            for (size_t j = 0; j < SIZE; ++j)
+                sine[j] = sinf(2.0f * M_PI * j * 440.0f / 44100.0f);
+
+            Sampler sampler(44100, mode);
+            sampler.start(
+                sine.data(), 0, SIZE, LOOP_MODE_CONTINUOUS, 100, SIZE - 100, 44100, 69,
+                0, 0, 100
+            );
+
+            float block[BLOCK_SIZE];
+            while (state.keepRunning())
+                sampler.process(block, BLOCK_SIZE, 70.3f);
+
+            state.setItemsProcessed(state.iterations() * BLOCK_SIZE);
+        });
+    }
+
+    runner.add("BiQuadFilter::process", [=](bench::State& state)
+    {
+        SynthesizerSettings settings(44100);
+        BiQuadFilter filter(settings);
+        filter.clearBuffer();
+        filter.setLowPassFilter(1000.0f, decibels_to_linear(6.0f));
+
+        float block[BLOCK_SIZE];
+        for (size_t j = 0; j < BLOCK_SIZE; ++j)
+            block[j] = (j % 2 ? 0.5f : -0.5f);
+
+        while (state.keepRunning())
+            filter.process(block, BLOCK_SIZE);
+
+        state.setItemsProcessed(state.iterations() * BLOCK_SIZE);
+    });
+
+    // Several voices, one after the other or in the SIMD lanes
+    for (bool batch : { false, true })
+    {
+        const size_t NB_FILTERS = 16;
+
+        runner.add(std::string("BiQuadFilter::process/16_filters") + (batch ? "/batch" : ""),
+                   [=](bench::State& state)
+        {
+            SynthesizerSettings settings(44100);
+
+            std::vector<BiQuadFilter> filters(NB_FILTERS, BiQuadFilter(settings));
+            std::vector<float> blocks(NB_FILTERS * BLOCK_SIZE);
+
+            BiQuadFilter* filter_pointers[NB_FILTERS];
+            float* block_pointers[NB_FILTERS];
+
+            for (size_t i = 0; i < NB_FILTERS; ++i)
+            {
+                filters[i].clearBuffer();
+                filters[i].setLowPassFilter(500.0f + 100.0f * i, decibels_to_linear(6.0f));
+
+                filter_pointers[i] = &filters[i];
+                block_pointers[i] = blocks.data() + i * BLOCK_SIZE;
+
+                for (size_t j = 0; j < BLOCK_SIZE; ++j)
+                    block_pointers[i][j] = (j % 2 ? 0.5f : -0.5f);
+            }
+
+            while (state.keepRunning())
+            {
+                if (batch)
+                {
+                    BiQuadFilter::process(filter_pointers, block_pointers, NB_FILTERS, BLOCK_SIZE);
+                }
+                else
+                {
+                    for (size_t i = 0; i < NB_FILTERS; ++i)
+                        filters[i].process(block_pointers[i], BLOCK_SIZE);
+                }
+            }
+
+            state.setItemsProcessed(state.iterations() * NB_FILTERS * BLOCK_SIZE);
+        });
+    }
+
+    // The per-block updates of the envelopes and LFOs of a track (the values they
+    // compute are constant during a block), for several voices
+    runner.add("envelopes_and_lfos/16_tracks", [=](bench::State& state)
+    {
+        const size_t NB_TRACKS = 16;
+
+        SynthesizerSettings settings(44100);
+
+        std::vector<VolumeEnvelope> volume_envelopes(NB_TRACKS, VolumeEnvelope(44100));
+        std::vector<ModulationEnvelope> modulation_envelopes(NB_TRACKS, ModulationEnvelope(44100));
+        std::vector<Lfo> vibrato_lfos(NB_TRACKS, Lfo(settings));
+        std::vector<Lfo> modulation_lfos(NB_TRACKS, Lfo(settings));
+
+        auto start = [&](size_t i)
+        {
+            volume_envelopes[i].start(0.0f, 0.01f, 0.0f, 1.0f + 0.5f * i, 0.0f, 1.0f);
+            modulation_envelopes[i].start(0.0f, 0.01f, 0.0f, 1.0f + 0.5f * i, 0.0f, 1.0f);
+            vibrato_lfos[i].start(0.0f, 5.0f + 0.1f * i);
+            modulation_lfos[i].start(0.1f, 3.0f + 0.1f * i);
+        };
+
+        for (size_t i = 0; i < NB_TRACKS; ++i)
+            start(i);
+
+        while (state.keepRunning())
+        {
+            for (size_t i = 0; i < NB_TRACKS; ++i)
+            {
+                if (!volume_envelopes[i].process(BLOCK_SIZE))
+                    start(i);
+
+                modulation_envelopes[i].process(BLOCK_SIZE);
+                vibrato_lfos[i].process(BLOCK_SIZE);
+                modulation_lfos[i].process(BLOCK_SIZE);
+            }
+        }
+
+        state.setItemsProcessed(state.iterations() * NB_TRACKS * BLOCK_SIZE);
+    });
+
+    // The kernels used by 'Synthesizer::writeBlock()'
+    runner.add("writeBlock/constant", [=](bench::State& state)
+    {
+        std::vector<float> source(BLOCK_SIZE, 0.25f);
+        std::vector<float> destination(BLOCK_SIZE, 0.0f);
+
+        while (state.keepRunning())
+            mix_constant(destination.data(), source.data(), 0.5f, BLOCK_SIZE);
+
+        state.setItemsProcessed(state.iterations() * BLOCK_SIZE);
+    });
+
+    runner.add("writeBlock/ramp", [=](bench::State& state)
+    {
+        std::vector<float> source(BLOCK_SIZE, 0.25f);
+        std::vector<float> destination(BLOCK_SIZE, 0.0f);
+
+        while (state.keepRunning())
+            mix_ramp(destination.data(), source.data(), 0.5f, 0.001f, BLOCK_SIZE);
+
+        state.setItemsProcessed(state.iterations() * BLOCK_SIZE);
+    });
+
+    runner.add("writeBlock/ramp_stereo", [=](bench::State& state)
+    {
+        std::vector<float> source(BLOCK_SIZE, 0.25f);
+        std::vector<float> left(BLOCK_SIZE, 0.0f);
+        std::vector<float> right(BLOCK_SIZE, 0.0f);
+
+        while (state.keepRunning())
+        {
+            mix_ramp_stereo(
+                left.data(), right.data(), source.data(), 0.5f, 0.001f, 0.4f, -0.001f,
+                BLOCK_SIZE
+            );
+        }
+
+        state.setItemsProcessed(state.iterations() * BLOCK_SIZE);
+    });
+}
+
+
+/**************************************** MAIN *****************************************/
+
+int main(int argc, char** argv)
+{
+    bench::Runner runner;
+    std::string path = DATA_DIR "440_16bits.sf2";
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "--help") == 0) || (strcmp(argv[i], "-h") == 0))
+        {
+            std::cout << "Usage: benchmarks [--json] [--filter <text>] [--min-time <seconds>] [<soundfont>]" << std::endl;
+            std::cout << std::endl;
+            std::cout << "Measure the performances of the synthesizer" << std::endl;
+            std::cout << std::endl;
+            std::cout << "    --json        Output the results in JSON" << std::endl;
+            std::cout << "    --filter      Only run the benchmarks whose name contains <text>" << std::endl;
+            std::cout << "    --min-time    Minimum duration of each benchmark (default: 0.5)" << std::endl;
+            return 0;
+        }
+        else if (strcmp(argv[i], "--json") == 0)
+        {
+            runner.setJsonOutput(true);
+        }
+        else if ((strcmp(argv[i], "--filter") == 0) && (i + 1 < argc))
+        {
+            runner.setFilter(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--min-time") == 0) && (i + 1 < argc))
+        {
+            runner.setMinimumTime(atof(argv[++i]));
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    register_render_benchmarks(runner, path);
+    register_note_on_benchmarks(runner, path);
+    register_load_benchmarks(runner, path);
+    register_kernel_benchmarks(runner);
+
+    runner.run(std::cout);
+
+    return 0;
+}
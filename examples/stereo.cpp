@@ -36,11 +36,10 @@ int main(int argc, char** argv)
     // Allocate the buffers (for a duration of 4 seconds)
     size_t size = 4.0f * settings.sampleRate();
 
-    float* left = new float[size];
-    float* right = new float[size];
+    // Interleaved: left, right, left, right, ...
+    float* buffer = new float[2 * size];
 
-    memset((char*) left, 0, size * sizeof(float));
-    memset((char*) right, 0, size * sizeof(float));
+    memset((char*) buffer, 0, 2 * size * sizeof(float));
 
     // Play some notes, each during 0.5 second
     uint8_t notes[] = {60, 62, 64, 65, 67, 69, 71, 72};
@@ -56,7 +55,7 @@ int main(int argc, char** argv)
         if (i < nb_notes)
             synthesizer.noteOn(0, notes[i], 100);
 
-        synthesizer.render(left + offset, right + offset, note_duration);
+        synthesizer.renderInterleaved(buffer + 2 * offset, note_duration);
 
         offset += note_duration;
     }
@@ -66,15 +65,10 @@ int main(int argc, char** argv)
     std::ofstream stream;
     stream.open(argv[2], std::ios_base::binary);
 
-    for (int i = 0; i < size; ++i)
-    {
-        stream.write((const char*) (&left[i]), sizeof(float));
-        stream.write((const char*) (&right[i]), sizeof(float));
-    }
+    stream.write((const char*) buffer, 2 * size * sizeof(float));
 
     // Cleanup
-    delete[] left;
-    delete[] right;
+    delete[] buffer;
 
     return 0;
 }
@@ -103,8 +103,11 @@ LICENSE
 #pragma once
 
 #include <filesystem>
-#include <string>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 
@@ -113,6 +116,21 @@ LICENSE
     #include <streambuf>
     #include <string>
     #include <cstring>
+
+    #ifdef _WIN32
+        #ifndef NOMINMAX
+            #define NOMINMAX
+        #endif
+        #ifndef WIN32_LEAN_AND_MEAN
+            #define WIN32_LEAN_AND_MEAN
+        #endif
+        #include <windows.h>
+    #else
+        #include <fcntl.h>
+        #include <sys/mman.h>
+        #include <sys/stat.h>
+        #include <unistd.h>
+    #endif
 #endif
 
 
@@ -255,6 +273,45 @@ namespace sf {
     typedef std::map<generator_type_t, generator_amount_t> generator_map_t;
 
 
+    //------------------------------------------------------------------------------------
+    /// @brief  Represents a list of generators, stored in a fixed-size array indexed by
+    ///         generator type (no memory allocation)
+    //------------------------------------------------------------------------------------
+    struct generator_set_t
+    {
+        generator_amount_t values[GEN_TYPE_UNUSED_END] = {};    ///< The values of the generators
+        uint64_t mask = 0;                                      ///< One bit per generator present
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Indicates if a generator is present
+        //--------------------------------------------------------------------------------
+        inline bool contains(generator_type_t type) const
+        {
+            return (type < GEN_TYPE_UNUSED_END) && ((mask >> type) & 1);
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the value of a generator or a default value if not present
+        //--------------------------------------------------------------------------------
+        inline generator_amount_t get(generator_type_t type, generator_amount_t default_value) const
+        {
+            return (contains(type) ? values[type] : default_value);
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Set the value of a generator (ignored for invalid generator types)
+        //--------------------------------------------------------------------------------
+        inline void set(generator_type_t type, generator_amount_t value)
+        {
+            if (type >= GEN_TYPE_UNUSED_END)
+                return;
+
+            values[type] = value;
+            mask |= uint64_t(1) << type;
+        }
+    };
+
+
     //------------------------------------------------------------------------------------
     /// @brief  The different modulator source types (for General Controller modulator
     ///         sources)
@@ -373,11 +430,13 @@ namespace sf {
     //------------------------------------------------------------------------------------
     /// @brief  The different types of modulator transforms
     ///
-    /// The SoundFont v2.1 specification only defines one transform.
+    /// The SoundFont v2.1 specification only defines one transform, v2.4 adds the
+    /// absolute value.
     //------------------------------------------------------------------------------------
     enum modulator_transform_t
     {
         MOD_TRANSFORM_LINEAR = 0,
+        MOD_TRANSFORM_ABSOLUTE_VALUE = 2,
     };
 
 
@@ -487,6 +546,9 @@ namespace sf {
         range_t velocities_range;
         generator_map_t generators;
         modulator_map_t modulators;
+        generator_set_t generator_set;  ///< Same content than 'generators', for fast access
+        uint16_t target = 0;            ///< Index of the instrument (for a preset zone) or
+                                        ///  of the sample (for an instrument zone) to use
     };
 
 
@@ -505,6 +567,19 @@ namespace sf {
     typedef preset_zone_t instrument_zone_t;
 
 
+    //------------------------------------------------------------------------------------
+    /// @brief  Index of the zones (of a preset or an instrument) valid for each key
+    ///
+    /// The zones valid for the key 'k' are 'zones[offsets[k]]' to 'zones[offsets[k+1]-1]'
+    /// (indices in the list of zones), in the order they appear in the SoundFont file.
+    //------------------------------------------------------------------------------------
+    struct key_index_t
+    {
+        uint32_t offsets[129] = { 0 };
+        std::vector<uint16_t> zones;
+    };
+
+
     //------------------------------------------------------------------------------------
     /// @brief  Identifier for a preset (bank:number)
     //------------------------------------------------------------------------------------
@@ -516,7 +591,7 @@ namespace sf {
         /// @brief Comparison operator for use in maps
         inline bool operator<(const preset_id_t& other) const
         {
-            return (bank < other.bank) || (number < other.number);
+            return (bank < other.bank) || ((bank == other.bank) && (number < other.number));
         }
     };
 
@@ -528,6 +603,7 @@ namespace sf {
     {
         std::string name;
         std::vector<preset_zone_t> zones;
+        key_index_t key_index;              ///< Index of the zones valid for each key
     };
 
 
@@ -544,6 +620,7 @@ namespace sf {
     {
         std::string name;
         std::vector<instrument_zone_t> zones;
+        key_index_t key_index;              ///< Index of the zones valid for each key
     };
 
 
@@ -560,6 +637,9 @@ namespace sf {
         SAMPLE_TYPE_ROM_RIGHT = 0x8002,
         SAMPLE_TYPE_ROM_LEFT = 0x8004,
         SAMPLE_TYPE_ROM_LINKED = 0x8008,
+
+        SAMPLE_TYPE_COMPRESSED = 0x0010,    ///< (SF3) Flag of the compressed samples in the
+                                            ///  file, removed from 'sample_t::sample_type'
     };
 
 
@@ -582,6 +662,264 @@ namespace sf {
                                     ///  sample on playback
         sample_type_t sample_type;  ///< Type of the sample
         uint16_t sample_link;       ///< Index of the other channel sample (if non-mono)
+        bool compressed = false;    ///< (SF3) Indicates if the audio data is compressed (Ogg
+                                    ///  Vorbis). 'start' and 'end' are then offsets (in
+                                    ///  bytes) in the compressed data, and the loop points
+                                    ///  are relative to the start of the decoded audio data
+                                    ///  (see SoundFont::getDecodedSample())
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  The ways to load a SoundFont file
+    //------------------------------------------------------------------------------------
+    enum load_mode_t
+    {
+        LOAD_MODE_FLOAT,            ///< The audio data is converted to floats in memory
+        LOAD_MODE_MEMORY_MAPPED,    ///< The file is memory-mapped and the audio data is kept
+                                    ///  in its original 16-bits (or 24-bits) format
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  The formats in which the audio data can be stored in memory
+    //------------------------------------------------------------------------------------
+    enum sample_format_t
+    {
+        SAMPLE_FORMAT_FLOAT,        ///< Floats in the [-1, 1] range
+        SAMPLE_FORMAT_INT16,        ///< Signed 16-bits integers
+        SAMPLE_FORMAT_INT24,        ///< Signed 16-bits integers + 8 bits of LSB (sm24 chunk)
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Gives access to the buffer of audio data, whatever its format is
+    ///
+    /// The conversion to float of the integer formats is identical to the one performed
+    /// when the SoundFont file is loaded with LOAD_MODE_FLOAT.
+    //------------------------------------------------------------------------------------
+    struct sample_buffer_t
+    {
+        sample_format_t format = SAMPLE_FORMAT_FLOAT;   ///< Format of the audio data
+        const float* data = nullptr;                    ///< The audio data (SAMPLE_FORMAT_FLOAT)
+        const int16_t* data16 = nullptr;                ///< The 16 MSB of the audio data
+                                                        ///  (SAMPLE_FORMAT_INT16/INT24)
+        const uint8_t* data8 = nullptr;                 ///< The 8 LSB of the audio data
+                                                        ///  (SAMPLE_FORMAT_INT24)
+
+        sample_buffer_t() = default;
+
+        sample_buffer_t(const float* buffer)
+        : data(buffer)
+        {
+        }
+
+        sample_buffer_t(const int16_t* msb, const uint8_t* lsb = nullptr)
+        : format(lsb ? SAMPLE_FORMAT_INT24 : SAMPLE_FORMAT_INT16), data16(msb), data8(lsb)
+        {
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns one value of the audio data, for a known format
+        //--------------------------------------------------------------------------------
+        template<sample_format_t FORMAT>
+        inline float get(uint32_t index) const
+        {
+            if constexpr (FORMAT == SAMPLE_FORMAT_FLOAT)
+            {
+                return data[index];
+            }
+            else if constexpr (FORMAT == SAMPLE_FORMAT_INT16)
+            {
+                return float(data16[index]) / 32767.0f;
+            }
+            else
+            {
+                int32_t v = data16[index] << 8 | data8[index];
+                return float(v) / 8388608.0f;
+            }
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns one value of the audio data
+        //--------------------------------------------------------------------------------
+        inline float operator[](uint32_t index) const
+        {
+            switch (format)
+            {
+                case SAMPLE_FORMAT_INT16: return get<SAMPLE_FORMAT_INT16>(index);
+                case SAMPLE_FORMAT_INT24: return get<SAMPLE_FORMAT_INT24>(index);
+                default: return get<SAMPLE_FORMAT_FLOAT>(index);
+            }
+        }
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Function decoding the audio data of a compressed (SF3) sample (see
+    ///         `SoundFont::setSampleDecoder()`)
+    ///
+    /// @param      data        The compressed data (an Ogg Vorbis stream)
+    /// @param      size        Size of the compressed data, in bytes
+    /// @param[out] result      The decoded audio data (mono, floats in the [-1, 1] range)
+    /// @param      user_data   Pointer given to `SoundFont::setSampleDecoder()`
+    /// @return True if the audio data was decoded successfully
+    //------------------------------------------------------------------------------------
+    typedef bool (*sample_decoder_t)(
+        const uint8_t* data, size_t size, std::vector<float>& result, void* user_data
+    );
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  The decoded audio data of a compressed sample, shared between the cache and
+    ///         the voices playing it
+    //------------------------------------------------------------------------------------
+    typedef std::shared_ptr<const std::vector<float>> decoded_sample_t;
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Default maximum size of the cache of decoded samples, in bytes
+    //------------------------------------------------------------------------------------
+    const size_t DEFAULT_DECODED_SAMPLES_CACHE_SIZE = 64 * 1024 * 1024;
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  A memory-bounded cache, removing its least recently used values when full
+    ///
+    /// The size of each value is provided when it is inserted. The cache isn't
+    /// thread-safe: its owner must protect it with a lock if needed.
+    //------------------------------------------------------------------------------------
+    template<typename KEY, typename VALUE>
+    class LruCache
+    {
+    public:
+        //--------------------------------------------------------------------------------
+        /// @brief  Constructor
+        ///
+        /// @param max_size The maximum size of the values in the cache, in bytes
+        //--------------------------------------------------------------------------------
+        LruCache(size_t max_size)
+        : _max_size(max_size)
+        {
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Set the maximum size of the values in the cache, in bytes (the least
+        ///         recently used values are removed if needed)
+        //--------------------------------------------------------------------------------
+        inline void setMaxSize(size_t max_size)
+        {
+            _max_size = max_size;
+            trim(0);
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the maximum size of the values in the cache, in bytes
+        //--------------------------------------------------------------------------------
+        inline size_t maxSize() const
+        {
+            return _max_size;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the size of the values in the cache, in bytes
+        //--------------------------------------------------------------------------------
+        inline size_t usage() const
+        {
+            return _size;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the number of values in the cache
+        //--------------------------------------------------------------------------------
+        inline size_t count() const
+        {
+            return _entries.size();
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the value associated to a key (which becomes the most recently
+        ///         used one), nullptr if it isn't in the cache
+        //--------------------------------------------------------------------------------
+        inline const VALUE* find(const KEY& key)
+        {
+            auto iter = _index.find(key);
+            if (iter == _index.end())
+                return nullptr;
+
+            _entries.splice(_entries.begin(), _entries, iter->second);
+            return &iter->second->value;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Add a value to the cache, as the most recently used one
+        ///
+        /// The new value is always kept, even if it is bigger than the maximum size of
+        /// the cache (until the next one is added). If the key is already in the cache,
+        /// its value isn't replaced.
+        ///
+        /// @param  key     The key
+        /// @param  value   The value
+        /// @param  size    Size of the value, in bytes
+        /// @return The value in the cache
+        //--------------------------------------------------------------------------------
+        inline const VALUE& insert(const KEY& key, const VALUE& value, size_t size)
+        {
+            const VALUE* existing = find(key);
+            if (existing)
+                return *existing;
+
+            _entries.push_front({ key, value, size });
+            _index[key] = _entries.begin();
+            _size += size;
+
+            trim(1);
+
+            return _entries.front().value;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Remove all the values
+        //--------------------------------------------------------------------------------
+        inline void clear()
+        {
+            _entries.clear();
+            _index.clear();
+            _size = 0;
+        }
+
+
+    private:
+        // Remove the least recently used values until the cache isn't too big, always
+        // keeping the 'nb_kept' most recently used ones
+        inline void trim(size_t nb_kept)
+        {
+            while ((_size > _max_size) && (_entries.size() > nb_kept))
+            {
+                const entry_t& entry = _entries.back();
+
+                _size -= entry.size;
+                _index.erase(entry.key);
+                _entries.pop_back();
+            }
+        }
+
+
+    private:
+        struct entry_t
+        {
+            KEY key;
+            VALUE value;
+            size_t size;
+        };
+
+        typedef std::list<entry_t> entry_list_t;
+
+        // The values, the most recently used first
+        entry_list_t _entries;
+        std::map<KEY, typename entry_list_t::iterator> _index;
+        size_t _size = 0;
+        size_t _max_size;
     };
 
 
@@ -590,9 +928,12 @@ namespace sf {
     //------------------------------------------------------------------------------------
     struct sample_info_t
     {
-        generator_map_t generators;         ///< The list of generators to use
-        modulator_map_t modulators;         ///< The list of modulators to use
-        const sample_t* sample = nullptr;   ///< The audio sample to use
+        generator_set_t generators;                         ///< The generators to use
+        const modulator_map_t* instrument_modulators = nullptr;  ///< The modulators of the
+                                                                  ///  instrument zone
+        const modulator_map_t* preset_modulators = nullptr; ///< The modulators of the preset
+                                                            ///  zone (additive)
+        const sample_t* sample = nullptr;                   ///< The audio sample to use
 
         //--------------------------------------------------------------------------------
         /// @brief  Returns the value of a generator or a default value if not present
@@ -601,10 +942,40 @@ namespace sf {
         /// @param default_value    The default value to use
         /// @return The value
         //--------------------------------------------------------------------------------
-        generator_amount_t generator(generator_type_t type, generator_amount_t default_value) const
+        inline generator_amount_t generator(generator_type_t type, generator_amount_t default_value) const
+        {
+            return generators.get(type, default_value);
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the combination of the modulators of the instrument and preset
+        ///         zones
+        ///
+        /// Note: this method allocates memory, iterate over 'instrument_modulators' and
+        /// 'preset_modulators' in real-time contexts.
+        ///
+        /// @return The modulators
+        //--------------------------------------------------------------------------------
+        modulator_map_t modulators() const
         {
-            auto iter = generators.find(type);
-            return (iter != generators.end() ? iter->second : default_value);
+            modulator_map_t result;
+
+            if (instrument_modulators)
+                result = *instrument_modulators;
+
+            if (preset_modulators)
+            {
+                for (auto& entry : *preset_modulators)
+                {
+                    auto iter = result.find(entry.first);
+                    if (iter != result.end())
+                        iter->second.amount += entry.second.amount;
+                    else
+                        result[entry.first] = entry.second;
+                }
+            }
+
+            return result;
         }
     };
 
@@ -640,6 +1011,13 @@ namespace sf {
         /// @brief  Destructor
         //--------------------------------------------------------------------------------
         ~SoundFont();
+
+        //--------------------------------------------------------------------------------
+        /// @brief  SoundFont objects own their audio buffer and can't be copied (share
+        ///         them via a pointer instead)
+        //--------------------------------------------------------------------------------
+        SoundFont(const SoundFont&) = delete;
+        SoundFont& operator=(const SoundFont&) = delete;
     /// @}
 
     /// @name SoundFont file loading methods
@@ -647,10 +1025,28 @@ namespace sf {
         //--------------------------------------------------------------------------------
         /// @brief  Load a SoundFont file
         ///
+        /// With LOAD_MODE_MEMORY_MAPPED, the file is memory-mapped for the lifetime of the
+        /// object and the audio data isn't copied: only the samples that are actually
+        /// played are paged in by the OS, and converted on the fly by the synthesizer. In
+        /// this mode getBuffer() returns nullptr, use getSampleBuffer() instead.
+        ///
+        /// @param  path    Path to the SoundFont file
+        /// @param  mode    The way to load the file
+        /// @return True if the file was loaded successfully, false otherwise
+        //--------------------------------------------------------------------------------
+        bool load(const std::filesystem::path& path, load_mode_t mode = LOAD_MODE_FLOAT);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Load a SoundFont file (prevents the ambiguity with the buffer variant)
+        ///
         /// @param  path    Path to the SoundFont file
+        /// @param  mode    The way to load the file
         /// @return True if the file was loaded successfully, false otherwise
         //--------------------------------------------------------------------------------
-        bool load(const std::filesystem::path& path);
+        inline bool load(const char* path, load_mode_t mode)
+        {
+            return load(std::filesystem::path(path), mode);
+        }
 
         //--------------------------------------------------------------------------------
         /// @brief  Load a SoundFont file from a buffer
@@ -660,6 +1056,43 @@ namespace sf {
         /// @return True if the file was loaded successfully, false otherwise
         //--------------------------------------------------------------------------------
         bool load(const char* buffer, size_t size);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Save the SoundFont in a binary cache file, much faster to load than the
+        ///         original file
+        ///
+        /// The cache contains the presets, instruments and samples already resolved (no
+        /// global zones, flattened generators, index of the zones valid for each key) in
+        /// aligned tables, and the audio data (page-aligned), either converted to floats
+        /// or in its original 16-bits (or 24-bits) format.
+        ///
+        /// A cache file can only be loaded by the same version of the library, on a
+        /// platform with the same endianness.
+        ///
+        /// @param  path            Path to the cache file
+        /// @param  float_samples   Indicates if the audio data must be stored as floats
+        ///                         (always the case if it was already converted to floats)
+        /// @return True if the cache file was saved successfully, false otherwise
+        //--------------------------------------------------------------------------------
+        bool saveCache(const std::filesystem::path& path, bool float_samples = true) const;
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Load a binary cache file created by saveCache()
+        ///
+        /// The cache file is memory-mapped and its tables are used as-is, without
+        /// parsing. With LOAD_MODE_MEMORY_MAPPED, the file stays mapped for the lifetime
+        /// of the object and the audio data is referenced in place (if the cache contains
+        /// floats, getBuffer() returns them). With LOAD_MODE_FLOAT, the audio data is
+        /// copied (and converted if needed) in memory.
+        ///
+        /// @param  path    Path to the cache file
+        /// @param  mode    The way to load the audio data
+        /// @return True if the cache file was loaded successfully, false otherwise (if it
+        ///         is invalid or was created by another version of the library)
+        //--------------------------------------------------------------------------------
+        bool loadCache(
+            const std::filesystem::path& path, load_mode_t mode = LOAD_MODE_MEMORY_MAPPED
+        );
     /// @}
 
     /// @name Principal methods for synthesis
@@ -687,12 +1120,109 @@ namespace sf {
         //--------------------------------------------------------------------------------
         /// @brief  Returns the buffer of audio data, from which samples must be extracted
         ///
-        /// @return The buffer of audio data
+        /// @return The buffer of audio data, nullptr if the audio data isn't stored as
+        ///         floats (see getSampleBuffer())
         //--------------------------------------------------------------------------------
         inline const float* getBuffer() const
         {
             return buffer;
         }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the buffer of audio data, from which samples must be extracted,
+        ///         whatever its format is
+        ///
+        /// @return The buffer of audio data
+        //--------------------------------------------------------------------------------
+        inline sample_buffer_t getSampleBuffer() const
+        {
+            if (buffer16)
+                return sample_buffer_t(buffer16, buffer24);
+
+            return sample_buffer_t(buffer);
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the number of values in the buffer of audio data
+        //--------------------------------------------------------------------------------
+        inline uint32_t getBufferSize() const
+        {
+            return buffer_size;
+        }
+    /// @}
+
+    /// @name Compressed samples (SF3)
+    /// @{
+        //--------------------------------------------------------------------------------
+        /// @brief  Indicates if the SoundFont contains compressed samples
+        //--------------------------------------------------------------------------------
+        inline bool hasCompressedSamples() const
+        {
+            return compressed_data != nullptr;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Set the function used to decode the compressed samples
+        ///
+        /// The library doesn't contain any Ogg Vorbis decoder, one must be provided to
+        /// play SF3 files. It might be called from several threads at the same time.
+        ///
+        /// @param decoder      The function (nullptr to remove it)
+        /// @param user_data    Pointer given to the function
+        //--------------------------------------------------------------------------------
+        void setSampleDecoder(sample_decoder_t decoder, void* user_data = nullptr);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Set the maximum size of the cache of decoded samples
+        ///
+        /// The least recently used samples are removed from the cache when it is full
+        /// (their audio data is released once no voice plays them anymore).
+        ///
+        /// @param  size    The maximum size, in bytes
+        //--------------------------------------------------------------------------------
+        void setDecodedSamplesCacheSize(size_t size);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the size of the decoded samples in the cache, in bytes
+        //--------------------------------------------------------------------------------
+        size_t getDecodedSamplesCacheUsage() const;
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the decoded audio data of a compressed sample, decoding it if
+        ///         it isn't in the cache of decoded samples yet
+        ///
+        /// This method is thread-safe. The decoding itself is performed outside of the
+        /// lock of the cache.
+        ///
+        /// @param  sample  The sample (from getSamples(), or a sample_info_t)
+        /// @return The decoded audio data, nullptr if the sample isn't compressed or
+        ///         can't be decoded
+        //--------------------------------------------------------------------------------
+        decoded_sample_t getDecodedSample(const sample_t* sample) const;
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the decoded audio data of a compressed sample if it is already
+        ///         in the cache of decoded samples, without decoding it
+        ///
+        /// This method never blocks nor allocates memory, so it can be used from the
+        /// audio thread: if the cache is being used by another thread, the sample is
+        /// considered as not decoded yet.
+        ///
+        /// @param  sample  The sample (from getSamples(), or a sample_info_t)
+        /// @return The decoded audio data, nullptr if the sample isn't compressed or isn't
+        ///         available right now
+        //--------------------------------------------------------------------------------
+        decoded_sample_t findDecodedSample(const sample_t* sample) const;
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Decode all the compressed samples used by a preset, to put them in the
+        ///         cache of decoded samples before they are played
+        ///
+        /// @param  bank    The preset bank
+        /// @param  number  The preset number
+        /// @return False if the preset doesn't exist
+        //--------------------------------------------------------------------------------
+        bool prefetchPreset(uint16_t bank, uint16_t number) const;
     /// @}
 
     /// @name SoundFont file content retrieval
@@ -786,10 +1316,26 @@ namespace sf {
         //--------------------------------------------------------------------------------
         /// @brief  Load a SoundFont file from a stream
         ///
-        /// @param  stream  The stream to use
+        /// If the content of the stream is available in memory (and outlives this object),
+        /// the audio data is referenced in place instead of being converted.
+        ///
+        /// @param  stream      The stream to use
+        /// @param  data        The content of the stream, if available in memory
+        /// @param  data_size   Size of the content of the stream
         /// @return True if the file was loaded successfully, false otherwise
         //--------------------------------------------------------------------------------
-        bool load(std::istream& stream);
+        bool load(std::istream& stream, const char* data = nullptr, size_t data_size = 0);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Load a binary cache file from memory
+        ///
+        /// @param  data            The content of the cache file
+        /// @param  size            Size of the content of the cache file
+        /// @param  reference_audio Indicates if the audio data must be referenced in place
+        ///                         (the content must then outlive this object)
+        /// @return True if the cache file was loaded successfully, false otherwise
+        //--------------------------------------------------------------------------------
+        bool loadCache(const char* data, size_t size, bool reference_audio);
 
         //--------------------------------------------------------------------------------
         /// @brief  Release all the memory used by this object (to restart fresh)
@@ -828,16 +1374,40 @@ namespace sf {
             const instrument_zone_t* instrument_zone, const preset_zone_t* preset_zone,
             sample_info_t* result
         ) const;
-    /// @}
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the index of a compressed sample which can be decoded, or the
+        ///         number of samples if it can't be
+        //--------------------------------------------------------------------------------
+        size_t decodableSampleIndex(const sample_t* sample) const;
+    /// @}
 
         //_____ Attributes __________
     protected:
         information_t information;
-        float* buffer = nullptr;
+        const float* buffer = nullptr;
+        bool owns_buffer = false;
+        const int16_t* buffer16 = nullptr;
+        const uint8_t* buffer24 = nullptr;
         uint32_t buffer_size = 0;
+        const char* mapping = nullptr;
+        size_t mapping_size = 0;
         preset_map_t presets;
         std::vector<instrument_t> instruments;
         std::vector<sample_t> samples;
+
+        // Compressed samples (SF3)
+        const uint8_t* compressed_data = nullptr;
+        bool owns_compressed_data = false;
+        uint32_t compressed_data_size = 0;
+        sample_decoder_t sample_decoder = nullptr;
+        void* sample_decoder_user_data = nullptr;
+
+        // Cache of the decoded samples, indexed by sample
+        mutable std::mutex decoded_samples_mutex;
+        mutable LruCache<size_t, decoded_sample_t> decoded_samples{
+            DEFAULT_DECODED_SAMPLES_CACHE_SIZE
+        };
     };
 
 
@@ -942,6 +1512,139 @@ namespace sf {
     };
 
 
+    //------------------------------------------------------------------------------------
+    /// @brief  Represents a string in the binary cache file (stored in the strings
+    ///         section)
+    //------------------------------------------------------------------------------------
+    struct cache_string_t
+    {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  The sections of the binary cache file
+    //------------------------------------------------------------------------------------
+    enum cache_section_index_t
+    {
+        CACHE_SECTION_STRINGS,
+        CACHE_SECTION_PRESETS,
+        CACHE_SECTION_INSTRUMENTS,
+        CACHE_SECTION_ZONES,
+        CACHE_SECTION_GENERATORS,      // sf_generator_t
+        CACHE_SECTION_MODULATORS,      // sf_modulator_t
+        CACHE_SECTION_KEY_INDICES,     // uint16_t
+        CACHE_SECTION_SAMPLES,
+        CACHE_SECTION_AUDIO,           // float or int16_t, according to the sample format
+        CACHE_SECTION_AUDIO_LSB,       // uint8_t (SAMPLE_FORMAT_INT24 only)
+        CACHE_SECTION_COMPRESSED,      // uint8_t, the compressed samples (SF3)
+        CACHE_NB_SECTIONS,
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Location of a section in the binary cache file
+    //------------------------------------------------------------------------------------
+    struct cache_section_t
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Header of the binary cache file
+    //------------------------------------------------------------------------------------
+    struct cache_header_t
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t sample_format;
+        uint32_t buffer_size;
+        uint16_t versions[4];           // major, minor, ROM major, ROM minor
+        cache_string_t information[9];  // In the order of the strings of information_t
+        cache_section_t sections[CACHE_NB_SECTIONS];
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Represents a preset or an instrument in the binary cache file
+    //------------------------------------------------------------------------------------
+    struct cache_preset_t
+    {
+        uint16_t bank;                  // Unused for the instruments
+        uint16_t number;                // Unused for the instruments
+        cache_string_t name;
+        uint32_t first_zone;
+        uint32_t nb_zones;
+        uint32_t first_key_index;
+        uint32_t key_offsets[129];      // Same as 'key_index_t::offsets'
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Represents a zone (of a preset or an instrument) in the binary cache file
+    //------------------------------------------------------------------------------------
+    struct cache_zone_t
+    {
+        generator_set_t generator_set;
+        range_t keys_range;
+        range_t velocities_range;
+        uint16_t target;
+        uint16_t padding;
+        uint32_t first_generator;
+        uint32_t nb_generators;
+        uint32_t first_modulator;
+        uint32_t nb_modulators;
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Represents a sample in the binary cache file
+    //------------------------------------------------------------------------------------
+    struct cache_sample_t
+    {
+        cache_string_t name;
+        uint32_t start;
+        uint32_t end;
+        uint32_t loop_start;
+        uint32_t loop_end;
+        uint32_t sample_rate;
+        uint8_t original_pitch;
+        int8_t pitch_correction;
+        uint16_t sample_type;
+        uint16_t sample_link;
+        uint16_t flags;                 // CACHE_SAMPLE_COMPRESSED
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  The tables of a binary cache file, used in place
+    //------------------------------------------------------------------------------------
+    struct cache_tables_t
+    {
+        const char* strings = nullptr;
+        const cache_preset_t* presets = nullptr;
+        const cache_preset_t* instruments = nullptr;
+        const cache_zone_t* zones = nullptr;
+        const sf_generator_t* generators = nullptr;
+        const sf_modulator_t* modulators = nullptr;
+        const uint16_t* key_indices = nullptr;
+        const cache_sample_t* samples = nullptr;
+
+        uint64_t nb_strings = 0;        // In bytes
+        uint64_t nb_presets = 0;
+        uint64_t nb_instruments = 0;
+        uint64_t nb_zones = 0;
+        uint64_t nb_generators = 0;
+        uint64_t nb_modulators = 0;
+        uint64_t nb_key_indices = 0;
+        uint64_t nb_samples = 0;
+    };
+
+
     /************************************ CONSTANTS *************************************/
 
     //------------------------------------------------------------------------------------
@@ -971,6 +1674,48 @@ namespace sf {
     };
 
 
+    //------------------------------------------------------------------------------------
+    /// @brief  The generators of a preset zone that are added to the ones of the
+    ///         instrument zone (the others are ignored)
+    //------------------------------------------------------------------------------------
+    static const uint64_t ADDITIVE_GENERATORS_MASK =
+        (uint64_t(1) << GEN_TYPE_INITIAL_FILTER_CUTOFF_FREQUENCY) |
+        (uint64_t(1) << GEN_TYPE_INITIAL_FILTER_Q) |
+        (uint64_t(1) << GEN_TYPE_CHORUS_EFFECTS_SEND) |
+        (uint64_t(1) << GEN_TYPE_REVERB_EFFECTS_SEND) |
+        (uint64_t(1) << GEN_TYPE_SUSTAIN_MODULATION_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_SUSTAIN_VOLUME_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_INITIAL_ATTENUATION) |
+        (uint64_t(1) << GEN_TYPE_SCALE_TUNING) |
+        (uint64_t(1) << GEN_TYPE_MODULATION_LFO_TO_PITCH) |
+        (uint64_t(1) << GEN_TYPE_VIBRATO_LFO_TO_PITCH) |
+        (uint64_t(1) << GEN_TYPE_MODULATION_ENVELOPE_TO_PITCH) |
+        (uint64_t(1) << GEN_TYPE_MODULATION_LFO_TO_FILTER_CUTOFF_FREQUENCY) |
+        (uint64_t(1) << GEN_TYPE_MODULATION_ENVELOPE_TO_FILTER_CUTOFF_FREQUENCY) |
+        (uint64_t(1) << GEN_TYPE_MODULATION_LFO_TO_VOLUME) |
+        (uint64_t(1) << GEN_TYPE_PAN) |
+        (uint64_t(1) << GEN_TYPE_DELAY_MODULATION_LFO) |
+        (uint64_t(1) << GEN_TYPE_FREQUENCY_MODULATION_LFO) |
+        (uint64_t(1) << GEN_TYPE_DELAY_VIBRATO_LFO) |
+        (uint64_t(1) << GEN_TYPE_FREQUENCY_VIBRATO_LFO) |
+        (uint64_t(1) << GEN_TYPE_DELAY_MODULATION_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_ATTACK_MODULATION_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_HOLD_MODULATION_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_DECAY_MODULATION_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_RELEASE_MODULATION_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_KEY_NUMBER_TO_MODULATION_ENVELOPE_HOLD) |
+        (uint64_t(1) << GEN_TYPE_KEY_NUMBER_TO_MODULATION_ENVELOPE_DECAY) |
+        (uint64_t(1) << GEN_TYPE_DELAY_VOLUME_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_ATTACK_VOLUME_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_HOLD_VOLUME_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_DECAY_VOLUME_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_RELEASE_VOLUME_ENVELOPE) |
+        (uint64_t(1) << GEN_TYPE_KEY_NUMBER_TO_VOLUME_ENVELOPE_HOLD) |
+        (uint64_t(1) << GEN_TYPE_KEY_NUMBER_TO_VOLUME_ENVELOPE_DECAY) |
+        (uint64_t(1) << GEN_TYPE_COARSE_TUNE) |
+        (uint64_t(1) << GEN_TYPE_FINE_TUNE);
+
+
     //------------------------------------------------------------------------------------
     /// @brief  List of the default instrument modulators always present in a SoundFont
     ///         file
@@ -1116,6 +1861,17 @@ namespace sf {
     };
 
 
+    //------------------------------------------------------------------------------------
+    /// @brief  Constants of the binary cache file
+    //------------------------------------------------------------------------------------
+    const char CACHE_MAGIC[8] = { 'K', 'N', 'M', 'S', 'F', 'C', 'C', 'H' };
+    const uint32_t CACHE_VERSION = (KNM_SOUNDFONT_VERSION_MAJOR << 16) + (KNM_SOUNDFONT_VERSION_MINOR << 8) + 2;
+    const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+    const uint64_t CACHE_ALIGNMENT = 16;
+    const uint64_t CACHE_AUDIO_ALIGNMENT = 4096;     // Page-aligned for memory-mapping
+    const uint16_t CACHE_SAMPLE_COMPRESSED = 0x0001;
+
+
     /******************************** HELPER FUNCTIONS **********************************/
 
     chunk_header_t readChunkHeader(std::istream& stream)
@@ -1132,6 +1888,32 @@ namespace sf {
         return info;
     }
 
+    modulator_source_t decodeModulatorSource(uint16_t operation)
+    {
+        modulator_source_t source;
+
+        source.type = static_cast<modulator_source_type_t>((operation & 0xFC00) >> 10);
+        source.polarity = (operation & 0x0200) != 0 ? MOD_SRC_POL_BIPOLAR : MOD_SRC_POL_UNIPOLAR;
+        source.direction = (operation & 0x0100) != 0 ? MOD_SRC_DIR_MAX_TO_MIN : MOD_SRC_DIR_MIN_TO_MAX;
+        source.controller_type = (operation & 0x0080) != 0 ? MOD_CTRL_TYPE_MIDI : MOD_CTRL_TYPE_SRC;
+
+        if (source.controller_type == MOD_CTRL_TYPE_MIDI)
+            source.midi = operation & 0x007F;
+        else
+            source.source = static_cast<modulator_controller_source_t>(operation & 0x007F);
+
+        return source;
+    }
+
+    uint16_t encodeModulatorSource(const modulator_source_t& source)
+    {
+        return (uint16_t(source.type) << 10) |
+               (source.polarity == MOD_SRC_POL_BIPOLAR ? 0x0200 : 0) |
+               (source.direction == MOD_SRC_DIR_MAX_TO_MIN ? 0x0100 : 0) |
+               (source.controller_type == MOD_CTRL_TYPE_MIDI ? 0x0080 | (source.midi & 0x7F) :
+                                                               (source.source & 0x7F));
+    }
+
     void readVersion(std::istream& stream, uint16_t* major, uint16_t* minor)
     {
         stream.read(reinterpret_cast<char*>(major), sizeof(uint16_t));
@@ -1153,6 +1935,275 @@ namespace sf {
         delete[] buffer;
     }
 
+    const char* mapFile(const std::filesystem::path& path, size_t& size)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileW(
+            path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr
+        );
+        if (file == INVALID_HANDLE_VALUE)
+            return nullptr;
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || (file_size.QuadPart == 0))
+        {
+            CloseHandle(file);
+            return nullptr;
+        }
+
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+
+        if (!mapping)
+            return nullptr;
+
+        // The view keeps the file mapping alive
+        void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+
+        if (!data)
+            return nullptr;
+
+        size = size_t(file_size.QuadPart);
+        return static_cast<const char*>(data);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+
+        struct stat st;
+        if ((fstat(fd, &st) != 0) || (st.st_size == 0))
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        // The mapping stays valid after the file is closed
+        void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (data == MAP_FAILED)
+            return nullptr;
+
+        size = size_t(st.st_size);
+        return static_cast<const char*>(data);
+#endif
+    }
+
+    void unmapFile(const char* data, size_t size)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<char*>(data), size);
+#endif
+    }
+
+    int countTrailingZeros(uint64_t value)
+    {
+        int count = 0;
+        while ((value & 1) == 0)
+        {
+            value >>= 1;
+            ++count;
+        }
+        return count;
+    }
+
+    void buildGeneratorSet(const generator_map_t& generators, generator_set_t& result)
+    {
+        result = generator_set_t();
+
+        for (const auto& entry : generators)
+            result.set(entry.first, entry.second);
+    }
+
+    void buildKeyIndex(const std::vector<preset_zone_t>& zones, key_index_t& index)
+    {
+        index.zones.clear();
+
+        for (int key = 0; key < 128; ++key)
+        {
+            index.offsets[key] = uint32_t(index.zones.size());
+
+            for (size_t i = 0; i < zones.size(); ++i)
+            {
+                if ((key >= zones[i].keys_range.lo) && (key <= zones[i].keys_range.hi))
+                    index.zones.push_back(uint16_t(i));
+            }
+        }
+
+        index.offsets[128] = uint32_t(index.zones.size());
+    }
+
+    cache_string_t addCacheString(std::string& strings, const std::string& value)
+    {
+        cache_string_t result = { uint32_t(strings.size()), uint32_t(value.size()) };
+        strings += value;
+        return result;
+    }
+
+    bool getCacheString(
+        const cache_tables_t& tables, const cache_string_t& string, std::string& result
+    )
+    {
+        if (uint64_t(string.offset) + string.size > tables.nb_strings)
+            return false;
+
+        result.assign(tables.strings + string.offset, string.size);
+        return true;
+    }
+
+    void addCacheZones(
+        const std::vector<preset_zone_t>& zones, const key_index_t& index,
+        cache_preset_t& record, std::vector<cache_zone_t>& cache_zones,
+        std::vector<sf_generator_t>& generators, std::vector<sf_modulator_t>& modulators,
+        std::vector<uint16_t>& key_indices
+    )
+    {
+        record.first_zone = uint32_t(cache_zones.size());
+        record.nb_zones = uint32_t(zones.size());
+
+        for (const auto& zone : zones)
+        {
+            cache_zone_t cache_zone = {};
+            cache_zone.generator_set = zone.generator_set;
+            cache_zone.keys_range = zone.keys_range;
+            cache_zone.velocities_range = zone.velocities_range;
+            cache_zone.target = zone.target;
+            cache_zone.first_generator = uint32_t(generators.size());
+            cache_zone.nb_generators = uint32_t(zone.generators.size());
+            cache_zone.first_modulator = uint32_t(modulators.size());
+            cache_zone.nb_modulators = uint32_t(zone.modulators.size());
+
+            for (const auto& entry : zone.generators)
+                generators.push_back({ uint16_t(entry.first), entry.second });
+
+            for (const auto& entry : zone.modulators)
+            {
+                modulators.push_back({
+                    encodeModulatorSource(entry.first.src), uint16_t(entry.first.dest),
+                    entry.second.amount, encodeModulatorSource(entry.first.amount_src),
+                    uint16_t(entry.second.transform)
+                });
+            }
+
+            cache_zones.push_back(cache_zone);
+        }
+
+        record.first_key_index = uint32_t(key_indices.size());
+        memcpy(record.key_offsets, index.offsets, sizeof(record.key_offsets));
+        key_indices.insert(key_indices.end(), index.zones.begin(), index.zones.end());
+    }
+
+    bool getCacheZones(
+        const cache_tables_t& tables, const cache_preset_t& record, uint64_t nb_targets,
+        std::vector<preset_zone_t>& zones, key_index_t& index
+    )
+    {
+        if (uint64_t(record.first_zone) + record.nb_zones > tables.nb_zones)
+            return false;
+
+        zones.resize(record.nb_zones);
+
+        for (uint32_t i = 0; i < record.nb_zones; ++i)
+        {
+            const cache_zone_t& cache_zone = tables.zones[record.first_zone + i];
+            preset_zone_t& zone = zones[i];
+
+            if ((cache_zone.target >= nb_targets) ||
+                (uint64_t(cache_zone.first_generator) + cache_zone.nb_generators > tables.nb_generators) ||
+                (uint64_t(cache_zone.first_modulator) + cache_zone.nb_modulators > tables.nb_modulators))
+            {
+                return false;
+            }
+
+            zone.keys_range = cache_zone.keys_range;
+            zone.velocities_range = cache_zone.velocities_range;
+            zone.generator_set = cache_zone.generator_set;
+            zone.target = cache_zone.target;
+
+            const sf_generator_t* generator = tables.generators + cache_zone.first_generator;
+            for (uint32_t j = 0; j < cache_zone.nb_generators; ++j, ++generator)
+                zone.generators[static_cast<generator_type_t>(generator->type)] = generator->amount;
+
+            const sf_modulator_t* modulator = tables.modulators + cache_zone.first_modulator;
+            for (uint32_t j = 0; j < cache_zone.nb_modulators; ++j, ++modulator)
+            {
+                modulator_id_t modulator_id;
+                modulator_id.src = decodeModulatorSource(modulator->src_operation);
+                modulator_id.dest = static_cast<generator_type_t>(modulator->dest_operation);
+                modulator_id.amount_src = decodeModulatorSource(modulator->amount_src_operation);
+
+                zone.modulators[modulator_id] = {
+                    modulator->amount,
+                    static_cast<modulator_transform_t>(modulator->transform_operation)
+                };
+            }
+        }
+
+        const uint32_t nb_indices = record.key_offsets[128];
+        if (uint64_t(record.first_key_index) + nb_indices > tables.nb_key_indices)
+            return false;
+
+        for (int key = 0; key < 128; ++key)
+        {
+            if (record.key_offsets[key] > record.key_offsets[key + 1])
+                return false;
+        }
+
+        memcpy(index.offsets, record.key_offsets, sizeof(index.offsets));
+        index.zones.assign(
+            tables.key_indices + record.first_key_index,
+            tables.key_indices + record.first_key_index + nb_indices
+        );
+
+        for (uint16_t zone_index : index.zones)
+        {
+            if (zone_index >= record.nb_zones)
+                return false;
+        }
+
+        return true;
+    }
+
+    template<typename T>
+    const T* getCacheSection(
+        const char* data, size_t size, const cache_section_t& section, uint64_t& count
+    )
+    {
+        if ((section.offset > size) || (section.size > size - section.offset) ||
+            (section.offset % alignof(T) != 0) || (section.size % sizeof(T) != 0))
+        {
+            return nullptr;
+        }
+
+        count = section.size / sizeof(T);
+        return reinterpret_cast<const T*>(data + section.offset);
+    }
+
+    bool writeCacheSection(
+        std::ofstream& file, cache_section_t& section, const void* data, uint64_t size,
+        uint64_t alignment = CACHE_ALIGNMENT
+    )
+    {
+        static const char padding[CACHE_AUDIO_ALIGNMENT] = { 0 };
+
+        uint64_t offset = uint64_t(file.tellp());
+        uint64_t nb_padding = (alignment - offset % alignment) % alignment;
+
+        file.write(padding, std::streamsize(nb_padding));
+
+        section.offset = offset + nb_padding;
+        section.size = size;
+
+        if (size > 0)
+            file.write(static_cast<const char*>(data), std::streamsize(size));
+
+        return file.good();
+    }
+
     std::string toString(modulator_controller_source_t src)
     {   
         switch (src)
@@ -1248,36 +2299,12 @@ namespace sf {
 
     SoundFont::~SoundFont()
     {
-        delete[] buffer;
+        cleanup();
     }
 
 
     /********************************** LOAD METHODS ************************************/
 
-    bool SoundFont::load(const std::filesystem::path& path)
-    {
-        // Cleanup (just in case)
-        cleanup();
-
-        // Check if the file exists
-        if (!std::filesystem::exists(path))
-            return false;
-
-        // Open the file
-        std::ifstream file(path.string(), std::ios::binary);
-        if (!file.is_open())
-            return false;
-        
-        // Parse the file
-        bool result = load(file);
-        
-        file.close();
-
-        return result;
-    }
-
-    //-----------------------------------------------------------------------
-
     struct membuf : std::streambuf
     {
         membuf(char* begin, size_t size)
@@ -1305,6 +2332,50 @@ namespace sf {
         }
     };
 
+    //-----------------------------------------------------------------------
+
+    bool SoundFont::load(const std::filesystem::path& path, load_mode_t mode)
+    {
+        // Cleanup (just in case)
+        cleanup();
+
+        // Check if the file exists
+        if (!std::filesystem::exists(path))
+            return false;
+
+        if (mode == LOAD_MODE_MEMORY_MAPPED)
+        {
+            mapping = mapFile(path, mapping_size);
+            if (!mapping)
+                return false;
+
+            membuf memory_buffer(const_cast<char*>(mapping), mapping_size);
+            std::istream stream(&memory_buffer);
+
+            if (!load(stream, mapping, mapping_size))
+            {
+                cleanup();
+                return false;
+            }
+
+            return true;
+        }
+
+        // Open the file
+        std::ifstream file(path.string(), std::ios::binary);
+        if (!file.is_open())
+            return false;
+        
+        // Parse the file
+        bool result = load(file);
+        
+        file.close();
+
+        return result;
+    }
+
+    //-----------------------------------------------------------------------
+
     bool SoundFont::load(const char* buffer, size_t size)
     {
         // Cleanup (just in case)
@@ -1332,12 +2403,16 @@ namespace sf {
             return false;
 
         const preset_zone_t* preset_zone = findPresetZone(preset, key, velocity);
+        if (!preset_zone || (preset_zone->target >= instruments.size()))
+            return false;
 
-        auto& instrument = instruments[preset_zone->generators.at(GEN_TYPE_INSTRUMENT).ivalue];
+        auto& instrument = instruments[preset_zone->target];
 
         const instrument_zone_t* instrument_zone = findInstrumentZone(&instrument, key, velocity);
+        if (!instrument_zone || (instrument_zone->target >= samples.size()))
+            return false;
 
-        int sample_id = instrument_zone->generators.at(GEN_TYPE_SAMPLE_ID).ivalue;
+        int sample_id = instrument_zone->target;
         auto& sample = samples[sample_id];
 
         if ((sample.sample_type == SAMPLE_TYPE_MONO) || (sample.sample_type == SAMPLE_TYPE_ROM_MONO))
@@ -1353,7 +2428,10 @@ namespace sf {
             result.stereo = true;
 
             const instrument_zone_t* instrument_zone2 = findInstrumentZone(&instrument, key, velocity, sample_id);
-            auto& sample2 = samples[instrument_zone2->generators.at(GEN_TYPE_SAMPLE_ID).ivalue];
+            if (!instrument_zone2 || (instrument_zone2->target >= samples.size()))
+                return false;
+
+            auto& sample2 = samples[instrument_zone2->target];
 
             if ((sample.sample_type == SAMPLE_TYPE_LEFT) || (sample.sample_type == SAMPLE_TYPE_ROM_LEFT))
             {
@@ -1666,11 +2744,13 @@ namespace sf {
             case SAMPLE_TYPE_ROM_RIGHT: stream << "ROM right"; break;
             case SAMPLE_TYPE_ROM_LEFT: stream << "ROM left"; break;
             case SAMPLE_TYPE_ROM_LINKED: stream << "ROM linked"; break;
+            case SAMPLE_TYPE_COMPRESSED: stream << "compressed"; break;
         }
         
         stream << std::endl;
 
         stream << "    Sample link:      " << sample.sample_link << std::endl;
+        stream << "    Compressed:       " << (sample.compressed ? "yes" : "no") << std::endl;
 
         return stream;
     }
@@ -1713,13 +2793,491 @@ namespace sf {
     }
 
 
-    /******************************** INTERNAL METHODS **********************************/
+    /********************************** CACHE METHODS ***********************************/
 
-    bool SoundFont::load(std::istream& stream)
+    bool SoundFont::saveCache(const std::filesystem::path& path, bool float_samples) const
     {
-        // Main chunk
-        chunk_header_t sfbk_header = readChunkHeader(stream);
-        if ((strncmp(sfbk_header.type, "RIFF", 4) != 0) ||
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            return false;
+
+        cache_header_t header = {};
+        memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+        header.version = CACHE_VERSION;
+        header.byte_order = CACHE_BYTE_ORDER;
+        header.buffer_size = buffer_size;
+
+        // Information
+        std::string strings;
+
+        header.versions[0] = information.major_version;
+        header.versions[1] = information.minor_version;
+        header.versions[2] = information.rom_major_version;
+        header.versions[3] = information.rom_minor_version;
+
+        const std::string* information_strings[9] = {
+            &information.name, &information.target_engine, &information.rom_name,
+            &information.creation_date, &information.engineers, &information.product,
+            &information.copyright, &information.comments, &information.creation_tool,
+        };
+
+        for (int i = 0; i < 9; ++i)
+            header.information[i] = addCacheString(strings, *information_strings[i]);
+
+        // Presets, instruments and their zones
+        std::vector<cache_preset_t> cache_presets;
+        std::vector<cache_preset_t> cache_instruments;
+        std::vector<cache_zone_t> cache_zones;
+        std::vector<sf_generator_t> generators;
+        std::vector<sf_modulator_t> modulators;
+        std::vector<uint16_t> key_indices;
+
+        for (const auto& entry : presets)
+        {
+            cache_preset_t record = {};
+            record.bank = entry.first.bank;
+            record.number = entry.first.number;
+            record.name = addCacheString(strings, entry.second.name);
+
+            addCacheZones(
+                entry.second.zones, entry.second.key_index, record, cache_zones,
+                generators, modulators, key_indices
+            );
+
+            cache_presets.push_back(record);
+        }
+
+        for (const auto& instrument : instruments)
+        {
+            cache_preset_t record = {};
+            record.name = addCacheString(strings, instrument.name);
+
+            addCacheZones(
+                instrument.zones, instrument.key_index, record, cache_zones, generators,
+                modulators, key_indices
+            );
+
+            cache_instruments.push_back(record);
+        }
+
+        // Samples
+        std::vector<cache_sample_t> cache_samples;
+
+        for (const auto& sample : samples)
+        {
+            cache_sample_t record = {};
+            record.name = addCacheString(strings, sample.name);
+            record.start = sample.start;
+            record.end = sample.end;
+            record.loop_start = sample.loop_start;
+            record.loop_end = sample.loop_end;
+            record.sample_rate = sample.sample_rate;
+            record.original_pitch = sample.original_pitch;
+            record.pitch_correction = sample.pitch_correction;
+            record.sample_type = uint16_t(sample.sample_type);
+            record.sample_link = sample.sample_link;
+            record.flags = (sample.compressed ? CACHE_SAMPLE_COMPRESSED : 0);
+
+            cache_samples.push_back(record);
+        }
+
+        // Write everything (the header is written again at the end, once the sections
+        // are known)
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        cache_section_t* sections = header.sections;
+
+        if (!writeCacheSection(file, sections[CACHE_SECTION_STRINGS], strings.data(), strings.size()) ||
+            !writeCacheSection(file, sections[CACHE_SECTION_PRESETS], cache_presets.data(), cache_presets.size() * sizeof(cache_preset_t)) ||
+            !writeCacheSection(file, sections[CACHE_SECTION_INSTRUMENTS], cache_instruments.data(), cache_instruments.size() * sizeof(cache_preset_t)) ||
+            !writeCacheSection(file, sections[CACHE_SECTION_ZONES], cache_zones.data(), cache_zones.size() * sizeof(cache_zone_t)) ||
+            !writeCacheSection(file, sections[CACHE_SECTION_GENERATORS], generators.data(), generators.size() * sizeof(sf_generator_t)) ||
+            !writeCacheSection(file, sections[CACHE_SECTION_MODULATORS], modulators.data(), modulators.size() * sizeof(sf_modulator_t)) ||
+            !writeCacheSection(file, sections[CACHE_SECTION_KEY_INDICES], key_indices.data(), key_indices.size() * sizeof(uint16_t)) ||
+            !writeCacheSection(file, sections[CACHE_SECTION_SAMPLES], cache_samples.data(), cache_samples.size() * sizeof(cache_sample_t)))
+        {
+            return false;
+        }
+
+        // Audio data
+        if (buffer || !buffer16 || float_samples)
+        {
+            header.sample_format = SAMPLE_FORMAT_FLOAT;
+
+            if (buffer || !buffer16)
+            {
+                if (!writeCacheSection(file, sections[CACHE_SECTION_AUDIO], buffer, uint64_t(buffer_size) * sizeof(float), CACHE_AUDIO_ALIGNMENT))
+                    return false;
+            }
+            else
+            {
+                // Conversion performed by chunks
+                if (!writeCacheSection(file, sections[CACHE_SECTION_AUDIO], nullptr, 0, CACHE_AUDIO_ALIGNMENT))
+                    return false;
+
+                sections[CACHE_SECTION_AUDIO].size = uint64_t(buffer_size) * sizeof(float);
+
+                const sample_buffer_t sample_buffer = getSampleBuffer();
+                const uint32_t chunk_size = 100000;
+
+                std::vector<float> chunk(chunk_size);
+
+                for (uint32_t start = 0; start < buffer_size; start += chunk_size)
+                {
+                    uint32_t count = std::min(buffer_size - start, chunk_size);
+
+                    for (uint32_t i = 0; i < count; ++i)
+                        chunk[i] = sample_buffer[start + i];
+
+                    file.write(reinterpret_cast<const char*>(chunk.data()), count * sizeof(float));
+                }
+            }
+        }
+        else
+        {
+            header.sample_format = (buffer24 ? SAMPLE_FORMAT_INT24 : SAMPLE_FORMAT_INT16);
+
+            if (!writeCacheSection(file, sections[CACHE_SECTION_AUDIO], buffer16, uint64_t(buffer_size) * sizeof(int16_t), CACHE_AUDIO_ALIGNMENT))
+                return false;
+
+            if (buffer24 && !writeCacheSection(file, sections[CACHE_SECTION_AUDIO_LSB], buffer24, buffer_size))
+                return false;
+        }
+
+        if (compressed_data && !writeCacheSection(file, sections[CACHE_SECTION_COMPRESSED], compressed_data, compressed_data_size))
+            return false;
+
+        file.seekp(0, std::ios::beg);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        return file.good();
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool SoundFont::loadCache(const std::filesystem::path& path, load_mode_t mode)
+    {
+        // Cleanup (just in case)
+        cleanup();
+
+        // Check if the file exists
+        if (!std::filesystem::exists(path))
+            return false;
+
+        mapping = mapFile(path, mapping_size);
+        if (!mapping)
+            return false;
+
+        if (!loadCache(mapping, mapping_size, mode == LOAD_MODE_MEMORY_MAPPED))
+        {
+            cleanup();
+            return false;
+        }
+
+        // Nothing references the file anymore
+        if (mode != LOAD_MODE_MEMORY_MAPPED)
+        {
+            unmapFile(mapping, mapping_size);
+            mapping = nullptr;
+            mapping_size = 0;
+        }
+
+        return true;
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool SoundFont::loadCache(const char* data, size_t size, bool reference_audio)
+    {
+        // Header
+        if (size < sizeof(cache_header_t))
+            return false;
+
+        cache_header_t header;
+        memcpy(&header, data, sizeof(header));
+
+        if ((memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0) ||
+            (header.version != CACHE_VERSION) || (header.byte_order != CACHE_BYTE_ORDER) ||
+            (header.sample_format > SAMPLE_FORMAT_INT24))
+        {
+            return false;
+        }
+
+        // Tables
+        const cache_section_t* sections = header.sections;
+        cache_tables_t tables;
+
+        tables.strings = getCacheSection<char>(data, size, sections[CACHE_SECTION_STRINGS], tables.nb_strings);
+        tables.presets = getCacheSection<cache_preset_t>(data, size, sections[CACHE_SECTION_PRESETS], tables.nb_presets);
+        tables.instruments = getCacheSection<cache_preset_t>(data, size, sections[CACHE_SECTION_INSTRUMENTS], tables.nb_instruments);
+        tables.zones = getCacheSection<cache_zone_t>(data, size, sections[CACHE_SECTION_ZONES], tables.nb_zones);
+        tables.generators = getCacheSection<sf_generator_t>(data, size, sections[CACHE_SECTION_GENERATORS], tables.nb_generators);
+        tables.modulators = getCacheSection<sf_modulator_t>(data, size, sections[CACHE_SECTION_MODULATORS], tables.nb_modulators);
+        tables.key_indices = getCacheSection<uint16_t>(data, size, sections[CACHE_SECTION_KEY_INDICES], tables.nb_key_indices);
+        tables.samples = getCacheSection<cache_sample_t>(data, size, sections[CACHE_SECTION_SAMPLES], tables.nb_samples);
+
+        if (!tables.strings || !tables.presets || !tables.instruments || !tables.zones ||
+            !tables.generators || !tables.modulators || !tables.key_indices || !tables.samples)
+        {
+            return false;
+        }
+
+        // Information
+        information.major_version = header.versions[0];
+        information.minor_version = header.versions[1];
+        information.rom_major_version = header.versions[2];
+        information.rom_minor_version = header.versions[3];
+
+        std::string* information_strings[9] = {
+            &information.name, &information.target_engine, &information.rom_name,
+            &information.creation_date, &information.engineers, &information.product,
+            &information.copyright, &information.comments, &information.creation_tool,
+        };
+
+        for (int i = 0; i < 9; ++i)
+        {
+            if (!getCacheString(tables, header.information[i], *information_strings[i]))
+                return false;
+        }
+
+        // Presets and instruments
+        for (uint64_t i = 0; i < tables.nb_presets; ++i)
+        {
+            const cache_preset_t& record = tables.presets[i];
+
+            preset_t& preset = presets[{ record.bank, record.number }];
+
+            if (!getCacheString(tables, record.name, preset.name) ||
+                !getCacheZones(tables, record, tables.nb_instruments, preset.zones, preset.key_index))
+            {
+                return false;
+            }
+        }
+
+        instruments.resize(tables.nb_instruments);
+
+        for (uint64_t i = 0; i < tables.nb_instruments; ++i)
+        {
+            const cache_preset_t& record = tables.instruments[i];
+            instrument_t& instrument = instruments[i];
+
+            if (!getCacheString(tables, record.name, instrument.name) ||
+                !getCacheZones(tables, record, tables.nb_samples, instrument.zones, instrument.key_index))
+            {
+                return false;
+            }
+        }
+
+        // Samples
+        samples.resize(tables.nb_samples);
+
+        for (uint64_t i = 0; i < tables.nb_samples; ++i)
+        {
+            const cache_sample_t& record = tables.samples[i];
+            sample_t& sample = samples[i];
+
+            if (!getCacheString(tables, record.name, sample.name))
+                return false;
+
+            sample.start = record.start;
+            sample.end = record.end;
+            sample.loop_start = record.loop_start;
+            sample.loop_end = record.loop_end;
+            sample.sample_rate = record.sample_rate;
+            sample.original_pitch = record.original_pitch;
+            sample.pitch_correction = record.pitch_correction;
+            sample.sample_type = static_cast<sample_type_t>(record.sample_type);
+            sample.sample_link = record.sample_link;
+            sample.compressed = (record.flags & CACHE_SAMPLE_COMPRESSED) != 0;
+        }
+
+        // Audio data
+        buffer_size = header.buffer_size;
+
+        uint64_t count = 0;
+
+        if (header.sample_format == SAMPLE_FORMAT_FLOAT)
+        {
+            const float* audio = getCacheSection<float>(data, size, sections[CACHE_SECTION_AUDIO], count);
+            if (!audio || (count != buffer_size))
+                return false;
+
+            if (reference_audio)
+            {
+                buffer = audio;
+            }
+            else
+            {
+                float* copy = new float[buffer_size];
+                memcpy(copy, audio, size_t(buffer_size) * sizeof(float));
+
+                buffer = copy;
+                owns_buffer = true;
+            }
+        }
+        else
+        {
+            const int16_t* msb = getCacheSection<int16_t>(data, size, sections[CACHE_SECTION_AUDIO], count);
+            if (!msb || (count != buffer_size))
+                return false;
+
+            const uint8_t* lsb = nullptr;
+            if (header.sample_format == SAMPLE_FORMAT_INT24)
+            {
+                lsb = getCacheSection<uint8_t>(data, size, sections[CACHE_SECTION_AUDIO_LSB], count);
+                if (!lsb || (count != buffer_size))
+                    return false;
+            }
+
+            if (reference_audio)
+            {
+                buffer16 = msb;
+                buffer24 = lsb;
+            }
+            else
+            {
+                // Same conversion than when loading the SoundFont file
+                const sample_buffer_t sample_buffer(msb, lsb);
+
+                float* converted = new float[buffer_size];
+                for (uint32_t i = 0; i < buffer_size; ++i)
+                    converted[i] = sample_buffer[i];
+
+                buffer = converted;
+                owns_buffer = true;
+            }
+        }
+
+        const uint8_t* compressed = getCacheSection<uint8_t>(data, size, sections[CACHE_SECTION_COMPRESSED], count);
+        if (!compressed)
+            return false;
+
+        if (count > 0)
+        {
+            if (reference_audio)
+            {
+                compressed_data = compressed;
+            }
+            else
+            {
+                uint8_t* copy = new uint8_t[count];
+                memcpy(copy, compressed, size_t(count));
+
+                compressed_data = copy;
+                owns_compressed_data = true;
+            }
+
+            compressed_data_size = uint32_t(count);
+        }
+
+        return true;
+    }
+
+
+    /******************************** COMPRESSED SAMPLES ********************************/
+
+    void SoundFont::setSampleDecoder(sample_decoder_t decoder, void* user_data)
+    {
+        sample_decoder = decoder;
+        sample_decoder_user_data = user_data;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SoundFont::setDecodedSamplesCacheSize(size_t size)
+    {
+        std::lock_guard<std::mutex> lock(decoded_samples_mutex);
+
+        decoded_samples.setMaxSize(size);
+    }
+
+    //-----------------------------------------------------------------------
+
+    size_t SoundFont::getDecodedSamplesCacheUsage() const
+    {
+        std::lock_guard<std::mutex> lock(decoded_samples_mutex);
+        return decoded_samples.usage();
+    }
+
+    //-----------------------------------------------------------------------
+
+    decoded_sample_t SoundFont::getDecodedSample(const sample_t* sample) const
+    {
+        const size_t sample_index = decodableSampleIndex(sample);
+        if (sample_index == samples.size())
+            return nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(decoded_samples_mutex);
+
+            const decoded_sample_t* decoded = decoded_samples.find(sample_index);
+            if (decoded)
+                return *decoded;
+        }
+
+        // Decode the sample without holding the lock (if several threads decode the same
+        // sample at the same time, only the first result is kept)
+        auto decoded = std::make_shared<std::vector<float>>();
+        if (!sample_decoder(compressed_data + sample->start, sample->end - sample->start,
+                            *decoded, sample_decoder_user_data))
+        {
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(decoded_samples_mutex);
+        return decoded_samples.insert(sample_index, decoded, decoded->size() * sizeof(float));
+    }
+
+    //-----------------------------------------------------------------------
+
+    decoded_sample_t SoundFont::findDecodedSample(const sample_t* sample) const
+    {
+        const size_t sample_index = decodableSampleIndex(sample);
+        if (sample_index == samples.size())
+            return nullptr;
+
+        std::unique_lock<std::mutex> lock(decoded_samples_mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+            return nullptr;
+
+        const decoded_sample_t* decoded = decoded_samples.find(sample_index);
+        return (decoded ? *decoded : nullptr);
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool SoundFont::prefetchPreset(uint16_t bank, uint16_t number) const
+    {
+        const preset_t* preset = getPreset(bank, number);
+        if (!preset)
+            return false;
+
+        if (!compressed_data)
+            return true;
+
+        for (const auto& preset_zone : preset->zones)
+        {
+            if (preset_zone.target >= instruments.size())
+                continue;
+
+            for (const auto& instrument_zone : instruments[preset_zone.target].zones)
+            {
+                if (instrument_zone.target < samples.size())
+                    getDecodedSample(&samples[instrument_zone.target]);
+            }
+        }
+
+        return true;
+    }
+
+
+    /******************************** INTERNAL METHODS **********************************/
+
+    bool SoundFont::load(std::istream& stream, const char* data, size_t data_size)
+    {
+        // Main chunk
+        chunk_header_t sfbk_header = readChunkHeader(stream);
+        if ((strncmp(sfbk_header.type, "RIFF", 4) != 0) ||
             (strncmp(sfbk_header.id, "sfbk", 4) != 0))
         {
             return false;
@@ -1759,59 +3317,103 @@ namespace sf {
 
             off_t smpl_data_start = stream.tellg();
 
-            // Are the samples 24 bits?
-            stream.seekg(smpl_field.size, std::ios_base::cur);
-            field_info_t sm24_field = readFieldInfo(stream);
-
-            uint8_t* lsb_buffer = nullptr;
-            if (strncmp(sm24_field.id, "sm24", 4) == 0)
+            // SoundFont 3: the audio data of each sample is compressed, and only decoded
+            // when needed (see getDecodedSample())
+            if (information.major_version >= 3)
             {
-                lsb_buffer = new uint8_t[sm24_field.size];
-                stream.read(reinterpret_cast<char*>(lsb_buffer), sm24_field.size);
+                if (data && (smpl_data_start >= 0) &&
+                    (size_t(smpl_data_start) + smpl_field.size <= data_size))
+                {
+                    compressed_data = reinterpret_cast<const uint8_t*>(data + smpl_data_start);
+                }
+                else
+                {
+                    uint8_t* copy = new uint8_t[smpl_field.size];
+                    stream.read(reinterpret_cast<char*>(copy), smpl_field.size);
+
+                    compressed_data = copy;
+                    owns_compressed_data = true;
+                }
+
+                compressed_data_size = smpl_field.size;
             }
+            else
+            {
+                // Are the samples 24 bits?
+                stream.seekg(smpl_field.size, std::ios_base::cur);
+                field_info_t sm24_field = readFieldInfo(stream);
 
-            stream.seekg(smpl_data_start, std::ios::beg);
+                const bool has_lsb = (strncmp(sm24_field.id, "sm24", 4) == 0);
+                off_t sm24_data_start = stream.tellg();
 
-            buffer_size = smpl_field.size >> 1;
-            buffer = new float[buffer_size];
+                buffer_size = smpl_field.size >> 1;
 
-            uint32_t remainder = buffer_size;
+                // Reference the audio data in place if possible (the 16-bits values must be
+                // aligned and entirely available)
+                if (data && (smpl_data_start >= 0) && (sm24_data_start >= 0) &&
+                    ((smpl_data_start & 1) == 0) &&
+                    (size_t(smpl_data_start) + smpl_field.size <= data_size) &&
+                    (!has_lsb || (size_t(sm24_data_start) + buffer_size <= data_size)))
+                {
+                    buffer16 = reinterpret_cast<const int16_t*>(data + smpl_data_start);
 
-            const uint32_t ibuffer_size = 100000;
+                    if (has_lsb)
+                        buffer24 = reinterpret_cast<const uint8_t*>(data + sm24_data_start);
+                }
+                else
+                {
+                    uint8_t* lsb_buffer = nullptr;
+                    if (has_lsb)
+                    {
+                        lsb_buffer = new uint8_t[sm24_field.size];
+                        stream.read(reinterpret_cast<char*>(lsb_buffer), sm24_field.size);
+                    }
 
-            int16_t* ibuffer = new int16_t[ibuffer_size];
-            float* dest = buffer;
-            uint8_t* lsb = lsb_buffer;
+                    stream.seekg(smpl_data_start, std::ios::beg);
 
-            while (remainder > 0)
-            {
-                uint32_t count = std::min(remainder, ibuffer_size);
+                    float* converted = new float[buffer_size];
+                    buffer = converted;
+                    owns_buffer = true;
 
-                stream.read(reinterpret_cast<char*>(ibuffer), count << 1);
+                    uint32_t remainder = buffer_size;
 
-                if (lsb)
-                {
-                    for (int i = 0; i < count; ++i)
+                    const uint32_t ibuffer_size = 100000;
+
+                    int16_t* ibuffer = new int16_t[ibuffer_size];
+                    float* dest = converted;
+                    uint8_t* lsb = lsb_buffer;
+
+                    while (remainder > 0)
                     {
-                        int32_t v = ibuffer[i] << 8 | lsb[i];
-                        dest[i] = float(v) / 8388608.0f;
+                        uint32_t count = std::min(remainder, ibuffer_size);
+
+                        stream.read(reinterpret_cast<char*>(ibuffer), count << 1);
+
+                        if (lsb)
+                        {
+                            for (int i = 0; i < count; ++i)
+                            {
+                                int32_t v = ibuffer[i] << 8 | lsb[i];
+                                dest[i] = float(v) / 8388608.0f;
+                            }
+                        }
+                        else
+                        {
+                            for (int i = 0; i < count; ++i)
+                                dest[i] = float(ibuffer[i]) / 32767.0f;
+                        }
+
+                        dest += count;
+                        remainder -= count;
+
+                        if (lsb)
+                            lsb += count;
                     }
-                }
-                else
-                {
-                    for (int i = 0; i < count; ++i)
-                        dest[i] = float(ibuffer[i]) / 32767.0f;
-                }
 
-                dest += count;
-                remainder -= count;
-
-                if (lsb)
-                    lsb += count;
+                    delete[] ibuffer;
+                    delete[] lsb_buffer;
+                }
             }
-
-            delete[] ibuffer;
-            delete[] lsb_buffer;
         }
 
         stream.seekg(end_of_chunk, std::ios::beg);
@@ -1836,12 +3438,37 @@ namespace sf {
     {
         information = information_t();
 
-        delete[] buffer;
+        if (owns_buffer)
+            delete[] buffer;
+
         buffer = nullptr;
+        owns_buffer = false;
+        buffer16 = nullptr;
+        buffer24 = nullptr;
         buffer_size = 0;
 
+        if (owns_compressed_data)
+            delete[] compressed_data;
+
+        compressed_data = nullptr;
+        owns_compressed_data = false;
+        compressed_data_size = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(decoded_samples_mutex);
+            decoded_samples.clear();
+        }
+
+        if (mapping)
+        {
+            unmapFile(mapping, mapping_size);
+            mapping = nullptr;
+            mapping_size = 0;
+        }
+
         presets.clear();
         instruments.clear();
+        samples.clear();
     }
 
     //-----------------------------------------------------------------------
@@ -2086,28 +3713,9 @@ namespace sf {
                     const auto& ref_modulator = preset_modulators[k];
 
                     modulator_id_t modulator_id;
-
-                    modulator_id.src.type = static_cast<modulator_source_type_t>((ref_modulator.src_operation & 0xFC00) >> 10);
-                    modulator_id.src.polarity = (ref_modulator.src_operation & 0x0200) != 0 ? MOD_SRC_POL_BIPOLAR : MOD_SRC_POL_UNIPOLAR;
-                    modulator_id.src.direction = (ref_modulator.src_operation & 0x0100) != 0 ? MOD_SRC_DIR_MAX_TO_MIN : MOD_SRC_DIR_MIN_TO_MAX;
-                    modulator_id.src.controller_type = (ref_modulator.src_operation & 0x0080) != 0 ? MOD_CTRL_TYPE_MIDI : MOD_CTRL_TYPE_SRC;
-
-                    if (modulator_id.src.controller_type == MOD_CTRL_TYPE_MIDI)
-                        modulator_id.src.midi = ref_modulator.src_operation & 0x003F;
-                    else
-                        modulator_id.src.source = static_cast<modulator_controller_source_t>(ref_modulator.src_operation & 0x003F);
-
+                    modulator_id.src = decodeModulatorSource(ref_modulator.src_operation);
                     modulator_id.dest = static_cast<generator_type_t>(ref_modulator.dest_operation);
-
-                    modulator_id.amount_src.type = static_cast<modulator_source_type_t>((ref_modulator.amount_src_operation & 0xFC00) >> 10);
-                    modulator_id.amount_src.polarity = (ref_modulator.amount_src_operation & 0x0200) != 0 ? MOD_SRC_POL_BIPOLAR : MOD_SRC_POL_UNIPOLAR;
-                    modulator_id.amount_src.direction = (ref_modulator.amount_src_operation & 0x0080) != 0 ? MOD_SRC_DIR_MAX_TO_MIN : MOD_SRC_DIR_MIN_TO_MAX;
-                    modulator_id.amount_src.controller_type = (ref_modulator.amount_src_operation & 0x0080) != 0 ? MOD_CTRL_TYPE_MIDI : MOD_CTRL_TYPE_SRC;
-
-                    if (modulator_id.amount_src.controller_type == MOD_CTRL_TYPE_MIDI)
-                        modulator_id.amount_src.midi = ref_modulator.amount_src_operation & 0x003F;
-                    else
-                        modulator_id.amount_src.source = static_cast<modulator_controller_source_t>(ref_modulator.amount_src_operation & 0x003F);
+                    modulator_id.amount_src = decodeModulatorSource(ref_modulator.amount_src_operation);
 
                     modulator_t modulator;
                     modulator.amount = ref_modulator.amount;
@@ -2131,10 +3739,15 @@ namespace sf {
                     zone.generators.erase(GEN_TYPE_KEY_RANGE);
                     zone.generators.erase(GEN_TYPE_VELOCITY_RANGE);
 
+                    zone.target = zone.generators[GEN_TYPE_INSTRUMENT].uvalue;
+                    buildGeneratorSet(zone.generators, zone.generator_set);
+
                     preset.zones.push_back(zone);
                 }
             }
-    
+
+            buildKeyIndex(preset.zones, preset.key_index);
+
             this->presets[preset_id] = preset;
         }
 
@@ -2191,18 +3804,9 @@ namespace sf {
                     const auto& ref_modulator = instrument_modulators[k];
 
                     modulator_id_t modulator_id;
-
-                    modulator_id.src.type = static_cast<modulator_source_type_t>((ref_modulator.src_operation & 0xFC00) >> 10);
-                    modulator_id.src.polarity = (ref_modulator.src_operation & 0x0200) != 0 ? MOD_SRC_POL_BIPOLAR : MOD_SRC_POL_UNIPOLAR;
-                    modulator_id.src.direction = (ref_modulator.src_operation & 0x0080) != 0 ? MOD_SRC_DIR_MAX_TO_MIN : MOD_SRC_DIR_MIN_TO_MAX;
-                    modulator_id.src.midi = ref_modulator.src_operation & 0x003F;
-
+                    modulator_id.src = decodeModulatorSource(ref_modulator.src_operation);
                     modulator_id.dest = static_cast<generator_type_t>(ref_modulator.dest_operation);
-
-                    modulator_id.amount_src.type = static_cast<modulator_source_type_t>((ref_modulator.amount_src_operation & 0xFC00) >> 10);
-                    modulator_id.amount_src.polarity = (ref_modulator.amount_src_operation & 0x0200) != 0 ? MOD_SRC_POL_BIPOLAR : MOD_SRC_POL_UNIPOLAR;
-                    modulator_id.amount_src.direction = (ref_modulator.amount_src_operation & 0x0080) != 0 ? MOD_SRC_DIR_MAX_TO_MIN : MOD_SRC_DIR_MIN_TO_MAX;
-                    modulator_id.amount_src.midi = ref_modulator.amount_src_operation & 0x003F;
+                    modulator_id.amount_src = decodeModulatorSource(ref_modulator.amount_src_operation);
 
                     modulator_t modulator;
                     modulator.amount = ref_modulator.amount;
@@ -2226,10 +3830,15 @@ namespace sf {
                     zone.generators.erase(GEN_TYPE_KEY_RANGE);
                     zone.generators.erase(GEN_TYPE_VELOCITY_RANGE);
 
+                    zone.target = zone.generators[GEN_TYPE_SAMPLE_ID].uvalue;
+                    buildGeneratorSet(zone.generators, zone.generator_set);
+
                     instrument.zones.push_back(zone);
                 }
             }
-    
+
+            buildKeyIndex(instrument.zones, instrument.key_index);
+
             this->instruments.push_back(instrument);
         }
 
@@ -2246,8 +3855,9 @@ namespace sf {
             sample.original_pitch = ref.original_pitch;
             sample.pitch_correction = ref.pitch_correction;
             sample.sample_rate = ref.sample_rate;
-            sample.sample_type = static_cast<sample_type_t>(ref.sample_type);
+            sample.sample_type = static_cast<sample_type_t>(ref.sample_type & ~SAMPLE_TYPE_COMPRESSED);
             sample.sample_link = ref.sample_link;
+            sample.compressed = (ref.sample_type & SAMPLE_TYPE_COMPRESSED) != 0;
 
             this->samples.push_back(sample);
         }
@@ -2261,10 +3871,16 @@ namespace sf {
         const preset_t* preset, uint8_t key, uint8_t velocity
     ) const
     {
-        for (auto& preset_zone : preset->zones)
+        if (key > 127)
+            return nullptr;
+
+        const key_index_t& index = preset->key_index;
+
+        for (uint32_t i = index.offsets[key]; i < index.offsets[key + 1]; ++i)
         {
-            if ((key >= preset_zone.keys_range.lo) && (key <= preset_zone.keys_range.hi) &&
-                (velocity >= preset_zone.velocities_range.lo) &&
+            const preset_zone_t& preset_zone = preset->zones[index.zones[i]];
+
+            if ((velocity >= preset_zone.velocities_range.lo) &&
                 (velocity <= preset_zone.velocities_range.hi))
             {
                 return &preset_zone;
@@ -2280,12 +3896,18 @@ namespace sf {
         const instrument_t* instrument, uint8_t key, uint8_t velocity, int exclude_sample_id
     ) const
     {
-        for (auto& instrument_zone : instrument->zones)
+        if (key > 127)
+            return nullptr;
+
+        const key_index_t& index = instrument->key_index;
+
+        for (uint32_t i = index.offsets[key]; i < index.offsets[key + 1]; ++i)
         {
-            if ((key >= instrument_zone.keys_range.lo) && (key <= instrument_zone.keys_range.hi) &&
-                (velocity >= instrument_zone.velocities_range.lo) &&
+            const instrument_zone_t& instrument_zone = instrument->zones[index.zones[i]];
+
+            if ((velocity >= instrument_zone.velocities_range.lo) &&
                 (velocity <= instrument_zone.velocities_range.hi) &&
-                (instrument_zone.generators.at(GEN_TYPE_SAMPLE_ID).ivalue != exclude_sample_id))
+                (int(instrument_zone.target) != exclude_sample_id))
             {
                 return &instrument_zone;
             }
@@ -2301,80 +3923,40 @@ namespace sf {
         sample_info_t* result
     ) const
     {
-        result->generators = instrument_zone->generators;
+        result->generators = instrument_zone->generator_set;
 
-        for (auto& entry : preset_zone->generators)
-        {
-            switch (entry.first)
-            {
-                case GEN_TYPE_INITIAL_FILTER_CUTOFF_FREQUENCY:
-                case GEN_TYPE_INITIAL_FILTER_Q:
-                case GEN_TYPE_CHORUS_EFFECTS_SEND:
-                case GEN_TYPE_REVERB_EFFECTS_SEND:
-                case GEN_TYPE_SUSTAIN_MODULATION_ENVELOPE:
-                case GEN_TYPE_SUSTAIN_VOLUME_ENVELOPE:
-                case GEN_TYPE_INITIAL_ATTENUATION:
-                case GEN_TYPE_SCALE_TUNING:
-                {
-                    auto iter = result->generators.find(entry.first);
-                    if (iter != result->generators.end())
-                        iter->second.uvalue += entry.second.uvalue;
-                    else
-                        result->generators[entry.first].uvalue = entry.second.uvalue;
-                    break;
-                }
+        const generator_set_t& preset_generators = preset_zone->generator_set;
+        uint64_t mask = preset_generators.mask & ADDITIVE_GENERATORS_MASK;
 
-                case GEN_TYPE_MODULATION_LFO_TO_PITCH:
-                case GEN_TYPE_VIBRATO_LFO_TO_PITCH:
-                case GEN_TYPE_MODULATION_ENVELOPE_TO_PITCH:
-                case GEN_TYPE_MODULATION_LFO_TO_FILTER_CUTOFF_FREQUENCY:
-                case GEN_TYPE_MODULATION_ENVELOPE_TO_FILTER_CUTOFF_FREQUENCY:
-                case GEN_TYPE_MODULATION_LFO_TO_VOLUME:
-                case GEN_TYPE_PAN:
-                case GEN_TYPE_DELAY_MODULATION_LFO:
-                case GEN_TYPE_FREQUENCY_MODULATION_LFO:
-                case GEN_TYPE_DELAY_VIBRATO_LFO:
-                case GEN_TYPE_FREQUENCY_VIBRATO_LFO:
-                case GEN_TYPE_DELAY_MODULATION_ENVELOPE:
-                case GEN_TYPE_ATTACK_MODULATION_ENVELOPE:
-                case GEN_TYPE_HOLD_MODULATION_ENVELOPE:
-                case GEN_TYPE_DECAY_MODULATION_ENVELOPE:
-                case GEN_TYPE_RELEASE_MODULATION_ENVELOPE:
-                case GEN_TYPE_KEY_NUMBER_TO_MODULATION_ENVELOPE_HOLD:
-                case GEN_TYPE_KEY_NUMBER_TO_MODULATION_ENVELOPE_DECAY:
-                case GEN_TYPE_DELAY_VOLUME_ENVELOPE:
-                case GEN_TYPE_ATTACK_VOLUME_ENVELOPE:
-                case GEN_TYPE_HOLD_VOLUME_ENVELOPE:
-                case GEN_TYPE_DECAY_VOLUME_ENVELOPE:
-                case GEN_TYPE_RELEASE_VOLUME_ENVELOPE:
-                case GEN_TYPE_KEY_NUMBER_TO_VOLUME_ENVELOPE_HOLD:
-                case GEN_TYPE_KEY_NUMBER_TO_VOLUME_ENVELOPE_DECAY:
-                case GEN_TYPE_COARSE_TUNE:
-                case GEN_TYPE_FINE_TUNE:
-                {
-                    auto iter = result->generators.find(entry.first);
-                    if (iter != result->generators.end())
-                        iter->second.ivalue += entry.second.ivalue;
-                    else
-                        result->generators[entry.first].ivalue = entry.second.ivalue;
-                    break;
-                }
+        while (mask != 0)
+        {
+            generator_type_t type = static_cast<generator_type_t>(countTrailingZeros(mask));
+            mask &= mask - 1;
 
-                default:
-                    break;
-            }
+            // Signed and unsigned values have the same binary representation, the
+            // addition can be done on either of them
+            if (result->generators.contains(type))
+                result->generators.values[type].uvalue += preset_generators.values[type].uvalue;
+            else
+                result->generators.set(type, preset_generators.values[type]);
         }
 
-        result->modulators = instrument_zone->modulators;
+        result->instrument_modulators = &instrument_zone->modulators;
+        result->preset_modulators = &preset_zone->modulators;
+    }
+
+    //-----------------------------------------------------------------------
 
-        for (auto& entry : preset_zone->modulators)
+    size_t SoundFont::decodableSampleIndex(const sample_t* sample) const
+    {
+        if (!sample || !sample->compressed || !sample_decoder || !compressed_data ||
+            (sample < samples.data()) || (sample >= samples.data() + samples.size()) ||
+            (sample->start >= sample->end) || (sample->end > compressed_data_size))
         {
-            auto iter = result->modulators.find(entry.first);
-            if (iter != result->modulators.end())
-                iter->second.amount += entry.second.amount;
-            else
-                result->modulators[entry.first] = entry.second;
+            return samples.size();
         }
+
+        return size_t(sample - samples.data());
     }
 
 #endif // KNM_SOUNDFONT_IMPLEMENTATION
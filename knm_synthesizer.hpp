@@ -24,6 +24,11 @@ USAGE
 
     In other files, just use #include <knm_synthesizer.hpp>
 
+    The mixing of the voices and the conversions of the output use SIMD instructions
+    (AVX, SSE or NEON, selected at compile-time from the target architecture). Define
+    KNM_SYNTHESIZER_NO_SIMD before including the implementation to use the portable
+    scalar code instead.
+
     Here is an example using the library to render a C4 note at velocity 100 during 0.5
     second using channel 0, in 1 second left & right buffers:
 
@@ -112,10 +117,43 @@ LICENSE
 #endif
 
 #include <knm_soundfont.hpp>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
 
 
 #ifdef KNM_SYNTHESIZER_IMPLEMENTATION
     #include <cmath>
+    #include <atomic>
+    #include <algorithm>
+    #include <condition_variable>
+    #include <chrono>
+    #include <fstream>
+    #include <new>
+    #include <thread>
+
+    #ifndef KNM_SYNTHESIZER_NO_SIMD
+        #if defined(__AVX__)
+            #define KNM_SYNTHESIZER_SIMD
+            #define KNM_SYNTHESIZER_AVX
+            #define KNM_SYNTHESIZER_SSE2
+            #include <immintrin.h>
+        #elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+            #define KNM_SYNTHESIZER_SIMD
+            #define KNM_SYNTHESIZER_SSE
+            #include <xmmintrin.h>
+
+            #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+                #define KNM_SYNTHESIZER_SSE2
+                #include <emmintrin.h>
+            #endif
+        #elif defined(__ARM_NEON)
+            #define KNM_SYNTHESIZER_SIMD
+            #define KNM_SYNTHESIZER_NEON
+            #include <arm_neon.h>
+        #endif
+    #endif
 #endif
 
 
@@ -133,6 +171,147 @@ namespace synth {
     class Lfo;
     class Voice;
     class VoiceCollection;
+    class WorkerPool;
+    class Reverb;
+    class Chorus;
+    class MidiQueue;
+    class ReleaseQueue;
+    class MidiFile;
+    class SynthesizerSnapshot;
+    class NoteClipCache;
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  The interpolation methods used to play the samples at the required pitch
+    //------------------------------------------------------------------------------------
+    enum interpolation_mode_t
+    {
+        INTERPOLATION_MODE_NEAREST,     ///< No interpolation (fastest, lowest quality)
+        INTERPOLATION_MODE_LINEAR,      ///< Linear interpolation between two points
+        INTERPOLATION_MODE_CUBIC,       ///< 4-points Hermite interpolation
+        INTERPOLATION_MODE_SINC,        ///< 8-points windowed-sinc interpolation (slowest,
+                                        ///  highest quality)
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  A MIDI message to process at a precise position of a rendered buffer
+    ///
+    /// See `Synthesizer::render()`.
+    //------------------------------------------------------------------------------------
+    struct midi_event_t
+    {
+        uint32_t offset;    ///< Position of the event in the buffer, in samples
+        uint8_t channel;    ///< The channel affected by the message ('port * 16 + channel')
+        uint8_t command;    ///< The command to process
+        uint8_t data1;      ///< Data associated to the command
+        uint8_t data2;      ///< Secondary data associated to the command
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  The silent parts of the buffers filled by a `Synthesizer::render()` method
+    ///
+    /// The silent parts are the ones rendered while nothing was playing (no active voice,
+    /// and the tail of the effects was over): they only contain zeros.
+    //------------------------------------------------------------------------------------
+    struct silent_ranges_t
+    {
+        size_t leading = 0;     ///< Number of silent samples at the start of the buffers
+        size_t trailing = 0;    ///< Number of silent samples at the end of the buffers
+        size_t size = 0;        ///< Size of the buffers
+
+        /// @brief  Indicates if the buffers only contain silence
+        inline bool silent() const
+        {
+            return (leading == size);
+        }
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  A MIDI message of a MIDI file (see `MidiFile`)
+    //------------------------------------------------------------------------------------
+    struct midi_file_event_t
+    {
+        double time;        ///< Time of the event from the start of the file, in seconds
+        uint8_t channel;    ///< The channel affected by the message ('port * 16 + channel')
+        uint8_t command;    ///< The command to process
+        uint8_t data1;      ///< Data associated to the command
+        uint8_t data2;      ///< Secondary data associated to the command
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  The stereo rendering of a single note (see `Synthesizer::renderNote()`)
+    //------------------------------------------------------------------------------------
+    struct note_clip_t
+    {
+        std::vector<float> left;    ///< The left buffer
+        std::vector<float> right;   ///< The right buffer
+
+        /// @brief  Returns the number of samples of the clip
+        inline size_t size() const
+        {
+            return left.size();
+        }
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Timings of the rendering of one block (see `Synthesizer::getStatistics()`)
+    //------------------------------------------------------------------------------------
+    struct block_statistics_t
+    {
+        uint32_t size;              ///< Number of samples in the block
+        uint16_t nb_active_voices;  ///< Number of active voices after the processing
+        double voices_time;         ///< Time spent processing the voices, in seconds
+        double mixing_time;         ///< Time spent mixing the voices, in seconds
+        double effects_time;        ///< Time spent in the reverb and chorus, in seconds
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Statistics about the rendering (see `Synthesizer::getStatistics()`)
+    //------------------------------------------------------------------------------------
+    struct statistics_t
+    {
+        /// Number of buckets of the histogram of the rendering times of the blocks
+        static const int HISTOGRAM_SIZE = 16;
+
+        uint64_t nb_blocks = 0;             ///< Number of blocks rendered
+        double voices_time = 0.0;           ///< Total time spent processing the voices, in s
+        double mixing_time = 0.0;           ///< Total time spent mixing the voices, in s
+        double effects_time = 0.0;          ///< Total time spent in the effects, in s
+        double max_block_time = 0.0;        ///< Longest rendering time of a block, in s
+
+        uint64_t nb_voice_steals = 0;       ///< Number of voices stopped to play new notes
+        uint16_t peak_polyphony = 0;        ///< Highest number of active voices
+        uint64_t nb_dropped_notes = 0;      ///< Number of notes without any preset to play
+                                            ///  them
+
+        /// Histogram of the rendering times of the blocks: bucket 0 counts the blocks
+        /// rendered in less than 1µs, bucket i those rendered in [2^(i-1), 2^i[ µs, and
+        /// the last one all the slower blocks
+        uint64_t block_time_histogram[HISTOGRAM_SIZE] = { 0 };
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Function called after the rendering of each block (see
+    ///         `Synthesizer::setStatisticsCallback()`)
+    //------------------------------------------------------------------------------------
+    typedef void (*statistics_callback_t)(const block_statistics_t& block, void* user_data);
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Function called when a preset is assigned to a channel (see
+    ///         `Synthesizer::setPrefetchCallback()`)
+    //------------------------------------------------------------------------------------
+    typedef void (*prefetch_callback_t)(
+        const std::shared_ptr<const sf::SoundFont>& soundfont, sf::preset_id_t preset,
+        void* user_data
+    );
 
 
     //------------------------------------------------------------------------------------
@@ -161,6 +340,10 @@ namespace synth {
         //--------------------------------------------------------------------------------
         /// @brief  Set the block size used internally during synthesis
         ///
+        /// The volume, the pitch and the cutoff frequency of the voices are updated
+        /// once per block, but go from their previous values to the new ones one sample
+        /// at a time: large blocks don't produce audible steps.
+        ///
         /// @param block_size   The block size
         //--------------------------------------------------------------------------------
         void setBlockSize(uint16_t block_size);
@@ -175,10 +358,115 @@ namespace synth {
         //--------------------------------------------------------------------------------
         /// @brief  Enable/disable reverb and chorus
         ///
+        /// The amount of signal sent to the effects is controlled by the reverb and
+        /// chorus send levels of the channels and of the instruments. The effects are
+        /// only applied when rendering in stereo.
+        ///
         /// @param enable   Whether to enable or disable
         //--------------------------------------------------------------------------------
         void enableReverbAndChorus(bool enable);
 
+        //--------------------------------------------------------------------------------
+        /// @brief  Set the number of worker threads used to process the voices
+        ///
+        /// The voices are processed in parallel by the worker threads and the calling
+        /// thread, then mixed in a deterministic order: the output doesn't depend on the
+        /// number of threads.
+        ///
+        /// @param nb_threads   The number of worker threads (0 to process all the voices
+        ///                     on the calling thread)
+        //--------------------------------------------------------------------------------
+        void setNbWorkerThreads(uint16_t nb_threads);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Set the interpolation method used to play the samples
+        ///
+        /// Higher-order interpolations give a better quality at a given sample rate,
+        /// avoiding the need to render at a higher sample rate and downsample.
+        ///
+        /// @param mode The interpolation method
+        //--------------------------------------------------------------------------------
+        void setInterpolationMode(interpolation_mode_t mode);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Enable/disable the measure of the rendering times
+        ///
+        /// When disabled (the default), no time is measured and the timings reported by
+        /// `Synthesizer::getStatistics()` stay at 0.
+        ///
+        /// @param enable   Whether to enable or disable
+        //--------------------------------------------------------------------------------
+        void enableStatistics(bool enable);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Set the capacity of the queue of MIDI messages posted with
+        ///         `Synthesizer::postMidiMessage()`
+        ///
+        /// @param size The maximum number of messages waiting in the queue (must be a
+        ///             power of two between 16 and 65536)
+        //--------------------------------------------------------------------------------
+        void setMidiQueueSize(uint32_t size);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Enable/disable the fast approximations of the mathematical functions
+        ///
+        /// When enabled, the transcendental functions evaluated for each block (pitch
+        /// ratios, gains in decibels, envelopes, filter coefficients) are replaced by
+        /// polynomial approximations, with a relative error below 1e-6 (an absolute
+        /// error below 1e-6 for the sines and cosines). Disabled by default.
+        ///
+        /// @param enable   Whether to enable or disable
+        //--------------------------------------------------------------------------------
+        void enableFastMath(bool enable);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Set the number of stems the synthesizer can render at once (see
+        ///         `Synthesizer::renderStems()`)
+        ///
+        /// Each one needs a stereo buffer of the size of a block. By default, there is
+        /// none.
+        ///
+        /// @param nb_stems The number of stems (between 0 and 256)
+        //--------------------------------------------------------------------------------
+        void setNbStems(uint16_t nb_stems);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Set the number of MIDI channels of the synthesizer
+        ///
+        /// The channels are grouped by ports of 16 channels: the channel 'c' of the port
+        /// 'p' is the channel 'p * 16 + c' of the synthesizer. All the ports share the
+        /// same voices. Defaults to 16 (one port).
+        ///
+        /// @param nb_channels  The number of channels (a multiple of 16, between 16 and
+        ///                     256)
+        //--------------------------------------------------------------------------------
+        void setNbChannels(uint16_t nb_channels);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Set the level of the volume envelope below which a voice is considered
+        ///         inaudible, and stopped
+        ///
+        /// A higher level stops the voices earlier in their release, at the cost of
+        /// shorter tails. Defaults to -60 dB.
+        ///
+        /// @param level    The level, in dB (between -100 and -20)
+        //--------------------------------------------------------------------------------
+        void setInaudibleLevel(float level);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Enable/disable the flushing of the denormal numbers to zero during the
+        ///         rendering
+        ///
+        /// When enabled (the default), the "flush-to-zero" and "denormals-are-zero" modes
+        /// of the CPU are set while a block is rendered (and restored afterwards), so the
+        /// decaying states of the filters and of the effects don't slow down the
+        /// computations. This has no effect on the CPUs without such modes, or when
+        /// KNM_SYNTHESIZER_NO_SIMD is defined.
+        ///
+        /// @param enable   Whether to enable or disable
+        //--------------------------------------------------------------------------------
+        void enableDenormalsFlushing(bool enable);
+
         //--------------------------------------------------------------------------------
         /// @brief  Returns the sample rate of the synthesized signal
         //--------------------------------------------------------------------------------
@@ -212,12 +500,95 @@ namespace synth {
             return _reverb_and_chorus_enabled;
         }
 
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the number of worker threads used to process the voices
+        //--------------------------------------------------------------------------------
+        inline uint16_t nbWorkerThreads() const
+        {
+            return _nb_worker_threads;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the interpolation method used to play the samples
+        //--------------------------------------------------------------------------------
+        inline interpolation_mode_t interpolationMode() const
+        {
+            return _interpolation_mode;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Indicates if the rendering times are measured
+        //--------------------------------------------------------------------------------
+        inline bool statisticsEnabled() const
+        {
+            return _statistics_enabled;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the capacity of the queue of posted MIDI messages
+        //--------------------------------------------------------------------------------
+        inline uint32_t midiQueueSize() const
+        {
+            return _midi_queue_size;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Indicates if the fast approximations of the mathematical functions are
+        ///         used
+        //--------------------------------------------------------------------------------
+        inline bool fastMathEnabled() const
+        {
+            return _fast_math_enabled;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the number of stems the synthesizer can render at once
+        //--------------------------------------------------------------------------------
+        inline uint16_t nbStems() const
+        {
+            return _nb_stems;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the number of MIDI channels of the synthesizer
+        //--------------------------------------------------------------------------------
+        inline uint16_t nbChannels() const
+        {
+            return _nb_channels;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the level below which a voice is considered inaudible, in dB
+        //--------------------------------------------------------------------------------
+        inline float inaudibleLevel() const
+        {
+            return _inaudible_level;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Indicates if the denormal numbers are flushed to zero during the
+        ///         rendering
+        //--------------------------------------------------------------------------------
+        inline bool denormalsFlushingEnabled() const
+        {
+            return _denormals_flushing_enabled;
+        }
+
 
         //_____ Constants __________
     private:
         const uint32_t DEFAULT_BLOCK_SIZE = 64;
         const uint16_t DEFAULT_MAXIMUM_POLYPHONY = 64;
         const bool DEFAULT_REVERB_AND_CHORUS_ENABLED = true;
+        const uint16_t DEFAULT_NB_WORKER_THREADS = 0;
+        const interpolation_mode_t DEFAULT_INTERPOLATION_MODE = INTERPOLATION_MODE_LINEAR;
+        const bool DEFAULT_STATISTICS_ENABLED = false;
+        const uint32_t DEFAULT_MIDI_QUEUE_SIZE = 1024;
+        const bool DEFAULT_FAST_MATH_ENABLED = false;
+        const uint16_t DEFAULT_NB_STEMS = 0;
+        const uint16_t DEFAULT_NB_CHANNELS = 16;
+        const float DEFAULT_INAUDIBLE_LEVEL = -60.0f;
+        const bool DEFAULT_DENORMALS_FLUSHING_ENABLED = true;
 
 
         //_____ Attributes __________
@@ -226,6 +597,35 @@ namespace synth {
         uint16_t _block_size;
         uint16_t _maximum_polyphony;
         bool _reverb_and_chorus_enabled;
+        uint16_t _nb_worker_threads;
+        interpolation_mode_t _interpolation_mode;
+        bool _statistics_enabled;
+        uint32_t _midi_queue_size;
+        bool _fast_math_enabled;
+        uint16_t _nb_stems;
+        uint16_t _nb_channels;
+        float _inaudible_level;
+        bool _denormals_flushing_enabled;
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  The values derived from the controllers of a channel, shared by all the
+    ///         voices of the channel (see `Channel::controls()`)
+    //------------------------------------------------------------------------------------
+    struct channel_controls_t
+    {
+        float gain;             ///< Volume gain multiplied by the expression
+        float pitch;            ///< Tuning adjustment and pitch bend, in semitones
+        float vibrato_depth;    ///< Vibrato depth added by the modulation wheel, in semitones
+        float pan;              ///< The pan value
+        bool pan_law;           ///< Indicates if the pan law applies to a centered voice
+        float pan_gain_left;    ///< Left gain of the pan law for a centered voice
+        float pan_gain_right;   ///< Right gain of the pan law for a centered voice
+        float reverb_send;      ///< The reverb send level
+        float chorus_send;      ///< The chorus send level
+        bool sustain;           ///< Indicates if sustain is enabled
+        uint32_t version;       ///< Incremented each time the controls change
     };
 
 
@@ -266,6 +666,26 @@ namespace synth {
         void resetControllers();
     /// @}
 
+    /// @name Control values
+    /// @{
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the values derived from the controllers, as computed by the
+        ///         last call to `updateControls()`
+        //--------------------------------------------------------------------------------
+        inline const channel_controls_t& controls() const
+        {
+            return _controls;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Recomputes the values derived from the controllers, if any of them was
+        ///         modified since the last call
+        ///
+        /// The synthesizer calls it once per block, before processing the voices.
+        //--------------------------------------------------------------------------------
+        void updateControls();
+    /// @}
+
     /// @name Setters for general parameters
     /// @{
         //--------------------------------------------------------------------------------
@@ -276,6 +696,16 @@ namespace synth {
             _bank = value + (_percussion ? 128 : 0);
         }
 
+        //--------------------------------------------------------------------------------
+        /// @brief  Sets whether the channel is a percussion channel (the bank number is
+        ///         kept)
+        //--------------------------------------------------------------------------------
+        inline void setPercussion(bool percussion)
+        {
+            _bank = (_bank & 0x7F) + (percussion ? 128 : 0);
+            _percussion = percussion;
+        }
+
         //--------------------------------------------------------------------------------
         /// @brief  Sets the preset number for the channel
         //--------------------------------------------------------------------------------
@@ -292,7 +722,34 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setPitchBend(uint8_t value1, uint8_t value2)
         {
-            _pitch_bend = (1.0f / 8192.0f) * (int16_t(value1 | (value2 << 7)) - 8192);
+            _dirty = true;
+            _pitch_wheel = value1 | (value2 << 7);
+            _pitch_bend = (1.0f / 8192.0f) * (int16_t(_pitch_wheel) - 8192);
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Sets the raw value of a MIDI controller, used as a source by the
+        ///         modulators of the SoundFont
+        ///
+        /// The controllers with a dedicated setter must be set with it too (this is done
+        /// by `Synthesizer::processMidiMessage()`).
+        ///
+        /// @param number   The number of the controller
+        /// @param value    The value of the controller
+        //--------------------------------------------------------------------------------
+        inline void setController(uint8_t number, uint8_t value)
+        {
+            _dirty = true;
+            _controllers[number & 0x7F] = value;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Sets the channel pressure (aftertouch)
+        //--------------------------------------------------------------------------------
+        inline void setChannelPressure(uint8_t value)
+        {
+            _dirty = true;
+            _channel_pressure = value;
         }
     /// @}
 
@@ -303,6 +760,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setModulationCoarse(uint8_t value)
         {
+            _dirty = true;
             _modulation = (value << 7) | (_modulation & 0x7F);
         }
 
@@ -311,6 +769,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setModulationFine(uint8_t value)
         {
+            _dirty = true;
             _modulation = (_modulation & 0xFF80) | value;
         }
 
@@ -319,6 +778,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setVolumeCoarse(uint8_t value)
         {
+            _dirty = true;
             _volume = (value << 7) | (_volume & 0x7F);
         }
 
@@ -327,6 +787,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setVolumeFine(uint8_t value)
         {
+            _dirty = true;
             _volume = (_volume & 0xFF80) | value;
         }
 
@@ -335,6 +796,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setPanCoarse(uint8_t value)
         {
+            _dirty = true;
             _pan = (value << 7) | (_pan & 0x7F);
         }
 
@@ -343,6 +805,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setPanFine(uint8_t value)
         {
+            _dirty = true;
             _pan = (_pan & 0xFF80) | value;
         }
 
@@ -351,6 +814,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setExpressionCoarse(uint8_t value)
         {
+            _dirty = true;
             _expression = (value << 7) | (_expression & 0x7F);
         }
 
@@ -359,6 +823,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setExpressionFine(uint8_t value)
         {
+            _dirty = true;
             _expression = (_expression & 0xFF80) | value;
         }
     /// @}
@@ -370,6 +835,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setSustain(uint8_t value)
         {
+            _dirty = true;
             _sustain = (value >= 64);
         }
     /// @}
@@ -381,6 +847,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setReverbSend(uint8_t value)
         {
+            _dirty = true;
             _reverb_send = value;
         }
 
@@ -389,6 +856,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setChorusSend(uint8_t value)
         {
+            _dirty = true;
             _chorus_send = value;
         }
     /// @}
@@ -416,6 +884,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setDataEntryCoarse(uint8_t value)
         {
+            _dirty = true;
             switch (_rpn)
             {
                 case 0:
@@ -440,6 +909,7 @@ namespace synth {
         //--------------------------------------------------------------------------------
         inline void setDataEntryFine(uint8_t value)
         {
+            _dirty = true;
             switch (_rpn)
             {
                 case 0:
@@ -498,6 +968,16 @@ namespace synth {
             return 40.0f * log10(float(_volume) / 16383.0f);
         }
 
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the volume value as a linear gain (the same as
+        ///         `decibels_to_linear(volume())`, without the logarithm)
+        //--------------------------------------------------------------------------------
+        inline float volumeGain() const
+        {
+            float ratio = float(_volume) / 16383.0f;
+            return ratio * ratio;
+        }
+
         //--------------------------------------------------------------------------------
         /// @brief  Returns the pan value
         //--------------------------------------------------------------------------------
@@ -561,6 +1041,30 @@ namespace synth {
         {
             return float(_coarse_tune) + (1.0f / 8192.0f) * (int16_t(_fine_tune) - 8192);
         }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the raw value of a MIDI controller
+        //--------------------------------------------------------------------------------
+        inline uint8_t controller(uint8_t number) const
+        {
+            return _controllers[number & 0x7F];
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the channel pressure
+        //--------------------------------------------------------------------------------
+        inline uint8_t channelPressure() const
+        {
+            return _channel_pressure;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the raw value of the pitch wheel (14 bits, 8192 is centered)
+        //--------------------------------------------------------------------------------
+        inline uint16_t pitchWheel() const
+        {
+            return _pitch_wheel;
+        }
     /// @}
 
         //_____ Attributes __________
@@ -570,6 +1074,7 @@ namespace synth {
         uint8_t _bank;
         uint8_t _preset;
         float _pitch_bend;
+        uint16_t _pitch_wheel;
 
         // High resolution continuous controllers (14 bits)
         uint16_t _modulation;
@@ -589,6 +1094,14 @@ namespace synth {
         uint16_t _pitch_bend_range;
         int8_t _coarse_tune;
         uint16_t _fine_tune;
+
+        // Raw values of the sources of the modulators
+        uint8_t _controllers[128];
+        uint8_t _channel_pressure;
+
+        // Derived values
+        channel_controls_t _controls;
+        bool _dirty;
     };
 
 
@@ -596,7 +1109,8 @@ namespace synth {
     /// @brief  Represents a MIDI synthesizer
     ///
     /// A SoundFont file must be loaded into the synthesizer before any synthesis can
-    /// happen.
+    /// happen. A SoundFont already loaded in memory can also be shared by any number of
+    /// synthesizers (see setSoundFont()): its samples are never copied.
     ///
     /// The synthesizer can be controlled either via MIDI messages, or directly by calling
     /// dedicated methods.
@@ -624,10 +1138,29 @@ namespace synth {
         //--------------------------------------------------------------------------------
         /// @brief  Load a SoundFont file
         ///
+        /// With sf::LOAD_MODE_MEMORY_MAPPED, the file is memory-mapped and its audio data
+        /// is converted on the fly during the synthesis, which makes the loading nearly
+        /// instantaneous and halves the memory used by large SoundFont files.
+        ///
+        /// @param  path    Path to the SoundFont file
+        /// @param  mode    The way to load the file
+        /// @return True if the file was loaded successfully, false otherwise
+        //--------------------------------------------------------------------------------
+        bool loadSoundFont(
+            const std::filesystem::path& path, sf::load_mode_t mode = sf::LOAD_MODE_FLOAT
+        );
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Load a SoundFont file (prevents the ambiguity with the buffer variant)
+        ///
         /// @param  path    Path to the SoundFont file
+        /// @param  mode    The way to load the file
         /// @return True if the file was loaded successfully, false otherwise
         //--------------------------------------------------------------------------------
-        bool loadSoundFont(const std::filesystem::path& path);
+        inline bool loadSoundFont(const char* path, sf::load_mode_t mode)
+        {
+            return loadSoundFont(std::filesystem::path(path), mode);
+        }
 
         //--------------------------------------------------------------------------------
         /// @brief  Load a SoundFont file from a buffer
@@ -638,10 +1171,33 @@ namespace synth {
         //--------------------------------------------------------------------------------
         bool loadSoundFont(const char* buffer, size_t size);
 
+        //--------------------------------------------------------------------------------
+        /// @brief  Use an already loaded SoundFont, which can be shared with other
+        ///         synthesizers
+        ///
+        /// The SoundFont isn't copied: the voices read their samples directly from its
+        /// buffer. It is kept alive as long as at least one synthesizer uses it.
+        ///
+        /// All the voices currently playing are stopped.
+        ///
+        /// @param  soundfont   The SoundFont (must contain at least one preset)
+        /// @return True if the SoundFont can be used, false otherwise
+        //--------------------------------------------------------------------------------
+        bool setSoundFont(const std::shared_ptr<const sf::SoundFont>& soundfont);
+
         //--------------------------------------------------------------------------------
         /// @brief  Returns the loaded SoundFont file representation
         //--------------------------------------------------------------------------------
         inline const sf::SoundFont& soundfont() const
+        {
+            return *_soundfont;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the loaded SoundFont file representation, to share it with
+        ///         other synthesizers
+        //--------------------------------------------------------------------------------
+        inline const std::shared_ptr<const sf::SoundFont>& sharedSoundFont() const
         {
             return _soundfont;
         }
@@ -662,28 +1218,89 @@ namespace synth {
         );
 
         //--------------------------------------------------------------------------------
-        /// @brief  Start to press a key
-        ///
-        /// The key will be pressed until `noteOff()` is called.
+        /// @brief  Process a MIDI message received on a port
         ///
-        /// @param channel  The channel
-        /// @param key      The key to press
-        /// @param velocity The velocity of the key press
+        /// @param port     The port (see `SynthesizerSettings::setNbChannels()`)
+        /// @param channel  The channel of the port affected by the message
+        /// @param command  The command to process
+        /// @param data1    Data associated to the command
+        /// @param data2    Secondary data associated to the command
         //--------------------------------------------------------------------------------
-        void noteOn(uint8_t channel, uint8_t key, uint8_t velocity);
+        inline bool processMidiMessage(
+            uint8_t port, uint8_t channel, uint8_t command, uint8_t data1, uint8_t data2
+        )
+        {
+            if ((port >= nbPorts()) || (channel >= CHANNELS_PER_PORT))
+                return false;
+
+            return processMidiMessage(
+                portChannel(port, channel), command, data1, data2
+            );
+        }
 
         //--------------------------------------------------------------------------------
-        /// @brief  Release a key
-        ///
-        /// It is expected that `noteOn()` has been called on that channel with that key
-        /// before.
+        /// @brief  Post a MIDI message, to be processed by the thread calling `render()`
         ///
-        /// When a key is released, its sound gradually falls off.
+        /// This is the only method that can be called from another thread than the one
+        /// rendering the audio: it never blocks nor allocates memory, and the message is
+        /// processed right before the next block is rendered. Only one thread at a time
+        /// can post messages.
         ///
-        /// @param channel  The channel
-        /// @param key      The key to release
+        /// @param channel  The channel affected by the message
+        /// @param command  The command to process
+        /// @param data1    Data associated to the command
+        /// @param data2    Secondary data associated to the command
+        /// @return         False if the queue is full (see
+        ///                 `SynthesizerSettings::setMidiQueueSize()`)
         //--------------------------------------------------------------------------------
-        void noteOff(uint8_t channel, uint8_t key);
+        bool postMidiMessage(
+            uint8_t channel, uint8_t command, uint8_t data1, uint8_t data2
+        );
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Post a MIDI message received on a port, to be processed by the thread
+        ///         calling `render()` (see `postMidiMessage()`)
+        ///
+        /// @param port     The port (see `SynthesizerSettings::setNbChannels()`)
+        /// @param channel  The channel of the port affected by the message
+        /// @param command  The command to process
+        /// @param data1    Data associated to the command
+        /// @param data2    Secondary data associated to the command
+        /// @return         False if the queue is full or the channel doesn't exist
+        //--------------------------------------------------------------------------------
+        inline bool postMidiMessage(
+            uint8_t port, uint8_t channel, uint8_t command, uint8_t data1, uint8_t data2
+        )
+        {
+            if ((port >= nbPorts()) || (channel >= CHANNELS_PER_PORT))
+                return false;
+
+            return postMidiMessage(portChannel(port, channel), command, data1, data2);
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Start to press a key
+        ///
+        /// The key will be pressed until `noteOff()` is called.
+        ///
+        /// @param channel  The channel
+        /// @param key      The key to press
+        /// @param velocity The velocity of the key press
+        //--------------------------------------------------------------------------------
+        void noteOn(uint8_t channel, uint8_t key, uint8_t velocity);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Release a key
+        ///
+        /// It is expected that `noteOn()` has been called on that channel with that key
+        /// before.
+        ///
+        /// When a key is released, its sound gradually falls off.
+        ///
+        /// @param channel  The channel
+        /// @param key      The key to release
+        //--------------------------------------------------------------------------------
+        void noteOff(uint8_t channel, uint8_t key);
 
         //--------------------------------------------------------------------------------
         /// @brief  Release all the keys
@@ -724,11 +1341,21 @@ namespace synth {
         /// each time a MIDI message is processed by `processMidiMessage()` or each time
         /// a key (or a group of keys) is pressed or released.
         ///
+        /// While nothing is playing (no active voice, and the tail of the effects is
+        /// over), the complete blocks are directly filled with zeros, without running the
+        /// synthesis (they aren't included in the statistics). This is done by all the
+        /// rendering methods.
+        ///
+        /// The returned ranges indicate how many samples at the start and at the end of
+        /// the buffers are silent, so the caller can skip them (when mixing or encoding,
+        /// for example).
+        ///
         /// @param left     The left buffer (will be filled)
         /// @param right    The right buffer (will be filled)
         /// @param size     Size of the buffers
+        /// @return         The silent ranges of the buffers
         //--------------------------------------------------------------------------------
-        void render(float* left, float* right, size_t size);
+        silent_ranges_t render(float* left, float* right, size_t size);
 
         //--------------------------------------------------------------------------------
         /// @brief  Render the audio into a mono buffer
@@ -737,10 +1364,117 @@ namespace synth {
         /// each time a MIDI message is processed by `processMidiMessage()` or each time
         /// a key (or a group of keys) is pressed or released.
         ///
+        /// The silent blocks are handled like in the stereo version.
+        ///
         /// @param buffer   The buffer (will be filled)
         /// @param size     Size of the buffer
+        /// @return         The silent ranges of the buffer
         //--------------------------------------------------------------------------------
-        void render(float* buffer, size_t size);
+        silent_ranges_t render(float* buffer, size_t size);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Render the audio into stereo buffers (left and right), processing
+        ///         MIDI events at precise positions
+        ///
+        /// The events must be sorted by offset. Each event is processed right before
+        /// the sample at its offset is rendered: the blocks are split internally where
+        /// needed, so there is no need to reduce the block size to get sample-accurate
+        /// timing. Events with an offset past the end of the buffers are processed
+        /// after the rendering.
+        ///
+        /// Note that if a previous call to `render()` without events didn't consume a
+        /// complete block, the remaining samples of that block are output first, and
+        /// the events falling in that range are delayed until after them.
+        ///
+        /// @param left         The left buffer (will be filled)
+        /// @param right        The right buffer (will be filled)
+        /// @param size         Size of the buffers
+        /// @param events       The events to process
+        /// @param nb_events    Number of events
+        /// @return             The silent ranges of the buffers
+        //--------------------------------------------------------------------------------
+        silent_ranges_t render(
+            float* left, float* right, size_t size, const midi_event_t* events,
+            size_t nb_events
+        );
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Render the audio into a mono buffer, processing MIDI events at precise
+        ///         positions
+        ///
+        /// See the stereo version for details.
+        ///
+        /// @param buffer       The buffer (will be filled)
+        /// @param size         Size of the buffer
+        /// @param events       The events to process
+        /// @param nb_events    Number of events
+        /// @return             The silent ranges of the buffer
+        //--------------------------------------------------------------------------------
+        silent_ranges_t render(
+            float* buffer, size_t size, const midi_event_t* events, size_t nb_events
+        );
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Render the audio into an interleaved stereo buffer (left, right, left,
+        ///         right, ...)
+        ///
+        /// @param buffer   The buffer (will be filled, must contain 2 * size values)
+        /// @param size     Number of samples to render for each side
+        /// @return         The silent ranges of the buffer (in samples of each side)
+        //--------------------------------------------------------------------------------
+        silent_ranges_t renderInterleaved(float* buffer, size_t size);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Render the audio into an interleaved stereo buffer of 16-bits integers
+        ///
+        /// The values are clamped to the range of the integers.
+        ///
+        /// @param buffer   The buffer (will be filled, must contain 2 * size values)
+        /// @param size     Number of samples to render for each side
+        /// @param dither   Whether to add a TPDF dither (of +/- 1 LSB) before the
+        ///                 quantization
+        /// @return         The silent ranges of the buffer (in samples of each side,
+        ///                 always empty with dithering)
+        //--------------------------------------------------------------------------------
+        silent_ranges_t renderInterleaved(int16_t* buffer, size_t size, bool dither = false);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Render the audio into an interleaved stereo buffer of 32-bits integers
+        ///
+        /// The values are clamped to the range of the integers.
+        ///
+        /// @param buffer   The buffer (will be filled, must contain 2 * size values)
+        /// @param size     Number of samples to render for each side
+        /// @return         The silent ranges of the buffer (in samples of each side)
+        //--------------------------------------------------------------------------------
+        silent_ranges_t renderInterleaved(int32_t* buffer, size_t size);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Render the audio of each stem into its own stereo buffers, in one pass
+        ///
+        /// Each channel is routed to a stem (see `setChannelStem()`), whose buffers
+        /// receive the voices of all the channels routed to it. The number of stems is
+        /// set with `SynthesizerSettings::setNbStems()`.
+        ///
+        /// The stems are dry: the reverb and the chorus are only in the master mix, which
+        /// is the same than the one produced by `render()` (up to the rounding errors).
+        ///
+        /// Note that if a previous call to `render()` didn't consume a complete block,
+        /// the stems are silent for the remaining samples of that block.
+        ///
+        /// The silent blocks are skipped like in `render()`.
+        ///
+        /// @param left         The left buffers of the stems (will be filled)
+        /// @param right        The right buffers of the stems (will be filled)
+        /// @param size         Size of the buffers
+        /// @param master_left  (optional) The left buffer of the master mix
+        /// @param master_right (optional) The right buffer of the master mix
+        /// @return             The silent ranges of all the buffers
+        //--------------------------------------------------------------------------------
+        silent_ranges_t renderStems(
+            float* const* left, float* const* right, size_t size,
+            float* master_left = nullptr, float* master_right = nullptr
+        );
 
         //--------------------------------------------------------------------------------
         /// @brief  Sets the master volume, in dB
@@ -766,6 +1500,37 @@ namespace synth {
         uint16_t nbActiveVoices() const;
     /// @}
 
+    /// @name Statistics
+    /// @{
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns a snapshot of the statistics about the rendering
+        ///
+        /// The counters (voice steals, peak polyphony, dropped notes) are always
+        /// maintained, but the timings are only measured if enabled in the settings (see
+        /// `SynthesizerSettings::enableStatistics()`).
+        //--------------------------------------------------------------------------------
+        statistics_t getStatistics() const;
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Reset all the statistics to 0
+        ///
+        /// Note that `reset()` doesn't reset the statistics.
+        //--------------------------------------------------------------------------------
+        void resetStatistics();
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Set a function to call after the rendering of each block
+        ///
+        /// The function is only called if the statistics are enabled in the settings
+        /// (see `SynthesizerSettings::enableStatistics()`). It is called from the thread
+        /// calling `render()`, and should return quickly.
+        ///
+        /// @param callback     The function (nullptr to remove it)
+        /// @param user_data    Pointer given to the function
+        //--------------------------------------------------------------------------------
+        void setStatisticsCallback(statistics_callback_t callback, void* user_data = nullptr);
+    /// @}
+
     /// @name Channels
     /// @{
         //--------------------------------------------------------------------------------
@@ -776,6 +1541,26 @@ namespace synth {
             return _channels.size();
         }
 
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the number of ports (of 16 channels each)
+        //--------------------------------------------------------------------------------
+        inline size_t nbPorts() const
+        {
+            return _channels.size() / CHANNELS_PER_PORT;
+        }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Sets whether a channel is a percussion channel
+        ///
+        /// By default the channel 10 of each port (9 when counting from 0) is a
+        /// percussion channel. This isn't modified by `reset()`.
+        ///
+        /// @param channel      The number of the channel
+        /// @param percussion   Whether the channel is a percussion channel
+        /// @return False if the channel doesn't exist
+        //--------------------------------------------------------------------------------
+        bool setPercussionChannel(uint8_t channel, bool percussion);
+
         //--------------------------------------------------------------------------------
         /// @brief  Assign a preset from the SoundFont file to a channel
         ///
@@ -796,6 +1581,43 @@ namespace synth {
             return configureChannel(channel, id.bank, id.number);
         }
 
+        //--------------------------------------------------------------------------------
+        /// @brief  Set a function to call each time a preset is assigned to a channel, with
+        ///         `configureChannel()` or by a MIDI message (bank select or program
+        ///         change)
+        ///
+        /// For the MIDI messages, the preset is the one the notes of the channel will
+        /// play (with the same fallbacks than for the notes), and the function is called
+        /// by the thread processing them: the one rendering the audio for the messages
+        /// posted with `postMidiMessage()` or given to the `render()` methods.
+        ///
+        /// Its purpose is to decode the compressed samples (SF3) of the preset before its
+        /// notes are played (see `sf::SoundFont::prefetchPreset()`), either directly or
+        /// from another thread, so the voices don't have to decode them when they start.
+        ///
+        /// When a callback is set, the voices never decode the samples nor wait for the
+        /// cache of decoded samples of the SoundFont: the notes whose samples aren't
+        /// decoded yet are silent.
+        ///
+        /// @param callback     The function (nullptr to remove it)
+        /// @param user_data    Pointer given to the function
+        //--------------------------------------------------------------------------------
+        void setPrefetchCallback(prefetch_callback_t callback, void* user_data = nullptr);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Releases the audio data of the compressed samples no longer played
+        ///
+        /// When a prefetch callback is set, the voices don't release the audio data of
+        /// the compressed samples themselves once they end: if the cache of the SoundFont
+        /// already removed it, its memory would be freed by the audio thread. This method
+        /// must then be called regularly by another thread (for instance, the one
+        /// prefetching the presets), but never by several threads at the same time.
+        ///
+        /// If it isn't called often enough (more than 1024 references waiting), the audio
+        /// thread releases the other ones itself.
+        //--------------------------------------------------------------------------------
+        void releaseDecodedSamples();
+
         //--------------------------------------------------------------------------------
         /// @brief  Retrieves a list of the names of all the presets in thr SoundFont file
         //--------------------------------------------------------------------------------
@@ -820,6 +1642,86 @@ namespace synth {
         {
             return _channels[channel];
         }
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Route a channel to a stem (see `renderStems()`)
+        ///
+        /// By default, the channel 'c' is routed to the stem 'c % nb_stems'. The routing
+        /// isn't modified by `reset()`.
+        ///
+        /// @param channel  The number of the channel
+        /// @param stem     The number of the stem
+        /// @return False if the channel or the stem doesn't exist
+        //--------------------------------------------------------------------------------
+        bool setChannelStem(uint8_t channel, uint16_t stem);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the stem a channel is routed to
+        ///
+        /// @param channel  The number of the channel
+        //--------------------------------------------------------------------------------
+        inline uint16_t channelStem(uint8_t channel) const
+        {
+            return _channel_stems[channel];
+        }
+    /// @}
+
+    /// @name Note clips
+    /// @{
+        //--------------------------------------------------------------------------------
+        /// @brief  Render a single note of a preset in a new clip
+        ///
+        /// The key is pressed during 'duration' samples, then released. The clip ends once
+        /// the release (and the tail of the effects) is over, or at most 10 seconds after
+        /// the release.
+        ///
+        /// The synthesizer is reset before and after the rendering of the clip (the
+        /// percussion channels are kept). If a cache is provided and already contains the
+        /// clip (with the same SoundFont, sample rate and master volume), it is returned
+        /// without using the synthesizer at all.
+        ///
+        /// @param preset   The id of the preset
+        /// @param key      The key to press
+        /// @param velocity The velocity of the key press
+        /// @param duration How long the key is pressed, in samples
+        /// @param cache    (optional) The cache of clips to use
+        /// @return         The clip, nullptr if the preset doesn't exist
+        //--------------------------------------------------------------------------------
+        std::shared_ptr<const note_clip_t> renderNote(
+            sf::preset_id_t preset, uint8_t key, uint8_t velocity, uint32_t duration,
+            NoteClipCache* cache = nullptr
+        );
+    /// @}
+
+    /// @name State snapshots
+    /// @{
+        //--------------------------------------------------------------------------------
+        /// @brief  Copy the complete state of the synthesizer into a snapshot
+        ///
+        /// The snapshot must have been created for a synthesizer with the same settings.
+        /// This doesn't allocate any memory, so it can be called from the audio thread,
+        /// like `render()` (but not concurrently with it).
+        ///
+        /// The MIDI messages posted with `postMidiMessage()` and not processed yet aren't
+        /// part of the snapshot.
+        ///
+        /// @param snapshot The snapshot (will be filled)
+        /// @return False if the snapshot is incompatible with the synthesizer
+        //--------------------------------------------------------------------------------
+        bool snapshot(SynthesizerSnapshot& snapshot) const;
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Restore the complete state of the synthesizer from a snapshot
+        ///
+        /// The snapshot can come from another synthesizer, as long as both have the same
+        /// settings and use the same SoundFont: the rendering then continues exactly like
+        /// it would have in the original synthesizer. This doesn't allocate any memory.
+        ///
+        /// @param snapshot The snapshot
+        /// @return False if the snapshot is empty or incompatible with the synthesizer
+        ///         (its state is then left unchanged)
+        //--------------------------------------------------------------------------------
+        bool restore(const SynthesizerSnapshot& snapshot);
     /// @}
 
     /// @name Other methods
@@ -840,2167 +1742,7709 @@ namespace synth {
     /// @}
 
     private:
-        void renderBlockStereo();
-        void renderBlockMono();
+        void renderBlockStereo(uint32_t size, bool stems = false);
+        void renderBlockMono(uint32_t size);
+
+        bool writeBlock(
+            float previous_gain, float current_gain, float* source, float* destination,
+            uint32_t size
+        );
+
+        bool writeBlockStereo(
+            float previous_gain_left, float current_gain_left, float previous_gain_right,
+            float current_gain_right, float* source, float* left, float* right,
+            uint32_t size
+        );
 
-        void writeBlock(
-            float previous_gain, float current_gain, float* source, float* destination
+        void updateStatistics(
+            uint32_t size, double voices_time, double mixing_time, double effects_time
         );
 
+        void processPostedMidiMessages();
+
+        // The preset played by a channel, with the same fallbacks than 'noteOn()'
+        sf::preset_id_t channelPreset(const Channel& channel) const;
+
+        // Calls the prefetch callback if a bank select or a program change modified the
+        // preset played by a channel
+        void prefetchChannelPreset(const Channel& channel, sf::preset_id_t previous);
+
+        // Releases a reference to the audio data of a compressed sample, or hands it to
+        // 'releaseDecodedSamples()' when a prefetch callback is set (it might be the last
+        // one). Used by the voices.
+        void releaseDecodedSample(sf::decoded_sample_t& sample) const;
+
+        bool isSilent() const;
+
+        // Skip the complete blocks rendered while nothing is playing, and returns their
+        // total size (at most 'max_size'). Used by all the 'render()' methods.
+        size_t skipSilentBlocks(size_t max_size);
+
+        // Offset of the next event to process in a buffer, or the size of the buffer
+        static inline size_t nextEventOffset(
+            const midi_event_t* events, size_t nb_events, size_t next_event, size_t size
+        )
+        {
+            return (next_event < nb_events ? std::min(size_t(events[next_event].offset), size) : size);
+        }
+
+        size_t fetchStereo(size_t max_size, const float*& left, const float*& right);
+
+        inline float inverseSize(uint32_t size) const
+        {
+            return (size == _settings.blockSize() ? _inverse_block_size : 1.0f / float(size));
+        }
+
+        // Index of the channel of a port (the port and the channel must exist: with 256
+        // channels, all the indices are valid)
+        inline uint8_t portChannel(uint8_t port, uint8_t channel) const
+        {
+            return port * CHANNELS_PER_PORT + channel;
+        }
+
 
         //_____ Constants __________
     private:
-        const uint32_t CHANNEL_COUNT = 16;
-        const uint16_t PERCUSSION_CHANNEL = 9;
+        const uint8_t CHANNELS_PER_PORT = 16;
+        const uint8_t PERCUSSION_CHANNEL = 9;
+        const uint32_t MAX_NOTE_CLIP_RELEASE = 10;  // In seconds
+        const uint32_t RELEASE_QUEUE_SIZE = 1024;   // Enough for 512 voices to end
 
 
         //_____ Attributes __________
     private:
-        sf::SoundFont _soundfont;
+        std::shared_ptr<const sf::SoundFont> _soundfont;
         SynthesizerSettings _settings;
 
         sf::preset_id_t _default_preset;
 
         std::vector<Channel> _channels;
         VoiceCollection* _voices = nullptr;
+        MidiQueue* _midi_queue = nullptr;
 
         float* _block_left = nullptr;
         float* _block_right = nullptr;
+        bool _block_silent = true;
+
+        // The stereo blocks of the stems, one after the other (left, then right)
+        float* _stem_blocks = nullptr;
+        size_t _stem_block_size = 0;
+        std::vector<uint16_t> _channel_stems;
+        bool _stems_rendered = false;
+
+        Reverb* _reverb = nullptr;
+        Chorus* _chorus = nullptr;
+        float* _reverb_input = nullptr;
+        float* _chorus_input_left = nullptr;
+        float* _chorus_input_right = nullptr;
+        float* _effect_left = nullptr;
+        float* _effect_right = nullptr;
+
+        float* _dither_noise = nullptr;
+        uint32_t _dither_state = 1;
         uint32_t _blocks_offset;
         float _inverse_block_size;
 
         uint32_t _nb_rendered_samples = 0;
         float _master_volume = 1.0f;
-    };
-
 
-#ifdef KNM_SYNTHESIZER_IMPLEMENTATION
+        statistics_t _statistics;
+        statistics_callback_t _statistics_callback = nullptr;
+        void* _statistics_user_data = nullptr;
 
-    /********************************* INTERNAL TYPES ***********************************/
+        prefetch_callback_t _prefetch_callback = nullptr;
+        void* _prefetch_user_data = nullptr;
+        ReleaseQueue* _release_queue = nullptr;
 
-    enum loop_mode_t
-    {
-        LOOP_MODE_NONE = 0,
-        LOOP_MODE_CONTINUOUS = 1,
-        LOOP_MODE_UNTIL_RELEASE = 3,
+        friend class Voice;
     };
 
-    //-----------------------------------------------------------------------
 
-    enum envelope_stage_t
+    //------------------------------------------------------------------------------------
+    /// @brief  Holds a copy of the complete state of a synthesizer (see
+    ///         `Synthesizer::snapshot()` and `Synthesizer::restore()`)
+    ///
+    /// All the memory needed is allocated by the constructor, so the snapshots can be
+    /// taken and restored from the audio thread. Only the state is stored (the voices,
+    /// the channels, the effects, ...), not the scratch buffers used during the
+    /// rendering.
+    ///
+    /// Periodic snapshots make it possible to seek quickly in a long sequence (by
+    /// restoring the last one before the position and rendering from there), or to
+    /// split a long offline rendering in chunks rendered in parallel by several
+    /// synthesizers.
+    ///
+    /// A snapshot keeps the SoundFont it was taken with alive.
+    //------------------------------------------------------------------------------------
+    class SynthesizerSnapshot
     {
-        ENV_STAGE_DELAY = 0,
-        ENV_STAGE_ATTACK = 1,
-        ENV_STAGE_HOLD = 2,
-        ENV_STAGE_DECAY = 3,
-        ENV_STAGE_RELEASE = 4,
-    };
- 
-    //-----------------------------------------------------------------------
+    public:
+        //--------------------------------------------------------------------------------
+        /// @brief  Constructor
+        ///
+        /// @param synthesizer  A synthesizer with the settings of the ones the snapshot
+        ///                     will be used with (its state isn't copied)
+        //--------------------------------------------------------------------------------
+        SynthesizerSnapshot(const Synthesizer& synthesizer);
 
-    enum voice_state_t
-    {
-        VOICE_STATE_PLAYING,
-        VOICE_STATE_RELEASE_REQUESTED,
-        VOICE_STATE_RELEASED,
-    };
+        //--------------------------------------------------------------------------------
+        /// @brief  Destructor
+        //--------------------------------------------------------------------------------
+        ~SynthesizerSnapshot();
 
+        SynthesizerSnapshot(const SynthesizerSnapshot&) = delete;
+        SynthesizerSnapshot& operator=(const SynthesizerSnapshot&) = delete;
 
-    /************************************ CONSTANTS *************************************/
+        //--------------------------------------------------------------------------------
+        /// @brief  Indicates if the snapshot contains a state
+        //--------------------------------------------------------------------------------
+        inline bool valid() const
+        {
+            return _valid;
+        }
 
-    const float NON_AUDIBLE = 0.001f;
-    const float LOG_NON_AUDIBLE = log(NON_AUDIBLE);
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the number of samples rendered by the synthesizer when the
+        ///         snapshot was taken
+        //--------------------------------------------------------------------------------
+        inline uint32_t nbRenderedSamples() const
+        {
+            return _nb_rendered_samples;
+        }
 
 
-    /******************************** HELPER FUNCTIONS **********************************/
+    private:
+        friend class Synthesizer;
+        friend class MidiFileSequencer;
 
-    inline float clamp(float value, float min, float max)
-    {
-        if (value < min)
-            return min;
-        else if (value > max)
-            return max;
-        else
-            return value;
-    }
+        // Indicates if the snapshot can be used with a synthesizer
+        bool compatible(const Synthesizer& synthesizer) const;
 
-    //-----------------------------------------------------------------------
 
-    inline float exp_cutoff(float x)
-    {
-        if (x < LOG_NON_AUDIBLE)
-            return 0.0f;
+        //_____ Attributes __________
+    private:
+        SynthesizerSettings _settings;
+        std::shared_ptr<const sf::SoundFont> _soundfont;
+        bool _valid = false;
 
-        return exp(x);
-    }
+        std::vector<Channel> _channels;
+        std::vector<uint16_t> _channel_stems;
+        VoiceCollection* _voices = nullptr;
 
-    //-----------------------------------------------------------------------
+        float* _block_left = nullptr;
+        float* _block_right = nullptr;
+        bool _block_silent = true;
+        uint32_t _blocks_offset = 0;
 
-    inline float timecents_to_seconds(float x)
-    {
-        return pow(2.0f, (1.0f / 1200.0f) * x);
-    }
+        float* _stem_blocks = nullptr;
+        size_t _stem_blocks_size = 0;
+        bool _stems_rendered = false;
 
-    //-----------------------------------------------------------------------
+        Reverb* _reverb = nullptr;
+        Chorus* _chorus = nullptr;
 
-    inline float decibels_to_linear(float x)
-    {
-        return pow(10.0f, 0.05f * x);
-    };
+        uint32_t _dither_state = 1;
+        uint32_t _nb_rendered_samples = 0;
+        float _master_volume = 1.0f;
 
-    //-----------------------------------------------------------------------
-
-    inline float linear_to_decibels(float x)
-    {
-        return 20.0f * log10(x);
-    }
-
-    //-----------------------------------------------------------------------
-
-    inline float cents_to_hertz(float x)
-    {
-        return 8.176f * pow(2.0f, (1.0f / 1200.0f) * x);
-    }
-
-    //-----------------------------------------------------------------------
-
-    inline float cents_to_multiplying_factor(float x)
-    {
-        return pow(2.0f, (1.0f / 1200.0f) * x);
-    }
-
-    //-----------------------------------------------------------------------
-
-    inline float key_number_to_multiplying_factor(int16_t cents, uint8_t key)
-    {
-        return timecents_to_seconds(cents * (60 - key));
-    }
-
-
-    /************************************* CHANNEL **************************************/
-
-    Channel::Channel(bool percussion)
-    : _percussion(percussion)
-    {
-        reset();
-    }
+        // State of a MIDI file sequencer (see `MidiFileSequencer::snapshot()`)
+        struct
+        {
+            bool valid = false;
+            const MidiFile* midi_file = nullptr;
+            bool loop = false;
+            size_t next_event = 0;
+            uint64_t start = 0;
+            uint64_t position = 0;
+        } _sequencer;
+    };
 
-    //-----------------------------------------------------------------------
 
-    void Channel::reset()
+    //------------------------------------------------------------------------------------
+    /// @brief  A Standard MIDI File (format 0 or 1)
+    ///
+    /// The messages of all the tracks are merged in one list, sorted by time. The times
+    /// are computed from the tempo changes found in the file.
+    ///
+    /// Only the channel messages are kept: the meta-events and the system exclusive
+    /// messages are skipped.
+    //------------------------------------------------------------------------------------
+    class MidiFile
     {
-        _bank = (_percussion ? 128 : 0);
-        _preset = 0;
-
-        _modulation = 0;
-        _volume = 100 << 7;
-        _pan = 64 << 7;
-        _expression = 127 << 7;
-        _sustain = false;
-
-        _reverb_send = 40;
-        _chorus_send = 0;
-
-        _rpn = -1;
-        _pitch_bend_range = 2 << 7;
-        _coarse_tune = 0;
-        _fine_tune = 8192;
+    public:
+        //--------------------------------------------------------------------------------
+        /// @brief  Load a MIDI file
+        ///
+        /// @param  path    Path to the MIDI file
+        /// @return True if the file was loaded successfully, false otherwise
+        //--------------------------------------------------------------------------------
+        bool load(const std::filesystem::path& path);
 
-        _pitch_bend = 0.0f;
-    }
-    
-    //-----------------------------------------------------------------------
+        //--------------------------------------------------------------------------------
+        /// @brief  Load a MIDI file from a buffer
+        ///
+        /// @param  buffer  The buffer
+        /// @param  size    Size of the buffer
+        /// @return True if the file was loaded successfully, false otherwise
+        //--------------------------------------------------------------------------------
+        bool load(const char* buffer, size_t size);
 
-    void Channel::resetControllers()
-    {
-        _modulation = 0;
-        _expression = 127 << 7;
-        _sustain = false;
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the messages of the file, sorted by time
+        //--------------------------------------------------------------------------------
+        inline const std::vector<midi_file_event_t>& events() const
+        {
+            return _events;
+        }
 
-        _rpn = -1;
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the length of the file (up to the end of its longest track),
+        ///         in seconds
+        //--------------------------------------------------------------------------------
+        inline double length() const
+        {
+            return _length;
+        }
 
-        _pitch_bend = 0.0f;
-    }
 
+        //_____ Attributes __________
+    private:
+        std::vector<midi_file_event_t> _events;
+        double _length = 0.0;
+    };
 
-    /************************************ SAMPLER ***************************************/
 
     //------------------------------------------------------------------------------------
-    /// @brief  
+    /// @brief  Plays a MIDI file with a synthesizer
+    ///
+    /// The messages are given to the synthesizer at their exact position in the rendered
+    /// buffers (see `Synthesizer::render()`), independently of the block size.
     //------------------------------------------------------------------------------------
-    class Sampler
+    class MidiFileSequencer
     {
     public:
         //--------------------------------------------------------------------------------
         /// @brief  Constructor
+        ///
+        /// @param synthesizer  The synthesizer to use (must outlive the sequencer)
         //--------------------------------------------------------------------------------
-        Sampler(uint16_t sample_rate);
+        MidiFileSequencer(Synthesizer& synthesizer);
 
         //--------------------------------------------------------------------------------
-        /// @brief  
+        /// @brief  Start to play a MIDI file
         ///
-        /// Start index of the sample in the buffer
-        /// End index of the sample in the buffer
-        /// Starting point of the loop
-        /// Ending point of the loop
-        /// Ending point of the loop
-        /// Samnple rate, in hertz, at which this sample was acquired
-        /// The MIDI key number of the recorded pitch of the sample
+        /// The synthesizer is reset first.
+        ///
+        /// @param midi_file    The MIDI file (must stay alive while it is played)
+        /// @param loop         Whether to restart from the beginning once the end of the
+        ///                     file is reached
         //--------------------------------------------------------------------------------
-        void start(
-            const float* buffer,
-            uint32_t start,
-            uint32_t end,
-            loop_mode_t loop_mode,
-            uint32_t loop_start,
-            uint32_t loop_end,
-            uint32_t sample_rate,
-            uint8_t root_key,
-            int8_t coarse_tune,
-            int8_t fine_tune,
-            uint16_t scale_tuning
-        );
-
-        void release();
-
-        bool process(float* dest, size_t size, float pitch);
-
+        void play(const MidiFile& midi_file, bool loop = false);
 
-        //_____ Attributes __________
-    private:
-        // Information about the audio sample
-        const float* _buffer = nullptr;
-        uint32_t _start;
-        uint32_t _end;
-        loop_mode_t _loop_mode;
-        uint32_t _loop_start;
-        uint32_t _loop_end;
-        uint32_t _sample_rate;
-        uint8_t _root_key;
-    
-        // Internal state
-        uint16_t _dest_sample_rate;
-        double _current_index;
-        bool _looping;
-        float _tune;
-        float _pitch_change_scale;
-        float _sample_rate_ratio;
-    };
+        //--------------------------------------------------------------------------------
+        /// @brief  Stop the playback and reset the synthesizer
+        //--------------------------------------------------------------------------------
+        void stop();
 
-    //-----------------------------------------------------------------------
+        //--------------------------------------------------------------------------------
+        /// @brief  Render the audio into stereo buffers (left and right)
+        ///
+        /// @param left     The left buffer (will be filled)
+        /// @param right    The right buffer (will be filled)
+        /// @param size     Size of the buffers
+        //--------------------------------------------------------------------------------
+        void render(float* left, float* right, size_t size);
 
-    Sampler::Sampler(uint16_t sample_rate)
-    : _dest_sample_rate(sample_rate)
-    {
-    }
+        //--------------------------------------------------------------------------------
+        /// @brief  Render the audio into a mono buffer
+        ///
+        /// @param buffer   The buffer (will be filled)
+        /// @param size     Size of the buffer
+        //--------------------------------------------------------------------------------
+        void render(float* buffer, size_t size);
 
-    //-----------------------------------------------------------------------
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the current position in the MIDI file, in seconds
+        //--------------------------------------------------------------------------------
+        double position() const;
 
-    void Sampler::start(
-        const float* buffer,
-        uint32_t start,
-        uint32_t end,
-        loop_mode_t loop_mode,
-        uint32_t loop_start,
-        uint32_t loop_end,
-        uint32_t sample_rate,
-        uint8_t original_pitch,
-        int8_t coarse_tune,
-        int8_t fine_tune,
-        uint16_t scale_tuning
-    )
-    {
-        _buffer = buffer;
-        _start = start;
-        _end = end;
-        _loop_mode = loop_mode;
-        _loop_start = loop_start;
-        _loop_end = loop_end;
-        _sample_rate = sample_rate;
-        _root_key = original_pitch;
+        //--------------------------------------------------------------------------------
+        /// @brief  Indicates if all the messages of the MIDI file were processed (always
+        ///         false when looping)
+        ///
+        /// Note that the last notes might still be audible.
+        //--------------------------------------------------------------------------------
+        bool endOfSequence() const;
 
-        _tune = float(coarse_tune) + 0.01f * float(fine_tune);
-        _pitch_change_scale = 0.01f * float(scale_tuning);
-        _sample_rate_ratio = float(sample_rate) / float(_dest_sample_rate);
+        //--------------------------------------------------------------------------------
+        /// @brief  Copy the state of the sequencer and of its synthesizer into a snapshot
+        ///
+        /// See `Synthesizer::snapshot()`.
+        ///
+        /// @param snapshot The snapshot (will be filled)
+        /// @return False if the snapshot is incompatible with the synthesizer
+        //--------------------------------------------------------------------------------
+        bool snapshot(SynthesizerSnapshot& snapshot) const;
 
-        _looping = (loop_mode != LOOP_MODE_NONE);
-        _current_index = (double) start;
-    }
+        //--------------------------------------------------------------------------------
+        /// @brief  Restore the state of the sequencer and of its synthesizer from a
+        ///         snapshot taken with `snapshot()`
+        ///
+        /// This is the fast way to seek in a MIDI file: restore the last snapshot taken
+        /// before the wanted position, then render (and discard) the remaining samples.
+        /// The MIDI file must still be alive.
+        ///
+        /// @param snapshot The snapshot
+        /// @return False if the snapshot doesn't contain the state of a sequencer or is
+        ///         incompatible with the synthesizer
+        //--------------------------------------------------------------------------------
+        bool restore(const SynthesizerSnapshot& snapshot);
 
-    //-----------------------------------------------------------------------
 
-    void Sampler::release()
-    {
-        if (_loop_mode == LOOP_MODE_UNTIL_RELEASE)
-            _looping = false;
-    }
+    private:
+        size_t collectEvents(size_t max_size, size_t& nb_events);
 
-    //-----------------------------------------------------------------------
+        uint64_t toSamples(double time) const;
 
-    bool Sampler::process(float* dest, size_t size, float pitch)
-    {
-        const float pitch_change = _pitch_change_scale * (pitch - _root_key) + _tune;
-        const float pitch_ratio = _sample_rate_ratio * pow(2.0f, pitch_change / 12.0f);
 
-        const uint32_t loop_length = _loop_end - _loop_start;
+        //_____ Constants __________
+    private:
+        static const size_t MAX_NB_EVENTS = 256;
 
-        for (int i = 0; i < size; ++i)
-        {
-            uint32_t index = (uint32_t) floor(_current_index);
-            uint32_t index2 = index + 1;
 
-            if (!_looping)
-            {
-                if (index >= _end)
-                {
-                    if (i == 0)
-                        return false;
+        //_____ Attributes __________
+    private:
+        Synthesizer& _synthesizer;
 
-                    for (int j = i; j < size; ++j)
-                        dest[j] = 0.0f;
+        const MidiFile* _midi_file = nullptr;
+        bool _loop = false;
 
-                    return true;
-                }
-            }
-            else
-            {
-                if (index2 >= _loop_end)
-                    index2 -= loop_length;
-            }
+        size_t _next_event = 0;
+        uint64_t _start = 0;
+        uint64_t _position = 0;
 
-            float x1 = (float) _buffer[index];
-            float x2 = (float) _buffer[index2];
-            float a = _current_index - float(index);
-            dest[i] = (x1 + a * (x2 - x1));
+        midi_event_t _events[MAX_NB_EVENTS];
+    };
 
-            _current_index += pitch_ratio;
 
-            if (_looping && (_current_index >= _loop_end))
-                _current_index -= (float) loop_length;
-        }
+    //------------------------------------------------------------------------------------
+    /// @brief  A MIDI file to render with `renderMidiFiles()`
+    //------------------------------------------------------------------------------------
+    struct midi_render_job_t
+    {
+        const MidiFile* midi_file;  ///< The MIDI file to render
+        float* left;                ///< The left buffer (will be filled)
+        float* right;               ///< The right buffer (will be filled), nullptr to
+                                    ///  render in mono in 'left'
+        size_t size;                ///< Size of the buffers
+    };
 
-        return true;
-    }
 
+    //------------------------------------------------------------------------------------
+    /// @brief  Render several MIDI files in parallel, all using the same SoundFont
+    ///
+    /// Each thread uses its own synthesizer, created with the provided settings, and
+    /// renders one file at a time. The SoundFont is shared by all the synthesizers, it
+    /// isn't copied.
+    ///
+    /// @param soundfont    The SoundFont (must contain at least one preset)
+    /// @param settings     The settings of the synthesizers
+    /// @param jobs         The files to render
+    /// @param nb_jobs      Number of files
+    /// @param nb_threads   Number of threads to use, including the calling one (0 to
+    ///                     use as many threads as there are CPU cores)
+    /// @return             False if the SoundFont can't be used
+    //------------------------------------------------------------------------------------
+    bool renderMidiFiles(
+        const std::shared_ptr<const sf::SoundFont>& soundfont,
+        const SynthesizerSettings& settings, const midi_render_job_t* jobs, size_t nb_jobs,
+        uint16_t nb_threads = 0
+    );
 
-    /********************************* VOLUME ENVELOPE **********************************/
 
     //------------------------------------------------------------------------------------
-    /// @brief  Allows to generate a volume envelope
+    /// @brief  A memory-bounded cache of note clips (see `Synthesizer::renderNote()`)
+    ///
+    /// The clips are identified by their preset, key, velocity, duration, sample rate and
+    /// master volume. When the cache is full, the least recently used clips are removed.
+    ///
+    /// The cache only holds the clips of one SoundFont at a time (and keeps it alive):
+    /// it is cleared when a clip of another SoundFont is added. The other settings of
+    /// the synthesizers using the cache should be identical.
+    ///
+    /// The cache can be used by several threads at the same time.
     //------------------------------------------------------------------------------------
-    class VolumeEnvelope
+    class NoteClipCache
     {
     public:
         //--------------------------------------------------------------------------------
         /// @brief  Constructor
         ///
-        /// @param sample_rate  The sample rate of the synthesized signal
+        /// @param max_size The maximum size of the clips in the cache, in bytes
         //--------------------------------------------------------------------------------
-        VolumeEnvelope(uint16_t sample_rate);
+        NoteClipCache(size_t max_size = DEFAULT_MAX_SIZE);
+
+        NoteClipCache(const NoteClipCache&) = delete;
+        NoteClipCache& operator=(const NoteClipCache&) = delete;
 
         //--------------------------------------------------------------------------------
-        /// @brief  Starts a new envelope
+        /// @brief  Set the maximum size of the clips in the cache, in bytes
         ///
-        /// Must be called when the key is pressed, before 'process()', to define the
-        /// shape of the envelope.
+        /// The least recently used clips are removed if needed. A clip bigger than that
+        /// size is never cached.
         //--------------------------------------------------------------------------------
-        void start(
-            float delay, float attack, float hold, float decay, float sustain,
-            float release
-        );
+        void setMaxSize(size_t max_size);
 
         //--------------------------------------------------------------------------------
-        /// @brief  Must be called when the key is released
+        /// @brief  Returns the maximum size of the clips in the cache, in bytes
         //--------------------------------------------------------------------------------
-        void release();
+        size_t maxSize() const;
 
         //--------------------------------------------------------------------------------
-        /// @brief  Update the value of the envelope
-        ///
-        /// @param nb_samples   The number of samples to process during this update
-        /// @return True if the envelope still allows the signal to be heard
+        /// @brief  Returns the size of the clips in the cache, in bytes
         //--------------------------------------------------------------------------------
-        bool process(uint32_t nb_samples);
+        size_t usage() const;
 
-        inline float getValue() const
-        {
-            return value;
-        }
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the number of clips in the cache
+        //--------------------------------------------------------------------------------
+        size_t nbClips() const;
 
-        inline float getPriority() const
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the number of clips found in the cache
+        //--------------------------------------------------------------------------------
+        uint64_t nbHits() const;
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the number of clips not found in the cache
+        //--------------------------------------------------------------------------------
+        uint64_t nbMisses() const;
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Remove all the clips (the counters of hits and misses are kept)
+        //--------------------------------------------------------------------------------
+        void clear();
+
+
+    private:
+        friend class Synthesizer;
+
+        struct key_t
         {
-            return priority;
-        }
+            sf::preset_id_t preset;
+            uint8_t key;
+            uint8_t velocity;
+            uint32_t duration;
+            uint32_t sample_rate;
+            float master_volume;
+
+            inline bool operator<(const key_t& other) const
+            {
+                return std::tie(preset.bank, preset.number, key, velocity, duration,
+                                sample_rate, master_volume) <
+                       std::tie(other.preset.bank, other.preset.number, other.key,
+                                other.velocity, other.duration, other.sample_rate,
+                                other.master_volume);
+            }
+        };
+
+        std::shared_ptr<const note_clip_t> find(
+            const std::shared_ptr<const sf::SoundFont>& soundfont, const key_t& key
+        );
+
+        void insert(
+            const std::shared_ptr<const sf::SoundFont>& soundfont, const key_t& key,
+            const std::shared_ptr<const note_clip_t>& clip
+        );
+
+        static size_t clipSize(const note_clip_t& clip);
+
+
+        //_____ Constants __________
+    private:
+        static const size_t DEFAULT_MAX_SIZE = 64 * 1024 * 1024;
 
 
         //_____ Attributes __________
     private:
-        uint16_t sample_rate;
+        mutable std::mutex _mutex;
+        std::shared_ptr<const sf::SoundFont> _soundfont;
 
-        float attack_slope;
-        float decay_slope;
-        float release_slope;
-    
-        float attack_start_time;
-        float hold_start_time;
-        float decay_start_time;
-        float release_start_time;
-    
-        float sustain_level;
-        float release_level;
-    
-        uint32_t nb_processed_samples;
-        envelope_stage_t stage;
+        sf::LruCache<key_t, std::shared_ptr<const note_clip_t>> _clips;
 
-        float value;
-        float priority;
+        uint64_t _nb_hits = 0;
+        uint64_t _nb_misses = 0;
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  A note to render with `renderNotes()`
+    //------------------------------------------------------------------------------------
+    struct note_render_job_t
+    {
+        sf::preset_id_t preset;     ///< The id of the preset
+        uint8_t key;                ///< The key to press
+        uint8_t velocity;           ///< The velocity of the key press
+        uint32_t duration;          ///< How long the key is pressed, in samples
+        float master_volume;        ///< The master volume, in dB
+
+        std::shared_ptr<const note_clip_t> clip;    ///< The rendered clip (filled,
+                                                    ///  nullptr if the preset doesn't
+                                                    ///  exist)
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Render several independent notes in parallel, all using the same SoundFont
+    ///
+    /// Each thread uses its own synthesizer, created with the provided settings, and
+    /// renders one note at a time with `Synthesizer::renderNote()`. The SoundFont is
+    /// shared by all the synthesizers, it isn't copied.
+    ///
+    /// @param soundfont    The SoundFont (must contain at least one preset)
+    /// @param settings     The settings of the synthesizers
+    /// @param jobs         The notes to render
+    /// @param nb_jobs      Number of notes
+    /// @param nb_threads   Number of threads to use, including the calling one (0 to
+    ///                     use as many threads as there are CPU cores)
+    /// @param cache        (optional) The cache of clips to use, shared by all the
+    ///                     threads
+    /// @return             False if the SoundFont can't be used
+    //------------------------------------------------------------------------------------
+    bool renderNotes(
+        const std::shared_ptr<const sf::SoundFont>& soundfont,
+        const SynthesizerSettings& settings, note_render_job_t* jobs, size_t nb_jobs,
+        uint16_t nb_threads = 0, NoteClipCache* cache = nullptr
+    );
+
+
+#ifdef KNM_SYNTHESIZER_IMPLEMENTATION
+
+    /********************************* INTERNAL TYPES ***********************************/
+
+    enum loop_mode_t
+    {
+        LOOP_MODE_NONE = 0,
+        LOOP_MODE_CONTINUOUS = 1,
+        LOOP_MODE_UNTIL_RELEASE = 3,
     };
 
     //-----------------------------------------------------------------------
 
-    VolumeEnvelope::VolumeEnvelope(uint16_t sample_rate)
-    : sample_rate(sample_rate)
+    enum envelope_stage_t
     {
-    }
+        ENV_STAGE_DELAY = 0,
+        ENV_STAGE_ATTACK = 1,
+        ENV_STAGE_HOLD = 2,
+        ENV_STAGE_DECAY = 3,
+        ENV_STAGE_RELEASE = 4,
+    };
+ 
+    //-----------------------------------------------------------------------
+
+    enum voice_state_t
+    {
+        VOICE_STATE_PLAYING,
+        VOICE_STATE_RELEASE_REQUESTED,
+        VOICE_STATE_RELEASED,
+    };
 
     //-----------------------------------------------------------------------
 
-    void VolumeEnvelope::start(
-        float delay, float attack, float hold, float decay, float sustain,
-        float release
-    )
+    // The generators the modulators can change during the whole note (the other ones
+    // are only modulated at note-on)
+    enum modulated_parameter_t
     {
-        attack_slope = 1.0f / attack;
-        decay_slope = -9.226f / decay;
-        release_slope = -9.226f / release;
+        MOD_PARAM_INITIAL_ATTENUATION,
+        MOD_PARAM_INITIAL_FILTER_Q,
+        MOD_PARAM_INITIAL_FILTER_CUTOFF,
+        MOD_PARAM_COARSE_TUNE,
+        MOD_PARAM_FINE_TUNE,
+        MOD_PARAM_PAN,
+        MOD_PARAM_REVERB_SEND,
+        MOD_PARAM_CHORUS_SEND,
+        MOD_PARAM_VIBRATO_LFO_TO_PITCH,
+        MOD_PARAM_MODULATION_LFO_TO_PITCH,
+        MOD_PARAM_MODULATION_ENVELOPE_TO_PITCH,
+        MOD_PARAM_MODULATION_LFO_TO_CUTOFF,
+        MOD_PARAM_MODULATION_ENVELOPE_TO_CUTOFF,
+        MOD_PARAM_MODULATION_LFO_TO_VOLUME,
+        MOD_PARAM_COUNT,
+    };
 
-        attack_start_time = delay;
-        hold_start_time = attack_start_time + attack;
-        decay_start_time = hold_start_time + hold;
-        release_start_time = 0;
+    //-----------------------------------------------------------------------
 
-        sustain_level = clamp(sustain, 0.0f, 1.0f);
-        release_level = 0.0f;
+    // A message read from a track of a MIDI file, before the conversion of its time.
+    // The tempo changes are the messages with a non-zero 'tempo' (in µs per quarter
+    // note), and the ends of tracks the ones with a zero 'command'
+    struct midi_track_event_t
+    {
+        uint64_t tick;
+        uint32_t tempo;
+        uint8_t channel;
+        uint8_t command;
+        uint8_t data1;
+        uint8_t data2;
+    };
 
-        nb_processed_samples = 0;
-        stage = ENV_STAGE_DELAY;
-        value = 0.0f;
 
-        process(0);
+    /************************************ CONSTANTS *************************************/
+
+    const float NON_AUDIBLE = 0.001f;
+    const float LOG_NON_AUDIBLE = log(NON_AUDIBLE);
+
+    const int SINC_TAPS = 8;
+    const int SINC_RESOLUTION_BITS = 10;
+    const int SINC_RESOLUTION = 1 << SINC_RESOLUTION_BITS;
+
+    // Alignment of the audio blocks, in bytes (a cache line, also enough for AVX)
+    const size_t BLOCK_ALIGNMENT = 64;
+
+
+    /******************************** HELPER FUNCTIONS **********************************/
+
+    inline float* allocate_aligned_floats(size_t size)
+    {
+        return static_cast<float*>(
+            ::operator new[](size * sizeof(float), std::align_val_t(BLOCK_ALIGNMENT))
+        );
     }
 
     //-----------------------------------------------------------------------
 
-    void VolumeEnvelope::release()
+    inline void free_aligned_floats(float* memory)
     {
-        stage = ENV_STAGE_RELEASE;
-        release_start_time = float(nb_processed_samples) / sample_rate;
-        release_level = value;
+        ::operator delete[](memory, std::align_val_t(BLOCK_ALIGNMENT));
     }
 
     //-----------------------------------------------------------------------
 
-    bool VolumeEnvelope::process(uint32_t nb_samples)
+    inline size_t aligned_block_size(size_t size)
     {
-        nb_processed_samples += nb_samples;
+        const size_t nb_floats = BLOCK_ALIGNMENT / sizeof(float);
+        return (size + nb_floats - 1) / nb_floats * nb_floats;
+    }
 
-        float current_time = float(nb_processed_samples) / sample_rate;
+    //-----------------------------------------------------------------------
 
-        // Change stage if necessary
-        while (stage <= ENV_STAGE_HOLD)
+    // Append 'size' samples (silent or not) at the end of rendered buffers
+    inline void append_range(silent_ranges_t& ranges, size_t size, bool silent)
+    {
+        if (silent)
         {
-            float end;
+            if (ranges.leading == ranges.size)
+                ranges.leading += size;
 
-            switch (stage)
-            {
-                case ENV_STAGE_DELAY: end = attack_start_time; break;
-                case ENV_STAGE_ATTACK: end = hold_start_time; break;
-                case ENV_STAGE_HOLD: end = decay_start_time; break;
-                default: return false;
-            }
+            ranges.trailing += size;
+        }
+        else
+        {
+            ranges.trailing = 0;
+        }
 
-            if (current_time < end)
-                break;
+        ranges.size += size;
+    }
 
-            stage = envelope_stage_t(int(stage) + 1);
-        }
+    //-----------------------------------------------------------------------
 
-        // Compute the envelope value at current stage
-        switch (stage)
-        {
-            case ENV_STAGE_DELAY:
-                value = 0.0f;
-                priority = 3.0;
-                return true;
-            
-            case ENV_STAGE_ATTACK:
-                value = attack_slope * (current_time - attack_start_time);
-                priority = 3.0 - value;
-                return true;
-            
-            case ENV_STAGE_HOLD:
-                value = 1.0;
-                priority = 2.0;
-                return true;
+    inline float clamp(float value, float min, float max)
+    {
+        if (value < min)
+            return min;
+        else if (value > max)
+            return max;
+        else
+            return value;
+    }
 
-            case ENV_STAGE_DECAY:
-                value = fmax(
-                    exp_cutoff(decay_slope * (current_time - decay_start_time)),
-                    sustain_level
-                );
-                priority = 1.0 + value;
-                return (value > NON_AUDIBLE);
+    //-----------------------------------------------------------------------
 
-            case ENV_STAGE_RELEASE:
-                value = release_level *
-                            exp_cutoff(release_slope * (current_time - release_start_time));
-                priority = value;
-                return (value > NON_AUDIBLE);
-        }
+    inline float exp_cutoff(float x)
+    {
+        if (x < LOG_NON_AUDIBLE)
+            return 0.0f;
 
-        return false;
+        return exp(x);
     }
 
+    //-----------------------------------------------------------------------
 
-    /******************************* MODULATION ENVELOPE ********************************/
+    inline float timecents_to_seconds(float x)
+    {
+        return pow(2.0f, (1.0f / 1200.0f) * x);
+    }
 
-    //------------------------------------------------------------------------------------
-    /// @brief  Allows to generate a modulation envelope
-    //------------------------------------------------------------------------------------
-    class ModulationEnvelope
+    //-----------------------------------------------------------------------
+
+    inline float decibels_to_linear(float x)
     {
-    public:
-        //--------------------------------------------------------------------------------
-        /// @brief  Constructor
-        ///
-        /// @param sample_rate  The sample rate of the synthesized signal
-        //--------------------------------------------------------------------------------
-        ModulationEnvelope(uint16_t sample_rate);
+        return pow(10.0f, 0.05f * x);
+    };
 
-        //--------------------------------------------------------------------------------
-        /// @brief  Starts a new envelope
-        ///
-        /// Must be called when the key is pressed, before 'process()', to define the
-        /// shape of the envelope.
-        //--------------------------------------------------------------------------------
-        void start(
-            float delay, float attack, float hold, float decay, float sustain,
-            float release
-        );
+    //-----------------------------------------------------------------------
 
-        //--------------------------------------------------------------------------------
-        /// @brief  Must be called when the key is released
-        //--------------------------------------------------------------------------------
-        void release();
+    inline float linear_to_decibels(float x)
+    {
+        return 20.0f * log10(x);
+    }
 
-        //--------------------------------------------------------------------------------
-        /// @brief  Update the value of the envelope
-        ///
-        /// @param nb_samples   The number of samples to process during this update
-        /// @return True if the envelope still allows the signal to be heard
-        //--------------------------------------------------------------------------------
-        bool process(uint32_t nb_samples);
+    //-----------------------------------------------------------------------
 
-        inline float getValue() const
-        {
-            return value;
-        }
+    inline float cents_to_hertz(float x)
+    {
+        return 8.176f * pow(2.0f, (1.0f / 1200.0f) * x);
+    }
 
+    //-----------------------------------------------------------------------
 
-        //_____ Attributes __________
-    private:
-        uint16_t sample_rate;
+    inline float cents_to_multiplying_factor(float x)
+    {
+        return pow(2.0f, (1.0f / 1200.0f) * x);
+    }
 
-        float attack_slope;
-        float decay_slope;
-        float release_slope;
-    
-        float attack_start_time;
-        float hold_start_time;
-        float decay_start_time;
+    //-----------------------------------------------------------------------
 
-        float decay_end_time;
-        float release_end_time;
-    
-        float sustain_level;
-        float release_level;
-    
-        uint32_t nb_processed_samples;
-        envelope_stage_t stage;
+    inline float key_number_to_multiplying_factor(int16_t cents, uint8_t key)
+    {
+        return timecents_to_seconds(cents * (60 - key));
+    }
 
-        float value;
-    };
+    //-----------------------------------------------------------------------
+
+    // The following functions are the fast approximations used when enabled in the
+    // settings (see `SynthesizerSettings::enableFastMath()`).
+
+    // 2^x, with a relative error below 1e-6
+    inline float fast_exp2(float x)
+    {
+        x = clamp(x, -126.0f, 127.0f);
+
+        // 2^x = 2^i * 2^f, with i an integer and f in [-0.5, 0.5]
+        float i = floorf(x + 0.5f);
+        float f = x - i;
+
+        // Minimax polynomial of 2^f (from Cephes)
+        float p = 1.535336188319500e-4f;
+        p = p * f + 1.339887440266574e-3f;
+        p = p * f + 9.618437357674640e-3f;
+        p = p * f + 5.550332471162809e-2f;
+        p = p * f + 2.402264791363012e-1f;
+        p = p * f + 6.931472028550421e-1f;
+        p = p * f + 1.0f;
+
+        // 2^i is built directly from its exponent bits
+        uint32_t bits = uint32_t(int32_t(i) + 127) << 23;
+
+        float scale;
+        memcpy(&scale, &bits, sizeof(float));
+
+        return p * scale;
+    }
+
+    //-----------------------------------------------------------------------
+
+    inline float fast_exp_cutoff(float x)
+    {
+        if (x < LOG_NON_AUDIBLE)
+            return 0.0f;
+
+        return fast_exp2(float(M_LOG2E) * x);
+    }
+
+    //-----------------------------------------------------------------------
+
+    inline float fast_decibels_to_linear(float x)
+    {
+        // 10^(x/20) = 2^(x * log2(10) / 20)
+        return fast_exp2(0.166096404744f * x);
+    }
+
+    //-----------------------------------------------------------------------
+
+    inline float fast_cents_to_multiplying_factor(float x)
+    {
+        return fast_exp2((1.0f / 1200.0f) * x);
+    }
+
+    //-----------------------------------------------------------------------
+
+    // sin(x), for x in [-pi/2, pi/2]
+    inline float fast_sin(float x)
+    {
+        // Taylor series up to x^11
+        float x2 = x * x;
+
+        float p = -2.5052108e-8f;
+        p = p * x2 + 2.7557319e-6f;
+        p = p * x2 - 1.9841270e-4f;
+        p = p * x2 + 8.3333333e-3f;
+        p = p * x2 - 1.6666667e-1f;
+
+        return x + x * x2 * p;
+    }
+
+    //-----------------------------------------------------------------------
+
+    // cos(x), for x in [0, pi]
+    inline float fast_cos(float x)
+    {
+        return fast_sin(float(M_PI_2) - x);
+    }
+
+    //-----------------------------------------------------------------------
+
+    // Gains of the pan law for a mono source, false if the pan is outside ]-50, 50[
+    inline bool pan_law(float pan, float& left, float& right)
+    {
+        if ((pan <= -50.0f) || (pan >= 50.0f))
+            return false;
+
+        float angle = (M_PI_2 / 50.0f) * pan;
+        float factor = 1.0 + (sqrtf(2.0f) - 1.0) * cosf(angle);
+
+        left = (50.0f - pan) / 100.0f * factor;
+        right = (50.0f + pan) / 100.0f * factor;
+
+        return true;
+    }
+
+
+    inline uint32_t read_big_endian(const uint8_t* data, size_t nb_bytes)
+    {
+        uint32_t value = 0;
+        for (size_t i = 0; i < nb_bytes; ++i)
+            value = (value << 8) | data[i];
+        return value;
+    }
+
+    //-----------------------------------------------------------------------
+
+    // Read a variable-length quantity of a MIDI file (at most 4 bytes)
+    inline bool read_variable_length(
+        const uint8_t* data, size_t size, size_t& position, uint32_t& value
+    )
+    {
+        value = 0;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if (position >= size)
+                return false;
+
+            uint8_t byte = data[position++];
+            value = (value << 7) | (byte & 0x7F);
+
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    //-----------------------------------------------------------------------
+
+    // Parse the content of a track chunk of a MIDI file, appending its messages to
+    // 'events'. The channels of the messages following a 'MIDI port' meta-event are
+    // offset by 16 channels per port
+    inline bool read_midi_track(
+        const uint8_t* data, size_t size, std::vector<midi_track_event_t>& events
+    )
+    {
+        size_t position = 0;
+        uint64_t tick = 0;
+        uint8_t running_status = 0;
+        uint8_t port = 0;
+
+        while (position < size)
+        {
+            uint32_t delta;
+            if (!read_variable_length(data, size, position, delta) || (position >= size))
+                return false;
+
+            tick += delta;
+
+            // A data byte instead of a status byte: reuse the last one (running status)
+            uint8_t status = data[position];
+            if (status & 0x80)
+            {
+                ++position;
+
+                if (status < 0xF0)
+                    running_status = status;
+            }
+            else if (running_status != 0)
+            {
+                status = running_status;
+            }
+            else
+            {
+                return false;
+            }
+
+            if (status == 0xFF)
+            {
+                // Meta-event
+                if (position >= size)
+                    return false;
+
+                uint8_t type = data[position++];
+
+                uint32_t length;
+                if (!read_variable_length(data, size, position, length) ||
+                    (length > size - position))
+                {
+                    return false;
+                }
+
+                // Set tempo
+                if ((type == 0x51) && (length == 3))
+                {
+                    uint32_t tempo = read_big_endian(data + position, 3);
+                    if (tempo > 0)
+                        events.push_back({ tick, tempo, 0, 0, 0, 0 });
+                }
+
+                // MIDI port
+                else if ((type == 0x21) && (length == 1))
+                {
+                    port = data[position] & 0x0F;
+                }
+
+                // End of track
+                else if (type == 0x2F)
+                {
+                    events.push_back({ tick, 0, 0, 0, 0, 0 });
+                    return true;
+                }
+
+                position += length;
+            }
+            else if ((status == 0xF0) || (status == 0xF7))
+            {
+                // System exclusive message
+                uint32_t length;
+                if (!read_variable_length(data, size, position, length) ||
+                    (length > size - position))
+                {
+                    return false;
+                }
+
+                position += length;
+            }
+            else if (status > 0xF0)
+            {
+                // System common and real-time messages can't appear in a MIDI file
+                return false;
+            }
+            else
+            {
+                uint8_t command = status & 0xF0;
+                size_t nb_data = ((command == 0xC0) || (command == 0xD0) ? 1 : 2);
+
+                if (nb_data > size - position)
+                    return false;
+
+                uint8_t data1 = data[position];
+                uint8_t data2 = (nb_data == 2 ? data[position + 1] : 0);
+                position += nb_data;
+
+                uint8_t channel = port * 16 + (status & 0x0F);
+                events.push_back({ tick, 0, channel, command, data1, data2 });
+            }
+        }
+
+        // Missing 'end of track' meta-event
+        events.push_back({ tick, 0, 0, 0, 0, 0 });
+
+        return true;
+    }
+
+    //-----------------------------------------------------------------------
+
+    // Sets the "flush-to-zero" and "denormals-are-zero" modes of the current thread
+    // during its lifetime, and restores the previous modes afterwards
+    class DenormalsGuard
+    {
+    public:
+        inline DenormalsGuard(bool enable)
+        {
+            if (!enable)
+                return;
+
+#if defined(KNM_SYNTHESIZER_SSE) || defined(KNM_SYNTHESIZER_SSE2)
+            _previous = _mm_getcsr();
+
+    #if defined(KNM_SYNTHESIZER_SSE2)
+            const uint32_t flags = 0x8040;  // FTZ | DAZ
+    #else
+            const uint32_t flags = 0x8000;  // FTZ
+    #endif
+
+            if ((_previous & flags) != flags)
+            {
+                _mm_setcsr(_previous | flags);
+                _restore = true;
+            }
+#elif defined(KNM_SYNTHESIZER_NEON) && defined(__aarch64__) && defined(__GNUC__)
+            uint64_t fpcr;
+            __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+            _previous = fpcr;
+
+            const uint64_t flags = uint64_t(1) << 24;   // FZ
+
+            if ((fpcr & flags) == 0)
+            {
+                __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | flags));
+                _restore = true;
+            }
+#endif
+        }
+
+        inline ~DenormalsGuard()
+        {
+            if (!_restore)
+                return;
+
+#if defined(KNM_SYNTHESIZER_SSE) || defined(KNM_SYNTHESIZER_SSE2)
+            _mm_setcsr(uint32_t(_previous));
+#elif defined(KNM_SYNTHESIZER_NEON) && defined(__aarch64__) && defined(__GNUC__)
+            __asm__ __volatile__("msr fpcr, %0" : : "r"(_previous));
+#endif
+        }
+
+        DenormalsGuard(const DenormalsGuard&) = delete;
+        DenormalsGuard& operator=(const DenormalsGuard&) = delete;
+
+    private:
+        uint64_t _previous = 0;
+        bool _restore = false;
+    };
+
+
+    /********************************* MIXING KERNELS ***********************************/
+
+    // The gain of the sample 'i' of a ramp is always computed as 'gain + step * i' (not
+    // by successive additions), so all the implementations give identical results
+
+#if defined(KNM_SYNTHESIZER_AVX)
+    const uint32_t SIMD_WIDTH = 8;
+    typedef __m256 simd_t;
+
+    inline simd_t simd_set(float x) { return _mm256_set1_ps(x); }
+    inline simd_t simd_load(const float* p) { return _mm256_loadu_ps(p); }
+    inline void simd_store(float* p, simd_t x) { _mm256_storeu_ps(p, x); }
+    inline simd_t simd_add(simd_t a, simd_t b) { return _mm256_add_ps(a, b); }
+    inline simd_t simd_mul(simd_t a, simd_t b) { return _mm256_mul_ps(a, b); }
+    inline simd_t simd_sub(simd_t a, simd_t b) { return _mm256_sub_ps(a, b); }
+    inline simd_t simd_indices() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+#elif defined(KNM_SYNTHESIZER_SSE)
+    const uint32_t SIMD_WIDTH = 4;
+    typedef __m128 simd_t;
+
+    inline simd_t simd_set(float x) { return _mm_set1_ps(x); }
+    inline simd_t simd_load(const float* p) { return _mm_loadu_ps(p); }
+    inline void simd_store(float* p, simd_t x) { _mm_storeu_ps(p, x); }
+    inline simd_t simd_add(simd_t a, simd_t b) { return _mm_add_ps(a, b); }
+    inline simd_t simd_mul(simd_t a, simd_t b) { return _mm_mul_ps(a, b); }
+    inline simd_t simd_sub(simd_t a, simd_t b) { return _mm_sub_ps(a, b); }
+    inline simd_t simd_indices() { return _mm_setr_ps(0, 1, 2, 3); }
+#elif defined(KNM_SYNTHESIZER_NEON)
+    const uint32_t SIMD_WIDTH = 4;
+    typedef float32x4_t simd_t;
+
+    inline simd_t simd_set(float x) { return vdupq_n_f32(x); }
+    inline simd_t simd_load(const float* p) { return vld1q_f32(p); }
+    inline void simd_store(float* p, simd_t x) { vst1q_f32(p, x); }
+    inline simd_t simd_add(simd_t a, simd_t b) { return vaddq_f32(a, b); }
+    inline simd_t simd_mul(simd_t a, simd_t b) { return vmulq_f32(a, b); }
+    inline simd_t simd_sub(simd_t a, simd_t b) { return vsubq_f32(a, b); }
+    inline simd_t simd_indices() { const float i[4] = { 0, 1, 2, 3 }; return vld1q_f32(i); }
+#endif
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Accumulates 'gain * source' into 'destination'
+    //------------------------------------------------------------------------------------
+    inline void mix_constant(float* destination, const float* source, float gain, uint32_t size)
+    {
+        uint32_t i = 0;
+
+#ifdef KNM_SYNTHESIZER_SIMD
+        const simd_t g = simd_set(gain);
+
+        for (; i + SIMD_WIDTH <= size; i += SIMD_WIDTH)
+        {
+            simd_store(
+                destination + i,
+                simd_add(simd_load(destination + i), simd_mul(g, simd_load(source + i)))
+            );
+        }
+#endif
+
+        for (; i < size; ++i)
+            destination[i] += gain * source[i];
+    }
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Accumulates 'source' into 'destination', with a gain going linearly from
+    ///         'gain' by increments of 'step'
+    //------------------------------------------------------------------------------------
+    inline void mix_ramp(
+        float* destination, const float* source, float gain, float step, uint32_t size
+    )
+    {
+        uint32_t i = 0;
+
+#ifdef KNM_SYNTHESIZER_SIMD
+        const simd_t g = simd_set(gain);
+        const simd_t s = simd_set(step);
+        const simd_t increment = simd_set(float(SIMD_WIDTH));
+        simd_t indices = simd_indices();
+
+        for (; i + SIMD_WIDTH <= size; i += SIMD_WIDTH)
+        {
+            simd_t gains = simd_add(g, simd_mul(s, indices));
+
+            simd_store(
+                destination + i,
+                simd_add(simd_load(destination + i), simd_mul(gains, simd_load(source + i)))
+            );
+
+            indices = simd_add(indices, increment);
+        }
+#endif
+
+        for (; i < size; ++i)
+            destination[i] += (gain + step * float(i)) * source[i];
+    }
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Accumulates a mono source into both 'left' and 'right' in one pass, with
+    ///         a (possibly constant) gain ramp for each side
+    //------------------------------------------------------------------------------------
+    inline void mix_ramp_stereo(
+        float* left, float* right, const float* source, float gain_left, float step_left,
+        float gain_right, float step_right, uint32_t size
+    )
+    {
+        uint32_t i = 0;
+
+#ifdef KNM_SYNTHESIZER_SIMD
+        const simd_t gl = simd_set(gain_left);
+        const simd_t sl = simd_set(step_left);
+        const simd_t gr = simd_set(gain_right);
+        const simd_t sr = simd_set(step_right);
+        const simd_t increment = simd_set(float(SIMD_WIDTH));
+        simd_t indices = simd_indices();
+
+        for (; i + SIMD_WIDTH <= size; i += SIMD_WIDTH)
+        {
+            simd_t x = simd_load(source + i);
+
+            simd_t gains_left = simd_add(gl, simd_mul(sl, indices));
+            simd_t gains_right = simd_add(gr, simd_mul(sr, indices));
+
+            simd_store(left + i, simd_add(simd_load(left + i), simd_mul(gains_left, x)));
+            simd_store(right + i, simd_add(simd_load(right + i), simd_mul(gains_right, x)));
+
+            indices = simd_add(indices, increment);
+        }
+#endif
+
+        for (; i < size; ++i)
+        {
+            left[i] += (gain_left + step_left * float(i)) * source[i];
+            right[i] += (gain_right + step_right * float(i)) * source[i];
+        }
+    }
+
+
+    /******************************* CONVERSION KERNELS *********************************/
+
+    // The conversions to integers clamp the values and round them to the nearest integer,
+    // exactly like the SIMD instructions do, so all the implementations give identical
+    // results
+
+    const float INT16_SCALE = 32767.0f;
+    const float INT16_LOWEST = -32768.0f;
+    const float INT16_HIGHEST = 32767.0f;
+
+    const float INT32_SCALE = 2147483648.0f;
+    const float INT32_LOWEST = -2147483648.0f;
+    const float INT32_HIGHEST = 2147483520.0f;     // Highest float below 2^31
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Interleaves 'left' and 'right' into 'destination'
+    //------------------------------------------------------------------------------------
+    inline void interleave(
+        float* destination, const float* left, const float* right, uint32_t size
+    )
+    {
+        uint32_t i = 0;
+
+#if defined(KNM_SYNTHESIZER_SSE2)
+        for (; i + 4 <= size; i += 4)
+        {
+            __m128 l = _mm_loadu_ps(left + i);
+            __m128 r = _mm_loadu_ps(right + i);
+
+            _mm_storeu_ps(destination + 2 * i, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(destination + 2 * i + 4, _mm_unpackhi_ps(l, r));
+        }
+#elif defined(KNM_SYNTHESIZER_NEON)
+        for (; i + 4 <= size; i += 4)
+        {
+            float32x4x2_t lr = { vld1q_f32(left + i), vld1q_f32(right + i) };
+            vst2q_f32(destination + 2 * i, lr);
+        }
+#endif
+
+        for (; i < size; ++i)
+        {
+            destination[2 * i] = left[i];
+            destination[2 * i + 1] = right[i];
+        }
+    }
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Interleaves 'left' and 'right' into 'destination', converted to 16-bits
+    ///         integers
+    ///
+    /// 'noise' (if not null) contains the interleaved dither to add to each sample, in
+    /// LSB units.
+    //------------------------------------------------------------------------------------
+    inline void interleave_int16(
+        int16_t* destination, const float* left, const float* right, const float* noise,
+        uint32_t size
+    )
+    {
+        uint32_t i = 0;
+
+#if defined(KNM_SYNTHESIZER_SSE2)
+        const __m128 scale = _mm_set1_ps(INT16_SCALE);
+        const __m128 min = _mm_set1_ps(INT16_LOWEST);
+        const __m128 max = _mm_set1_ps(INT16_HIGHEST);
+
+        for (; i + 4 <= size; i += 4)
+        {
+            __m128 l = _mm_mul_ps(_mm_loadu_ps(left + i), scale);
+            __m128 r = _mm_mul_ps(_mm_loadu_ps(right + i), scale);
+
+            __m128 a = _mm_unpacklo_ps(l, r);
+            __m128 b = _mm_unpackhi_ps(l, r);
+
+            if (noise)
+            {
+                a = _mm_add_ps(a, _mm_loadu_ps(noise + 2 * i));
+                b = _mm_add_ps(b, _mm_loadu_ps(noise + 2 * i + 4));
+            }
+
+            a = _mm_min_ps(_mm_max_ps(a, min), max);
+            b = _mm_min_ps(_mm_max_ps(b, min), max);
+
+            _mm_storeu_si128(
+                (__m128i*) (destination + 2 * i),
+                _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b))
+            );
+        }
+#elif defined(KNM_SYNTHESIZER_NEON) && defined(__aarch64__)
+        const float32x4_t scale = vdupq_n_f32(INT16_SCALE);
+        const float32x4_t min = vdupq_n_f32(INT16_LOWEST);
+        const float32x4_t max = vdupq_n_f32(INT16_HIGHEST);
+
+        for (; i + 4 <= size; i += 4)
+        {
+            float32x4_t l = vmulq_f32(vld1q_f32(left + i), scale);
+            float32x4_t r = vmulq_f32(vld1q_f32(right + i), scale);
+
+            float32x4x2_t lr = vzipq_f32(l, r);
+            float32x4_t a = lr.val[0];
+            float32x4_t b = lr.val[1];
+
+            if (noise)
+            {
+                a = vaddq_f32(a, vld1q_f32(noise + 2 * i));
+                b = vaddq_f32(b, vld1q_f32(noise + 2 * i + 4));
+            }
+
+            a = vminq_f32(vmaxq_f32(a, min), max);
+            b = vminq_f32(vmaxq_f32(b, min), max);
+
+            vst1q_s16(
+                destination + 2 * i,
+                vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b)))
+            );
+        }
+#endif
+
+        for (; i < size; ++i)
+        {
+            float l = left[i] * INT16_SCALE;
+            float r = right[i] * INT16_SCALE;
+
+            if (noise)
+            {
+                l += noise[2 * i];
+                r += noise[2 * i + 1];
+            }
+
+            destination[2 * i] = int16_t(lrintf(fmin(fmax(l, INT16_LOWEST), INT16_HIGHEST)));
+            destination[2 * i + 1] = int16_t(lrintf(fmin(fmax(r, INT16_LOWEST), INT16_HIGHEST)));
+        }
+    }
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Interleaves 'left' and 'right' into 'destination', converted to 32-bits
+    ///         integers
+    //------------------------------------------------------------------------------------
+    inline void interleave_int32(
+        int32_t* destination, const float* left, const float* right, uint32_t size
+    )
+    {
+        uint32_t i = 0;
+
+#if defined(KNM_SYNTHESIZER_SSE2)
+        const __m128 scale = _mm_set1_ps(INT32_SCALE);
+        const __m128 min = _mm_set1_ps(INT32_LOWEST);
+        const __m128 max = _mm_set1_ps(INT32_HIGHEST);
+
+        for (; i + 4 <= size; i += 4)
+        {
+            __m128 l = _mm_mul_ps(_mm_loadu_ps(left + i), scale);
+            __m128 r = _mm_mul_ps(_mm_loadu_ps(right + i), scale);
+
+            __m128 a = _mm_min_ps(_mm_max_ps(_mm_unpacklo_ps(l, r), min), max);
+            __m128 b = _mm_min_ps(_mm_max_ps(_mm_unpackhi_ps(l, r), min), max);
+
+            _mm_storeu_si128((__m128i*) (destination + 2 * i), _mm_cvtps_epi32(a));
+            _mm_storeu_si128((__m128i*) (destination + 2 * i + 4), _mm_cvtps_epi32(b));
+        }
+#elif defined(KNM_SYNTHESIZER_NEON) && defined(__aarch64__)
+        const float32x4_t scale = vdupq_n_f32(INT32_SCALE);
+        const float32x4_t min = vdupq_n_f32(INT32_LOWEST);
+        const float32x4_t max = vdupq_n_f32(INT32_HIGHEST);
+
+        for (; i + 4 <= size; i += 4)
+        {
+            float32x4_t l = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(left + i), scale), min), max);
+            float32x4_t r = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(right + i), scale), min), max);
+
+            int32x4x2_t lr = { vcvtnq_s32_f32(l), vcvtnq_s32_f32(r) };
+            vst2q_s32(destination + 2 * i, lr);
+        }
+#endif
+
+        for (; i < size; ++i)
+        {
+            float l = fmin(fmax(left[i] * INT32_SCALE, INT32_LOWEST), INT32_HIGHEST);
+            float r = fmin(fmax(right[i] * INT32_SCALE, INT32_LOWEST), INT32_HIGHEST);
+
+            destination[2 * i] = int32_t(lrintf(l));
+            destination[2 * i + 1] = int32_t(lrintf(r));
+        }
+    }
+
+
+    /************************************* CHANNEL **************************************/
+
+    Channel::Channel(bool percussion)
+    : _percussion(percussion)
+    {
+        _controls.version = 0;
+        reset();
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Channel::reset()
+    {
+        _bank = (_percussion ? 128 : 0);
+        _preset = 0;
+
+        _modulation = 0;
+        _volume = 100 << 7;
+        _pan = 64 << 7;
+        _expression = 127 << 7;
+        _sustain = false;
+
+        _reverb_send = 40;
+        _chorus_send = 0;
+
+        _rpn = -1;
+        _pitch_bend_range = 2 << 7;
+        _coarse_tune = 0;
+        _fine_tune = 8192;
+
+        _pitch_bend = 0.0f;
+        _pitch_wheel = 8192;
+
+        memset(_controllers, 0, sizeof(_controllers));
+        _controllers[0x07] = 100;
+        _controllers[0x0A] = 64;
+        _controllers[0x0B] = 127;
+        _controllers[0x5B] = 40;
+        _channel_pressure = 0;
+
+        _dirty = true;
+        updateControls();
+    }
+    
+    //-----------------------------------------------------------------------
+
+    void Channel::resetControllers()
+    {
+        _modulation = 0;
+        _expression = 127 << 7;
+        _sustain = false;
+
+        _rpn = -1;
+
+        _pitch_bend = 0.0f;
+        _pitch_wheel = 8192;
+
+        _controllers[0x01] = 0;
+        _controllers[0x0B] = 127;
+        _controllers[0x40] = 0;
+        _channel_pressure = 0;
+
+        _dirty = true;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Channel::updateControls()
+    {
+        if (!_dirty)
+            return;
+
+        _controls.gain = volumeGain() * expression();
+        _controls.pitch = tune() + pitchBend();
+        _controls.vibrato_depth = 0.01f * modulation();
+        _controls.pan = pan();
+        _controls.pan_law = pan_law(
+            _controls.pan, _controls.pan_gain_left, _controls.pan_gain_right
+        );
+        _controls.reverb_send = reverbSend();
+        _controls.chorus_send = chorusSend();
+        _controls.sustain = _sustain;
+        ++_controls.version;
+
+        _dirty = false;
+    }
+
+
+    /************************************ SAMPLER ***************************************/
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Table of the coefficients of the windowed-sinc interpolation
+    ///
+    /// Each row contains the SINC_TAPS coefficients to apply to the samples around the
+    /// current position (from -SINC_TAPS/2+1 to +SINC_TAPS/2), for one of the
+    /// SINC_RESOLUTION possible fractional positions.
+    //------------------------------------------------------------------------------------
+    struct sinc_table_t
+    {
+        float coefficients[SINC_RESOLUTION][SINC_TAPS];
+
+        sinc_table_t()
+        {
+            for (int p = 0; p < SINC_RESOLUTION; ++p)
+            {
+                const double t = double(p) / double(SINC_RESOLUTION);
+                double sum = 0.0;
+
+                for (int k = 0; k < SINC_TAPS; ++k)
+                {
+                    // Distance between the tap and the position to interpolate
+                    const double x = double(k - (SINC_TAPS / 2 - 1)) - t;
+
+                    const double sinc = (fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x));
+
+                    // Blackman window
+                    const double w = 2.0 * M_PI * (x + 0.5 * SINC_TAPS) / SINC_TAPS;
+                    const double window = 0.42 - 0.5 * cos(w) + 0.08 * cos(2.0 * w);
+
+                    coefficients[p][k] = float(sinc * window);
+                    sum += sinc * window;
+                }
+
+                // Unity gain for constant signals
+                for (int k = 0; k < SINC_TAPS; ++k)
+                    coefficients[p][k] = float(coefficients[p][k] / sum);
+            }
+        }
+
+        static const sinc_table_t& instance()
+        {
+            static const sinc_table_t table;
+            return table;
+        }
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Generates the audio signal of a sample, at the required pitch
+    ///
+    /// The position in the sample is a 32.32 fixed-point number. For each block, the
+    /// output is computed in segments: as long as all the points needed by the
+    /// interpolation are inside the sample (and don't cross the loop end), the inner loop
+    /// contains no branch.
+    //------------------------------------------------------------------------------------
+    class Sampler
+    {
+    public:
+        //--------------------------------------------------------------------------------
+        /// @brief  Constructor
+        ///
+        /// @param sample_rate      The sample rate of the synthesized signal
+        /// @param interpolation    The interpolation method to use
+        /// @param fast_math        Whether to use a fast approximation to compute the
+        ///                         pitch ratio
+        //--------------------------------------------------------------------------------
+        Sampler(
+            uint32_t sample_rate, interpolation_mode_t interpolation = INTERPOLATION_MODE_LINEAR,
+            bool fast_math = false
+        );
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Starts to play a sample
+        ///
+        /// @param buffer           The buffer of audio data
+        /// @param start            Start index of the sample in the buffer
+        /// @param end              End index of the sample in the buffer
+        /// @param loop_mode        The loop mode
+        /// @param loop_start       Starting point of the loop
+        /// @param loop_end         Ending point of the loop
+        /// @param sample_rate      Sample rate, in hertz, at which this sample was acquired
+        /// @param root_key         The MIDI key number of the recorded pitch of the sample
+        /// @param coarse_tune      Pitch offset, in semitones
+        /// @param fine_tune        Pitch offset, in cents
+        /// @param scale_tuning     Degree to which the MIDI key number influences pitch
+        //--------------------------------------------------------------------------------
+        void start(
+            const sf::sample_buffer_t& buffer,
+            uint32_t start,
+            uint32_t end,
+            loop_mode_t loop_mode,
+            uint32_t loop_start,
+            uint32_t loop_end,
+            uint32_t sample_rate,
+            uint8_t root_key,
+            int8_t coarse_tune,
+            int8_t fine_tune,
+            uint16_t scale_tuning
+        );
+
+        void release();
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Generates a block of audio data
+        ///
+        /// The pitch is reached at the end of the block: the increment of the position
+        /// in the sample goes from the one of the previous block to the new one, one
+        /// sample at a time (except for the first block).
+        //--------------------------------------------------------------------------------
+        bool process(float* dest, size_t size, float pitch);
+
+    private:
+        template<sf::sample_format_t FORMAT>
+        bool process(float* dest, size_t size, uint64_t from, uint64_t to);
+
+        template<sf::sample_format_t FORMAT, interpolation_mode_t INTERPOLATION>
+        bool process(float* dest, size_t size, uint64_t from, uint64_t to);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Interpolates the audio data, converting it on the fly from its format
+        ///
+        /// The loop state can only change between two blocks (see `release()`), so it
+        /// is a template parameter: the per-sample loops don't test it.
+        //--------------------------------------------------------------------------------
+        template<sf::sample_format_t FORMAT, interpolation_mode_t INTERPOLATION, bool LOOPING>
+        bool process(float* dest, size_t size, uint64_t from, uint64_t to);
+
+        template<interpolation_mode_t INTERPOLATION>
+        static inline float interpolate(const float* x, uint32_t fraction);
+
+
+        //_____ Constants __________
+    private:
+        static const uint64_t PHASE_ONE = uint64_t(1) << 32;
+
+
+        //_____ Attributes __________
+    private:
+        // Information about the audio sample
+        sf::sample_buffer_t _buffer;
+        uint32_t _start;
+        uint32_t _end;
+        loop_mode_t _loop_mode;
+        uint32_t _loop_start;
+        uint32_t _loop_end;
+        uint32_t _sample_rate;
+        uint8_t _root_key;
+    
+        // Internal state
+        uint32_t _dest_sample_rate;
+        interpolation_mode_t _interpolation;
+        bool _fast_math;
+        uint64_t _phase;
+        uint64_t _increment;        // Used by the last block
+        bool _started;              // Indicates if a block was already generated
+        bool _looping;
+        float _tune;
+        float _pitch_change_scale;
+        float _sample_rate_ratio;
+    };
+
+    //-----------------------------------------------------------------------
+
+    Sampler::Sampler(uint32_t sample_rate, interpolation_mode_t interpolation, bool fast_math)
+    : _dest_sample_rate(sample_rate), _interpolation(interpolation), _fast_math(fast_math)
+    {
+        if (_interpolation == INTERPOLATION_MODE_SINC)
+            sinc_table_t::instance();
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Sampler::start(
+        const sf::sample_buffer_t& buffer,
+        uint32_t start,
+        uint32_t end,
+        loop_mode_t loop_mode,
+        uint32_t loop_start,
+        uint32_t loop_end,
+        uint32_t sample_rate,
+        uint8_t original_pitch,
+        int8_t coarse_tune,
+        int8_t fine_tune,
+        uint16_t scale_tuning
+    )
+    {
+        _buffer = buffer;
+        _start = start;
+        _end = end;
+        _loop_mode = loop_mode;
+        _loop_start = loop_start;
+        _loop_end = loop_end;
+        _sample_rate = sample_rate;
+        _root_key = original_pitch;
+
+        _tune = float(coarse_tune) + 0.01f * float(fine_tune);
+        _pitch_change_scale = 0.01f * float(scale_tuning);
+        _sample_rate_ratio = float(sample_rate) / float(_dest_sample_rate);
+
+        _looping = (loop_mode != LOOP_MODE_NONE) && (loop_end > loop_start);
+        _phase = uint64_t(start) << 32;
+        _increment = 0;
+        _started = false;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Sampler::release()
+    {
+        if (_loop_mode == LOOP_MODE_UNTIL_RELEASE)
+            _looping = false;
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool Sampler::process(float* dest, size_t size, float pitch)
+    {
+        const float pitch_change = _pitch_change_scale * (pitch - _root_key) + _tune;
+        const float pitch_ratio = _sample_rate_ratio * (
+            _fast_math ? fast_exp2(pitch_change / 12.0f) : pow(2.0f, pitch_change / 12.0f)
+        );
+
+        const uint64_t increment = uint64_t(double(pitch_ratio) * double(PHASE_ONE));
+
+        // No ramp for the first block of the sample
+        const uint64_t from = (_started ? _increment : increment);
+
+        _increment = increment;
+        _started = true;
+
+        switch (_buffer.format)
+        {
+            case sf::SAMPLE_FORMAT_INT16:
+                return process<sf::SAMPLE_FORMAT_INT16>(dest, size, from, increment);
+
+            case sf::SAMPLE_FORMAT_INT24:
+                return process<sf::SAMPLE_FORMAT_INT24>(dest, size, from, increment);
+
+            default:
+                return process<sf::SAMPLE_FORMAT_FLOAT>(dest, size, from, increment);
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    template<sf::sample_format_t FORMAT>
+    bool Sampler::process(float* dest, size_t size, uint64_t from, uint64_t to)
+    {
+        switch (_interpolation)
+        {
+            case INTERPOLATION_MODE_NEAREST:
+                return process<FORMAT, INTERPOLATION_MODE_NEAREST>(dest, size, from, to);
+
+            case INTERPOLATION_MODE_CUBIC:
+                return process<FORMAT, INTERPOLATION_MODE_CUBIC>(dest, size, from, to);
+
+            case INTERPOLATION_MODE_SINC:
+                return process<FORMAT, INTERPOLATION_MODE_SINC>(dest, size, from, to);
+
+            default:
+                return process<FORMAT, INTERPOLATION_MODE_LINEAR>(dest, size, from, to);
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    template<sf::sample_format_t FORMAT, interpolation_mode_t INTERPOLATION>
+    bool Sampler::process(float* dest, size_t size, uint64_t from, uint64_t to)
+    {
+        if (_looping)
+            return process<FORMAT, INTERPOLATION, true>(dest, size, from, to);
+        else
+            return process<FORMAT, INTERPOLATION, false>(dest, size, from, to);
+    }
+
+    //-----------------------------------------------------------------------
+
+    template<sf::sample_format_t FORMAT, interpolation_mode_t INTERPOLATION, bool LOOPING>
+    bool Sampler::process(float* dest, size_t size, uint64_t from, uint64_t to)
+    {
+        // Number of points needed before and after the current position
+        constexpr uint32_t BEFORE = (INTERPOLATION == INTERPOLATION_MODE_CUBIC ? 1 :
+                                     INTERPOLATION == INTERPOLATION_MODE_SINC ? SINC_TAPS / 2 - 1 :
+                                     0);
+        constexpr uint32_t AFTER = (INTERPOLATION == INTERPOLATION_MODE_CUBIC ? 2 :
+                                    INTERPOLATION == INTERPOLATION_MODE_SINC ? SINC_TAPS / 2 :
+                                    1);
+        constexpr uint32_t NB_POINTS = BEFORE + AFTER + 1;
+
+        const uint32_t loop_length = _loop_end - _loop_start;
+        const uint32_t limit = (LOOPING ? _loop_end : _end);
+
+        // The increment of each sample is the previous one plus 'step' (the unsigned
+        // additions wrap around for a negative step), and never exceeds 'max_increment'
+        const uint64_t step = (size > 0 ? uint64_t((int64_t(to) - int64_t(from)) / int64_t(size)) : 0);
+        const uint64_t max_increment = std::max(from, to);
+
+        // Kept in registers during the loops
+        uint64_t phase = _phase;
+        uint64_t increment = from;
+
+        float x[NB_POINTS];
+        size_t i = 0;
+
+        while (i < size)
+        {
+            const uint32_t index = uint32_t(phase >> 32);
+
+            if constexpr (!LOOPING)
+            {
+                if (index >= _end)
+                {
+                    _phase = phase;
+
+                    if (i == 0)
+                        return false;
+
+                    for (size_t j = i; j < size; ++j)
+                        dest[j] = 0.0f;
+
+                    return true;
+                }
+            }
+
+            // Number of samples that can be generated without any boundary check
+            size_t count = 0;
+
+            if ((index >= _start + BEFORE) && (uint64_t(index) + AFTER < limit))
+            {
+                const uint64_t bound = uint64_t(limit - AFTER) << 32;
+
+                if (max_increment > 0)
+                {
+                    count = std::min(
+                        size_t((bound - phase + max_increment - 1) / max_increment), size - i
+                    );
+                }
+                else
+                {
+                    count = size - i;
+                }
+            }
+
+            if (count > 0)
+            {
+                for (size_t n = 0; n < count; ++n, ++i)
+                {
+                    const uint32_t idx = uint32_t(phase >> 32) - BEFORE;
+
+                    for (uint32_t k = 0; k < NB_POINTS; ++k)
+                        x[k] = _buffer.get<FORMAT>(idx + k);
+
+                    dest[i] = interpolate<INTERPOLATION>(x, uint32_t(phase));
+                    increment += step;
+                    phase += increment;
+                }
+            }
+            else
+            {
+                // Near the boundaries: wrap around the loop and stay after the start
+                for (uint32_t k = 0; k < NB_POINTS; ++k)
+                {
+                    int64_t j = int64_t(index) + k - BEFORE;
+
+                    if constexpr (LOOPING)
+                    {
+                        while (j >= _loop_end)
+                            j -= loop_length;
+                    }
+
+                    if (j < _start)
+                        j = _start;
+
+                    x[k] = _buffer.get<FORMAT>(uint32_t(j));
+                }
+
+                dest[i] = interpolate<INTERPOLATION>(x, uint32_t(phase));
+                increment += step;
+                phase += increment;
+                ++i;
+            }
+
+            if constexpr (LOOPING)
+            {
+                if (phase >= (uint64_t(_loop_end) << 32))
+                    phase -= uint64_t(loop_length) << 32;
+            }
+        }
+
+        _phase = phase;
+
+        return true;
+    }
+
+    //-----------------------------------------------------------------------
+
+    template<interpolation_mode_t INTERPOLATION>
+    inline float Sampler::interpolate(const float* x, uint32_t fraction)
+    {
+        if constexpr (INTERPOLATION == INTERPOLATION_MODE_NEAREST)
+        {
+            return (fraction < 0x80000000u ? x[0] : x[1]);
+        }
+        else if constexpr (INTERPOLATION == INTERPOLATION_MODE_LINEAR)
+        {
+            const float a = float(fraction) * (1.0f / 4294967296.0f);
+            return x[0] + a * (x[1] - x[0]);
+        }
+        else if constexpr (INTERPOLATION == INTERPOLATION_MODE_CUBIC)
+        {
+            // 4-points, 3rd-order Hermite (Catmull-Rom)
+            const float t = float(fraction) * (1.0f / 4294967296.0f);
+
+            const float c1 = 0.5f * (x[2] - x[0]);
+            const float c2 = x[0] - 2.5f * x[1] + 2.0f * x[2] - 0.5f * x[3];
+            const float c3 = 0.5f * (x[3] - x[0]) + 1.5f * (x[1] - x[2]);
+
+            return ((c3 * t + c2) * t + c1) * t + x[1];
+        }
+        else
+        {
+            const float* coefficients =
+                sinc_table_t::instance().coefficients[fraction >> (32 - SINC_RESOLUTION_BITS)];
+
+            float result = 0.0f;
+            for (int k = 0; k < SINC_TAPS; ++k)
+                result += coefficients[k] * x[k];
+
+            return result;
+        }
+    }
+
+
+    /********************************* VOLUME ENVELOPE **********************************/
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Allows to generate a volume envelope
+    //------------------------------------------------------------------------------------
+    class VolumeEnvelope
+    {
+    public:
+        //--------------------------------------------------------------------------------
+        /// @brief  Constructor
+        ///
+        /// @param sample_rate  The sample rate of the synthesized signal
+        /// @param fast_math    Whether to use a fast approximation of the exponential
+        /// @param cutoff       The level below which the signal can't be heard anymore
+        //--------------------------------------------------------------------------------
+        VolumeEnvelope(
+            uint32_t sample_rate, bool fast_math = false, float cutoff = NON_AUDIBLE
+        );
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Starts a new envelope
+        ///
+        /// Must be called when the key is pressed, before 'process()', to define the
+        /// shape of the envelope.
+        //--------------------------------------------------------------------------------
+        void start(
+            float delay, float attack, float hold, float decay, float sustain,
+            float release
+        );
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Must be called when the key is released
+        //--------------------------------------------------------------------------------
+        void release();
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Update the value of the envelope
+        ///
+        /// @param nb_samples   The number of samples to process during this update
+        /// @return True if the envelope still allows the signal to be heard
+        //--------------------------------------------------------------------------------
+        bool process(uint32_t nb_samples);
+
+        inline float getValue() const
+        {
+            return value;
+        }
+
+        inline float getPriority() const
+        {
+            return priority;
+        }
+
+
+    private:
+        float segmentFactor(float slope, uint32_t nb_samples);
+
+
+        //_____ Attributes __________
+    private:
+        uint32_t sample_rate;
+        bool fast_math;
+        float cutoff;
+
+        // Slopes, per sample (the exponential ones in the log domain)
+        float attack_slope;
+        float decay_slope;
+        float release_slope;
+
+        // Starts of the stages, in samples
+        double attack_start;
+        double hold_start;
+        double decay_start;
+    
+        float sustain_level;
+        float release_level;
+    
+        uint64_t nb_processed_samples;
+        envelope_stage_t stage;
+
+        // State of the exponential segments (decay and release): the current level,
+        // multiplied at each update by the factor corresponding to the number of samples
+        float level;
+        float factor;
+        uint32_t factor_nb_samples;
+
+        float value;
+        float priority;
+    };
+
+    //-----------------------------------------------------------------------
+
+    VolumeEnvelope::VolumeEnvelope(uint32_t sample_rate, bool fast_math, float cutoff)
+    : sample_rate(sample_rate), fast_math(fast_math), cutoff(cutoff)
+    {
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VolumeEnvelope::start(
+        float delay, float attack, float hold, float decay, float sustain,
+        float release
+    )
+    {
+        attack_slope = 1.0f / (attack * sample_rate);
+        decay_slope = -9.226f / (decay * sample_rate);
+        release_slope = -9.226f / (release * sample_rate);
+
+        attack_start = double(delay) * sample_rate;
+        hold_start = attack_start + double(attack) * sample_rate;
+        decay_start = hold_start + double(hold) * sample_rate;
+
+        sustain_level = clamp(sustain, 0.0f, 1.0f);
+        release_level = 0.0f;
+
+        nb_processed_samples = 0;
+        stage = ENV_STAGE_DELAY;
+        value = 0.0f;
+
+        level = 1.0f;
+        factor_nb_samples = 0;
+
+        process(0);
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VolumeEnvelope::release()
+    {
+        stage = ENV_STAGE_RELEASE;
+        release_level = value;
+
+        level = 1.0f;
+        factor_nb_samples = 0;
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool VolumeEnvelope::process(uint32_t nb_samples)
+    {
+        nb_processed_samples += nb_samples;
+
+        const double current = double(nb_processed_samples);
+
+        // Change stage if necessary
+        while (stage <= ENV_STAGE_HOLD)
+        {
+            double end;
+
+            switch (stage)
+            {
+                case ENV_STAGE_DELAY: end = attack_start; break;
+                case ENV_STAGE_ATTACK: end = hold_start; break;
+                case ENV_STAGE_HOLD: end = decay_start; break;
+                default: return false;
+            }
+
+            if (current < end)
+                break;
+
+            stage = envelope_stage_t(int(stage) + 1);
+
+            // Start of the exponential segment, somewhere in the last update
+            if (stage == ENV_STAGE_DECAY)
+            {
+                float x = decay_slope * float(current - decay_start);
+                level = (fast_math ? fast_exp_cutoff(x) : exp_cutoff(x));
+                factor_nb_samples = 0;
+                nb_samples = 0;
+            }
+        }
+
+        // Compute the envelope value at current stage
+        switch (stage)
+        {
+            case ENV_STAGE_DELAY:
+                value = 0.0f;
+                priority = 3.0;
+                return true;
+            
+            case ENV_STAGE_ATTACK:
+                value = attack_slope * float(current - attack_start);
+                priority = 3.0 - value;
+                return true;
+            
+            case ENV_STAGE_HOLD:
+                value = 1.0;
+                priority = 2.0;
+                return true;
+
+            case ENV_STAGE_DECAY:
+            {
+                // Once the sustain level is reached, the level doesn't matter anymore
+                if ((nb_samples > 0) && (level > sustain_level))
+                    level *= segmentFactor(decay_slope, nb_samples);
+
+                value = fmax(level, sustain_level);
+                priority = 1.0 + value;
+                return (value > cutoff);
+            }
+
+            case ENV_STAGE_RELEASE:
+            {
+                if (nb_samples > 0)
+                    level *= segmentFactor(release_slope, nb_samples);
+
+                value = release_level * level;
+                priority = value;
+                return (value > cutoff);
+            }
+        }
+
+        return false;
+    }
+
+    //-----------------------------------------------------------------------
+
+    float VolumeEnvelope::segmentFactor(float slope, uint32_t nb_samples)
+    {
+        // The updates are usually done by blocks of the same size, so the factor is
+        // only computed at the start of the segment
+        if (nb_samples != factor_nb_samples)
+        {
+            float x = slope * float(nb_samples);
+            factor = (fast_math ? fast_exp2(float(M_LOG2E) * x) : exp(x));
+            factor_nb_samples = nb_samples;
+        }
+
+        // Same cutoff than 'exp_cutoff()' (unless the voices are stopped at a lower
+        // level), and no denormals
+        if (level * factor < std::min(cutoff, NON_AUDIBLE))
+            return 0.0f;
+
+        return factor;
+    }
+
+
+    /******************************* MODULATION ENVELOPE ********************************/
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Allows to generate a modulation envelope
+    //------------------------------------------------------------------------------------
+    class ModulationEnvelope
+    {
+    public:
+        //--------------------------------------------------------------------------------
+        /// @brief  Constructor
+        ///
+        /// @param sample_rate  The sample rate of the synthesized signal
+        //--------------------------------------------------------------------------------
+        ModulationEnvelope(uint32_t sample_rate);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Starts a new envelope
+        ///
+        /// Must be called when the key is pressed, before 'process()', to define the
+        /// shape of the envelope.
+        //--------------------------------------------------------------------------------
+        void start(
+            float delay, float attack, float hold, float decay, float sustain,
+            float release
+        );
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Must be called when the key is released
+        //--------------------------------------------------------------------------------
+        void release();
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Update the value of the envelope
+        ///
+        /// @param nb_samples   The number of samples to process during this update
+        /// @return True if the envelope still allows the signal to be heard
+        //--------------------------------------------------------------------------------
+        bool process(uint32_t nb_samples);
+
+        inline float getValue() const
+        {
+            return value;
+        }
+
+
+        //_____ Attributes __________
+    private:
+        uint32_t sample_rate;
+
+        // Slopes, per sample
+        float attack_slope;
+        float decay_slope;
+        float release_slope;
+
+        // Starts and ends of the stages, in samples
+        double attack_start;
+        double hold_start;
+        double decay_start;
+
+        double decay_end;
+        double release_end;
+    
+        float sustain_level;
+        float release_level;
+    
+        uint64_t nb_processed_samples;
+        envelope_stage_t stage;
+
+        float value;
+    };
+
+    //-----------------------------------------------------------------------
+
+    ModulationEnvelope::ModulationEnvelope(uint32_t sample_rate)
+    : sample_rate(sample_rate)
+    {
+    }
+
+    //-----------------------------------------------------------------------
+
+    void ModulationEnvelope::start(
+        float delay, float attack, float hold, float decay, float sustain,
+        float release
+    )
+    {
+        attack_slope = 1.0f / (attack * sample_rate);
+        decay_slope = 1.0f / (decay * sample_rate);
+        release_slope = 1.0f / (release * sample_rate);
+
+        attack_start = double(delay) * sample_rate;
+        hold_start = attack_start + double(attack) * sample_rate;
+        decay_start = hold_start + double(hold) * sample_rate;
+
+        decay_end = decay_start + double(decay) * sample_rate;
+        release_end = double(release) * sample_rate;
+
+        sustain_level = clamp(sustain, 0.0f, 1.0f);
+        release_level = 0.0f;
+
+        nb_processed_samples = 0;
+        stage = ENV_STAGE_DELAY;
+        value = 0.0f;
+
+        process(0);
+    }
+
+    //-----------------------------------------------------------------------
+
+    void ModulationEnvelope::release()
+    {
+        stage = ENV_STAGE_RELEASE;
+        release_end += double(nb_processed_samples);
+        release_level = value;
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool ModulationEnvelope::process(uint32_t nb_samples)
+    {
+        nb_processed_samples += nb_samples;
+
+        const double current = double(nb_processed_samples);
+
+        // Change stage if necessary
+        while (stage <= ENV_STAGE_HOLD)
+        {
+            double end;
+
+            switch (stage)
+            {
+                case ENV_STAGE_DELAY: end = attack_start; break;
+                case ENV_STAGE_ATTACK: end = hold_start; break;
+                case ENV_STAGE_HOLD: end = decay_start; break;
+                default: return false;
+            }
+
+            if (current < end)
+                break;
+
+            stage = envelope_stage_t(int(stage) + 1);
+        }
+
+        // Compute the envelope value at current stage
+        switch (stage)
+        {
+            case ENV_STAGE_DELAY:
+                value = 0.0f;
+                return true;
+            
+            case ENV_STAGE_ATTACK:
+                value = attack_slope * float(current - attack_start);
+                return true;
+            
+            case ENV_STAGE_HOLD:
+                value = 1.0;
+                return true;
+
+            case ENV_STAGE_DECAY:
+                value = fmax(
+                    decay_slope * float(decay_end - current),
+                    sustain_level
+                );
+                return (value > NON_AUDIBLE);
+
+            case ENV_STAGE_RELEASE:
+                value = fmax(
+                    release_level * release_slope * float(release_end - current),
+                    0.0f
+                );
+                return (value > NON_AUDIBLE);
+        }
+
+        return false;
+    }
+
+
+    /*************************************** LFO ****************************************/
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Low frequency oscillator
+    //------------------------------------------------------------------------------------
+    class Lfo
+    {
+    public:
+        Lfo(const SynthesizerSettings& settings);
+
+        void start(float delay, float frequency);
+
+        void process();
+        void process(uint32_t nb_samples);
+
+        inline float value()
+        {
+            return _value;
+        }
+    
+
+        //_____ Attributes __________
+    private:
+        uint32_t _sample_rate;
+        uint32_t _block_size;
+
+        bool _active;
+        double _remaining_delay;    // In samples
+        double _frequency;          // In cycles per sample
+
+        // Phase accumulator, one cycle being 2^64 (precise enough for notes held for
+        // hours)
+        uint64_t _phase;
+        uint64_t _increment;
+
+        float _value;
+    };
+
+    //-----------------------------------------------------------------------
+
+    Lfo::Lfo(const SynthesizerSettings& settings)
+    : _sample_rate(settings.sampleRate()), _block_size(settings.blockSize())
+    {
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Lfo::start(float delay, float frequency)
+    {
+        if (frequency > 0.001f)
+        {
+            _active = true;
+
+            _remaining_delay = double(delay) * _sample_rate;
+            _frequency = double(frequency) / _sample_rate;
+
+            _phase = 0;
+            _increment = uint64_t(ldexp(_frequency - floor(_frequency), 64));
+
+            _value = 0.0f;
+        }
+        else
+        {
+            _active = false;
+            _value = 0.0f;
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Lfo::process()
+    {
+        process(_block_size);
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Lfo::process(uint32_t nb_samples)
+    {
+        if (!_active)
+            return;
+
+        if (_remaining_delay > 0.0)
+        {
+            _remaining_delay -= nb_samples;
+
+            if (_remaining_delay > 0.0)
+            {
+                _value = 0.0f;
+                return;
+            }
+
+            // The oscillation started during this update
+            double phase = -_remaining_delay * _frequency;
+            _phase = uint64_t(ldexp(phase - floor(phase), 32)) << 32;
+        }
+        else
+        {
+            // Wraps around at the end of each cycle
+            _phase += nb_samples * _increment;
+        }
+
+        float phase = float(_phase >> 40) * (1.0f / 16777216.0f);
+
+        if (phase < 0.25f)
+            _value = 4.0f * phase;
+        else if (phase < 0.75f)
+            _value = 4.0f * (0.5f - phase);
+        else
+            _value = 4.0f * (phase - 1.0f);
+    }
+
+
+    /*********************************** BIQUADFILTER ***********************************/
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Bi-quad filter
+    //------------------------------------------------------------------------------------
+    class BiQuadFilter
+    {
+    public:
+        BiQuadFilter(const SynthesizerSettings& settings);
+
+        void clearBuffer();
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Sets the parameters of the low-pass filter
+        ///
+        /// The coefficients aren't recomputed for a change of the cutoff frequency below
+        /// one cent. When they change, the next block goes from the previous cutoff
+        /// frequency to the new one (linearly in cents): the coefficients are computed
+        /// every `RAMP_STEP` samples, and interpolated one sample at a time in-between.
+        //--------------------------------------------------------------------------------
+        void setLowPassFilter(float cutoff_frequency, float resonance);
+
+        void process(float* block, size_t size);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Process the blocks of several filters, several of them at the same
+        ///         time (one per SIMD lane)
+        ///
+        /// The results are identical to calling `process()` on each filter.
+        //--------------------------------------------------------------------------------
+        static void process(
+            BiQuadFilter* const* filters, float* const* blocks, size_t nb_filters,
+            size_t size
+        );
+
+        inline bool active() const
+        {
+            return _active;
+        }
+
+    private:
+        void computeCoefficients(float cutoff_frequency, float resonance, float* a) const;
+
+        // Coefficients at a position of the transition from the previous parameters to
+        // the current ones, during a block of 'size' samples
+        void rampCoefficients(size_t position, size_t size, float* a) const;
+
+        template<bool RAMP>
+        void processActive(float* block, size_t size);
+
+#ifdef KNM_SYNTHESIZER_SIMD
+        template<bool RAMP>
+        static void processLanes(
+            BiQuadFilter* const* filters, float* const* blocks, size_t size
+        );
+#endif
+
+
+        //_____ Constants __________
+    private:
+        // 1 - 1 / sqrt(2)
+        static constexpr float RESONANCE_PEAK_OFFSET = 0.29289322f;
+
+        // One cent
+        static constexpr float CUTOFF_TOLERANCE = 0.0005778f;
+
+        static const size_t NB_COEFFICIENTS = 5;
+
+        // Number of samples between two computations of the coefficients during a
+        // transition (also the number of samples processed at a time by
+        // 'processLanes()')
+        static constexpr size_t RAMP_STEP = 64;
+
+
+        //_____ Attributes __________
+    private:
+        uint32_t _sample_rate;
+        bool _fast_math;
+
+        bool _active = false;
+
+        // Parameters used to compute the current coefficients
+        float _cutoff = 0.0f;
+        float _resonance = 0.0f;
+
+        float _a[NB_COEFFICIENTS];
+
+        // The coefficients (and their parameters) used by the last block, when the next
+        // one must go from them to the new ones
+        float _previous_a[NB_COEFFICIENTS];
+        float _previous_cutoff = 0.0f;
+        float _previous_resonance = 0.0f;
+        bool _ramp = false;
+        bool _in_use = false;
+    
+        float _x1;
+        float _x2;
+        float _y1;
+        float _y2;
+    };
+
+    //-----------------------------------------------------------------------
+
+    BiQuadFilter::BiQuadFilter(const SynthesizerSettings& settings)
+    : _sample_rate(settings.sampleRate()), _fast_math(settings.fastMathEnabled())
+    {
+    }
+
+    //-----------------------------------------------------------------------
+
+    void BiQuadFilter::clearBuffer()
+    {
+        _x1 = 0.0f;
+        _x2 = 0.0f;
+        _y1 = 0.0f;
+        _y2 = 0.0f;
+
+        // A new sound: no transition from the previous coefficients
+        _cutoff = 0.0f;
+        _ramp = false;
+        _in_use = false;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void BiQuadFilter::setLowPassFilter(float cutoff_frequency, float resonance)
+    {
+        if (cutoff_frequency < 0.499f * _sample_rate)
+        {
+            if (_active && (resonance == _resonance) &&
+                (fabsf(cutoff_frequency - _cutoff) <= CUTOFF_TOLERANCE * _cutoff))
+            {
+                return;
+            }
+
+            if (_active && _in_use && !_ramp)
+            {
+                memcpy(_previous_a, _a, sizeof(_a));
+                _previous_cutoff = _cutoff;
+                _previous_resonance = _resonance;
+                _ramp = true;
+            }
+
+            _active = true;
+            _cutoff = cutoff_frequency;
+            _resonance = resonance;
+
+            computeCoefficients(cutoff_frequency, resonance, _a);
+        }
+        else
+        {
+            _active = false;
+            _ramp = false;
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    void BiQuadFilter::computeCoefficients(
+        float cutoff_frequency, float resonance, float* a
+    ) const
+    {
+        // This equation gives the Q value which makes the desired resonance peak.
+        // The error of the resultant peak height is less than 3%.
+        float q = resonance - RESONANCE_PEAK_OFFSET / (1.0f + 6.0f * (resonance - 1.0f));
+
+        float w = 2.0f * M_PI * cutoff_frequency / _sample_rate;
+
+        float cosw;
+        float sinw;
+
+        if (_fast_math)
+        {
+            // From the half angle (in [0, pi/2[), which keeps 1 - cos(w) precise
+            // for the low cutoff frequencies
+            float sin_half = fast_sin(0.5f * w);
+            float cos_half = fast_cos(0.5f * w);
+
+            cosw = 1.0f - 2.0f * sin_half * sin_half;
+            sinw = 2.0f * sin_half * cos_half;
+        }
+        else
+        {
+            cosw = cos(w);
+            sinw = sin(w);
+        }
+
+        float alpha = sinw / (2.0f * q);
+
+        float b0 = (1.0f - cosw) / 2.0f;
+        float b1 = 1.0f - cosw;
+        float b2 = (1.0f - cosw) / 2.0f;
+        float a0 = 1.0f + alpha;
+        float a1 = -2.0f * cosw;
+        float a2 = 1.0f - alpha;
+
+        a[0] = b0 / a0;
+        a[1] = b1 / a0;
+        a[2] = b2 / a0;
+        a[3] = a1 / a0;
+        a[4] = a2 / a0;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void BiQuadFilter::rampCoefficients(size_t position, size_t size, float* a) const
+    {
+        if (position >= size)
+        {
+            memcpy(a, _a, sizeof(_a));
+            return;
+        }
+
+        const float t = float(position) / float(size);
+        const float octaves = t * log2f(_cutoff / _previous_cutoff);
+
+        computeCoefficients(
+            _previous_cutoff * (_fast_math ? fast_exp2(octaves) : exp2f(octaves)),
+            _previous_resonance + t * (_resonance - _previous_resonance),
+            a
+        );
+    }
+
+    //-----------------------------------------------------------------------
+
+    void BiQuadFilter::process(float* block, size_t size)
+    {
+        if (size == 0)
+            return;
+
+        if (_active)
+        {
+            if (_ramp)
+                processActive<true>(block, size);
+            else
+                processActive<false>(block, size);
+
+            _ramp = false;
+            _in_use = true;
+        }
+        else
+        {
+            // The blocks can be as small as one sample (see `Synthesizer::render()`)
+            _x2 = (size >= 2 ? block[size - 2] : _x1);
+            _x1 = block[size - 1];
+            _y2 = _x2;
+            _y1 = _x1;
+
+            _in_use = false;
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    void BiQuadFilter::process(
+        BiQuadFilter* const* filters, float* const* blocks, size_t nb_filters, size_t size
+    )
+    {
+        size_t nb_full = 0;
+
+#ifdef KNM_SYNTHESIZER_SIMD
+        // The filters filling all the lanes, the remaining ones are processed one by one
+        if (size > 0)
+            nb_full = nb_filters - nb_filters % SIMD_WIDTH;
+
+        for (size_t i = 0; i < nb_full; i += SIMD_WIDTH)
+        {
+            bool active = true;
+            bool ramp = false;
+
+            for (size_t lane = 0; lane < SIMD_WIDTH; ++lane)
+            {
+                active = active && filters[i + lane]->_active;
+                ramp = ramp || filters[i + lane]->_ramp;
+            }
+
+            if (!active)
+            {
+                for (size_t lane = 0; lane < SIMD_WIDTH; ++lane)
+                    filters[i + lane]->process(blocks[i + lane], size);
+
+                continue;
+            }
+
+            if (ramp)
+                processLanes<true>(filters + i, blocks + i, size);
+            else
+                processLanes<false>(filters + i, blocks + i, size);
+
+            for (size_t lane = 0; lane < SIMD_WIDTH; ++lane)
+            {
+                filters[i + lane]->_ramp = false;
+                filters[i + lane]->_in_use = true;
+            }
+        }
+#endif
+
+        for (size_t i = nb_full; i < nb_filters; ++i)
+            filters[i]->process(blocks[i], size);
+    }
+
+    //-----------------------------------------------------------------------
+
+    template<bool RAMP>
+    void BiQuadFilter::processActive(float* block, size_t size)
+    {
+        // Local copies: the writes to the block could alias the attributes, which
+        // would otherwise be stored and reloaded at each sample
+        float a[NB_COEFFICIENTS];
+        float from[NB_COEFFICIENTS];
+        float to[NB_COEFFICIENTS];
+        float step[NB_COEFFICIENTS];
+
+        memcpy(a, _a, sizeof(_a));
+
+        if constexpr (RAMP)
+            memcpy(from, _previous_a, sizeof(_previous_a));
+
+        float x1 = _x1;
+        float x2 = _x2;
+        float y1 = _y1;
+        float y2 = _y2;
+
+        // During a transition, the coefficients are interpolated between the ones
+        // computed every 'RAMP_STEP' samples
+        size_t count;
+        for (size_t start = 0; start < size; start += count)
+        {
+            count = (RAMP ? std::min(RAMP_STEP, size - start) : size);
+
+            if constexpr (RAMP)
+            {
+                rampCoefficients(start + count, size, to);
+
+                for (size_t k = 0; k < NB_COEFFICIENTS; ++k)
+                    step[k] = (to[k] - from[k]) / float(count);
+            }
+
+            for (size_t t = 0; t < count; ++t)
+            {
+                if constexpr (RAMP)
+                {
+                    for (size_t k = 0; k < NB_COEFFICIENTS; ++k)
+                        a[k] = from[k] + step[k] * float(t + 1);
+                }
+
+                float input = block[start + t];
+                float output = a[0] * input + a[1] * x1 + a[2] * x2 - a[3] * y1 - a[4] * y2;
+
+                x2 = x1;
+                x1 = input;
+                y2 = y1;
+                y1 = output;
+
+                block[start + t] = output;
+            }
+
+            if constexpr (RAMP)
+                memcpy(from, to, sizeof(to));
+        }
+
+        _x1 = x1;
+        _x2 = x2;
+        _y1 = y1;
+        _y2 = y2;
+    }
+
+    //-----------------------------------------------------------------------
+
+#ifdef KNM_SYNTHESIZER_SIMD
+    template<bool RAMP>
+    void BiQuadFilter::processLanes(
+        BiQuadFilter* const* filters, float* const* blocks, size_t size
+    )
+    {
+        // Number of samples transposed at a time, one lane per filter (during a
+        // transition, the coefficients are computed for each chunk)
+        const size_t CHUNK_SIZE = RAMP_STEP;
+
+        float lanes[SIMD_WIDTH];
+
+        auto gather = [&](auto member) {
+            for (size_t lane = 0; lane < SIMD_WIDTH; ++lane)
+                lanes[lane] = member(filters[lane]);
+            return simd_load(lanes);
+        };
+
+        simd_t a[NB_COEFFICIENTS];
+        simd_t from[NB_COEFFICIENTS];
+        simd_t step[NB_COEFFICIENTS];
+
+        // Coefficients of each lane at the start and at the end of a chunk, during a
+        // transition (the non-ramping lanes use their current coefficients in both)
+        float lanes_from[SIMD_WIDTH][NB_COEFFICIENTS];
+        float lanes_to[SIMD_WIDTH][NB_COEFFICIENTS];
+
+        for (size_t k = 0; k < NB_COEFFICIENTS; ++k)
+            a[k] = gather([k](BiQuadFilter* f) { return f->_a[k]; });
+
+        if constexpr (RAMP)
+        {
+            for (size_t lane = 0; lane < SIMD_WIDTH; ++lane)
+            {
+                const BiQuadFilter* filter = filters[lane];
+                const float* coefficients = (filter->_ramp ? filter->_previous_a : filter->_a);
+                memcpy(lanes_from[lane], coefficients, sizeof(filter->_a));
+            }
+        }
+
+        simd_t x1 = gather([](BiQuadFilter* f) { return f->_x1; });
+        simd_t x2 = gather([](BiQuadFilter* f) { return f->_x2; });
+        simd_t y1 = gather([](BiQuadFilter* f) { return f->_y1; });
+        simd_t y2 = gather([](BiQuadFilter* f) { return f->_y2; });
+
+        float interleaved[CHUNK_SIZE * SIMD_WIDTH];
+
+        for (size_t start = 0; start < size; start += CHUNK_SIZE)
+        {
+            const size_t count = std::min(CHUNK_SIZE, size - start);
+
+            for (size_t lane = 0; lane < SIMD_WIDTH; ++lane)
+            {
+                const float* block = blocks[lane] + start;
+                for (size_t t = 0; t < count; ++t)
+                    interleaved[t * SIMD_WIDTH + lane] = block[t];
+            }
+
+            if constexpr (RAMP)
+            {
+                // Same computation than 'processActive()'
+                for (size_t lane = 0; lane < SIMD_WIDTH; ++lane)
+                {
+                    const BiQuadFilter* filter = filters[lane];
+
+                    if (filter->_ramp)
+                        filter->rampCoefficients(start + count, size, lanes_to[lane]);
+                    else
+                        memcpy(lanes_to[lane], filter->_a, sizeof(filter->_a));
+                }
+
+                for (size_t k = 0; k < NB_COEFFICIENTS; ++k)
+                {
+                    for (size_t lane = 0; lane < SIMD_WIDTH; ++lane)
+                        lanes[lane] = lanes_from[lane][k];
+                    from[k] = simd_load(lanes);
+
+                    for (size_t lane = 0; lane < SIMD_WIDTH; ++lane)
+                        lanes[lane] = (lanes_to[lane][k] - lanes_from[lane][k]) / float(count);
+                    step[k] = simd_load(lanes);
+                }
+
+                memcpy(lanes_from, lanes_to, sizeof(lanes_to));
+            }
+
+            for (size_t t = 0; t < count; ++t)
+            {
+                if constexpr (RAMP)
+                {
+                    const simd_t index = simd_set(float(t + 1));
+                    for (size_t k = 0; k < NB_COEFFICIENTS; ++k)
+                        a[k] = simd_add(from[k], simd_mul(step[k], index));
+                }
+
+                simd_t input = simd_load(interleaved + t * SIMD_WIDTH);
+
+                simd_t output = simd_add(simd_mul(a[0], input), simd_mul(a[1], x1));
+                output = simd_add(output, simd_mul(a[2], x2));
+                output = simd_sub(output, simd_mul(a[3], y1));
+                output = simd_sub(output, simd_mul(a[4], y2));
+
+                x2 = x1;
+                x1 = input;
+                y2 = y1;
+                y1 = output;
+
+                simd_store(interleaved + t * SIMD_WIDTH, output);
+            }
+
+            for (size_t lane = 0; lane < SIMD_WIDTH; ++lane)
+            {
+                float* block = blocks[lane] + start;
+                for (size_t t = 0; t < count; ++t)
+                    block[t] = interleaved[t * SIMD_WIDTH + lane];
+            }
+        }
+
+        auto scatter = [&](simd_t value, auto member) {
+            simd_store(lanes, value);
+            for (size_t lane = 0; lane < SIMD_WIDTH; ++lane)
+                member(filters[lane]) = lanes[lane];
+        };
+
+        scatter(x1, [](BiQuadFilter* f) -> float& { return f->_x1; });
+        scatter(x2, [](BiQuadFilter* f) -> float& { return f->_x2; });
+        scatter(y1, [](BiQuadFilter* f) -> float& { return f->_y1; });
+        scatter(y2, [](BiQuadFilter* f) -> float& { return f->_y2; });
+    }
+#endif
+
+    //-----------------------------------------------------------------------
+
+    /************************************** REVERB **************************************/
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Freeverb-style reverb: 8 parallel comb filters followed by 4 all-pass
+    ///         filters, for each side
+    //------------------------------------------------------------------------------------
+    class Reverb
+    {
+        //_____ Internal types __________
+    private:
+        struct comb_t
+        {
+            std::vector<float> buffer;
+            size_t index = 0;
+            float filter_store = 0.0f;
+        };
+
+        struct allpass_t
+        {
+            std::vector<float> buffer;
+            size_t index = 0;
+        };
+
+
+    public:
+        Reverb(uint32_t sample_rate);
+
+        void clear();
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Process a block, writing the reverberated signal in 'left' and 'right'
+        ///
+        /// 'has_input' indicates if there is something in 'input', when it is false the
+        /// content of 'input' isn't used (only the tail of the reverb is rendered).
+        //--------------------------------------------------------------------------------
+        void process(
+            const float* input, bool has_input, float* left, float* right, size_t size
+        );
+
+        inline bool idle() const
+        {
+            return _remaining_tail == 0;
+        }
+
+    private:
+        void processComb(comb_t& comb, const float* input, float* output, size_t size);
+        void processAllPass(allpass_t& allpass, float* block, size_t size);
+
+
+        //_____ Constants __________
+    private:
+        static const int NB_COMBS = 8;
+        static const int NB_ALLPASSES = 4;
+        static const int STEREO_SPREAD = 23;
+
+        static constexpr float FIXED_GAIN = 0.015f;
+        static constexpr float ROOM_SIZE = 0.5f * 0.28f + 0.7f;
+        static constexpr float DAMPING = 0.5f * 0.4f;
+        static constexpr float ALLPASS_FEEDBACK = 0.5f;
+
+        // Tunings at 44100 Hz
+        static constexpr int COMB_TUNINGS[NB_COMBS] = { 1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617 };
+        static constexpr int ALLPASS_TUNINGS[NB_ALLPASSES] = { 556, 441, 341, 225 };
+
+
+        //_____ Attributes __________
+    private:
+        comb_t _combs_left[NB_COMBS];
+        comb_t _combs_right[NB_COMBS];
+        allpass_t _allpasses_left[NB_ALLPASSES];
+        allpass_t _allpasses_right[NB_ALLPASSES];
+
+        size_t _tail_length;
+        size_t _remaining_tail = 0;
+    };
+
+    //-----------------------------------------------------------------------
+
+    Reverb::Reverb(uint32_t sample_rate)
+    {
+        float factor = float(sample_rate) / 44100.0f;
+
+        size_t longest_comb = 0;
+        size_t allpasses_length = 0;
+
+        for (int i = 0; i < NB_COMBS; ++i)
+        {
+            _combs_left[i].buffer.resize(size_t(factor * COMB_TUNINGS[i]));
+            _combs_right[i].buffer.resize(size_t(factor * (COMB_TUNINGS[i] + STEREO_SPREAD)));
+            longest_comb = std::max(longest_comb, _combs_right[i].buffer.size());
+        }
+
+        for (int i = 0; i < NB_ALLPASSES; ++i)
+        {
+            _allpasses_left[i].buffer.resize(size_t(factor * ALLPASS_TUNINGS[i]));
+            _allpasses_right[i].buffer.resize(size_t(factor * (ALLPASS_TUNINGS[i] + STEREO_SPREAD)));
+            allpasses_length += _allpasses_right[i].buffer.size();
+        }
+
+        // Number of samples needed by the feedback of the combs to decrease the signal
+        // by 120 dB once the input is silent
+        size_t nb_loops = size_t(ceil(log(1.0e-6) / log(ROOM_SIZE)));
+        _tail_length = nb_loops * longest_comb + allpasses_length;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Reverb::clear()
+    {
+        for (int i = 0; i < NB_COMBS; ++i)
+        {
+            std::fill(_combs_left[i].buffer.begin(), _combs_left[i].buffer.end(), 0.0f);
+            std::fill(_combs_right[i].buffer.begin(), _combs_right[i].buffer.end(), 0.0f);
+            _combs_left[i].filter_store = 0.0f;
+            _combs_right[i].filter_store = 0.0f;
+        }
+
+        for (int i = 0; i < NB_ALLPASSES; ++i)
+        {
+            std::fill(_allpasses_left[i].buffer.begin(), _allpasses_left[i].buffer.end(), 0.0f);
+            std::fill(_allpasses_right[i].buffer.begin(), _allpasses_right[i].buffer.end(), 0.0f);
+        }
+
+        _remaining_tail = 0;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Reverb::process(
+        const float* input, bool has_input, float* left, float* right, size_t size
+    )
+    {
+        if (has_input)
+        {
+            _remaining_tail = _tail_length;
+        }
+        else if (_remaining_tail <= size)
+        {
+            // The tail is over: reset the filters, so no denormal value is left in them
+            clear();
+            memset((char*) left, 0, size * sizeof(float));
+            memset((char*) right, 0, size * sizeof(float));
+            return;
+        }
+        else
+        {
+            _remaining_tail -= size;
+            input = nullptr;
+        }
+
+        memset((char*) left, 0, size * sizeof(float));
+        memset((char*) right, 0, size * sizeof(float));
+
+        // Each filter processes the whole block at once
+        for (int i = 0; i < NB_COMBS; ++i)
+        {
+            processComb(_combs_left[i], input, left, size);
+            processComb(_combs_right[i], input, right, size);
+        }
+
+        for (int i = 0; i < NB_ALLPASSES; ++i)
+        {
+            processAllPass(_allpasses_left[i], left, size);
+            processAllPass(_allpasses_right[i], right, size);
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Reverb::processComb(comb_t& comb, const float* input, float* output, size_t size)
+    {
+        float* buffer = comb.buffer.data();
+        size_t length = comb.buffer.size();
+        size_t index = comb.index;
+        float filter_store = comb.filter_store;
+
+        for (int t = 0; t < size; ++t)
+        {
+            float value = buffer[index];
+            output[t] += value;
+
+            filter_store = value * (1.0f - DAMPING) + filter_store * DAMPING;
+            buffer[index] = filter_store * ROOM_SIZE + (input ? input[t] * FIXED_GAIN : 0.0f);
+
+            if (++index == length)
+                index = 0;
+        }
+
+        comb.index = index;
+        comb.filter_store = filter_store;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Reverb::processAllPass(allpass_t& allpass, float* block, size_t size)
+    {
+        float* buffer = allpass.buffer.data();
+        size_t length = allpass.buffer.size();
+        size_t index = allpass.index;
+
+        for (int t = 0; t < size; ++t)
+        {
+            float value = buffer[index];
+            float input = block[t];
+
+            block[t] = value - input;
+            buffer[index] = input + value * ALLPASS_FEEDBACK;
+
+            if (++index == length)
+                index = 0;
+        }
+
+        allpass.index = index;
+    }
+
+
+    /************************************** CHORUS **************************************/
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Stereo chorus: a modulated delay line for each side, with the modulations
+    ///         of both sides in quadrature
+    //------------------------------------------------------------------------------------
+    class Chorus
+    {
+    public:
+        Chorus(uint32_t sample_rate);
+
+        void clear();
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Process a block, writing the delayed (wet) signal in 'left' and 'right'
+        ///
+        /// 'has_input' indicates if there is something in the inputs, when it is false
+        /// their content isn't used (only the remaining of the delay lines is rendered).
+        //--------------------------------------------------------------------------------
+        void process(
+            const float* input_left, const float* input_right, bool has_input,
+            float* left, float* right, size_t size
+        );
+
+        inline bool idle() const
+        {
+            return _remaining_tail == 0;
+        }
+
+    private:
+        void processLine(
+            std::vector<float>& line, const float* input, float delay_start,
+            float delay_end, float* output, size_t size
+        );
+
+
+        //_____ Constants __________
+    private:
+        static constexpr float DELAY = 0.002f;
+        static constexpr float DEPTH = 0.0019f;
+        static constexpr float FREQUENCY = 0.4f;
+
+
+        //_____ Attributes __________
+    private:
+        uint32_t _sample_rate;
+
+        std::vector<float> _line_left;
+        std::vector<float> _line_right;
+        size_t _index = 0;
+
+        // The modulation is computed at the boundaries of the blocks only, and linearly
+        // interpolated in between (its period is several orders of magnitude longer)
+        double _phase = 0.0;
+        double _phase_increment;
+
+        size_t _remaining_tail = 0;
+    };
+
+    //-----------------------------------------------------------------------
+
+    Chorus::Chorus(uint32_t sample_rate)
+    : _sample_rate(sample_rate)
+    {
+        size_t length = size_t(ceil(sample_rate * (DELAY + DEPTH))) + 2;
+        _line_left.resize(length);
+        _line_right.resize(length);
+
+        _phase_increment = 2.0 * M_PI * FREQUENCY / sample_rate;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Chorus::clear()
+    {
+        std::fill(_line_left.begin(), _line_left.end(), 0.0f);
+        std::fill(_line_right.begin(), _line_right.end(), 0.0f);
+        _remaining_tail = 0;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Chorus::process(
+        const float* input_left, const float* input_right, bool has_input,
+        float* left, float* right, size_t size
+    )
+    {
+        double next_phase = fmod(_phase + _phase_increment * size, 2.0 * M_PI);
+
+        if (has_input)
+        {
+            _remaining_tail = _line_left.size();
+        }
+        else if (_remaining_tail <= size)
+        {
+            clear();
+            memset((char*) left, 0, size * sizeof(float));
+            memset((char*) right, 0, size * sizeof(float));
+            _index = (_index + size) % _line_left.size();
+            _phase = next_phase;
+            return;
+        }
+        else
+        {
+            _remaining_tail -= size;
+            input_left = nullptr;
+            input_right = nullptr;
+        }
+
+        float delay_start_left = _sample_rate * (DELAY + DEPTH * sin(_phase));
+        float delay_end_left = _sample_rate * (DELAY + DEPTH * sin(next_phase));
+        float delay_start_right = _sample_rate * (DELAY + DEPTH * cos(_phase));
+        float delay_end_right = _sample_rate * (DELAY + DEPTH * cos(next_phase));
+
+        processLine(_line_left, input_left, delay_start_left, delay_end_left, left, size);
+        processLine(_line_right, input_right, delay_start_right, delay_end_right, right, size);
+
+        _index = (_index + size) % _line_left.size();
+        _phase = next_phase;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Chorus::processLine(
+        std::vector<float>& line, const float* input, float delay_start,
+        float delay_end, float* output, size_t size
+    )
+    {
+        float* buffer = line.data();
+        size_t length = line.size();
+        size_t index = _index;
+
+        float step = (delay_end - delay_start) / size;
+
+        for (int t = 0; t < size; ++t)
+        {
+            buffer[index] = (input ? input[t] : 0.0f);
+
+            float position = float(index) - (delay_start + step * t);
+            if (position < 0.0f)
+                position += length;
+
+            size_t index1 = size_t(position);
+            size_t index2 = (index1 + 1 == length ? 0 : index1 + 1);
+            float fraction = position - float(index1);
+
+            output[t] = buffer[index1] + fraction * (buffer[index2] - buffer[index1]);
+
+            if (++index == length)
+                index = 0;
+        }
+    }
+
+
+    /************************************ MODULATORS ************************************/
+
+    // Sources of the compiled modulators: the MIDI controllers use their number, the
+    // general controllers come after them
+    const uint8_t MOD_SOURCE_NONE = 128;
+    const uint8_t MOD_SOURCE_VELOCITY = 129;
+    const uint8_t MOD_SOURCE_KEY = 130;
+    const uint8_t MOD_SOURCE_POLY_PRESSURE = 131;
+    const uint8_t MOD_SOURCE_CHANNEL_PRESSURE = 132;
+    const uint8_t MOD_SOURCE_PITCH_WHEEL = 133;
+    const uint8_t MOD_SOURCE_PITCH_WHEEL_SENSITIVITY = 134;
+
+    //-----------------------------------------------------------------------
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Table of the curves of the modulator sources
+    ///
+    /// There is one curve for each combination of type, direction and polarity (indexed
+    /// by 'type * 4 + direction * 2 + polarity'), sampled at the 128 positions of a MIDI
+    /// controller (plus one, to interpolate up to the last position).
+    //------------------------------------------------------------------------------------
+    struct modulator_curves_t
+    {
+        static const int NB_CURVES = 16;
+
+        float values[NB_CURVES][129];
+
+        modulator_curves_t()
+        {
+            for (int curve = 0; curve < NB_CURVES; ++curve)
+            {
+                const int type = curve / 4;
+                const bool max_to_min = ((curve / 2) & 1) != 0;
+                const bool bipolar = (curve & 1) != 0;
+
+                for (int i = 0; i <= 128; ++i)
+                {
+                    double x = double(std::min(i, 127)) / 127.0;
+                    if (max_to_min)
+                        x = 1.0 - x;
+
+                    double y;
+                    switch (type)
+                    {
+                        case sf::MOD_SRC_TYPE_CONCAVE:
+                            y = (x >= 1.0 ? 1.0 : -20.0 / 96.0 * log10((1.0 - x) * (1.0 - x)));
+                            break;
+
+                        case sf::MOD_SRC_TYPE_CONVEX:
+                            y = (x <= 0.0 ? 0.0 : 1.0 + 20.0 / 96.0 * log10(x * x));
+                            break;
+
+                        case sf::MOD_SRC_TYPE_SWITCH:
+                            y = (x >= 0.5 ? 1.0 : 0.0);
+                            break;
+
+                        default:
+                            y = x;
+                            break;
+                    }
+
+                    y = std::clamp(y, 0.0, 1.0);
+                    values[curve][i] = float(bipolar ? 2.0 * y - 1.0 : y);
+                }
+            }
+        }
+
+        // 'position' must be in [0, 127]
+        inline float get(uint8_t curve, float position) const
+        {
+            const int index = int(position);
+            const float* v = values[curve];
+            return v[index] + (position - float(index)) * (v[index + 1] - v[index]);
+        }
+
+        static const modulator_curves_t& instance()
+        {
+            static const modulator_curves_t curves;
+            return curves;
+        }
+    };
+
+    //-----------------------------------------------------------------------
+
+    // A modulator, once compiled for a voice
+    struct modulator_op_t
+    {
+        float amount;
+        uint8_t source;
+        uint8_t source_curve;
+        uint8_t amount_source;
+        uint8_t amount_curve;
+        uint8_t parameter;
+        bool absolute;
+    };
+
+    //-----------------------------------------------------------------------
+
+    inline modulated_parameter_t modulated_parameter(sf::generator_type_t type)
+    {
+        switch (type)
+        {
+            case sf::GEN_TYPE_INITIAL_ATTENUATION: return MOD_PARAM_INITIAL_ATTENUATION;
+            case sf::GEN_TYPE_INITIAL_FILTER_Q: return MOD_PARAM_INITIAL_FILTER_Q;
+            case sf::GEN_TYPE_INITIAL_FILTER_CUTOFF_FREQUENCY: return MOD_PARAM_INITIAL_FILTER_CUTOFF;
+            case sf::GEN_TYPE_COARSE_TUNE: return MOD_PARAM_COARSE_TUNE;
+            case sf::GEN_TYPE_FINE_TUNE: return MOD_PARAM_FINE_TUNE;
+            case sf::GEN_TYPE_PAN: return MOD_PARAM_PAN;
+            case sf::GEN_TYPE_REVERB_EFFECTS_SEND: return MOD_PARAM_REVERB_SEND;
+            case sf::GEN_TYPE_CHORUS_EFFECTS_SEND: return MOD_PARAM_CHORUS_SEND;
+            case sf::GEN_TYPE_VIBRATO_LFO_TO_PITCH: return MOD_PARAM_VIBRATO_LFO_TO_PITCH;
+            case sf::GEN_TYPE_MODULATION_LFO_TO_PITCH: return MOD_PARAM_MODULATION_LFO_TO_PITCH;
+            case sf::GEN_TYPE_MODULATION_ENVELOPE_TO_PITCH: return MOD_PARAM_MODULATION_ENVELOPE_TO_PITCH;
+            case sf::GEN_TYPE_MODULATION_LFO_TO_FILTER_CUTOFF_FREQUENCY: return MOD_PARAM_MODULATION_LFO_TO_CUTOFF;
+            case sf::GEN_TYPE_MODULATION_ENVELOPE_TO_FILTER_CUTOFF_FREQUENCY: return MOD_PARAM_MODULATION_ENVELOPE_TO_CUTOFF;
+            case sf::GEN_TYPE_MODULATION_LFO_TO_VOLUME: return MOD_PARAM_MODULATION_LFO_TO_VOLUME;
+            default: return MOD_PARAM_COUNT;
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    // Indicates if a generator can be modulated at note-on (the ones of the envelopes and
+    // of the LFOs, and the scale tuning)
+    inline bool note_on_modulated(sf::generator_type_t type)
+    {
+        return ((type >= sf::GEN_TYPE_DELAY_MODULATION_LFO) &&
+                (type <= sf::GEN_TYPE_KEY_NUMBER_TO_VOLUME_ENVELOPE_DECAY)) ||
+               (type == sf::GEN_TYPE_SCALE_TUNING);
+    }
+
+    //-----------------------------------------------------------------------
+
+    // Returns the default modulator with the same id if the synthesizer already
+    // implements it natively (all of them except the velocity to filter cutoff and the
+    // channel pressure to vibrato LFO depth)
+    inline const sf::modulator_t* builtin_modulator(const sf::modulator_id_t& id)
+    {
+        auto iter = sf::DEFAULT_MODULATORS.find(id);
+        if (iter == sf::DEFAULT_MODULATORS.end())
+            return nullptr;
+
+        if ((id.dest == sf::GEN_TYPE_INITIAL_FILTER_CUTOFF_FREQUENCY) ||
+            ((id.src.controller_type == sf::MOD_CTRL_TYPE_SRC) &&
+             (id.src.source == sf::MOD_CTRL_SRC_CHANNEL_PRESSURE)))
+        {
+            return nullptr;
+        }
+
+        return &iter->second;
+    }
+
+    //-----------------------------------------------------------------------
+
+    inline bool compile_modulator_source(
+        const sf::modulator_source_t& source, uint8_t& index, uint8_t& curve
+    )
+    {
+        if (source.type > sf::MOD_SRC_TYPE_SWITCH)
+            return false;
+
+        curve = source.type * 4 + source.direction * 2 + source.polarity;
+
+        if (source.controller_type == sf::MOD_CTRL_TYPE_MIDI)
+        {
+            index = source.midi & 0x7F;
+            return true;
+        }
+
+        switch (source.source)
+        {
+            case sf::MOD_CTRL_SRC_NONE: index = MOD_SOURCE_NONE; return true;
+            case sf::MOD_CTRL_SRC_NOTE_ON_VELOCITY: index = MOD_SOURCE_VELOCITY; return true;
+            case sf::MOD_CTRL_SRC_NOTE_ON_KEY_NUMBER: index = MOD_SOURCE_KEY; return true;
+            case sf::MOD_CTRL_SRC_POLY_PRESSURE: index = MOD_SOURCE_POLY_PRESSURE; return true;
+            case sf::MOD_CTRL_SRC_CHANNEL_PRESSURE: index = MOD_SOURCE_CHANNEL_PRESSURE; return true;
+            case sf::MOD_CTRL_SRC_PITCH_WHEEL: index = MOD_SOURCE_PITCH_WHEEL; return true;
+            case sf::MOD_CTRL_SRC_PITCH_WHEEL_SENSITIVITY: index = MOD_SOURCE_PITCH_WHEEL_SENSITIVITY; return true;
+            default: return false;
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    // Indicates if a source has the same value for the whole note (the polyphonic
+    // pressure isn't tracked by the channels, it is always 0)
+    inline bool constant_modulator_source(uint8_t source)
+    {
+        return (source == MOD_SOURCE_NONE) || (source == MOD_SOURCE_VELOCITY) ||
+               (source == MOD_SOURCE_KEY) || (source == MOD_SOURCE_POLY_PRESSURE);
+    }
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  The modulators of one sample of a voice, compiled at note-on into a flat
+    ///         list of operations
+    ///
+    /// The contributions of the modulators depending only on the note (velocity, key
+    /// number) are computed once. The ones depending on the controllers of the channel
+    /// are kept in the list, and evaluated again only when the controls of the channel
+    /// changed. The generators that aren't used for each block (envelopes, LFOs) are only
+    /// modulated at note-on.
+    ///
+    /// The default modulators already implemented natively by the synthesizer (volume,
+    /// expression, pan, ...) only contribute the difference between their amount and the
+    /// default one.
+    //------------------------------------------------------------------------------------
+    class ModulatorSet
+    {
+    public:
+        //--------------------------------------------------------------------------------
+        /// @brief  Compile the modulators of a sample
+        ///
+        /// @param sample_info  The sample
+        /// @param channel      The channel playing the note
+        /// @param key          The key of the note
+        /// @param velocity     The velocity of the note
+        /// @param generators   The generators of the sample, the modulations of the ones
+        ///                     only modulated at note-on are added to them
+        //--------------------------------------------------------------------------------
+        void start(
+            const sf::sample_info_t& sample_info, const Channel& channel, uint8_t key,
+            uint8_t velocity, sf::generator_set_t& generators
+        );
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Evaluate the modulators again if the controls of the channel changed
+        ///
+        /// @return True if the modulations changed
+        //--------------------------------------------------------------------------------
+        bool update(const Channel& channel);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Returns the modulation of a generator, in the unit of the generator
+        //--------------------------------------------------------------------------------
+        inline float value(modulated_parameter_t parameter) const
+        {
+            return _values[parameter];
+        }
+
+    private:
+        void add(
+            const sf::modulator_id_t& id, int amount, sf::modulator_transform_t transform,
+            const Channel& channel, float* note_on_values
+        );
+
+        void evaluate(const Channel& channel, float* values) const;
+        float evaluate(const modulator_op_t& op, const Channel& channel) const;
+        float source(uint8_t source, uint8_t curve, const Channel& channel) const;
+
+
+        //_____ Constants __________
+    private:
+        static const size_t MAX_NB_OPERATIONS = 16;
+
+
+        //_____ Attributes __________
+    private:
+        modulator_op_t _operations[MAX_NB_OPERATIONS];
+        size_t _nb_operations = 0;
+
+        float _constant_values[MOD_PARAM_COUNT];
+        float _values[MOD_PARAM_COUNT];
+
+        uint32_t _version = 0;
+        uint8_t _key = 0;
+        uint8_t _velocity = 0;
+    };
+
+    //-----------------------------------------------------------------------
+
+    void ModulatorSet::start(
+        const sf::sample_info_t& sample_info, const Channel& channel, uint8_t key,
+        uint8_t velocity, sf::generator_set_t& generators
+    )
+    {
+        _nb_operations = 0;
+        _key = key;
+        _velocity = velocity;
+
+        for (int i = 0; i < MOD_PARAM_COUNT; ++i)
+            _constant_values[i] = 0.0f;
+
+        float note_on_values[sf::GEN_TYPE_UNUSED_END] = {};
+
+        const sf::modulator_map_t* instrument = sample_info.instrument_modulators;
+        const sf::modulator_map_t* preset = sample_info.preset_modulators;
+
+        // The amounts of the preset modulators are added to the ones of the instrument
+        // modulators with the same id
+        if (instrument)
+        {
+            for (const auto& entry : *instrument)
+            {
+                int amount = entry.second.amount;
+
+                if (preset)
+                {
+                    auto iter = preset->find(entry.first);
+                    if (iter != preset->end())
+                        amount += iter->second.amount;
+                }
+
+                add(entry.first, amount, entry.second.transform, channel, note_on_values);
+            }
+        }
+
+        if (preset)
+        {
+            for (const auto& entry : *preset)
+            {
+                if (!instrument || (instrument->find(entry.first) == instrument->end()))
+                    add(entry.first, entry.second.amount, entry.second.transform, channel, note_on_values);
+            }
+        }
+
+        for (int i = 0; i < sf::GEN_TYPE_UNUSED_END; ++i)
+        {
+            if (note_on_values[i] == 0.0f)
+                continue;
+
+            sf::generator_type_t type = static_cast<sf::generator_type_t>(i);
+
+            float value = clamp(
+                float(generators.get(type, { 0 }).ivalue) + note_on_values[i], -32768.0f,
+                32767.0f
+            );
+
+            generators.set(type, { .ivalue=int16_t(lround(value)) });
+        }
+
+        _version = channel.controls().version;
+        evaluate(channel, _values);
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool ModulatorSet::update(const Channel& channel)
+    {
+        if ((_nb_operations == 0) || (channel.controls().version == _version))
+            return false;
+
+        _version = channel.controls().version;
+
+        float values[MOD_PARAM_COUNT];
+        evaluate(channel, values);
+
+        if (memcmp(values, _values, sizeof(values)) == 0)
+            return false;
+
+        memcpy(_values, values, sizeof(values));
+        return true;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void ModulatorSet::add(
+        const sf::modulator_id_t& id, int amount, sf::modulator_transform_t transform,
+        const Channel& channel, float* note_on_values
+    )
+    {
+        const sf::modulator_t* builtin = builtin_modulator(id);
+        if (builtin)
+            amount -= builtin->amount;
+
+        if (amount == 0)
+            return;
+
+        modulator_op_t op;
+
+        if (!compile_modulator_source(id.src, op.source, op.source_curve) ||
+            !compile_modulator_source(id.amount_src, op.amount_source, op.amount_curve))
+        {
+            return;
+        }
+
+        op.amount = float(amount);
+        op.absolute = (transform == sf::MOD_TRANSFORM_ABSOLUTE_VALUE);
+
+        modulated_parameter_t parameter = modulated_parameter(id.dest);
+        if (parameter == MOD_PARAM_COUNT)
+        {
+            if (note_on_modulated(id.dest))
+                note_on_values[id.dest] += evaluate(op, channel);
+
+            return;
+        }
+
+        op.parameter = parameter;
+
+        if (constant_modulator_source(op.source) && constant_modulator_source(op.amount_source))
+            _constant_values[parameter] += evaluate(op, channel);
+        else if (_nb_operations < MAX_NB_OPERATIONS)
+            _operations[_nb_operations++] = op;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void ModulatorSet::evaluate(const Channel& channel, float* values) const
+    {
+        memcpy(values, _constant_values, sizeof(_constant_values));
+
+        for (size_t i = 0; i < _nb_operations; ++i)
+        {
+            const modulator_op_t& op = _operations[i];
+            values[op.parameter] += evaluate(op, channel);
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    float ModulatorSet::evaluate(const modulator_op_t& op, const Channel& channel) const
+    {
+        float value = op.amount * source(op.source, op.source_curve, channel) *
+                      source(op.amount_source, op.amount_curve, channel);
+
+        return (op.absolute ? fabs(value) : value);
+    }
+
+    //-----------------------------------------------------------------------
+
+    float ModulatorSet::source(uint8_t source, uint8_t curve, const Channel& channel) const
+    {
+        float position;
+
+        switch (source)
+        {
+            case MOD_SOURCE_NONE: return 1.0f;
+            case MOD_SOURCE_VELOCITY: position = _velocity; break;
+            case MOD_SOURCE_KEY: position = _key; break;
+            case MOD_SOURCE_POLY_PRESSURE: position = 0.0f; break;
+            case MOD_SOURCE_CHANNEL_PRESSURE: position = channel.channelPressure(); break;
+            case MOD_SOURCE_PITCH_WHEEL: position = (1.0f / 128.0f) * channel.pitchWheel(); break;
+            case MOD_SOURCE_PITCH_WHEEL_SENSITIVITY: position = channel.pitchBendRange(); break;
+            default: position = channel.controller(source); break;
+        }
+
+        return modulator_curves_t::instance().get(curve, clamp(position, 0.0f, 127.0f));
+    }
+
+
+    /************************************** VOICE ***************************************/
+
+    //------------------------------------------------------------------------------------
+    /// @brief  The active filters of a group of voices, whose processing is postponed to
+    ///         do it several at a time (see `BiQuadFilter::process()`)
+    //------------------------------------------------------------------------------------
+    struct filter_batch_t
+    {
+        static const size_t MAX_NB_FILTERS = 16;
+
+        BiQuadFilter* filters[MAX_NB_FILTERS];
+        float* blocks[MAX_NB_FILTERS];
+        size_t nb_filters = 0;
+    };
+
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Each voice is responsible to play one note
+    //------------------------------------------------------------------------------------
+    class Voice
+    {
+        //_____ Internal types __________
+    private:
+        struct track_t
+        {
+            track_t(const SynthesizerSettings& settings)
+            : volume_envelope(
+                  settings.sampleRate(), settings.fastMathEnabled(),
+                  decibels_to_linear(settings.inaudibleLevel())
+              ),
+              modulation_envelope(settings.sampleRate()),
+              vibrato_lfo(settings),
+              modulation_lfo(settings),
+              sampler(
+                  settings.sampleRate(), settings.interpolationMode(),
+                  settings.fastMathEnabled()
+              ),
+              filter(settings)
+            {}
+
+            VolumeEnvelope volume_envelope;
+            ModulationEnvelope modulation_envelope;
+
+            Lfo vibrato_lfo;
+            Lfo modulation_lfo;
+
+            Sampler sampler;
+            BiQuadFilter filter;
+
+            // Keeps the audio data of a compressed sample alive while it is played
+            sf::decoded_sample_t decoded_sample;
+
+            float note_gain;
+
+            float cutoff;
+            float resonance;
+
+            ModulatorSet modulators;
+
+            // Values of the generators modulated for each block, without the modulators
+            float generators[MOD_PARAM_COUNT];
+
+            float pitch_offset;
+            float modulation_gain;
+
+            float vib_lfo_to_pitch;
+            float mod_lfo_to_pitch;
+            float mod_env_to_pitch;
+
+            float mod_lfo_to_cutoff;
+            float mod_env_to_cutoff;
+            bool dynamic_cutoff;
+
+            float mod_lfo_to_volume;
+            bool dynamic_volume;
+
+            float instrument_pan;
+            float instrument_reverb;
+            float instrument_chorus;
+
+            // Some instruments require fast cutoff change, which can cause pop noise.
+            // This is used to smooth out the cutoff frequency.
+            float smoothed_cutoff;
+
+            float* block = nullptr;
+
+            float previous_mix_gain = 0.0f;
+            float current_mix_gain = 0.0f;
+        };
+
+
+        //_____ Methods __________
+    public:
+        //--------------------------------------------------------------------------------
+        /// @brief  Constructor
+        ///
+        /// @param settings The settings of the synthesizer
+        //--------------------------------------------------------------------------------
+        Voice(const Synthesizer* synthesizer);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Constructor, using blocks allocated by the caller
+        ///
+        /// @param settings     The settings of the synthesizer
+        /// @param block_left   The block of the left track (at least `blockSize()` floats)
+        /// @param block_right  The block of the right track (at least `blockSize()` floats)
+        //--------------------------------------------------------------------------------
+        Voice(const Synthesizer* synthesizer, float* block_left, float* block_right);
+
+        Voice(const Voice&) = delete;
+        Voice& operator=(const Voice&) = delete;
+
+        ~Voice();
+
+        // If 'prefetched' is true, the compressed samples are expected to be already
+        // decoded: they aren't decoded by the voice (which stops immediately if they
+        // aren't available), and the cache of the SoundFont is never waited for
+        void start(
+            const sf::key_info_t& key_info, const sf::sample_buffer_t& buffer, uint8_t channel,
+            uint8_t key, uint8_t velocity, bool prefetched = false
+        );
+
+        void end();
+        void kill();
+
+        // Release the audio data of the compressed samples once the voice ended (see
+        // 'Synthesizer::releaseDecodedSample()')
+        void releaseSamples();
+
+        bool process();
+        bool process(uint32_t size);
+
+        // Copy the state of another voice (but not the content of its audio blocks). The
+        // voices it references are translated from the storage 'from' to 'to'.
+        void copyState(const Voice& other, const Voice* from, Voice* to);
+
+        inline float priority() const
+        {
+            if (_stereo)
+            {
+                if ((_left.note_gain < NON_AUDIBLE) && (_right.note_gain < NON_AUDIBLE))
+                    return 0.0f;
+
+                return std::max(_left.volume_envelope.getPriority(), _right.volume_envelope.getPriority());
+            }
+            else
+            {
+                if (_left.note_gain < NON_AUDIBLE)
+                    return 0.0f;
+
+                return _left.volume_envelope.getPriority();
+            }
+        }
+
+        inline bool stereo() const
+        {
+            return _stereo;
+        }
+
+        inline float* block_left() const
+        {
+            return _left.block;
+        }
+
+        inline float* block_right() const
+        {
+            return _right.block;
+        }
+
+        inline float previousMixGainLeft() const
+        {
+            return _left.previous_mix_gain;
+        }
+
+        inline float previousMixGainRight() const
+        {
+            return _right.previous_mix_gain;
+        }
+
+        inline float currentMixGainLeft() const
+        {
+            return _left.current_mix_gain;
+        }
+
+        inline float currentMixGainRight() const
+        {
+            return _right.current_mix_gain;
+        }
+
+        inline float previousReverbSend() const
+        {
+            return _previous_reverb_send;
+        }
+
+        inline float previousChorusSend() const
+        {
+            return _previous_chorus_send;
+        }
+
+        inline float currentReverbSend() const
+        {
+            return _current_reverb_send;
+        }
+
+        inline float currentChorusSend() const
+        {
+            return _current_chorus_send;
+        }
+
+        inline uint8_t exclusiveClass() const
+        {
+            return _exclusive_class;
+        }
+
+        inline uint8_t channel() const
+        {
+            return _channel;
+        }
+
+        inline uint8_t key() const
+        {
+            return _key;
+        }
+
+        inline uint8_t velocity() const
+        {
+            return _velocity;
+        }
+
+        inline uint32_t voiceLength() const
+        {
+            return _voice_length;
+        }
+
+        // Next voice with the same channel and key (see VoiceCollection)
+        inline Voice* nextVoiceOfKey() const
+        {
+            return _key_links.next;
+        }
+
+        // Next voice with the same channel (see VoiceCollection)
+        inline Voice* nextVoiceOfChannel() const
+        {
+            return _channel_links.next;
+        }
+
+    private:
+        friend class VoiceCollection;
+
+        struct links_t
+        {
+            Voice* previous = nullptr;
+            Voice* next = nullptr;
+        };
+
+        static inline Voice* translate(const Voice* voice, const Voice* from, Voice* to)
+        {
+            return (voice ? to + (voice - from) : nullptr);
+        }
+
+        void start(
+            const sf::sample_info_t& key_info, const sf::sample_buffer_t& buffer,
+            bool prefetched, track_t& track
+        );
+
+        // Compute the parameters of a track depending on the modulated generators
+        void updateParameters(track_t& track);
+
+        // With a batch, the active filters are added to it instead of being processed
+        bool process(uint32_t size, filter_batch_t* batch);
+        bool process(
+            const channel_controls_t& controls, track_t& track, uint32_t size,
+            filter_batch_t* batch
+        );
+
+
+        //_____ Attributes __________
+    private:
+        const Synthesizer* _synthesizer;
+        bool _owns_blocks;
+
+        bool _stereo = false;
+        track_t _left;
+        track_t _right;
+
+        float _previous_reverb_send = 0.0f;
+        float _previous_chorus_send = 0.0f;
+        float _current_reverb_send = 0.0f;
+        float _current_chorus_send = 0.0f;
+
+        uint8_t _exclusive_class;
+        uint8_t _channel;
+        uint8_t _key;
+        uint8_t _velocity;
+
+        voice_state_t _voice_state;
+        uint32_t _voice_length;
+
+        // Links of the lists of active voices maintained by VoiceCollection
+        links_t _key_links;
+        links_t _channel_links;
+        bool _listed = false;
+
+        // Position in the heap of the candidates for stealing of VoiceCollection
+        size_t _candidate_index = 0;
+    };
+
+    //-----------------------------------------------------------------------
+
+    Voice::Voice(const Synthesizer* synthesizer)
+    : _synthesizer(synthesizer), _owns_blocks(true), _left(synthesizer->settings()),
+      _right(synthesizer->settings())
+    {
+        _left.block = new float[synthesizer->settings().blockSize()];
+        _right.block = new float[synthesizer->settings().blockSize()];
+
+        modulator_curves_t::instance();
+    }
+
+    //-----------------------------------------------------------------------
+
+    Voice::Voice(const Synthesizer* synthesizer, float* block_left, float* block_right)
+    : _synthesizer(synthesizer), _owns_blocks(false), _left(synthesizer->settings()),
+      _right(synthesizer->settings())
+    {
+        _left.block = block_left;
+        _right.block = block_right;
+
+        modulator_curves_t::instance();
+    }
+
+    //-----------------------------------------------------------------------
+
+    Voice::~Voice()
+    {
+        if (_owns_blocks)
+        {
+            delete[] _left.block;
+            delete[] _right.block;
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Voice::copyState(const Voice& other, const Voice* from, Voice* to)
+    {
+        // The audio blocks are only used while a block is rendered
+        float* block_left = _left.block;
+        float* block_right = _right.block;
+
+        // Overwriting the references to the audio data might free it
+        releaseSamples();
+
+        // The right track is only started for stereo samples, but its gains are used by
+        // the mono voices too
+        _stereo = other._stereo;
+        _left = other._left;
+
+        if (_stereo)
+        {
+            _right = other._right;
+        }
+        else
+        {
+            _right.note_gain = other._right.note_gain;
+            _right.previous_mix_gain = other._right.previous_mix_gain;
+            _right.current_mix_gain = other._right.current_mix_gain;
+        }
+
+        _left.block = block_left;
+        _right.block = block_right;
+
+        _previous_reverb_send = other._previous_reverb_send;
+        _previous_chorus_send = other._previous_chorus_send;
+        _current_reverb_send = other._current_reverb_send;
+        _current_chorus_send = other._current_chorus_send;
+
+        _exclusive_class = other._exclusive_class;
+        _channel = other._channel;
+        _key = other._key;
+        _velocity = other._velocity;
+
+        _voice_state = other._voice_state;
+        _voice_length = other._voice_length;
+
+        _key_links.previous = translate(other._key_links.previous, from, to);
+        _key_links.next = translate(other._key_links.next, from, to);
+        _channel_links.previous = translate(other._channel_links.previous, from, to);
+        _channel_links.next = translate(other._channel_links.next, from, to);
+        _listed = other._listed;
+        _candidate_index = other._candidate_index;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Voice::start(
+        const sf::key_info_t& key_info, const sf::sample_buffer_t& buffer, uint8_t channel, uint8_t key,
+        uint8_t velocity, bool prefetched
+    )
+    {
+        // The voice might have been stopped to play this note
+        releaseSamples();
+
+        _stereo = key_info.stereo;
+
+        _exclusive_class = key_info.left.generator(sf::GEN_TYPE_EXCLUSIVE_CLASS, { 0 }).uvalue;
+        _channel = channel;
+        _key = key;
+        _velocity = velocity;
+
+        start(key_info.left, buffer, prefetched, _left);
+
+        if (_stereo)
+            start(key_info.right, buffer, prefetched, _right);
+
+        _voice_state = VOICE_STATE_PLAYING;
+        _voice_length = 0;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Voice::end()
+    {
+        if (_voice_state == VOICE_STATE_PLAYING)
+            _voice_state = VOICE_STATE_RELEASE_REQUESTED;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Voice::kill()
+    {
+        _left.note_gain = 0.0f;
+        _right.note_gain = 0.0f;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Voice::releaseSamples()
+    {
+        _synthesizer->releaseDecodedSample(_left.decoded_sample);
+        _synthesizer->releaseDecodedSample(_right.decoded_sample);
+    }
+    
+    //-----------------------------------------------------------------------
+
+    bool Voice::process()
+    {
+        return process(_synthesizer->settings().blockSize());
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool Voice::process(uint32_t size)
+    {
+        return process(size, nullptr);
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool Voice::process(uint32_t size, filter_batch_t* batch)
+    {
+        if ((_left.note_gain < NON_AUDIBLE) && (!_stereo || (_right.note_gain < NON_AUDIBLE)))
+            return false;
+
+        const Channel& channel = _synthesizer->getChannel(_channel);
+        const channel_controls_t& controls = channel.controls();
+
+        // The modulators are only evaluated again when the controls of the channel changed
+        if (_left.modulators.update(channel))
+            updateParameters(_left);
+
+        if (_stereo && _right.modulators.update(channel))
+            updateParameters(_right);
+
+        if ((_voice_length >= _synthesizer->settings().sampleRate() / 500) &&
+            (_voice_state == VOICE_STATE_RELEASE_REQUESTED) &&
+            !controls.sustain)
+        {
+            _left.volume_envelope.release();
+            _left.modulation_envelope.release();
+            _left.sampler.release();
+
+            if (_stereo)
+            {
+                _right.volume_envelope.release();
+                _right.modulation_envelope.release();
+                _right.sampler.release();
+            }
+
+            _voice_state = VOICE_STATE_RELEASED;
+        }
+
+        _left.previous_mix_gain = _left.current_mix_gain;
+        _right.previous_mix_gain = _right.current_mix_gain;
+
+        bool success = process(controls, _left, size, batch);
+
+        if (_stereo)
+            success = process(controls, _right, size, batch) || success;
+
+        if (!success)
+            return false;
+
+        float left_gain;
+        float right_gain;
+
+        if (!_stereo)
+        {
+            // Centered voices use the pan law precomputed by the channel
+            bool apply;
+            if (_left.instrument_pan == 0.0f)
+            {
+                apply = controls.pan_law;
+                left_gain = controls.pan_gain_left;
+                right_gain = controls.pan_gain_right;
+            }
+            else
+            {
+                apply = pan_law(controls.pan + _left.instrument_pan, left_gain, right_gain);
+            }
+
+            if (apply)
+            {
+                float gain = _left.current_mix_gain;
+
+                _left.current_mix_gain = gain * left_gain;
+                _right.current_mix_gain = gain * right_gain;
+            }
+        }
+        else
+        {
+            if (pan_law(controls.pan + _left.instrument_pan, left_gain, right_gain))
+                _left.current_mix_gain *= left_gain;
+
+            if (pan_law(controls.pan + _right.instrument_pan, left_gain, right_gain))
+                _right.current_mix_gain *= left_gain;
+        }
+
+        _previous_reverb_send = _current_reverb_send;
+        _previous_chorus_send = _current_chorus_send;
+
+        if (_stereo)
+        {
+            _current_reverb_send = clamp(
+                controls.reverb_send + (_left.instrument_reverb + _right.instrument_reverb) * 0.5f,
+                0, 1
+            );
+            _current_chorus_send = clamp(
+                controls.chorus_send + (_left.instrument_chorus + _right.instrument_chorus) * 0.5f,
+                0, 1
+            );
+        }
+        else
+        {
+            _current_reverb_send = clamp(controls.reverb_send + _left.instrument_reverb, 0, 1);
+            _current_chorus_send = clamp(controls.chorus_send + _left.instrument_chorus, 0, 1);
+        }
+
+        if (_voice_length == 0)
+        {
+            _left.previous_mix_gain = _left.current_mix_gain;
+            _right.previous_mix_gain = _right.current_mix_gain;
+            _previous_reverb_send = _current_reverb_send;
+            _previous_chorus_send = _current_chorus_send;
+        }
+
+        _voice_length += size;
+
+        return true;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Voice::start(
+        const sf::sample_info_t& zone_info, const sf::sample_buffer_t& buffer,
+        bool prefetched, track_t& track
+    )
+    {
+        // The generators modulated at note-on are modified in a copy
+        sf::sample_info_t sample_info = zone_info;
+        track.modulators.start(
+            zone_info, _synthesizer->getChannel(_channel), _key, _velocity,
+            sample_info.generators
+        );
+
+        if (_velocity > 0)
+        {
+            // According to the Polyphone's implementation, the initial attenuation should be reduced to 40%.
+            float sample_attenuation =
+                0.1f * 0.1f * float(sample_info.generator(sf::GEN_TYPE_INITIAL_ATTENUATION, { 0 }).uvalue);
+
+            float filter_attenuation =
+                0.5f * 0.1f * float(sample_info.generator(sf::GEN_TYPE_INITIAL_FILTER_Q, { 0 }).uvalue);
+
+            float decibels = -linear_to_decibels(127.0f / _velocity) -
+                             sample_attenuation - filter_attenuation;
+
+            track.note_gain = decibels_to_linear(decibels);
+        }
+        else
+        {
+            track.note_gain = 0.0f;
+        }
+
+        float* generators = track.generators;
+        generators[MOD_PARAM_INITIAL_ATTENUATION] = 0.0f;   // Already in 'note_gain'
+        generators[MOD_PARAM_INITIAL_FILTER_Q] = float(sample_info.generator(sf::GEN_TYPE_INITIAL_FILTER_Q, { 0 }).uvalue);
+        generators[MOD_PARAM_INITIAL_FILTER_CUTOFF] = float(sample_info.generator(sf::GEN_TYPE_INITIAL_FILTER_CUTOFF_FREQUENCY, { .uvalue=13500 }).uvalue);
+        generators[MOD_PARAM_COARSE_TUNE] = 0.0f;           // Already in the sampler
+        generators[MOD_PARAM_FINE_TUNE] = 0.0f;             // Already in the sampler
+        generators[MOD_PARAM_PAN] = float(sample_info.generator(sf::GEN_TYPE_PAN, { 0 }).ivalue);
+        generators[MOD_PARAM_REVERB_SEND] = float(sample_info.generator(sf::GEN_TYPE_REVERB_EFFECTS_SEND, { 0 }).uvalue);
+        generators[MOD_PARAM_CHORUS_SEND] = float(sample_info.generator(sf::GEN_TYPE_CHORUS_EFFECTS_SEND, { 0 }).uvalue);
+        generators[MOD_PARAM_VIBRATO_LFO_TO_PITCH] = float(sample_info.generator(sf::GEN_TYPE_VIBRATO_LFO_TO_PITCH, { 0 }).ivalue);
+        generators[MOD_PARAM_MODULATION_LFO_TO_PITCH] = float(sample_info.generator(sf::GEN_TYPE_MODULATION_LFO_TO_PITCH, { 0 }).ivalue);
+        generators[MOD_PARAM_MODULATION_ENVELOPE_TO_PITCH] = float(sample_info.generator(sf::GEN_TYPE_MODULATION_ENVELOPE_TO_PITCH, { 0 }).ivalue);
+        generators[MOD_PARAM_MODULATION_LFO_TO_CUTOFF] = float(sample_info.generator(sf::GEN_TYPE_MODULATION_LFO_TO_FILTER_CUTOFF_FREQUENCY, { 0 }).ivalue);
+        generators[MOD_PARAM_MODULATION_ENVELOPE_TO_CUTOFF] = float(sample_info.generator(sf::GEN_TYPE_MODULATION_ENVELOPE_TO_FILTER_CUTOFF_FREQUENCY, { 0 }).ivalue);
+        generators[MOD_PARAM_MODULATION_LFO_TO_VOLUME] = float(sample_info.generator(sf::GEN_TYPE_MODULATION_LFO_TO_VOLUME, { 0 }).ivalue);
+
+        updateParameters(track);
+
+        {
+            float delay = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DELAY_VOLUME_ENVELOPE, { .ivalue=-12000 }).ivalue);
+
+            float attack = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_ATTACK_VOLUME_ENVELOPE, { .ivalue=-12000 }).ivalue);
+
+            float hold = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_HOLD_VOLUME_ENVELOPE, { .ivalue=-12000 }).ivalue) *
+                key_number_to_multiplying_factor(sample_info.generator(sf::GEN_TYPE_KEY_NUMBER_TO_VOLUME_ENVELOPE_HOLD, { 0 }).ivalue, _key);
+
+            float decay = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DECAY_VOLUME_ENVELOPE, { .ivalue=-12000 }).ivalue) *
+                key_number_to_multiplying_factor(sample_info.generator(sf::GEN_TYPE_KEY_NUMBER_TO_VOLUME_ENVELOPE_DECAY, { 0 }).ivalue, _key);
+
+            float sustain = decibels_to_linear(-0.1f * float(sample_info.generator(sf::GEN_TYPE_SUSTAIN_VOLUME_ENVELOPE, { 0 }).uvalue));
+
+            float release = fmax(timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_RELEASE_VOLUME_ENVELOPE, { .ivalue=-12000 }).ivalue), 0.01f);
+
+            track.volume_envelope.start(delay, attack, hold, decay, sustain, release);
+        }
+
+        {
+            float delay = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DELAY_MODULATION_ENVELOPE, { .ivalue=-12000 }).ivalue);
+
+            float attack = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_ATTACK_MODULATION_ENVELOPE, { .ivalue=-12000 }).ivalue) *
+                           ((145.0f - _velocity) / 144.0f);
+
+            float hold = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_HOLD_MODULATION_ENVELOPE, { .ivalue=-12000 }).ivalue) *
+                key_number_to_multiplying_factor(sample_info.generator(sf::GEN_TYPE_KEY_NUMBER_TO_MODULATION_ENVELOPE_HOLD, { 0 }).ivalue, _key);
+
+            float decay = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DECAY_MODULATION_ENVELOPE, { .ivalue=-12000 }).ivalue) *
+                key_number_to_multiplying_factor(sample_info.generator(sf::GEN_TYPE_KEY_NUMBER_TO_MODULATION_ENVELOPE_DECAY, { 0 }).ivalue, _key);
+
+            float sustain = 1.0f - float(sample_info.generator(sf::GEN_TYPE_SUSTAIN_MODULATION_ENVELOPE, { 0 }).uvalue) / 100.0f;
+
+            float release = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_RELEASE_MODULATION_ENVELOPE, { .ivalue=-12000 }).ivalue);
+
+            track.modulation_envelope.start(delay, attack, hold, decay, sustain, release);
+        }
+
+        track.vibrato_lfo.start(
+            timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DELAY_VIBRATO_LFO, { .ivalue=-12000 }).ivalue),
+            cents_to_hertz(sample_info.generator(sf::GEN_TYPE_FREQUENCY_VIBRATO_LFO, { 0 }).ivalue)
+        );
+
+        track.modulation_lfo.start(
+            timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DELAY_MODULATION_LFO, { .ivalue=-12000 }).ivalue),
+            cents_to_hertz(sample_info.generator(sf::GEN_TYPE_FREQUENCY_MODULATION_LFO, { 0 }).ivalue)
+        );
+
+        int overriding_root_key = sample_info.generator(sf::GEN_TYPE_OVERRIDING_ROOT_KEY, { .ivalue=-1 }).ivalue;
+        loop_mode_t loop_mode = static_cast<loop_mode_t>(sample_info.generator(sf::GEN_TYPE_SAMPLE_MODES, { 0 }).uvalue);
+        int8_t coarse_tune = sample_info.generator(sf::GEN_TYPE_COARSE_TUNE, { 0 }).ivalue;
+        int8_t fine_tune = sample_info.generator(sf::GEN_TYPE_FINE_TUNE, { 0 }).ivalue;
+        int16_t scale_tuning = sample_info.generator(sf::GEN_TYPE_SCALE_TUNING, { 100 }).uvalue;
+
+        uint8_t root_key = (overriding_root_key != -1 ? uint8_t(overriding_root_key) : sample_info.sample->original_pitch);
+
+        sf::sample_buffer_t sample_buffer = buffer;
+        uint32_t start = sample_info.sample->start;
+        uint32_t end = sample_info.sample->end;
+        uint32_t loop_start = sample_info.sample->loop_start;
+        uint32_t loop_end = sample_info.sample->loop_end;
+
+        // The compressed samples are decoded the first time they are played (unless they
+        // are prefetched: decoding on the audio thread is then avoided), and then kept in
+        // the cache of the SoundFont. If the audio data isn't available, the voice stops
+        // immediately.
+        if (sample_info.sample->compressed)
+        {
+            const sf::SoundFont& soundfont = _synthesizer->soundfont();
+
+            if (prefetched)
+                track.decoded_sample = soundfont.findDecodedSample(sample_info.sample);
+            else
+                track.decoded_sample = soundfont.getDecodedSample(sample_info.sample);
+
+            const uint32_t size = (track.decoded_sample ? uint32_t(track.decoded_sample->size()) : 0);
+
+            sample_buffer = sf::sample_buffer_t(size > 0 ? track.decoded_sample->data() : nullptr);
+            start = 0;
+            end = size;
+            loop_start = std::min(loop_start, size);
+            loop_end = std::min(loop_end, size);
+        }
+
+        track.sampler.start(
+            sample_buffer,
+            start, end,
+            loop_mode,
+            loop_start, loop_end,
+            sample_info.sample->sample_rate, root_key,
+            coarse_tune,
+            fine_tune + sample_info.sample->pitch_correction,
+            scale_tuning
+        );
+
+        track.filter.clearBuffer();
+        track.filter.setLowPassFilter(track.cutoff, track.resonance);
+
+        track.smoothed_cutoff = track.cutoff;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Voice::updateParameters(track_t& track)
+    {
+        float values[MOD_PARAM_COUNT];
+        for (int i = 0; i < MOD_PARAM_COUNT; ++i)
+            values[i] = track.generators[i] + track.modulators.value(modulated_parameter_t(i));
+
+        track.cutoff = cents_to_hertz(values[MOD_PARAM_INITIAL_FILTER_CUTOFF]);
+        track.resonance = decibels_to_linear(0.1f * values[MOD_PARAM_INITIAL_FILTER_Q]);
+
+        track.pitch_offset = values[MOD_PARAM_COARSE_TUNE] + 0.01f * values[MOD_PARAM_FINE_TUNE];
+
+        // The initial attenuation and the filter attenuation of the generators are
+        // already in 'note_gain' (see 'start()')
+        float decibels = -0.1f * 0.1f * values[MOD_PARAM_INITIAL_ATTENUATION] -
+                         0.5f * 0.1f * track.modulators.value(MOD_PARAM_INITIAL_FILTER_Q);
+        track.modulation_gain = (decibels != 0.0f ? decibels_to_linear(decibels) : 1.0f);
+
+        track.vib_lfo_to_pitch = 0.01f * values[MOD_PARAM_VIBRATO_LFO_TO_PITCH];
+        track.mod_lfo_to_pitch = 0.01f * values[MOD_PARAM_MODULATION_LFO_TO_PITCH];
+        track.mod_env_to_pitch = 0.01f * values[MOD_PARAM_MODULATION_ENVELOPE_TO_PITCH];
+
+        track.mod_lfo_to_cutoff = values[MOD_PARAM_MODULATION_LFO_TO_CUTOFF];
+        track.mod_env_to_cutoff = values[MOD_PARAM_MODULATION_ENVELOPE_TO_CUTOFF];
+        track.dynamic_cutoff = (track.mod_lfo_to_cutoff != 0.0f) || (track.mod_env_to_cutoff != 0.0f);
+
+        track.mod_lfo_to_volume = 0.1f * values[MOD_PARAM_MODULATION_LFO_TO_VOLUME];
+        track.dynamic_volume = (track.mod_lfo_to_volume > 0.05f);
+
+        track.instrument_pan = clamp(0.1f * values[MOD_PARAM_PAN], -50.0f, 50.0f);
+        track.instrument_reverb = 0.01f * 0.1f * values[MOD_PARAM_REVERB_SEND];
+        track.instrument_chorus = 0.01f * 0.1f * values[MOD_PARAM_CHORUS_SEND];
+
+        // The dynamic cutoffs are updated for each block
+        if (!track.dynamic_cutoff)
+            track.filter.setLowPassFilter(track.cutoff, track.resonance);
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool Voice::process(
+        const channel_controls_t& controls, track_t& track, uint32_t size,
+        filter_batch_t* batch
+    )
+    {
+        if (!track.volume_envelope.process(size))
+            return false;
+
+        track.modulation_envelope.process(size);
+        track.vibrato_lfo.process(size);
+        track.modulation_lfo.process(size);
+
+        float vib_pitch_change = (controls.vibrato_depth + track.vib_lfo_to_pitch) * track.vibrato_lfo.value();
+        float mod_pitch_change = track.mod_lfo_to_pitch * track.modulation_lfo.value() +
+                                 track.mod_env_to_pitch * track.modulation_envelope.getValue();
+
+        float pitch = _key + vib_pitch_change + mod_pitch_change + controls.pitch +
+                      track.pitch_offset;
+
+        if (!track.sampler.process(track.block, size, pitch))
+            return false;
+
+        if (track.dynamic_cutoff)
+        {
+            float cents = track.mod_lfo_to_cutoff * track.modulation_lfo.value() +
+                          track.mod_env_to_cutoff * track.modulation_envelope.getValue();
+
+            float factor = (_synthesizer->settings().fastMathEnabled() ?
+                                fast_cents_to_multiplying_factor(cents) :
+                                cents_to_multiplying_factor(cents));
+            float new_cutoff = factor * track.cutoff;
+
+            // The cutoff change is limited within x0.5 and x2 to reduce pop noise
+            float lower_limit = 0.5 * track.smoothed_cutoff;
+            float upper_limit = 2.0 * track.smoothed_cutoff;
+            if (new_cutoff < lower_limit)
+                track.smoothed_cutoff = lower_limit;
+            else if (new_cutoff > upper_limit)
+                track.smoothed_cutoff = upper_limit;
+            else
+                track.smoothed_cutoff = new_cutoff;
+
+            track.filter.setLowPassFilter(track.smoothed_cutoff, track.resonance);
+        }
+
+        if (batch && track.filter.active())
+        {
+            batch->filters[batch->nb_filters] = &track.filter;
+            batch->blocks[batch->nb_filters] = track.block;
+            ++batch->nb_filters;
+        }
+        else
+        {
+            track.filter.process(track.block, size);
+        }
+
+        float mix_gain = track.note_gain * controls.gain * track.volume_envelope.getValue() *
+                         track.modulation_gain;
+        if (track.dynamic_volume)
+        {
+            float decibels = track.mod_lfo_to_volume * track.modulation_lfo.value();
+            mix_gain *= (_synthesizer->settings().fastMathEnabled() ?
+                            fast_decibels_to_linear(decibels) :
+                            decibels_to_linear(decibels));
+        }
+
+        track.current_mix_gain = mix_gain;
+
+        return true;
+    }
+
+
+    /*********************************** WORKER POOL ************************************/
+
+    //------------------------------------------------------------------------------------
+    /// @brief  A pool of threads processing a list of items in parallel
+    ///
+    /// The items are split in chunks of fixed size, claimed by the threads (including the
+    /// calling one) as soon as they are idle, until none is left.
+    //------------------------------------------------------------------------------------
+    class WorkerPool
+    {
+    public:
+        typedef void (*function_t)(void* context, size_t index);
+
+        // The threads can flush the denormal numbers to zero during their whole lifetime
+        WorkerPool(uint16_t nb_threads, bool flush_denormals = false);
+        ~WorkerPool();
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Calls 'function(context, i)' for all 'i' in [0, nb_items), and returns
+        ///         once all the calls are done
+        //--------------------------------------------------------------------------------
+        void run(size_t nb_items, function_t function, void* context);
+
+    private:
+        void worker();
+        void execute();
+
+
+        //_____ Constants __________
+    private:
+        // The items are already groups of voices (see 'VoiceCollection::process()')
+        static const size_t CHUNK_SIZE = 1;
+
+
+        //_____ Attributes __________
+    private:
+        std::vector<std::thread> _threads;
+        bool _flush_denormals;
+        std::mutex _mutex;
+        std::condition_variable _start_condition;
+        std::condition_variable _done_condition;
+        uint64_t _generation = 0;
+        bool _stop = false;
+
+        function_t _function = nullptr;
+        void* _context = nullptr;
+        size_t _nb_items = 0;
+        std::atomic<size_t> _next_item = 0;
+        std::atomic<size_t> _nb_running = 0;
+    };
+
+    //-----------------------------------------------------------------------
+
+    WorkerPool::WorkerPool(uint16_t nb_threads, bool flush_denormals)
+    : _flush_denormals(flush_denormals)
+    {
+        for (int i = 0; i < nb_threads; ++i)
+            _threads.emplace_back(&WorkerPool::worker, this);
+    }
+
+    //-----------------------------------------------------------------------
+
+    WorkerPool::~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+
+        _start_condition.notify_all();
+
+        for (auto& thread : _threads)
+            thread.join();
+    }
+
+    //-----------------------------------------------------------------------
+
+    void WorkerPool::run(size_t nb_items, function_t function, void* context)
+    {
+        // Not worth waking up the threads
+        if (_threads.empty() || (nb_items <= CHUNK_SIZE))
+        {
+            for (size_t i = 0; i < nb_items; ++i)
+                function(context, i);
+            return;
+        }
+
+        _function = function;
+        _context = context;
+        _nb_items = nb_items;
+        _next_item = 0;
+        _nb_running = _threads.size();
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_generation;
+        }
+
+        _start_condition.notify_all();
+
+        // The calling thread participates too
+        execute();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done_condition.wait(lock, [this] { return _nb_running == 0; });
+    }
+
+    //-----------------------------------------------------------------------
+
+    void WorkerPool::worker()
+    {
+        DenormalsGuard guard(_flush_denormals);
+
+        uint64_t generation = 0;
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _start_condition.wait(lock, [&] { return _stop || (_generation != generation); });
+
+                if (_stop)
+                    return;
+
+                generation = _generation;
+            }
+
+            execute();
+
+            if (_nb_running.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _done_condition.notify_one();
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    void WorkerPool::execute()
+    {
+        while (true)
+        {
+            size_t start = _next_item.fetch_add(CHUNK_SIZE);
+            if (start >= _nb_items)
+                break;
+
+            size_t end = std::min(start + CHUNK_SIZE, _nb_items);
+
+            for (size_t i = start; i < end; ++i)
+                _function(_context, i);
+        }
+    }
+
+
+    /*********************************** RING BUFFERS ***********************************/
+
+    //------------------------------------------------------------------------------------
+    /// @brief  Wait-free single-producer/single-consumer ring buffer (its size must be a
+    ///         power of two)
+    //------------------------------------------------------------------------------------
+    template<typename T>
+    class RingBuffer
+    {
+    public:
+        RingBuffer(uint32_t size);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Add an item at the end of the queue (producer thread only). The item
+        ///         is only moved if there is enough space.
+        //--------------------------------------------------------------------------------
+        bool push(T&& item);
+
+        //--------------------------------------------------------------------------------
+        /// @brief  Remove the item at the front of the queue (consumer thread only)
+        //--------------------------------------------------------------------------------
+        bool pop(T& item);
+
+
+        //_____ Attributes __________
+    private:
+        std::vector<T> _items;
+        size_t _mask;
+
+        // Each index is only written by one thread: keep them on separate cache lines
+        alignas(64) std::atomic<size_t> _write_index = 0;
+        alignas(64) std::atomic<size_t> _read_index = 0;
+    };
+
+    //-----------------------------------------------------------------------
+
+    template<typename T>
+    RingBuffer<T>::RingBuffer(uint32_t size)
+    : _items(size), _mask(size - 1)
+    {
+    }
+
+    //-----------------------------------------------------------------------
+
+    template<typename T>
+    bool RingBuffer<T>::push(T&& item)
+    {
+        size_t write_index = _write_index.load(std::memory_order_relaxed);
+        size_t read_index = _read_index.load(std::memory_order_acquire);
+
+        if (write_index - read_index == _items.size())
+            return false;
+
+        _items[write_index & _mask] = std::move(item);
+        _write_index.store(write_index + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    //-----------------------------------------------------------------------
+
+    template<typename T>
+    bool RingBuffer<T>::pop(T& item)
+    {
+        size_t read_index = _read_index.load(std::memory_order_relaxed);
+        size_t write_index = _write_index.load(std::memory_order_acquire);
+
+        if (read_index == write_index)
+            return false;
+
+        // Moved, so the queue doesn't keep a reference to the item
+        item = std::move(_items[read_index & _mask]);
+        _read_index.store(read_index + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    //-----------------------------------------------------------------------
+
+    // The MIDI messages posted to the synthesizer, processed by the audio thread
+    class MidiQueue : public RingBuffer<midi_event_t>
+    {
+    public:
+        using RingBuffer::RingBuffer;
+    };
+
+    //-----------------------------------------------------------------------
+
+    // The audio data of the compressed samples no longer played, released by the thread
+    // calling 'Synthesizer::releaseDecodedSamples()'
+    class ReleaseQueue : public RingBuffer<sf::decoded_sample_t>
+    {
+    public:
+        using RingBuffer::RingBuffer;
+    };
+
+
+    /******************************** VOICE COLLECTION **********************************/
+
+    class VoiceCollection
+    {
+    public:
+        // With 'state_only', the voices have no audio blocks and there is no worker pool:
+        // the collection can only hold the state of another one (see 'copyState()')
+        VoiceCollection(const Synthesizer* synthesizer, bool state_only = false);
+        ~VoiceCollection();
+
+        // The returned voice must then be started, and given to 'started()'
+        Voice* request(uint8_t channel, uint8_t key, uint8_t exclusive_class);
+        void started(Voice* voice);
+
+        void process(uint32_t size);
+        void clear();
+
+        // Copy the state of another collection with the same number of voices and
+        // channels, without allocating memory
+        void copyState(const VoiceCollection& other);
+
+        // Must be called when the priority of a voice changed outside of 'process()'
+        // (for instance, when it is killed)
+        void updatePriority(Voice* voice);
+    
+        inline size_t nbActiveVoices() const
+        {
+            return _nb_active_voices;            
+        }
+
+        inline uint64_t nbSteals() const
+        {
+            return _nb_steals;
+        }
+
+        inline void resetNbSteals()
+        {
+            _nb_steals = 0;
+        }
+
+        inline std::vector<Voice*>& voices()
+        {
+            return _voices;            
+        }
+
+        // First active voice playing a key on a channel, the others are found with
+        // 'Voice::nextVoiceOfKey()'
+        inline Voice* firstVoiceOfKey(uint8_t channel, uint8_t key) const
+        {
+            return _key_lists[channel * 256 + key];
+        }
+
+        // First active voice of a channel, the others are found with
+        // 'Voice::nextVoiceOfChannel()'
+        inline Voice* firstVoiceOfChannel(uint8_t channel) const
+        {
+            return _channel_lists[channel];
+        }
+
+    private:
+        // A voice that can be stopped to play a new note, with its priority when it was
+        // last updated
+        struct candidate_t
+        {
+            float priority;
+            uint64_t start_order;
+            Voice* voice;
+        };
+
+        static void processGroup(void* context, size_t index);
+
+        void removeInactiveVoice(size_t index);
+
+        void removeCandidate(Voice* voice);
+        void moveCandidate(size_t index);
+        void placeCandidate(const candidate_t& candidate, size_t index);
+
+        void link(Voice* voice, uint8_t channel, uint8_t key);
+        void unlink(Voice* voice);
+
+        inline Voice*& exclusiveVoice(uint8_t channel, uint8_t exclusive_class)
+        {
+            return _exclusive_voices[channel * 256 + exclusive_class];
+        }
+
+        // Indicates if 'a' is more suitable than 'b' to be stopped (the top of the heap
+        // is the best candidate): lowest priority first, then the oldest voice
+        static inline bool moreSuitable(const candidate_t& a, const candidate_t& b)
+        {
+            if (a.priority != b.priority)
+                return a.priority < b.priority;
+
+            return a.start_order < b.start_order;
+        }
+
+
+        //_____ Constants __________
+    private:
+        // The voices are processed by groups, whose active filters are then processed
+        // together (two tracks per voice)
+        static const size_t VOICES_PER_GROUP = filter_batch_t::MAX_NB_FILTERS / 2;
+
+
+        //_____ Attributes __________
+    private:
+        // All the voices are stored contiguously in '_storage', and all their audio
+        // blocks in '_blocks'. '_voices' only defines their order (the active ones
+        // first).
+        Voice* _storage = nullptr;
+        float* _blocks = nullptr;
+
+        std::vector<Voice*> _voices;
+        size_t _nb_active_voices = 0;
+        uint64_t _nb_steals = 0;
+
+        // Heap of the active voices, to find the one to stop when all of them are in
+        // use. The priorities are updated as the voices are processed (they rarely
+        // change their order, so most updates don't move anything), the position of
+        // each voice is stored in it.
+        std::vector<candidate_t> _candidates;
+        uint64_t _nb_started = 0;
+
+        // The active voice of each (channel, exclusive class) pair, if any
+        std::vector<Voice*> _exclusive_voices;
+
+        // Heads of the lists of active voices of each (channel, key) pair and of each
+        // channel (the links are stored in the voices)
+        std::vector<Voice*> _key_lists;
+        std::vector<Voice*> _channel_lists;
+
+        WorkerPool* _pool = nullptr;
+        std::vector<uint8_t> _alive;
+        uint32_t _block_size = 0;
+    };
+
+    //-----------------------------------------------------------------------
+
+    VoiceCollection::VoiceCollection(const Synthesizer* synthesizer, bool state_only)
+    {
+        const size_t nb_voices = synthesizer->settings().maximumPolyphony();
+        const size_t block_size = aligned_block_size(synthesizer->settings().blockSize());
+
+        if (!state_only)
+            _blocks = allocate_aligned_floats(nb_voices * 2 * block_size);
+
+        _storage = static_cast<Voice*>(
+            ::operator new[](nb_voices * sizeof(Voice), std::align_val_t(BLOCK_ALIGNMENT))
+        );
+
+        _voices.reserve(nb_voices);
+        _candidates.reserve(nb_voices);
+        _exclusive_voices.resize(synthesizer->nbChannels() * 256, nullptr);
+        _key_lists.resize(synthesizer->nbChannels() * 256, nullptr);
+        _channel_lists.resize(synthesizer->nbChannels(), nullptr);
+
+        for (size_t i = 0; i < nb_voices; ++i)
+        {
+            float* block_left = (_blocks ? _blocks + 2 * i * block_size : nullptr);
+            Voice* voice = new (_storage + i) Voice(
+                synthesizer, block_left, (_blocks ? block_left + block_size : nullptr)
+            );
+
+            _voices.push_back(voice);
+        }
+
+        if (!state_only && (synthesizer->settings().nbWorkerThreads() > 0))
+        {
+            _pool = new WorkerPool(
+                synthesizer->settings().nbWorkerThreads(),
+                synthesizer->settings().denormalsFlushingEnabled()
+            );
+        }
+
+        _alive.resize(_voices.size());
+    }
+
+    //-----------------------------------------------------------------------
+
+    VoiceCollection::~VoiceCollection()
+    {
+        delete _pool;
+
+        for (auto voice : _voices)
+            voice->~Voice();
+
+        ::operator delete[](_storage, std::align_val_t(BLOCK_ALIGNMENT));
+        free_aligned_floats(_blocks);
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::copyState(const VoiceCollection& other)
+    {
+        const size_t nb_voices = other._voices.size();
+
+        // The voices reference each other, and are referenced by the lists, through
+        // pointers to the storage of 'other'. Only the active ones have a state, the
+        // others are started again before being used.
+        for (size_t i = 0; i < nb_voices; ++i)
+        {
+            Voice* voice = Voice::translate(other._voices[i], other._storage, _storage);
+
+            if (i < other._nb_active_voices)
+            {
+                voice->copyState(*other._voices[i], other._storage, _storage);
+            }
+            else
+            {
+                voice->_listed = false;
+                voice->releaseSamples();
+            }
+
+            _voices[i] = voice;
+        }
+
+        _nb_active_voices = other._nb_active_voices;
+
+        // No allocation: the capacity of the heap is the number of voices
+        _candidates.resize(other._candidates.size());
+        for (size_t i = 0; i < _candidates.size(); ++i)
+        {
+            _candidates[i] = other._candidates[i];
+            _candidates[i].voice = Voice::translate(
+                other._candidates[i].voice, other._storage, _storage
+            );
+        }
+
+        _nb_started = other._nb_started;
+
+        for (size_t i = 0; i < _exclusive_voices.size(); ++i)
+        {
+            _exclusive_voices[i] = Voice::translate(
+                other._exclusive_voices[i], other._storage, _storage
+            );
+        }
+
+        for (size_t i = 0; i < _key_lists.size(); ++i)
+            _key_lists[i] = Voice::translate(other._key_lists[i], other._storage, _storage);
+
+        for (size_t i = 0; i < _channel_lists.size(); ++i)
+        {
+            _channel_lists[i] = Voice::translate(
+                other._channel_lists[i], other._storage, _storage
+            );
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    Voice* VoiceCollection::request(uint8_t channel, uint8_t key, uint8_t exclusive_class)
+    {
+        // If an exclusive class is assigned to the region, find a voice with the same class.
+        // If found, reuse it to avoid playing multiple voices with the same class at a time.
+        if (exclusive_class != 0)
+        {
+            Voice* voice = exclusiveVoice(channel, exclusive_class);
+            if (voice)
+            {
+                // The voice will be restarted, and put back in the heap then
+                removeCandidate(voice);
+
+                unlink(voice);
+                link(voice, channel, key);
+                return voice;
+            }
+        }
+
+        Voice* voice;
+
+        // If the number of active voices is less than the limit, use a free one
+        if (_nb_active_voices < _voices.size())
+        {
+            voice = _voices[_nb_active_voices];
+            ++_nb_active_voices;
+        }
+        else
+        {
+            // Too many active voices: stop the one which has the lowest priority
+            voice = _candidates.front().voice;
+            removeCandidate(voice);
+
+            if ((voice->exclusiveClass() != 0) &&
+                (exclusiveVoice(voice->channel(), voice->exclusiveClass()) == voice))
+            {
+                exclusiveVoice(voice->channel(), voice->exclusiveClass()) = nullptr;
+            }
+
+            ++_nb_steals;
+        }
+
+        if (exclusive_class != 0)
+            exclusiveVoice(channel, exclusive_class) = voice;
+
+        unlink(voice);
+        link(voice, channel, key);
+
+        return voice;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::link(Voice* voice, uint8_t channel, uint8_t key)
+    {
+        Voice*& first_of_key = _key_lists[channel * 256 + key];
+        voice->_key_links = { nullptr, first_of_key };
+        if (first_of_key)
+            first_of_key->_key_links.previous = voice;
+        first_of_key = voice;
+
+        Voice*& first_of_channel = _channel_lists[channel];
+        voice->_channel_links = { nullptr, first_of_channel };
+        if (first_of_channel)
+            first_of_channel->_channel_links.previous = voice;
+        first_of_channel = voice;
+
+        voice->_listed = true;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::unlink(Voice* voice)
+    {
+        if (!voice->_listed)
+            return;
+
+        // The voice was started with the channel and key it was listed with
+        Voice::links_t& key_links = voice->_key_links;
+        if (key_links.previous)
+            key_links.previous->_key_links.next = key_links.next;
+        else
+            _key_lists[voice->channel() * 256 + voice->key()] = key_links.next;
+
+        if (key_links.next)
+            key_links.next->_key_links.previous = key_links.previous;
+
+        Voice::links_t& channel_links = voice->_channel_links;
+        if (channel_links.previous)
+            channel_links.previous->_channel_links.next = channel_links.next;
+        else
+            _channel_lists[voice->channel()] = channel_links.next;
+
+        if (channel_links.next)
+            channel_links.next->_channel_links.previous = channel_links.previous;
+
+        voice->_key_links = Voice::links_t();
+        voice->_channel_links = Voice::links_t();
+        voice->_listed = false;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::started(Voice* voice)
+    {
+        _candidates.push_back({ voice->priority(), _nb_started++, voice });
+        moveCandidate(_candidates.size() - 1);
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::updatePriority(Voice* voice)
+    {
+        const size_t index = voice->_candidate_index;
+
+        _candidates[index].priority = voice->priority();
+        moveCandidate(index);
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::removeCandidate(Voice* voice)
+    {
+        const size_t index = voice->_candidate_index;
+
+        _candidates[index] = _candidates.back();
+        _candidates.pop_back();
+
+        if (index < _candidates.size())
+        {
+            _candidates[index].voice->_candidate_index = index;
+            moveCandidate(index);
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::moveCandidate(size_t index)
+    {
+        const candidate_t candidate = _candidates[index];
+
+        // Towards the top of the heap...
+        while (index > 0)
+        {
+            const size_t parent = (index - 1) / 2;
+            if (!moreSuitable(candidate, _candidates[parent]))
+                break;
+
+            placeCandidate(_candidates[parent], index);
+            index = parent;
+        }
+
+        // ... or towards the bottom
+        while (true)
+        {
+            size_t child = 2 * index + 1;
+            if (child >= _candidates.size())
+                break;
+
+            if ((child + 1 < _candidates.size()) &&
+                moreSuitable(_candidates[child + 1], _candidates[child]))
+            {
+                ++child;
+            }
+
+            if (!moreSuitable(_candidates[child], candidate))
+                break;
+
+            placeCandidate(_candidates[child], index);
+            index = child;
+        }
+
+        placeCandidate(candidate, index);
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::placeCandidate(const candidate_t& candidate, size_t index)
+    {
+        _candidates[index] = candidate;
+        candidate.voice->_candidate_index = index;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::removeInactiveVoice(size_t index)
+    {
+        Voice* voice = _voices[index];
+
+        if ((voice->exclusiveClass() != 0) &&
+            (exclusiveVoice(voice->channel(), voice->exclusiveClass()) == voice))
+        {
+            exclusiveVoice(voice->channel(), voice->exclusiveClass()) = nullptr;
+        }
+
+        unlink(voice);
+        removeCandidate(voice);
+        voice->releaseSamples();
+
+        --_nb_active_voices;
+        std::swap(_voices[index], _voices[_nb_active_voices]);
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::process(uint32_t size)
+    {
+        const size_t nb_groups = (_nb_active_voices + VOICES_PER_GROUP - 1) / VOICES_PER_GROUP;
+
+        _block_size = size;
+
+        // The voices are independent from each other, the groups can be processed in
+        // parallel
+        if (_pool)
+        {
+            _pool->run(nb_groups, &VoiceCollection::processGroup, this);
+        }
+        else
+        {
+            for (size_t i = 0; i < nb_groups; ++i)
+                processGroup(this, i);
+        }
+
+        // Remove the finished voices in the same order than if they were removed while
+        // being processed one by one, so the order of the voices (and thus of the
+        // mixing) doesn't depend on the number of threads
+        int i = 0;
+
+        while (i != _nb_active_voices)
+        {
+            if (_alive[i])
+            {
+                ++i;
+            }
+            else
+            {
+                removeInactiveVoice(i);
+                std::swap(_alive[i], _alive[_nb_active_voices]);
+            }
+        }
+
+        // The envelopes have advanced
+        for (size_t i = 0; i < _nb_active_voices; ++i)
+            updatePriority(_voices[i]);
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::processGroup(void* context, size_t index)
+    {
+        VoiceCollection* self = static_cast<VoiceCollection*>(context);
+
+        const size_t start = index * VOICES_PER_GROUP;
+        const size_t end = std::min(start + VOICES_PER_GROUP, self->_nb_active_voices);
+
+        filter_batch_t batch;
+
+        for (size_t i = start; i < end; ++i)
+            self->_alive[i] = self->_voices[i]->process(self->_block_size, &batch) ? 1 : 0;
+
+        BiQuadFilter::process(batch.filters, batch.blocks, batch.nb_filters, self->_block_size);
+    }
+
+    //-----------------------------------------------------------------------
+
+    void VoiceCollection::clear()
+    {
+        _nb_active_voices = 0;
+        _candidates.clear();
+        std::fill(_exclusive_voices.begin(), _exclusive_voices.end(), nullptr);
+        std::fill(_key_lists.begin(), _key_lists.end(), nullptr);
+        std::fill(_channel_lists.begin(), _channel_lists.end(), nullptr);
+
+        for (auto voice : _voices)
+        {
+            voice->_key_links = Voice::links_t();
+            voice->_channel_links = Voice::links_t();
+            voice->_listed = false;
+            voice->releaseSamples();
+        }
+    }
+
+
+    /****************************** SYNTHESIZER SETTINGS ********************************/
+
+    SynthesizerSettings::SynthesizerSettings(uint32_t sample_rate)
+    {
+        setSampleRate(sample_rate);
+        _block_size = DEFAULT_BLOCK_SIZE;
+        _maximum_polyphony = DEFAULT_MAXIMUM_POLYPHONY;
+        _reverb_and_chorus_enabled = DEFAULT_REVERB_AND_CHORUS_ENABLED;
+        _nb_worker_threads = DEFAULT_NB_WORKER_THREADS;
+        _interpolation_mode = DEFAULT_INTERPOLATION_MODE;
+        _statistics_enabled = DEFAULT_STATISTICS_ENABLED;
+        _midi_queue_size = DEFAULT_MIDI_QUEUE_SIZE;
+        _fast_math_enabled = DEFAULT_FAST_MATH_ENABLED;
+        _nb_stems = DEFAULT_NB_STEMS;
+        _nb_channels = DEFAULT_NB_CHANNELS;
+        _inaudible_level = DEFAULT_INAUDIBLE_LEVEL;
+        _denormals_flushing_enabled = DEFAULT_DENORMALS_FLUSHING_ENABLED;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::setSampleRate(uint32_t sample_rate)
+    {
+        if ((sample_rate < 16000) || (sample_rate > 192000))
+            throw std::runtime_error(std::string("The sample rate must be between 16000 and 192000."));
+
+        _sample_rate = sample_rate;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::setBlockSize(uint16_t block_size)
+    {
+        if ((block_size < 8) || (block_size > 1024))
+            throw std::runtime_error(std::string("The block size must be between 8 and 1024."));
+
+        _block_size = block_size;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::setMaximumPolyphony(uint16_t maximum_polyphony)
+    {
+        if ((maximum_polyphony < 8) || (maximum_polyphony > 256))
+            throw std::runtime_error(std::string("The block size must be between 8 and 256."));
+
+            _maximum_polyphony = maximum_polyphony;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::enableReverbAndChorus(bool enable)
+    {
+        _reverb_and_chorus_enabled = enable;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::setNbWorkerThreads(uint16_t nb_threads)
+    {
+        if (nb_threads > 64)
+            throw std::runtime_error(std::string("The number of worker threads must be between 0 and 64."));
+
+        _nb_worker_threads = nb_threads;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::setInterpolationMode(interpolation_mode_t mode)
+    {
+        if ((mode < INTERPOLATION_MODE_NEAREST) || (mode > INTERPOLATION_MODE_SINC))
+            throw std::runtime_error(std::string("Unknown interpolation mode."));
+
+        _interpolation_mode = mode;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::enableStatistics(bool enable)
+    {
+        _statistics_enabled = enable;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::setMidiQueueSize(uint32_t size)
+    {
+        if ((size < 16) || (size > 65536) || ((size & (size - 1)) != 0))
+            throw std::runtime_error(std::string("The size of the MIDI queue must be a power of two between 16 and 65536."));
+
+        _midi_queue_size = size;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::enableFastMath(bool enable)
+    {
+        _fast_math_enabled = enable;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::setNbStems(uint16_t nb_stems)
+    {
+        if (nb_stems > 256)
+            throw std::runtime_error(std::string("The number of stems must be between 0 and 256."));
+
+        _nb_stems = nb_stems;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::setNbChannels(uint16_t nb_channels)
+    {
+        if ((nb_channels < 16) || (nb_channels > 256) || (nb_channels % 16 != 0))
+            throw std::runtime_error(std::string("The number of channels must be a multiple of 16 between 16 and 256."));
+
+        _nb_channels = nb_channels;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::setInaudibleLevel(float level)
+    {
+        if ((level < -100.0f) || (level > -20.0f))
+            throw std::runtime_error(std::string("The inaudible level must be between -100 and -20 dB."));
+
+        _inaudible_level = level;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void SynthesizerSettings::enableDenormalsFlushing(bool enable)
+    {
+        _denormals_flushing_enabled = enable;
+    }
+
+
+    /*********************************** SYNTHESIZER ************************************/
+
+    Synthesizer::Synthesizer(const SynthesizerSettings& settings)
+    : _soundfont(std::make_shared<sf::SoundFont>()), _settings(settings)
+    {
+        for (int i = 0; i < _settings.nbChannels(); ++i)
+            _channels.emplace_back(Channel(i % CHANNELS_PER_PORT == PERCUSSION_CHANNEL));
+
+        _voices = new VoiceCollection(this);
+        _midi_queue = new MidiQueue(_settings.midiQueueSize());
+        _release_queue = new ReleaseQueue(RELEASE_QUEUE_SIZE);
+        _dither_noise = allocate_aligned_floats(2 * _settings.blockSize());
+
+        _block_left = allocate_aligned_floats(_settings.blockSize());
+        _block_right = allocate_aligned_floats(_settings.blockSize());
+        _blocks_offset = _settings.blockSize();
+        _inverse_block_size = 1.0f / float(_settings.blockSize());
+
+        if (_settings.nbStems() > 0)
+        {
+            _stem_block_size = aligned_block_size(_settings.blockSize());
+            _stem_blocks = allocate_aligned_floats(2 * _settings.nbStems() * _stem_block_size);
+
+            for (size_t i = 0; i < _channels.size(); ++i)
+                _channel_stems.push_back(i % _settings.nbStems());
+        }
+        else
+        {
+            _channel_stems.resize(_channels.size(), 0);
+        }
+
+        if (_settings.reverbAndChorusEnabled())
+        {
+            _reverb = new Reverb(_settings.sampleRate());
+            _chorus = new Chorus(_settings.sampleRate());
+
+            _reverb_input = allocate_aligned_floats(_settings.blockSize());
+            _chorus_input_left = allocate_aligned_floats(_settings.blockSize());
+            _chorus_input_right = allocate_aligned_floats(_settings.blockSize());
+            _effect_left = allocate_aligned_floats(_settings.blockSize());
+            _effect_right = allocate_aligned_floats(_settings.blockSize());
+        }
+    }
+
+    //-----------------------------------------------------------------------
+
+    Synthesizer::~Synthesizer()
+    {
+        free_aligned_floats(_block_left);
+        free_aligned_floats(_block_right);
+        free_aligned_floats(_stem_blocks);
+        delete _voices;
+        delete _midi_queue;
+        delete _release_queue;
+        free_aligned_floats(_dither_noise);
+
+        delete _reverb;
+        delete _chorus;
+        free_aligned_floats(_reverb_input);
+        free_aligned_floats(_chorus_input_left);
+        free_aligned_floats(_chorus_input_right);
+        free_aligned_floats(_effect_left);
+        free_aligned_floats(_effect_right);
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool Synthesizer::loadSoundFont(const std::filesystem::path& path, sf::load_mode_t mode)
+    {
+        auto soundfont = std::make_shared<sf::SoundFont>();
+        if (!soundfont->load(path, mode))
+            return false;
+
+        return setSoundFont(soundfont);
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool Synthesizer::loadSoundFont(const char* buffer, size_t size)
+    {
+        auto soundfont = std::make_shared<sf::SoundFont>();
+        if (!soundfont->load(buffer, size))
+            return false;
+
+        return setSoundFont(soundfont);
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool Synthesizer::setSoundFont(const std::shared_ptr<const sf::SoundFont>& soundfont)
+    {
+        if (!soundfont || soundfont->getPresets().empty())
+            return false;
+
+        // The voices might still reference the samples of the previous SoundFont
+        _voices->clear();
+
+        _soundfont = soundfont;
+        _default_preset = _soundfont->getPresets().begin()->first;
+
+        return true;
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool Synthesizer::processMidiMessage(
+        uint8_t channel, uint8_t command, uint8_t data1, uint8_t data2
+    )
+    {
+        if (channel >= _channels.size())
+            return false;
+
+        auto& channel_info = _channels[channel];
+
+        switch (command)
+        {
+            // Note Off
+            case 0x80: 
+                noteOff(channel, data1);
+                break;
+
+            // Note On
+            case 0x90:
+                noteOn(channel, data1, data2);
+                break;
+
+            // Controller
+            case 0xB0:
+            {
+                channel_info.setController(data1, data2);
+
+                switch (data1)
+                {
+                    // Bank Selection
+                    case 0x00:
+                    {
+                        sf::preset_id_t previous = channelPreset(channel_info);
+                        channel_info.setBank(data2);
+                        prefetchChannelPreset(channel_info, previous);
+                        break;
+                    }
+
+                    // Modulation Coarse
+                    case 0x01:
+                        channel_info.setModulationCoarse(data2);
+                        break;
+
+                    // Modulation Fine
+                    case 0x21:
+                        channel_info.setModulationFine(data2);
+                        break;
+
+                    // Data Entry Coarse
+                    case 0x06:
+                        channel_info.setDataEntryCoarse(data2);
+                        break;
+
+                    // Data Entry Fine
+                    case 0x26:
+                        channel_info.setDataEntryFine(data2);
+                        break;
+
+                    // Channel Volume Coarse
+                    case 0x07:
+                        channel_info.setVolumeCoarse(data2);
+                        break;
+
+                    // Channel Volume Fine
+                    case 0x27:
+                        channel_info.setVolumeFine(data2);
+                        break;
+
+                    // Pan Coarse
+                    case 0x0A:
+                        channel_info.setPanCoarse(data2);
+                        break;
+
+                    // Pan Fine
+                    case 0x2A:
+                        channel_info.setPanFine(data2);
+                        break;
+
+                    // Expression Coarse
+                    case 0x0B:
+                        channel_info.setExpressionCoarse(data2);
+                        break;
+
+                    // Expression Fine
+                    case 0x2B:
+                        channel_info.setExpressionFine(data2);
+                        break;
+
+                    // Sustain
+                    case 0x40:
+                        channel_info.setSustain(data2);
+                        break;
+
+                    // Reverb Send
+                    case 0x5B:
+                        channel_info.setReverbSend(data2);
+                        break;
+
+                    // Chorus Send
+                    case 0x5D:
+                        channel_info.setChorusSend(data2);
+                        break;
+
+                    // RPN Coarse
+                    case 0x65:
+                        channel_info.setRPNCoarse(data2);
+                        break;
+
+                    // RPN Fine
+                    case 0x64:
+                        channel_info.setRPNFine(data2);
+                        break;
+
+                    // All Sound Off
+                    case 0x78:
+                        allNotesOff(channel, true);
+                        break;
+
+                    // Reset All Controllers
+                    case 0x79:
+                        resetControllers(channel);
+                        break;
+
+                    // All Note Off
+                    case 0x7B:
+                        allNotesOff(channel, false);
+                        break;
+
+                    default:
+                        break;
+                }
+           
+                break;
+            }
+
+            // Program Change
+            case 0xC0:
+            {
+                sf::preset_id_t previous = channelPreset(channel_info);
+                channel_info.setPreset(data1);
+                prefetchChannelPreset(channel_info, previous);
+                break;
+            }
+
+            // Channel Pressure
+            case 0xD0:
+                channel_info.setChannelPressure(data1);
+                break;
+
+            // Pitch Bend
+            case 0xE0:
+                channel_info.setPitchBend(data1, data2);
+
+            default:
+                break;
+        }
+
+        return true;
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Synthesizer::noteOff(uint8_t channel, uint8_t key)
+    {
+        if (channel >= _channels.size())
+            return;
+
+        Voice* voice = _voices->firstVoiceOfKey(channel, key);
+        for (; voice; voice = voice->nextVoiceOfKey())
+            voice->end();
+    }
+
+    //-----------------------------------------------------------------------
+
+    bool Synthesizer::postMidiMessage(
+        uint8_t channel, uint8_t command, uint8_t data1, uint8_t data2
+    )
+    {
+        return _midi_queue->push({ 0, channel, command, data1, data2 });
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Synthesizer::processPostedMidiMessages()
+    {
+        midi_event_t event;
+        while (_midi_queue->pop(event))
+            processMidiMessage(event.channel, event.command, event.data1, event.data2);
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Synthesizer::noteOn(uint8_t channel, uint8_t key, uint8_t velocity)
+    {
+        if (velocity == 0)
+        {
+            noteOff(channel, key);
+            return;
+        }
+
+        if (channel >= _channels.size())
+            return;
+
+        auto& channel_info = _channels[channel];
+
+        sf::preset_id_t preset_id = { channel_info.bank(), channel_info.preset() };
+
+        sf::key_info_t key_info;
+        if (!_soundfont->getKeyInfo(preset_id.bank, preset_id.number, key, velocity, key_info))
+        {
+            // Try fallback to the GM sound set.
+            // Normally, the given preset number + the bank number 0 will work.
+            // For drums (bank number >= 128), it seems to be better to select the standard set (128:0).
+            if (channel_info.bank() < 128)
+            {
+                preset_id.bank = 0;
+            }
+            else
+            {
+                preset_id.bank = 128;
+                preset_id.number = 0;
+            }
+
+            if (!_soundfont->getKeyInfo(preset_id.bank, preset_id.number, key, velocity, key_info))
+            {
+                // No corresponding preset was found. Use the default one.
+                if (!_soundfont->getKeyInfo(_default_preset.bank, _default_preset.number, key, velocity, key_info))
+                {
+                    ++_statistics.nb_dropped_notes;
+                    return;
+                }
+            }
+        }
+
+        Voice* voice = _voices->request(
+            channel, key, key_info.left.generator(sf::GEN_TYPE_EXCLUSIVE_CLASS, { 0 }).uvalue
+        );
+        voice->start(
+            key_info, _soundfont->getSampleBuffer(), channel, key, velocity,
+            _prefetch_callback != nullptr
+        );
+        _voices->started(voice);
+
+        _statistics.peak_polyphony = std::max(
+            _statistics.peak_polyphony, uint16_t(_voices->nbActiveVoices())
+        );
+    }
+
+    //-----------------------------------------------------------------------
+
+    void Synthesizer::allNotesOff(bool immediate)
+    {
+        if (immediate)
+        {
+            _voices->clear();
+        }
+        else
+        {
+            auto& voices = _voices->voices();
+            for (int i = 0; i < _voices->nbActiveVoices(); ++i)
+                voices[i]->end();
+        }
+    }
 
     //-----------------------------------------------------------------------
 
-    ModulationEnvelope::ModulationEnvelope(uint16_t sample_rate)
-    : sample_rate(sample_rate)
+    void Synthesizer::allNotesOff(uint8_t channel, bool immediate)
     {
+        if (channel >= _channels.size())
+            return;
+
+        Voice* voice = _voices->firstVoiceOfChannel(channel);
+
+        if (immediate)
+        {
+            for (; voice; voice = voice->nextVoiceOfChannel())
+            {
+                voice->kill();
+                _voices->updatePriority(voice);
+            }
+        }
+        else
+        {
+            for (; voice; voice = voice->nextVoiceOfChannel())
+                voice->end();
+        }
     }
 
     //-----------------------------------------------------------------------
 
-    void ModulationEnvelope::start(
-        float delay, float attack, float hold, float decay, float sustain,
-        float release
-    )
+    void Synthesizer::resetAllControllers()
     {
-        attack_slope = 1.0f / attack;
-        decay_slope = 1.0f / decay;
-        release_slope = 1.0f / release;
-
-        attack_start_time = delay;
-        hold_start_time = attack_start_time + attack;
-        decay_start_time = hold_start_time + hold;
-
-        decay_end_time = decay_start_time + decay;
-        release_end_time = release;
+        for (auto& channel : _channels)
+            channel.resetControllers();
+    }
 
-        sustain_level = clamp(sustain, 0.0f, 1.0f);
-        release_level = 0.0f;
+    //-----------------------------------------------------------------------
 
-        nb_processed_samples = 0;
-        stage = ENV_STAGE_DELAY;
-        value = 0.0f;
+    void Synthesizer::resetControllers(uint8_t channel)
+    {
+        if (channel >= _channels.size())
+            return;
 
-        process(0);
+        _channels[channel].resetControllers();
     }
 
     //-----------------------------------------------------------------------
 
-    void ModulationEnvelope::release()
+    void Synthesizer::reset()
     {
-        stage = ENV_STAGE_RELEASE;
-        release_end_time += float(nb_processed_samples) / sample_rate;
-        release_level = value;
+        _voices->clear();
+
+        for (auto& channel : _channels)
+            channel.reset();
+
+        if (_reverb)
+        {
+            _reverb->clear();
+            _chorus->clear();
+        }
+    
+        _blocks_offset = _settings.blockSize();
+        _nb_rendered_samples = 0;
     }
 
     //-----------------------------------------------------------------------
 
-    bool ModulationEnvelope::process(uint32_t nb_samples)
+    bool Synthesizer::snapshot(SynthesizerSnapshot& snapshot) const
     {
-        nb_processed_samples += nb_samples;
-
-        float current_time = float(nb_processed_samples) / sample_rate;
+        if (!snapshot.compatible(*this))
+            return false;
 
-        // Change stage if necessary
-        while (stage <= ENV_STAGE_HOLD)
-        {
-            float end;
+        snapshot._soundfont = _soundfont;
 
-            switch (stage)
-            {
-                case ENV_STAGE_DELAY: end = attack_start_time; break;
-                case ENV_STAGE_ATTACK: end = hold_start_time; break;
-                case ENV_STAGE_HOLD: end = decay_start_time; break;
-                default: return false;
-            }
+        // Same sizes: the vectors aren't reallocated
+        snapshot._channels = _channels;
+        snapshot._channel_stems = _channel_stems;
+        snapshot._voices->copyState(*_voices);
 
-            if (current_time < end)
-                break;
+        memcpy(snapshot._block_left, _block_left, _settings.blockSize() * sizeof(float));
+        memcpy(snapshot._block_right, _block_right, _settings.blockSize() * sizeof(float));
+        snapshot._block_silent = _block_silent;
+        snapshot._blocks_offset = _blocks_offset;
 
-            stage = envelope_stage_t(int(stage) + 1);
+        if (_stem_blocks)
+        {
+            memcpy(snapshot._stem_blocks, _stem_blocks,
+                   snapshot._stem_blocks_size * sizeof(float));
         }
 
-        // Compute the envelope value at current stage
-        switch (stage)
+        snapshot._stems_rendered = _stems_rendered;
+
+        if (_reverb)
         {
-            case ENV_STAGE_DELAY:
-                value = 0.0f;
-                return true;
-            
-            case ENV_STAGE_ATTACK:
-                value = attack_slope * (current_time - attack_start_time);
-                return true;
-            
-            case ENV_STAGE_HOLD:
-                value = 1.0;
-                return true;
+            *snapshot._reverb = *_reverb;
+            *snapshot._chorus = *_chorus;
+        }
 
-            case ENV_STAGE_DECAY:
-                value = fmax(
-                    decay_slope * (decay_end_time - current_time),
-                    sustain_level
-                );
-                return (value > NON_AUDIBLE);
+        snapshot._dither_state = _dither_state;
+        snapshot._nb_rendered_samples = _nb_rendered_samples;
+        snapshot._master_volume = _master_volume;
 
-            case ENV_STAGE_RELEASE:
-                value = fmax(
-                    release_level * release_slope * (release_end_time - current_time),
-                    0.0f
-                );
-                return (value > NON_AUDIBLE);
-        }
+        snapshot._sequencer.valid = false;
+        snapshot._valid = true;
 
-        return false;
+        return true;
     }
 
+    //-----------------------------------------------------------------------
 
-    /*************************************** LFO ****************************************/
-
-    //------------------------------------------------------------------------------------
-    /// @brief  Low frequency oscillator
-    //------------------------------------------------------------------------------------
-    class Lfo
+    bool Synthesizer::restore(const SynthesizerSnapshot& snapshot)
     {
-    public:
-        Lfo(const SynthesizerSettings& settings);
+        if (!snapshot._valid || !snapshot.compatible(*this) ||
+            (snapshot._soundfont != _soundfont))
+        {
+            return false;
+        }
 
-        void start(float delay, float frequency);
+        _channels = snapshot._channels;
+        _channel_stems = snapshot._channel_stems;
+        _voices->copyState(*snapshot._voices);
 
-        void process();
+        memcpy(_block_left, snapshot._block_left, _settings.blockSize() * sizeof(float));
+        memcpy(_block_right, snapshot._block_right, _settings.blockSize() * sizeof(float));
+        _block_silent = snapshot._block_silent;
+        _blocks_offset = snapshot._blocks_offset;
 
-        inline float value()
+        if (_stem_blocks)
         {
-            return _value;
+            memcpy(_stem_blocks, snapshot._stem_blocks,
+                   snapshot._stem_blocks_size * sizeof(float));
         }
-    
 
-        //_____ Attributes __________
-    private:
-        const SynthesizerSettings& _settings;
-
-        bool _active;
-        float _delay;
-        float _period;
+        _stems_rendered = snapshot._stems_rendered;
 
-        uint32_t _nb_processed_samples;
-        float _value;
-    };
+        if (_reverb)
+        {
+            *_reverb = *snapshot._reverb;
+            *_chorus = *snapshot._chorus;
+        }
 
-    //-----------------------------------------------------------------------
+        _dither_state = snapshot._dither_state;
+        _nb_rendered_samples = snapshot._nb_rendered_samples;
+        _master_volume = snapshot._master_volume;
 
-    Lfo::Lfo(const SynthesizerSettings& settings)
-    : _settings(settings)
-    {
+        return true;
     }
 
     //-----------------------------------------------------------------------
 
-    void Lfo::start(float delay, float frequency)
+    silent_ranges_t Synthesizer::render(float* left, float* right, size_t size)
     {
-        if (frequency > 0.001f)
+        size_t nb_written = 0;
+        silent_ranges_t silence;
+
+        while (nb_written < size)
         {
-            _active = true;
+            size_t nb_silent = skipSilentBlocks(size - nb_written);
+            if (nb_silent > 0)
+            {
+                memset((char*) (left + nb_written), 0, nb_silent * sizeof(float));
+                memset((char*) (right + nb_written), 0, nb_silent * sizeof(float));
 
-            _delay = delay;
-            _period = 1.0f / frequency;
+                append_range(silence, nb_silent, true);
+                nb_written += nb_silent;
+                continue;
+            }
 
-            _nb_processed_samples = 0;
-            _value = 0.0f;
-        }
-        else
-        {
-            _active = false;
-            _value = 0.0f;
+            const float* block_left;
+            const float* block_right;
+            size_t remainder = fetchStereo(size - nb_written, block_left, block_right);
+
+            memcpy(left + nb_written, block_left, remainder * sizeof(float));
+            memcpy(right + nb_written, block_right, remainder * sizeof(float));
+
+            append_range(silence, remainder, _block_silent);
+            nb_written += remainder;
         }
+
+        _nb_rendered_samples += nb_written;
+
+        return silence;
     }
 
     //-----------------------------------------------------------------------
 
-    void Lfo::process()
+    silent_ranges_t Synthesizer::renderInterleaved(float* buffer, size_t size)
     {
-        if (!_active)
-            return;
+        size_t nb_written = 0;
+        silent_ranges_t silence;
 
-        _nb_processed_samples += _settings.blockSize();
+        while (nb_written < size)
+        {
+            size_t nb_silent = skipSilentBlocks(size - nb_written);
+            if (nb_silent > 0)
+            {
+                memset((char*) (buffer + 2 * nb_written), 0, 2 * nb_silent * sizeof(float));
+                append_range(silence, nb_silent, true);
+                nb_written += nb_silent;
+                continue;
+            }
 
-        float current_time = float(_nb_processed_samples) / _settings.sampleRate();
+            const float* left;
+            const float* right;
+            size_t remainder = fetchStereo(size - nb_written, left, right);
 
-        if (current_time < _delay)
-        {
-            _value = 0.0f;
-        }
-        else
-        {
-            float phase = fmod(current_time - _delay, _period) / _period;
+            interleave(buffer + 2 * nb_written, left, right, remainder);
 
-            if (phase < 0.25f)
-                _value = 4.0f * phase;
-            else if (phase < 0.75f)
-                _value = 4.0f * (0.5f - phase);
-            else
-                _value = 4.0f * (phase - 1.0f);
+            append_range(silence, remainder, _block_silent);
+            nb_written += remainder;
         }
-    }
 
+        _nb_rendered_samples += nb_written;
 
-    /*********************************** BIQUADFILTER ***********************************/
+        return silence;
+    }
 
-    //------------------------------------------------------------------------------------
-    /// @brief  Bi-quad filter
-    //------------------------------------------------------------------------------------
-    class BiQuadFilter
-    {
-    public:
-        BiQuadFilter(const SynthesizerSettings& settings);
+    //-----------------------------------------------------------------------
 
-        void clearBuffer();
+    silent_ranges_t Synthesizer::renderInterleaved(int16_t* buffer, size_t size, bool dither)
+    {
+        size_t nb_written = 0;
+        silent_ranges_t silence;
 
-        void setLowPassFilter(float cutoff_frequency, float resonance);
+        while (nb_written < size)
+        {
+            // The dither noise is added to the silent blocks too
+            size_t nb_silent = (dither ? 0 : skipSilentBlocks(size - nb_written));
+            if (nb_silent > 0)
+            {
+                memset((char*) (buffer + 2 * nb_written), 0, 2 * nb_silent * sizeof(int16_t));
+                append_range(silence, nb_silent, true);
+                nb_written += nb_silent;
+                continue;
+            }
 
-        void process(float* block, size_t size);
+            const float* left;
+            const float* right;
+            size_t remainder = fetchStereo(size - nb_written, left, right);
 
-    private:
-        void setCoefficients(float a0, float a1, float a2, float b0, float b1, float b2);
+            if (dither)
+            {
+                // Triangular distribution in ]-1, 1[ LSB, from the sum of two uniform
+                // distributions (linear congruential generator)
+                const float factor = 1.0f / 16777216.0f;
 
+                for (size_t t = 0; t < 2 * remainder; ++t)
+                {
+                    _dither_state = _dither_state * 1664525u + 1013904223u;
+                    float u1 = float(_dither_state >> 8) * factor;
 
-        //_____ Constants __________
-    private:
-        const float RESONANCE_PEAK_OFFSET = 1.0f - 1.0f / sqrt(2.0f);
+                    _dither_state = _dither_state * 1664525u + 1013904223u;
+                    float u2 = float(_dither_state >> 8) * factor;
 
+                    _dither_noise[t] = u1 - u2;
+                }
+            }
 
-        //_____ Attributes __________
-    private:
-        const SynthesizerSettings& _settings;
-        
-        bool _active;
+            interleave_int16(
+                buffer + 2 * nb_written, left, right, (dither ? _dither_noise : nullptr),
+                remainder
+            );
 
-        float _a0;
-        float _a1;
-        float _a2;
-        float _a3;
-        float _a4;
-    
-        float _x1;
-        float _x2;
-        float _y1;
-        float _y2;
-    };
+            append_range(silence, remainder, _block_silent && !dither);
+            nb_written += remainder;
+        }
 
-    //-----------------------------------------------------------------------
+        _nb_rendered_samples += nb_written;
 
-    BiQuadFilter::BiQuadFilter(const SynthesizerSettings& settings)
-    : _settings(settings)
-    {
+        return silence;
     }
 
     //-----------------------------------------------------------------------
 
-    void BiQuadFilter::clearBuffer()
+    silent_ranges_t Synthesizer::renderInterleaved(int32_t* buffer, size_t size)
     {
-        _x1 = 0.0f;
-        _x2 = 0.0f;
-        _y1 = 0.0f;
-        _y2 = 0.0f;
+        size_t nb_written = 0;
+        silent_ranges_t silence;
+
+        while (nb_written < size)
+        {
+            size_t nb_silent = skipSilentBlocks(size - nb_written);
+            if (nb_silent > 0)
+            {
+                memset((char*) (buffer + 2 * nb_written), 0, 2 * nb_silent * sizeof(int32_t));
+                append_range(silence, nb_silent, true);
+                nb_written += nb_silent;
+                continue;
+            }
+
+            const float* left;
+            const float* right;
+            size_t remainder = fetchStereo(size - nb_written, left, right);
+
+            interleave_int32(buffer + 2 * nb_written, left, right, remainder);
+
+            append_range(silence, remainder, _block_silent);
+            nb_written += remainder;
+        }
+
+        _nb_rendered_samples += nb_written;
+
+        return silence;
     }
 
     //-----------------------------------------------------------------------
 
-    void BiQuadFilter::setLowPassFilter(float cutoff_frequency, float resonance)
+    silent_ranges_t Synthesizer::renderStems(
+        float* const* left, float* const* right, size_t size, float* master_left,
+        float* master_right
+    )
     {
-        if (cutoff_frequency < 0.499f * _settings.sampleRate())
+        size_t nb_written = 0;
+        silent_ranges_t silence;
+
+        while (nb_written < size)
         {
-            _active = true;
+            size_t nb_silent = skipSilentBlocks(size - nb_written);
+            if (nb_silent > 0)
+            {
+                for (uint16_t stem = 0; stem < _settings.nbStems(); ++stem)
+                {
+                    memset((char*) (left[stem] + nb_written), 0, nb_silent * sizeof(float));
+                    memset((char*) (right[stem] + nb_written), 0, nb_silent * sizeof(float));
+                }
 
-            // This equation gives the Q value which makes the desired resonance peak.
-            // The error of the resultant peak height is less than 3%.
-            float q = resonance - RESONANCE_PEAK_OFFSET / (1.0f + 6.0f * (resonance - 1.0f));
+                if (master_left)
+                    memset((char*) (master_left + nb_written), 0, nb_silent * sizeof(float));
 
-            float w = 2.0f * M_PI * cutoff_frequency / _settings.sampleRate();
-            float cosw = cos(w);
-            float alpha = sin(w) / (2.0f * q);
+                if (master_right)
+                    memset((char*) (master_right + nb_written), 0, nb_silent * sizeof(float));
 
-            float b0 = (1.0f - cosw) / 2.0f;
-            float b1 = 1.0f - cosw;
-            float b2 = (1.0f - cosw) / 2.0f;
-            float a0 = 1.0f + alpha;
-            float a1 = -2.0f * cosw;
-            float a2 = 1.0f - alpha;
+                append_range(silence, nb_silent, true);
+                nb_written += nb_silent;
+                continue;
+            }
 
-            setCoefficients(a0, a1, a2, b0, b1, b2);
-        }
-        else
-        {
-            _active = false;
+            if (_blocks_offset == _settings.blockSize())
+            {
+                processPostedMidiMessages();
+                renderBlockStereo(_settings.blockSize(), true);
+                _blocks_offset = 0;
+            }
+
+            size_t count = std::min(size_t(_settings.blockSize() - _blocks_offset), size - nb_written);
+
+            for (uint16_t stem = 0; stem < _settings.nbStems(); ++stem)
+            {
+                if (_stems_rendered)
+                {
+                    const float* block = _stem_blocks + 2 * stem * _stem_block_size + _blocks_offset;
+
+                    memcpy(left[stem] + nb_written, block, count * sizeof(float));
+                    memcpy(right[stem] + nb_written, block + _stem_block_size, count * sizeof(float));
+                }
+                else
+                {
+                    memset((char*) (left[stem] + nb_written), 0, count * sizeof(float));
+                    memset((char*) (right[stem] + nb_written), 0, count * sizeof(float));
+                }
+            }
+
+            if (master_left)
+                memcpy(master_left + nb_written, _block_left + _blocks_offset, count * sizeof(float));
+
+            if (master_right)
+                memcpy(master_right + nb_written, _block_right + _blocks_offset, count * sizeof(float));
+
+            append_range(silence, count, _block_silent);
+            _blocks_offset += count;
+            nb_written += count;
         }
+
+        _nb_rendered_samples += nb_written;
+
+        return silence;
     }
 
     //-----------------------------------------------------------------------
 
-    void BiQuadFilter::process(float* block, size_t size)
+    size_t Synthesizer::fetchStereo(size_t max_size, const float*& left, const float*& right)
     {
-        if (_active)
+        if (_blocks_offset == _settings.blockSize())
         {
-            for (int t = 0; t < size; ++t)
-            {
-                float input = block[t];
-                float output = _a0 * input + _a1 * _x1 + _a2 * _x2 - _a3 * _y1 - _a4 * _y2;
+            processPostedMidiMessages();
+            renderBlockStereo(_settings.blockSize());
+            _blocks_offset = 0;
+        }
 
-                _x2 = _x1;
-                _x1 = input;
-                _y2 = _y1;
-                _y1 = output;
+        size_t size = std::min(size_t(_settings.blockSize() - _blocks_offset), max_size);
 
-                block[t] = output;
-            }
-        }
-        else
-        {
-            _x2 = block[size - 2];
-            _x1 = block[size - 1];
-            _y2 = _x2;
-            _y1 = _x1;
-        }
+        left = _block_left + _blocks_offset;
+        right = _block_right + _blocks_offset;
+
+        _blocks_offset += size;
+
+        return size;
     }
 
     //-----------------------------------------------------------------------
 
-    void BiQuadFilter::setCoefficients(
-        float a0, float a1, float a2, float b0, float b1, float b2
-    )
+    size_t Synthesizer::skipSilentBlocks(size_t max_size)
     {
-        _a0 = b0 / a0;
-        _a1 = b1 / a0;
-        _a2 = b2 / a0;
-        _a3 = a1 / a0;
-        _a4 = a2 / a0;
-    }
+        const size_t block_size = _settings.blockSize();
 
+        // Only at the start of a block, so nothing is left in the internal one
+        if (_blocks_offset < block_size)
+            return 0;
 
-    /************************************** VOICE ***************************************/
+        size_t size = 0;
 
-    //------------------------------------------------------------------------------------
-    /// @brief  Each voice is responsible to play one note
-    //------------------------------------------------------------------------------------
-    class Voice
-    {
-        //_____ Internal types __________
-    private:
-        struct track_t
+        // The posted MIDI messages are still processed before each block
+        while (max_size - size >= block_size)
         {
-            track_t(const SynthesizerSettings& settings)
-            : volume_envelope(settings.sampleRate()),
-              modulation_envelope(settings.sampleRate()),
-              vibrato_lfo(settings),
-              modulation_lfo(settings),
-              sampler(settings.sampleRate()),
-              filter(settings)
-            {}
+            processPostedMidiMessages();
 
-            VolumeEnvelope volume_envelope;
-            ModulationEnvelope modulation_envelope;
+            if (!isSilent())
+                break;
 
-            Lfo vibrato_lfo;
-            Lfo modulation_lfo;
+            size += block_size;
+        }
 
-            Sampler sampler;
-            BiQuadFilter filter;
+        // Like after the rendering of the blocks
+        if (size > 0)
+        {
+            for (auto& channel : _channels)
+                channel.updateControls();
+        }
 
-            float note_gain;
+        return size;
+    }
 
-            float cutoff;
-            float resonance;
+    //-----------------------------------------------------------------------
 
-            float vib_lfo_to_pitch;
-            float mod_lfo_to_pitch;
-            float mod_env_to_pitch;
+    silent_ranges_t Synthesizer::render(float* buffer, size_t size)
+    {
+        size_t nb_written = 0;
+        silent_ranges_t silence;
 
-            int mod_lfo_to_cutoff;
-            int mod_env_to_cutoff;
-            bool dynamic_cutoff;
+        while (nb_written < size)
+        {
+            size_t nb_silent = skipSilentBlocks(size - nb_written);
+            if (nb_silent > 0)
+            {
+                memset((char*) (buffer + nb_written), 0, nb_silent * sizeof(float));
+                append_range(silence, nb_silent, true);
+                nb_written += nb_silent;
+                continue;
+            }
 
-            float mod_lfo_to_volume;
-            bool dynamic_volume;
+            if (_blocks_offset == _settings.blockSize())
+            {
+                processPostedMidiMessages();
+                renderBlockMono(_settings.blockSize());
+                _blocks_offset = 0;
+            }
 
-            float instrument_pan;
-            float instrument_reverb;
-            float instrument_chorus;
+            size_t src_remainder = _settings.blockSize() - _blocks_offset;
+            size_t dst_remainder = size - nb_written;
+            size_t remainder = fmin(src_remainder, dst_remainder);
 
-            // Some instruments require fast cutoff change, which can cause pop noise.
-            // This is used to smooth out the cutoff frequency.
-            float smoothed_cutoff;
+            memcpy(buffer + nb_written, _block_left + _blocks_offset, remainder * sizeof(float));
 
-            float* block = nullptr;
+            append_range(silence, remainder, _block_silent);
+            _blocks_offset += remainder;
+            nb_written += remainder;
+        }
 
-            float previous_mix_gain = 0.0f;
-            float current_mix_gain = 0.0f;
-        };
+        _nb_rendered_samples += nb_written;
 
+        return silence;
+    }
 
-        //_____ Methods __________
-    public:
-        //--------------------------------------------------------------------------------
-        /// @brief  Constructor
-        ///
-        /// @param settings The settings of the synthesizer
-        //--------------------------------------------------------------------------------
-        Voice(const Synthesizer* synthesizer);
+    //-----------------------------------------------------------------------
 
-        ~Voice();
+    silent_ranges_t Synthesizer::render(
+        float* left, float* right, size_t size, const midi_event_t* events,
+        size_t nb_events
+    )
+    {
+        size_t nb_written = 0;
+        size_t next_event = 0;
+        silent_ranges_t silence;
 
-        void start(
-            const sf::key_info_t key_info, const float* buffer, uint8_t channel,
-            uint8_t key, uint8_t velocity
-        );
+        // First output the samples remaining from a previous call
+        if (_blocks_offset < _settings.blockSize())
+        {
+            nb_written = std::min(size_t(_settings.blockSize() - _blocks_offset), size);
 
-        void end();
-        void kill();
+            memcpy(left, _block_left + _blocks_offset, nb_written * sizeof(float));
+            memcpy(right, _block_right + _blocks_offset, nb_written * sizeof(float));
 
-        bool process();
+            append_range(silence, nb_written, _block_silent);
+            _blocks_offset += nb_written;
+        }
 
-        inline float priority() const
+        while (nb_written < size)
         {
-            if (_stereo)
+            while ((next_event < nb_events) && (events[next_event].offset <= nb_written))
             {
-                if ((_left.note_gain < NON_AUDIBLE) && (_right.note_gain < NON_AUDIBLE))
-                    return 0.0f;
-
-                return std::max(_left.volume_envelope.getPriority(), _right.volume_envelope.getPriority());
+                const midi_event_t& event = events[next_event];
+                processMidiMessage(event.channel, event.command, event.data1, event.data2);
+                ++next_event;
             }
-            else
+
+            const size_t next_offset = nextEventOffset(events, nb_events, next_event, size);
+
+            // Nothing is playing: skip the complete blocks up to the next event
+            size_t nb_silent = skipSilentBlocks(next_offset - nb_written);
+            if (nb_silent > 0)
             {
-                if (_left.note_gain < NON_AUDIBLE)
-                    return 0.0f;
+                memset((char*) (left + nb_written), 0, nb_silent * sizeof(float));
+                memset((char*) (right + nb_written), 0, nb_silent * sizeof(float));
 
-                return _left.volume_envelope.getPriority();
+                append_range(silence, nb_silent, true);
+                nb_written += nb_silent;
+                continue;
             }
-        }
-
-        inline bool stereo() const
-        {
-            return _stereo;
-        }
 
-        inline float* block_left() const
-        {
-            return _left.block;
-        }
+            // Render up to the next event, without any leftover in the internal block
+            size_t block_size = std::min(size_t(_settings.blockSize()), next_offset - nb_written);
 
-        inline float* block_right() const
-        {
-            return _right.block;
-        }
+            processPostedMidiMessages();
+            renderBlockStereo(block_size);
 
-        inline float previousMixGainLeft() const
-        {
-            return _left.previous_mix_gain;
-        }
+            memcpy(left + nb_written, _block_left, block_size * sizeof(float));
+            memcpy(right + nb_written, _block_right, block_size * sizeof(float));
 
-        inline float previousMixGainRight() const
-        {
-            return _right.previous_mix_gain;
+            append_range(silence, block_size, _block_silent);
+            nb_written += block_size;
         }
 
-        inline float currentMixGainLeft() const
+        for (; next_event < nb_events; ++next_event)
         {
-            return _left.current_mix_gain;
+            const midi_event_t& event = events[next_event];
+            processMidiMessage(event.channel, event.command, event.data1, event.data2);
         }
 
-        inline float currentMixGainRight() const
-        {
-            return _right.current_mix_gain;
-        }
+        _nb_rendered_samples += nb_written;
 
-        inline float previousReverbSend() const
-        {
-            return _previous_reverb_send;
-        }
+        return silence;
+    }
 
-        inline float previousChorusSend() const
-        {
-            return _previous_chorus_send;
-        }
+    //-----------------------------------------------------------------------
 
-        inline float currentReverbSend() const
-        {
-            return _current_reverb_send;
-        }
+    silent_ranges_t Synthesizer::render(
+        float* buffer, size_t size, const midi_event_t* events, size_t nb_events
+    )
+    {
+        size_t nb_written = 0;
+        size_t next_event = 0;
+        silent_ranges_t silence;
 
-        inline float currentChorusSend() const
+        // First output the samples remaining from a previous call
+        if (_blocks_offset < _settings.blockSize())
         {
-            return _current_chorus_send;
-        }
+            nb_written = std::min(size_t(_settings.blockSize() - _blocks_offset), size);
 
-        inline uint8_t exclusiveClass() const
-        {
-            return _exclusive_class;
-        }
+            memcpy(buffer, _block_left + _blocks_offset, nb_written * sizeof(float));
 
-        inline uint8_t channel() const
-        {
-            return _channel;
+            append_range(silence, nb_written, _block_silent);
+            _blocks_offset += nb_written;
         }
 
-        inline uint8_t key() const
+        while (nb_written < size)
         {
-            return _key;
-        }
+            while ((next_event < nb_events) && (events[next_event].offset <= nb_written))
+            {
+                const midi_event_t& event = events[next_event];
+                processMidiMessage(event.channel, event.command, event.data1, event.data2);
+                ++next_event;
+            }
 
-        inline uint8_t velocity() const
-        {
-            return _velocity;
-        }
+            const size_t next_offset = nextEventOffset(events, nb_events, next_event, size);
 
-        inline uint32_t voiceLength() const
-        {
-            return _voice_length;
-        }
+            // Nothing is playing: skip the complete blocks up to the next event
+            size_t nb_silent = skipSilentBlocks(next_offset - nb_written);
+            if (nb_silent > 0)
+            {
+                memset((char*) (buffer + nb_written), 0, nb_silent * sizeof(float));
+                append_range(silence, nb_silent, true);
+                nb_written += nb_silent;
+                continue;
+            }
 
-    private:
-        void start(const sf::sample_info_t& key_info, const float* buffer, track_t& track);
-        bool process(const Channel& channel_info, track_t& track);
+            // Render up to the next event, without any leftover in the internal block
+            size_t block_size = std::min(size_t(_settings.blockSize()), next_offset - nb_written);
 
+            processPostedMidiMessages();
+            renderBlockMono(block_size);
 
-        //_____ Attributes __________
-    private:
-        const Synthesizer* _synthesizer;
+            memcpy(buffer + nb_written, _block_left, block_size * sizeof(float));
 
-        bool _stereo = false;
-        track_t _left;
-        track_t _right;
+            append_range(silence, block_size, _block_silent);
+            nb_written += block_size;
+        }
 
-        float _previous_reverb_send = 0.0f;
-        float _previous_chorus_send = 0.0f;
-        float _current_reverb_send = 0.0f;
-        float _current_chorus_send = 0.0f;
+        for (; next_event < nb_events; ++next_event)
+        {
+            const midi_event_t& event = events[next_event];
+            processMidiMessage(event.channel, event.command, event.data1, event.data2);
+        }
 
-        uint8_t _exclusive_class;
-        uint8_t _channel;
-        uint8_t _key;
-        uint8_t _velocity;
+        _nb_rendered_samples += nb_written;
 
-        voice_state_t _voice_state;
-        uint32_t _voice_length;
-    };
+        return silence;
+    }
 
     //-----------------------------------------------------------------------
 
-    Voice::Voice(const Synthesizer* synthesizer)
-    : _synthesizer(synthesizer), _left(synthesizer->settings()), _right(synthesizer->settings())
+    bool Synthesizer::isSilent() const
     {
-        _left.block = new float[synthesizer->settings().blockSize()];
-        _right.block = new float[synthesizer->settings().blockSize()];
+        if (_voices->nbActiveVoices() > 0)
+            return false;
+
+        return !_reverb || (_reverb->idle() && _chorus->idle());
     }
 
     //-----------------------------------------------------------------------
 
-    Voice::~Voice()
+    uint16_t Synthesizer::nbActiveVoices() const
     {
-        delete[] _left.block;
-        delete[] _right.block;
+        return _voices->nbActiveVoices();
     }
 
     //-----------------------------------------------------------------------
 
-    void Voice::start(
-        const sf::key_info_t key_info, const float* buffer, uint8_t channel, uint8_t key,
-        uint8_t velocity
-    )
+    statistics_t Synthesizer::getStatistics() const
     {
-        _stereo = key_info.stereo;
-
-        _exclusive_class = key_info.left.generator(sf::GEN_TYPE_EXCLUSIVE_CLASS, { 0 }).uvalue;
-        _channel = channel;
-        _key = key;
-        _velocity = velocity;
-
-        start(key_info.left, buffer, _left);
+        statistics_t statistics = _statistics;
+        statistics.nb_voice_steals = _voices->nbSteals();
+        return statistics;
+    }
 
-        if (_stereo)
-            start(key_info.right, buffer, _right);
+    //-----------------------------------------------------------------------
 
-        _voice_state = VOICE_STATE_PLAYING;
-        _voice_length = 0;
+    void Synthesizer::resetStatistics()
+    {
+        _statistics = statistics_t();
+        _voices->resetNbSteals();
     }
 
     //-----------------------------------------------------------------------
 
-    void Voice::end()
+    void Synthesizer::setStatisticsCallback(statistics_callback_t callback, void* user_data)
     {
-        if (_voice_state == VOICE_STATE_PLAYING)
-            _voice_state = VOICE_STATE_RELEASE_REQUESTED;
+        _statistics_callback = callback;
+        _statistics_user_data = user_data;
     }
 
     //-----------------------------------------------------------------------
 
-    void Voice::kill()
+    float Synthesizer::masterVolume() const
     {
-        _left.note_gain = 0.0f;
-        _right.note_gain = 0.0f;
+        return linear_to_decibels(_master_volume);
     }
-    
+
     //-----------------------------------------------------------------------
 
-    bool Voice::process()
+    void Synthesizer::setMasterVolume(float volume)
     {
-        if ((_left.note_gain < NON_AUDIBLE) && (!_stereo || (_right.note_gain < NON_AUDIBLE)))
-            return false;
+        _master_volume = decibels_to_linear(volume);
+    }
 
-        auto channel_info = _synthesizer->getChannel(_channel);
+    //-----------------------------------------------------------------------
 
-        if ((_voice_length >= _synthesizer->settings().sampleRate() / 500) &&
-            (_voice_state == VOICE_STATE_RELEASE_REQUESTED) &&
-            !channel_info.sustain())
-        {
-            _left.volume_envelope.release();
-            _left.modulation_envelope.release();
-            _left.sampler.release();
+    bool Synthesizer::configureChannel(uint8_t channel, uint8_t bank, uint8_t preset)
+    {
+        if (channel >= _channels.size())
+            return false;
 
-            if (_stereo)
-            {
-                _right.volume_envelope.release();
-                _right.modulation_envelope.release();
-                _right.sampler.release();
-            }
+        const sf::preset_t* p = _soundfont->getPreset(bank, preset);
+        if (!p)
+            return false;
 
-            _voice_state = VOICE_STATE_RELEASED;
-        }
+        Channel& c = _channels[channel];
+        c.setBank(bank);
+        c.setPreset(preset);
 
-        _left.previous_mix_gain = _left.current_mix_gain;
-        _right.previous_mix_gain = _right.current_mix_gain;
+        if (_prefetch_callback && _soundfont->hasCompressedSamples())
+            _prefetch_callback(_soundfont, { bank, preset }, _prefetch_user_data);
 
-        bool success = process(channel_info, _left);
+        return true;
+    }
 
-        if (_stereo)
-            success = process(channel_info, _right) || success;
+    //-----------------------------------------------------------------------
 
-        if (!success)
-            return false;
+    void Synthesizer::setPrefetchCallback(prefetch_callback_t callback, void* user_data)
+    {
+        _prefetch_callback = callback;
+        _prefetch_user_data = user_data;
+    }
 
-        if (!_stereo)
-        {
-            float pan = channel_info.pan() + _left.instrument_pan;
-            if ((pan > -50.0f) &&  (pan < 50.0f))
-            {
-                float angle = (M_PI_2 / 50.0f) * pan;
-                float factor = 1.0 + (sqrtf(2.0f) - 1.0) * cosf(angle);
+    //-----------------------------------------------------------------------
 
-                float gain = _left.current_mix_gain;
+    void Synthesizer::releaseDecodedSamples()
+    {
+        sf::decoded_sample_t sample;
+        while (_release_queue->pop(sample))
+            sample.reset();
+    }
 
-                _left.current_mix_gain = gain * (50.0f - pan) / 100.0f * factor;
-                _right.current_mix_gain = gain * (50.0f + pan) / 100.0f * factor;
-            }
-        }
-        else
-        {
-            float pan = channel_info.pan() + _left.instrument_pan;
-            if ((pan > -50.0f) &&  (pan < 50.0f))
-            {
-                float angle = (M_PI_2 / 50.0f) * pan;
-                float factor = 1.0 + (sqrtf(2.0f) - 1.0) * cosf(angle);
+    //-----------------------------------------------------------------------
 
-                _left.current_mix_gain *= (50.0f - pan) / 100.0f * factor;
-            }
+    void Synthesizer::releaseDecodedSample(sf::decoded_sample_t& sample) const
+    {
+        if (!sample)
+            return;
 
-            pan = channel_info.pan() + _right.instrument_pan;
-            if ((pan > -50.0f) &&  (pan < 50.0f))
-            {
-                float angle = (M_PI_2 / 50.0f) * pan;
-                float factor = 1.0 + (sqrtf(2.0f) - 1.0) * cosf(angle);
+        if (!_prefetch_callback || !_release_queue->push(std::move(sample)))
+            sample.reset();
+    }
 
-                _right.current_mix_gain *= (50.0f - pan) / 100.0f * factor;
-            }
-        }
+    //-----------------------------------------------------------------------
 
-        _previous_reverb_send = _current_reverb_send;
-        _previous_chorus_send = _current_chorus_send;
+    sf::preset_id_t Synthesizer::channelPreset(const Channel& channel) const
+    {
+        sf::preset_id_t preset_id = { channel.bank(), channel.preset() };
+        if (_soundfont->getPreset(preset_id.bank, preset_id.number))
+            return preset_id;
 
-        if (_stereo)
+        if (channel.bank() < 128)
         {
-            _current_reverb_send = clamp(
-                channel_info.reverbSend() + (_left.instrument_reverb + _right.instrument_reverb) * 0.5f,
-                0, 1
-            );
-            _current_chorus_send = clamp(
-                channel_info.chorusSend() + (_left.instrument_chorus + _right.instrument_chorus) * 0.5f,
-                0, 1
-            );
+            preset_id.bank = 0;
         }
         else
         {
-            _current_reverb_send = clamp(channel_info.reverbSend() + _left.instrument_reverb, 0, 1);
-            _current_chorus_send = clamp(channel_info.chorusSend() + _left.instrument_chorus, 0, 1);
-        }
-
-        if (_voice_length == 0)
-        {
-            _left.previous_mix_gain = _left.current_mix_gain;
-            _right.previous_mix_gain = _right.current_mix_gain;
-            _previous_reverb_send = _current_reverb_send;
-            _previous_chorus_send = _current_chorus_send;
+            preset_id.bank = 128;
+            preset_id.number = 0;
         }
 
-        _voice_length += _synthesizer->settings().blockSize();
+        if (_soundfont->getPreset(preset_id.bank, preset_id.number))
+            return preset_id;
 
-        return true;
+        return _default_preset;
     }
 
     //-----------------------------------------------------------------------
 
-    void Voice::start(const sf::sample_info_t& sample_info, const float* buffer, track_t& track)
+    void Synthesizer::prefetchChannelPreset(const Channel& channel, sf::preset_id_t previous)
     {
-        if (_velocity > 0)
-        {
-            // According to the Polyphone's implementation, the initial attenuation should be reduced to 40%.
-            float sample_attenuation =
-                0.1f * 0.1f * float(sample_info.generator(sf::GEN_TYPE_INITIAL_ATTENUATION, { 0 }).uvalue);
+        if (!_prefetch_callback || !_soundfont->hasCompressedSamples())
+            return;
 
-            float filter_attenuation =
-                0.5f * 0.1f * float(sample_info.generator(sf::GEN_TYPE_INITIAL_FILTER_Q, { 0 }).uvalue);
+        sf::preset_id_t preset_id = channelPreset(channel);
+        if ((preset_id.bank != previous.bank) || (preset_id.number != previous.number))
+            _prefetch_callback(_soundfont, preset_id, _prefetch_user_data);
+    }
 
-            float decibels = -linear_to_decibels(127.0f / _velocity) -
-                             sample_attenuation - filter_attenuation;
+    //-----------------------------------------------------------------------
 
-            track.note_gain = decibels_to_linear(decibels);
-        }
-        else
-        {
-            track.note_gain = 0.0f;
-        }
+    bool Synthesizer::setPercussionChannel(uint8_t channel, bool percussion)
+    {
+        if (channel >= _channels.size())
+            return false;
 
-        track.cutoff = cents_to_hertz(sample_info.generator(sf::GEN_TYPE_INITIAL_FILTER_CUTOFF_FREQUENCY, { .uvalue=13500 }).uvalue);
-        track.resonance = decibels_to_linear(0.1f * float(sample_info.generator(sf::GEN_TYPE_INITIAL_FILTER_Q, { 0 }).uvalue));
+        _channels[channel].setPercussion(percussion);
+        return true;
+    }
 
-        track.vib_lfo_to_pitch = 0.01f * float(sample_info.generator(sf::GEN_TYPE_VIBRATO_LFO_TO_PITCH, { 0 }).ivalue);
-        track.mod_lfo_to_pitch = 0.01f * float(sample_info.generator(sf::GEN_TYPE_MODULATION_LFO_TO_PITCH, { 0 }).ivalue);
-        track.mod_env_to_pitch = 0.01f * float(sample_info.generator(sf::GEN_TYPE_MODULATION_ENVELOPE_TO_PITCH, { 0 }).ivalue);
+    //-----------------------------------------------------------------------
 
-        track.mod_lfo_to_cutoff = sample_info.generator(sf::GEN_TYPE_MODULATION_LFO_TO_FILTER_CUTOFF_FREQUENCY, { 0 }).ivalue;
-        track.mod_env_to_cutoff = sample_info.generator(sf::GEN_TYPE_MODULATION_ENVELOPE_TO_FILTER_CUTOFF_FREQUENCY, { 0 }).ivalue;
-        track.dynamic_cutoff = (track.mod_lfo_to_cutoff != 0) || (track.mod_env_to_cutoff != 0);
+    bool Synthesizer::setChannelStem(uint8_t channel, uint16_t stem)
+    {
+        if ((channel >= _channels.size()) || (stem >= _settings.nbStems()))
+            return false;
 
-        track.mod_lfo_to_volume = 0.1f * float(sample_info.generator(sf::GEN_TYPE_MODULATION_LFO_TO_VOLUME, { 0 }).ivalue);
-        track.dynamic_volume = (track.mod_lfo_to_volume > 0.05f);
+        _channel_stems[channel] = stem;
+        return true;
+    }
 
-        track.instrument_pan = clamp(0.1f * float(sample_info.generator(sf::GEN_TYPE_PAN, { 0 }).ivalue), -50.0f, 50.0f);
-        track.instrument_reverb = 0.01f * 0.1f * float(sample_info.generator(sf::GEN_TYPE_REVERB_EFFECTS_SEND, { 0 }).uvalue);
-        track.instrument_chorus = 0.01f * 0.1f * float(sample_info.generator(sf::GEN_TYPE_CHORUS_EFFECTS_SEND, { 0 }).uvalue);
+    //-----------------------------------------------------------------------
 
-        {
-            float delay = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DELAY_VOLUME_ENVELOPE, { .ivalue=-12000 }).ivalue);
+    std::map<sf::preset_id_t, std::string> Synthesizer::presetNames()
+    {
+        std::map<sf::preset_id_t, std::string> result;
 
-            float attack = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_ATTACK_VOLUME_ENVELOPE, { .ivalue=-12000 }).ivalue);
+        for (const auto& preset : _soundfont->getPresets())
+            result[preset.first] = preset.second.name;
 
-            float hold = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_HOLD_VOLUME_ENVELOPE, { .ivalue=-12000 }).ivalue) *
-                key_number_to_multiplying_factor(sample_info.generator(sf::GEN_TYPE_KEY_NUMBER_TO_VOLUME_ENVELOPE_HOLD, { 0 }).ivalue, _key);
+        return result;
+    }
 
-            float decay = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DECAY_VOLUME_ENVELOPE, { .ivalue=-12000 }).ivalue) *
-                key_number_to_multiplying_factor(sample_info.generator(sf::GEN_TYPE_KEY_NUMBER_TO_VOLUME_ENVELOPE_DECAY, { 0 }).ivalue, _key);
+    //-----------------------------------------------------------------------
 
-            float sustain = decibels_to_linear(-0.1f * float(sample_info.generator(sf::GEN_TYPE_SUSTAIN_VOLUME_ENVELOPE, { 0 }).uvalue));
+    std::shared_ptr<const note_clip_t> Synthesizer::renderNote(
+        sf::preset_id_t preset, uint8_t key, uint8_t velocity, uint32_t duration,
+        NoteClipCache* cache
+    )
+    {
+        if (!_soundfont->getPreset(preset.bank, preset.number))
+            return nullptr;
 
-            float release = fmax(timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_RELEASE_VOLUME_ENVELOPE, { .ivalue=-12000 }).ivalue), 0.01f);
+        NoteClipCache::key_t cache_key = {
+            preset, key, velocity, duration, _settings.sampleRate(), _master_volume
+        };
 
-            track.volume_envelope.start(delay, attack, hold, decay, sustain, release);
+        if (cache)
+        {
+            auto clip = cache->find(_soundfont, cache_key);
+            if (clip)
+                return clip;
         }
 
-        {
-            float delay = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DELAY_MODULATION_ENVELOPE, { .ivalue=-12000 }).ivalue);
+        reset();
 
-            float attack = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_ATTACK_MODULATION_ENVELOPE, { .ivalue=-12000 }).ivalue) *
-                           ((145.0f - _velocity) / 144.0f);
+        // The bank number of a percussion channel is offset by 128
+        Channel& channel = _channels[0];
+        const bool percussion = channel.percussion();
 
-            float hold = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_HOLD_MODULATION_ENVELOPE, { .ivalue=-12000 }).ivalue) *
-                key_number_to_multiplying_factor(sample_info.generator(sf::GEN_TYPE_KEY_NUMBER_TO_MODULATION_ENVELOPE_HOLD, { 0 }).ivalue, _key);
+        channel.setPercussion(false);
+        channel.setBank(uint8_t(preset.bank));
+        channel.setPreset(uint8_t(preset.number));
 
-            float decay = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DECAY_MODULATION_ENVELOPE, { .ivalue=-12000 }).ivalue) *
-                key_number_to_multiplying_factor(sample_info.generator(sf::GEN_TYPE_KEY_NUMBER_TO_MODULATION_ENVELOPE_DECAY, { 0 }).ivalue, _key);
+        const size_t max_size = size_t(duration) + MAX_NOTE_CLIP_RELEASE * _settings.sampleRate();
 
-            float sustain = 1.0f - float(sample_info.generator(sf::GEN_TYPE_SUSTAIN_MODULATION_ENVELOPE, { 0 }).uvalue) / 100.0f;
+        auto clip = std::make_shared<note_clip_t>();
+        clip->left.resize(max_size);
+        clip->right.resize(max_size);
 
-            float release = timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_RELEASE_MODULATION_ENVELOPE, { .ivalue=-12000 }).ivalue);
+        noteOn(0, key, velocity);
+        render(clip->left.data(), clip->right.data(), duration, nullptr, 0);
+        noteOff(0, key);
 
-            track.modulation_envelope.start(delay, attack, hold, decay, sustain, release);
+        // Render the release one block at a time, until everything is silent
+        size_t size = duration;
+        while ((size < max_size) && !isSilent())
+        {
+            size_t count = std::min(size_t(_settings.blockSize()), max_size - size);
+            render(clip->left.data() + size, clip->right.data() + size, count, nullptr, 0);
+            size += count;
         }
 
-        track.vibrato_lfo.start(
-            timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DELAY_VIBRATO_LFO, { .ivalue=-12000 }).ivalue),
-            cents_to_hertz(sample_info.generator(sf::GEN_TYPE_FREQUENCY_VIBRATO_LFO, { 0 }).ivalue)
-        );
-
-        track.modulation_lfo.start(
-            timecents_to_seconds(sample_info.generator(sf::GEN_TYPE_DELAY_MODULATION_LFO, { .ivalue=-12000 }).ivalue),
-            cents_to_hertz(sample_info.generator(sf::GEN_TYPE_FREQUENCY_MODULATION_LFO, { 0 }).ivalue)
-        );
-
-        int overriding_root_key = sample_info.generator(sf::GEN_TYPE_OVERRIDING_ROOT_KEY, { .ivalue=-1 }).ivalue;
-        loop_mode_t loop_mode = static_cast<loop_mode_t>(sample_info.generator(sf::GEN_TYPE_SAMPLE_MODES, { 0 }).uvalue);
-        int8_t coarse_tune = sample_info.generator(sf::GEN_TYPE_COARSE_TUNE, { 0 }).ivalue;
-        int8_t fine_tune = sample_info.generator(sf::GEN_TYPE_FINE_TUNE, { 0 }).ivalue;
-        int16_t scale_tuning = sample_info.generator(sf::GEN_TYPE_SCALE_TUNING, { 100 }).uvalue;
-
-        uint8_t root_key = (overriding_root_key != -1 ? uint8_t(overriding_root_key) : sample_info.sample->original_pitch);
+        clip->left.resize(size);
+        clip->left.shrink_to_fit();
+        clip->right.resize(size);
+        clip->right.shrink_to_fit();
 
-        track.sampler.start(
-            buffer,
-            sample_info.sample->start, sample_info.sample->end,
-            loop_mode,
-            sample_info.sample->loop_start, sample_info.sample->loop_end,
-            sample_info.sample->sample_rate, root_key,
-            coarse_tune,
-            fine_tune + sample_info.sample->pitch_correction,
-            scale_tuning
-        );
+        reset();
+        channel.setPercussion(percussion);
 
-        track.filter.clearBuffer();
-        track.filter.setLowPassFilter(track.cutoff, track.resonance);
+        if (cache)
+            cache->insert(_soundfont, cache_key, clip);
 
-        track.smoothed_cutoff = track.cutoff;
+        return clip;
     }
 
     //-----------------------------------------------------------------------
 
-    bool Voice::process(const Channel& channel_info, track_t& track)
+    void Synthesizer::renderBlockStereo(uint32_t size, bool stems)
     {
-        if (!track.volume_envelope.process(_synthesizer->settings().blockSize()))
-            return false;
+        const bool measure = _settings.statisticsEnabled();
 
-        track.modulation_envelope.process(_synthesizer->settings().blockSize());
-        track.vibrato_lfo.process();
-        track.modulation_lfo.process();
-
-        float vib_pitch_change = (0.01f * channel_info.modulation() + track.vib_lfo_to_pitch) * track.vibrato_lfo.value();
-        float mod_pitch_change = track.mod_lfo_to_pitch * track.modulation_lfo.value() +
-                                 track.mod_env_to_pitch * track.modulation_envelope.getValue();
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point voices_end;
+        std::chrono::steady_clock::time_point mixing_end;
 
-        float channel_pitch_change = channel_info.tune() + channel_info.pitchBend();
-        float pitch = _key + vib_pitch_change + mod_pitch_change + channel_pitch_change;
+        if (measure)
+            start = std::chrono::steady_clock::now();
 
-        if (!track.sampler.process(track.block, _synthesizer->settings().blockSize(), pitch))
-            return false;
+        for (auto& channel : _channels)
+            channel.updateControls();
 
-        if (track.dynamic_cutoff)
+        // Nothing is playing: no voice to process, and no effect to run
+        _block_silent = isSilent();
+        if (_block_silent)
         {
-            float cents = float(track.mod_lfo_to_cutoff) * track.modulation_lfo.value() +
-                          float(track.mod_env_to_cutoff) * track.modulation_envelope.getValue();
+            memset((char*) _block_left, 0, size * sizeof(float));
+            memset((char*) _block_right, 0, size * sizeof(float));
+            _stems_rendered = false;
 
-            float factor = cents_to_multiplying_factor(cents);
-            float new_cutoff = factor * track.cutoff;
-
-            // The cutoff change is limited within x0.5 and x2 to reduce pop noise
-            float lower_limit = 0.5 * track.smoothed_cutoff;
-            float upper_limit = 2.0 * track.smoothed_cutoff;
-            if (new_cutoff < lower_limit)
-                track.smoothed_cutoff = lower_limit;
-            else if (new_cutoff > upper_limit)
-                track.smoothed_cutoff = upper_limit;
-            else
-                track.smoothed_cutoff = new_cutoff;
+            if (measure)
+            {
+                updateStatistics(
+                    size,
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+                    0.0, 0.0
+                );
+            }
 
-            track.filter.setLowPassFilter(track.smoothed_cutoff, track.resonance);
+            return;
         }
 
-        track.filter.process(track.block, _synthesizer->settings().blockSize());
+        DenormalsGuard guard(_settings.denormalsFlushingEnabled());
 
-        float channel_gain = decibels_to_linear(channel_info.volume()) * channel_info.expression();
+        _voices->process(size);
 
-        float mix_gain = track.note_gain * channel_gain * track.volume_envelope.getValue();
-        if (track.dynamic_volume)
+        if (measure)
+            voices_end = std::chrono::steady_clock::now();
+
+       memset((char*) _block_left, 0, size * sizeof(float));
+       memset((char*) _block_right, 0, size * sizeof(float));
+
+        // The voices are written in the stems, which are then added in the master mix
+        stems = stems && _stem_blocks;
+        _stems_rendered = stems;
+
+        if (stems)
+            memset((char*) _stem_blocks, 0, 2 * _settings.nbStems() * _stem_block_size * sizeof(float));
+
+        bool reverb_input = false;
+        bool chorus_input = false;
+
+        if (_reverb)
         {
-            float decibels = track.mod_lfo_to_volume * track.modulation_lfo.value();
-            mix_gain *= decibels_to_linear(decibels);
+            memset((char*) _reverb_input, 0, size * sizeof(float));
+            memset((char*) _chorus_input_left, 0, size * sizeof(float));
+            memset((char*) _chorus_input_right, 0, size * sizeof(float));
         }
 
-        track.current_mix_gain = mix_gain;
+        auto& voices = _voices->voices();
+        for (int i = 0; i < _voices->nbActiveVoices(); ++i)
+        {
+            Voice* voice = voices[i];
 
-        return true;
-    }
+            float previous_gain_left = _master_volume * voice->previousMixGainLeft();
+            float current_gain_left = _master_volume * voice->currentMixGainLeft();
+            float previous_gain_right = _master_volume * voice->previousMixGainRight();
+            float current_gain_right = _master_volume * voice->currentMixGainRight();
 
+            float* left = _block_left;
+            float* right = _block_right;
 
-    /******************************** VOICE COLLECTION **********************************/
+            if (stems)
+            {
+                left = _stem_blocks + 2 * _channel_stems[voice->channel()] * _stem_block_size;
+                right = left + _stem_block_size;
+            }
 
-    class VoiceCollection
-    {
-    public:
-        VoiceCollection(const Synthesizer* synthesizer);
-        ~VoiceCollection();
+            if (voice->stereo())
+            {
+                writeBlock(
+                    previous_gain_left, current_gain_left, voice->block_left(), left, size
+                );
 
-        Voice* request(uint8_t channel, uint8_t exclusive_class);
-        void process();
-        void clear();
-    
-        inline size_t nbActiveVoices() const
-        {
-            return _nb_active_voices;            
+                writeBlock(
+                    previous_gain_right, current_gain_right, voice->block_right(), right,
+                    size
+                );
+            }
+            else
+            {
+                // Mono voice: fill both sides in one pass
+                writeBlockStereo(
+                    previous_gain_left, current_gain_left, previous_gain_right,
+                    current_gain_right, voice->block_left(), left, right, size
+                );
+            }
+
+            if (!_reverb)
+                continue;
+
+            // Effect sends
+            float previous_reverb = voice->previousReverbSend();
+            float current_reverb = voice->currentReverbSend();
+            float previous_chorus = voice->previousChorusSend();
+            float current_chorus = voice->currentChorusSend();
+
+            if (voice->stereo())
+            {
+                reverb_input = writeBlock(
+                    previous_reverb * previous_gain_left, current_reverb * current_gain_left,
+                    voice->block_left(), _reverb_input, size
+                ) || reverb_input;
+
+                reverb_input = writeBlock(
+                    previous_reverb * previous_gain_right, current_reverb * current_gain_right,
+                    voice->block_right(), _reverb_input, size
+                ) || reverb_input;
+
+                chorus_input = writeBlock(
+                    previous_chorus * previous_gain_left, current_chorus * current_gain_left,
+                    voice->block_left(), _chorus_input_left, size
+                ) || chorus_input;
+
+                chorus_input = writeBlock(
+                    previous_chorus * previous_gain_right, current_chorus * current_gain_right,
+                    voice->block_right(), _chorus_input_right, size
+                ) || chorus_input;
+            }
+            else
+            {
+                reverb_input = writeBlock(
+                    previous_reverb * (previous_gain_left + previous_gain_right),
+                    current_reverb * (current_gain_left + current_gain_right),
+                    voice->block_left(), _reverb_input, size
+                ) || reverb_input;
+
+                chorus_input = writeBlockStereo(
+                    previous_chorus * previous_gain_left, current_chorus * current_gain_left,
+                    previous_chorus * previous_gain_right, current_chorus * current_gain_right,
+                    voice->block_left(), _chorus_input_left, _chorus_input_right, size
+                ) || chorus_input;
+            }
         }
 
-        inline std::vector<Voice*>& voices()
+        if (stems)
         {
-            return _voices;            
+            for (uint16_t stem = 0; stem < _settings.nbStems(); ++stem)
+            {
+                const float* left = _stem_blocks + 2 * stem * _stem_block_size;
+
+                mix_constant(_block_left, left, 1.0f, size);
+                mix_constant(_block_right, left + _stem_block_size, 1.0f, size);
+            }
         }
 
+        if (measure)
+            mixing_end = std::chrono::steady_clock::now();
 
-        //_____ Attributes __________
-    private:
-        std::vector<Voice*> _voices;
-        size_t _nb_active_voices = 0;
-    };
+        // The effects are skipped entirely when nothing is sent to them and their tail
+        // is over
+        if (chorus_input || (_chorus && !_chorus->idle()))
+        {
+            _chorus->process(
+                _chorus_input_left, _chorus_input_right, chorus_input, _effect_left,
+                _effect_right, size
+            );
 
-    //-----------------------------------------------------------------------
+            mix_constant(_block_left, _effect_left, 1.0f, size);
+            mix_constant(_block_right, _effect_right, 1.0f, size);
+        }
 
-    VoiceCollection::VoiceCollection(const Synthesizer* synthesizer)
-    {
-        for (int i = 0; i < synthesizer->settings().maximumPolyphony(); ++i)
-            _voices.push_back(new Voice(synthesizer));
-    }
+        if (reverb_input || (_reverb && !_reverb->idle()))
+        {
+            _reverb->process(_reverb_input, reverb_input, _effect_left, _effect_right, size);
 
-    //-----------------------------------------------------------------------
+            mix_constant(_block_left, _effect_left, 1.0f, size);
+            mix_constant(_block_right, _effect_right, 1.0f, size);
+        }
 
-    VoiceCollection::~VoiceCollection()
-    {
-        for (auto voice : _voices)
-            delete voice;
+        if (measure)
+        {
+            auto end = std::chrono::steady_clock::now();
+
+            updateStatistics(
+                size,
+                std::chrono::duration<double>(voices_end - start).count(),
+                std::chrono::duration<double>(mixing_end - voices_end).count(),
+                std::chrono::duration<double>(end - mixing_end).count()
+            );
+        }
     }
 
     //-----------------------------------------------------------------------
 
-    Voice* VoiceCollection::request(uint8_t channel, uint8_t exclusive_class)
+    void Synthesizer::renderBlockMono(uint32_t size)
     {
-        // If an exclusive class is assigned to the region, find a voice with the same class.
-        // If found, reuse it to avoid playing multiple voices with the same class at a time.
-        if (exclusive_class != 0)
-        {
-            for (int i = 0; i < _nb_active_voices; ++i)
-            {
-                Voice* voice = _voices[i];
-                if ((voice->exclusiveClass() == exclusive_class) && (voice->channel() == channel))
-                    return voice;
-            }
-        }
+        const bool measure = _settings.statisticsEnabled();
 
-        // If the number of active voices is less than the limit, use a free one
-        if (_nb_active_voices < _voices.size())
-        {
-            Voice* voice = _voices[_nb_active_voices];
-            ++_nb_active_voices;
-            return voice;
-        }
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point voices_end;
 
-        // Too many active voices: find the one which has the lowest priority
-        Voice* candidate = nullptr;
-        float lowest_priority = 1000000.0f;
+        if (measure)
+            start = std::chrono::steady_clock::now();
 
-        for (auto voice : _voices)
+        for (auto& channel : _channels)
+            channel.updateControls();
+
+        _stems_rendered = false;
+
+        // No voice to process (the effects aren't used in mono)
+        _block_silent = (_voices->nbActiveVoices() == 0);
+        if (_block_silent)
         {
-            float priority = voice->priority();
+            memset((char*) _block_left, 0, size * sizeof(float));
 
-            if (priority < lowest_priority)
-            {
-                lowest_priority = priority;
-                candidate = voice;
-            }
-            else if (priority == lowest_priority)
+            if (measure)
             {
-                // Same priority : the older one should be more suitable for reuse
-                if (voice->voiceLength() > candidate->voiceLength())
-                    candidate = voice;
+                updateStatistics(
+                    size,
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+                    0.0, 0.0
+                );
             }
+
+            return;
         }
 
-        return candidate;
-    }
+        DenormalsGuard guard(_settings.denormalsFlushingEnabled());
 
-    //-----------------------------------------------------------------------
+        _voices->process(size);
 
-    void VoiceCollection::process()
-    {
-        int i = 0;
+        if (measure)
+            voices_end = std::chrono::steady_clock::now();
 
-        while (i != _nb_active_voices)
+       memset((char*) _block_left, 0, size * sizeof(float));
+
+        auto& voices = _voices->voices();
+        for (int i = 0; i < _voices->nbActiveVoices(); ++i)
         {
-            if (_voices[i]->process())
+            Voice* voice = voices[i];
+
+            if (voice->stereo())
             {
-                ++i;
+                float previous_gain_left = _master_volume * voice->previousMixGainLeft();
+                float current_gain_left = _master_volume * voice->currentMixGainLeft();
+                writeBlock(
+                    previous_gain_left, current_gain_left, voice->block_left(), _block_left,
+                    size
+                );
+    
+                float previous_gain_right = _master_volume * voice->previousMixGainRight();
+                float current_gain_right = _master_volume * voice->currentMixGainRight();
+                writeBlock(
+                    previous_gain_right, current_gain_right, voice->block_right(), _block_left,
+                    size
+                );
             }
             else
             {
-                --_nb_active_voices;
-
-                auto tmp = _voices[i];
-                _voices[i] = _voices[_nb_active_voices];
-                _voices[_nb_active_voices] = tmp;
+                float previous_gain = _master_volume * voice->previousMixGainLeft();
+                float current_gain = _master_volume * voice->currentMixGainLeft();
+                writeBlock(
+                    previous_gain, current_gain, voice->block_left(), _block_left,
+                    size
+                );
             }
         }
+
+        if (measure)
+        {
+            auto end = std::chrono::steady_clock::now();
+
+            updateStatistics(
+                size,
+                std::chrono::duration<double>(voices_end - start).count(),
+                std::chrono::duration<double>(end - voices_end).count(),
+                0.0
+            );
+        }
     }
 
     //-----------------------------------------------------------------------
 
-    void VoiceCollection::clear()
+    void Synthesizer::updateStatistics(
+        uint32_t size, double voices_time, double mixing_time, double effects_time
+    )
     {
-        _nb_active_voices = 0;
-    }
+        double total = voices_time + mixing_time + effects_time;
 
+        ++_statistics.nb_blocks;
+        _statistics.voices_time += voices_time;
+        _statistics.mixing_time += mixing_time;
+        _statistics.effects_time += effects_time;
+        _statistics.max_block_time = std::max(_statistics.max_block_time, total);
 
-    /****************************** SYNTHESIZER SETTINGS ********************************/
+        double microseconds = total * 1.0e6;
+        int bucket = 0;
+        if (microseconds >= 1.0)
+            bucket = std::min(statistics_t::HISTOGRAM_SIZE - 1, 1 + ilogb(microseconds));
 
-    SynthesizerSettings::SynthesizerSettings(uint32_t sample_rate)
-    {
-        setSampleRate(sample_rate);
-        _block_size = DEFAULT_BLOCK_SIZE;
-        _maximum_polyphony = DEFAULT_MAXIMUM_POLYPHONY;
-        _reverb_and_chorus_enabled = DEFAULT_REVERB_AND_CHORUS_ENABLED;
+        ++_statistics.block_time_histogram[bucket];
+
+        if (_statistics_callback)
+        {
+            block_statistics_t block = {
+                size, uint16_t(_voices->nbActiveVoices()), voices_time, mixing_time,
+                effects_time
+            };
+
+            _statistics_callback(block, _statistics_user_data);
+        }
     }
 
     //-----------------------------------------------------------------------
 
-    void SynthesizerSettings::setSampleRate(uint32_t sample_rate)
+    bool Synthesizer::writeBlock(
+        float previous_gain, float current_gain, float* source, float* destination,
+        uint32_t size
+    )
     {
-        if ((sample_rate < 16000) || (sample_rate > 192000))
-            throw std::runtime_error(std::string("The sample rate must be between 16000 and 192000."));
+        if (fmax(previous_gain, current_gain) < NON_AUDIBLE)
+            return false;
 
-        _sample_rate = sample_rate;
+        if (fabs(current_gain - previous_gain) < 1.0e-3)
+        {
+            mix_constant(destination, source, current_gain, size);
+        }
+        else
+        {
+            float step = inverseSize(size) * (current_gain - previous_gain);
+            mix_ramp(destination, source, previous_gain, step, size);
+        }
+
+        return true;
     }
 
     //-----------------------------------------------------------------------
 
-    void SynthesizerSettings::setBlockSize(uint16_t block_size)
+    bool Synthesizer::writeBlockStereo(
+        float previous_gain_left, float current_gain_left, float previous_gain_right,
+        float current_gain_right, float* source, float* left, float* right,
+        uint32_t size
+    )
     {
-        if ((block_size < 8) || (block_size > 1024))
-            throw std::runtime_error(std::string("The block size must be between 8 and 1024."));
+        if ((fmax(previous_gain_left, current_gain_left) < NON_AUDIBLE) ||
+            (fmax(previous_gain_right, current_gain_right) < NON_AUDIBLE))
+        {
+            bool written = writeBlock(previous_gain_left, current_gain_left, source, left, size);
+            return writeBlock(previous_gain_right, current_gain_right, source, right, size) || written;
+        }
 
-        _block_size = block_size;
-    }
+        float inverse_size = inverseSize(size);
 
-    //-----------------------------------------------------------------------
+        float gain_left = current_gain_left;
+        float step_left = 0.0f;
 
-    void SynthesizerSettings::setMaximumPolyphony(uint16_t maximum_polyphony)
-    {
-        if ((maximum_polyphony < 8) || (maximum_polyphony > 256))
-            throw std::runtime_error(std::string("The block size must be between 8 and 256."));
+        if (fabs(current_gain_left - previous_gain_left) >= 1.0e-3)
+        {
+            gain_left = previous_gain_left;
+            step_left = inverse_size * (current_gain_left - previous_gain_left);
+        }
 
-            _maximum_polyphony = maximum_polyphony;
-    }
+        float gain_right = current_gain_right;
+        float step_right = 0.0f;
 
-    //-----------------------------------------------------------------------
+        if (fabs(current_gain_right - previous_gain_right) >= 1.0e-3)
+        {
+            gain_right = previous_gain_right;
+            step_right = inverse_size * (current_gain_right - previous_gain_right);
+        }
 
-    void SynthesizerSettings::enableReverbAndChorus(bool enable)
-    {
-        _reverb_and_chorus_enabled = enable;
+        mix_ramp_stereo(
+            left, right, source, gain_left, step_left, gain_right, step_right, size
+        );
+
+        return true;
     }
 
 
-    /*********************************** SYNTHESIZER ************************************/
+    /******************************* SYNTHESIZER SNAPSHOT *******************************/
 
-    Synthesizer::Synthesizer(const SynthesizerSettings& settings)
-    : _settings(settings)
+    SynthesizerSnapshot::SynthesizerSnapshot(const Synthesizer& synthesizer)
+    : _settings(synthesizer.settings()),
+      _channels(synthesizer.nbChannels()),
+      _channel_stems(synthesizer.nbChannels(), 0)
     {
-        for (int i = 0; i < CHANNEL_COUNT; ++i)
-            _channels.emplace_back(Channel(i == PERCUSSION_CHANNEL));
+        _voices = new VoiceCollection(&synthesizer, true);
 
-        _voices = new VoiceCollection(this);
+        _block_left = allocate_aligned_floats(_settings.blockSize());
+        _block_right = allocate_aligned_floats(_settings.blockSize());
 
-        _block_left = new float[_settings.blockSize()];
-        _block_right = new float[_settings.blockSize()];
-        _blocks_offset = _settings.blockSize();
-        _inverse_block_size = 1.0f / float(_settings.blockSize());
+        if (_settings.nbStems() > 0)
+        {
+            _stem_blocks_size = 2 * _settings.nbStems() * aligned_block_size(_settings.blockSize());
+            _stem_blocks = allocate_aligned_floats(_stem_blocks_size);
+        }
+
+        if (_settings.reverbAndChorusEnabled())
+        {
+            _reverb = new Reverb(_settings.sampleRate());
+            _chorus = new Chorus(_settings.sampleRate());
+        }
     }
 
     //-----------------------------------------------------------------------
 
-    Synthesizer::~Synthesizer()
+    SynthesizerSnapshot::~SynthesizerSnapshot()
     {
-        delete[] _block_left;
-        delete[] _block_right;
         delete _voices;
+        free_aligned_floats(_block_left);
+        free_aligned_floats(_block_right);
+        free_aligned_floats(_stem_blocks);
+        delete _reverb;
+        delete _chorus;
     }
 
     //-----------------------------------------------------------------------
 
-    bool Synthesizer::loadSoundFont(const std::filesystem::path& path)
+    bool SynthesizerSnapshot::compatible(const Synthesizer& synthesizer) const
     {
-        if (!_soundfont.load(path))
-            return false;
-
-        _default_preset = _soundfont.getPresets().begin()->first;
-
-        return true;
+        // The settings copied with the state of the voices, or determining the sizes
+        // of the buffers, must be the same
+        const SynthesizerSettings& settings = synthesizer.settings();
+
+        return (settings.sampleRate() == _settings.sampleRate()) &&
+               (settings.blockSize() == _settings.blockSize()) &&
+               (settings.maximumPolyphony() == _settings.maximumPolyphony()) &&
+               (settings.nbChannels() == _settings.nbChannels()) &&
+               (settings.nbStems() == _settings.nbStems()) &&
+               (settings.reverbAndChorusEnabled() == _settings.reverbAndChorusEnabled()) &&
+               (settings.interpolationMode() == _settings.interpolationMode()) &&
+               (settings.fastMathEnabled() == _settings.fastMathEnabled()) &&
+               (settings.inaudibleLevel() == _settings.inaudibleLevel());
     }
 
-    //-----------------------------------------------------------------------
 
-    bool Synthesizer::loadSoundFont(const char* buffer, size_t size)
+    /************************************ MIDI FILE *************************************/
+
+    bool MidiFile::load(const std::filesystem::path& path)
     {
-        if (!_soundfont.load(buffer, size))
+        std::ifstream file(path.string(), std::ios::binary);
+        if (!file.is_open())
             return false;
 
-        _default_preset = _soundfont.getPresets().begin()->first;
+        std::vector<char> content(
+            (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()
+        );
+
+        file.close();
 
-        return true;
+        return load(content.data(), content.size());
     }
 
     //-----------------------------------------------------------------------
 
-    bool Synthesizer::processMidiMessage(
-        uint8_t channel, uint8_t command, uint8_t data1, uint8_t data2
-    )
+    bool MidiFile::load(const char* buffer, size_t size)
     {
-        if (channel >= _channels.size())
-            return false;
-
-        auto& channel_info = _channels[channel];
-
-        switch (command)
-        {
-            // Note Off
-            case 0x80: 
-                noteOff(channel, data1);
-                break;
+        _events.clear();
+        _length = 0.0;
 
-            // Note On
-            case 0x90:
-                noteOn(channel, data1, data2);
-                break;
-
-            // Controller
-            case 0xB0:
-            {
-                switch (data1)
-                {
-                    // Bank Selection
-                    case 0x00:
-                        channel_info.setBank(data2);
-                        break;
+        const uint8_t* data = (const uint8_t*) buffer;
 
-                    // Modulation Coarse
-                    case 0x01:
-                        channel_info.setModulationCoarse(data2);
-                        break;
+        // Header chunk
+        if ((size < 14) || (memcmp(data, "MThd", 4) != 0))
+            return false;
 
-                    // Modulation Fine
-                    case 0x21:
-                        channel_info.setModulationFine(data2);
-                        break;
+        uint32_t header_size = read_big_endian(data + 4, 4);
+        if ((header_size < 6) || (header_size > size - 8))
+            return false;
 
-                    // Data Entry Coarse
-                    case 0x06:
-                        channel_info.setDataEntryCoarse(data2);
-                        break;
+        uint16_t format = read_big_endian(data + 8, 2);
+        uint16_t nb_tracks = read_big_endian(data + 10, 2);
+        uint16_t division = read_big_endian(data + 12, 2);
 
-                    // Data Entry Fine
-                    case 0x26:
-                        channel_info.setDataEntryFine(data2);
-                        break;
+        if ((format > 1) || (division == 0))
+            return false;
 
-                    // Channel Volume Coarse
-                    case 0x07:
-                        channel_info.setVolumeCoarse(data2);
-                        break;
+        // Duration of a tick, either in quarter notes or in SMPTE frames
+        const bool smpte = (division & 0x8000) != 0;
 
-                    // Channel Volume Fine
-                    case 0x27:
-                        channel_info.setVolumeFine(data2);
-                        break;
+        double tick_duration;
+        if (smpte)
+        {
+            int8_t frames_per_second = int8_t(division >> 8);
+            uint8_t ticks_per_frame = division & 0xFF;
 
-                    // Pan Coarse
-                    case 0x0A:
-                        channel_info.setPanCoarse(data2);
-                        break;
+            if ((frames_per_second >= 0) || (ticks_per_frame == 0))
+                return false;
 
-                    // Pan Fine
-                    case 0x2A:
-                        channel_info.setPanFine(data2);
-                        break;
+            tick_duration = 1.0 / (-frames_per_second * ticks_per_frame);
+        }
+        else
+        {
+            // 120 BPM until the first tempo change
+            tick_duration = 500000.0e-6 / division;
+        }
 
-                    // Expression Coarse
-                    case 0x0B:
-                        channel_info.setExpressionCoarse(data2);
-                        break;
+        // Tracks chunks (the unknown chunks are skipped)
+        std::vector<midi_track_event_t> track_events;
 
-                    // Expression Fine
-                    case 0x2B:
-                        channel_info.setExpressionFine(data2);
-                        break;
+        size_t position = 8 + header_size;
+        uint16_t nb_loaded_tracks = 0;
 
-                    // Sustain
-                    case 0x40:
-                        channel_info.setSustain(data2);
-                        break;
+        while ((nb_loaded_tracks < nb_tracks) && (size - position >= 8))
+        {
+            uint32_t chunk_size = read_big_endian(data + position + 4, 4);
+            if (chunk_size > size - position - 8)
+                return false;
 
-                    // Reverb Send
-                    case 0x5B:
-                        channel_info.setReverbSend(data2);
-                        break;
+            if (memcmp(data + position, "MTrk", 4) == 0)
+            {
+                if (!read_midi_track(data + position + 8, chunk_size, track_events))
+                    return false;
 
-                    // Chorus Send
-                    case 0x5D:
-                        channel_info.setChorusSend(data2);
-                        break;
+                ++nb_loaded_tracks;
+            }
 
-                    // RPN Coarse
-                    case 0x65:
-                        channel_info.setRPNCoarse(data2);
-                        break;
+            position += 8 + chunk_size;
+        }
 
-                    // RPN Fine
-                    case 0x64:
-                        channel_info.setRPNFine(data2);
-                        break;
+        if (nb_loaded_tracks == 0)
+            return false;
 
-                    // All Sound Off
-                    case 0x78:
-                        allNotesOff(channel, true);
-                        break;
+        // Merge the tracks (the messages of the first tracks come first when they
+        // happen at the same time), then convert the ticks to seconds
+        std::stable_sort(
+            track_events.begin(), track_events.end(),
+            [](const midi_track_event_t& a, const midi_track_event_t& b)
+            {
+                return a.tick < b.tick;
+            }
+        );
 
-                    // Reset All Controllers
-                    case 0x79:
-                        resetControllers(channel);
-                        break;
+        uint64_t tick = 0;
+        double time = 0.0;
 
-                    // All Note Off
-                    case 0x7B:
-                        allNotesOff(channel, false);
-                        break;
+        for (const auto& event : track_events)
+        {
+            time += (event.tick - tick) * tick_duration;
+            tick = event.tick;
 
-                    default:
-                        break;
-                }
-           
-                break;
+            if (event.tempo > 0)
+            {
+                if (!smpte)
+                    tick_duration = event.tempo * 1.0e-6 / division;
+            }
+            else if (event.command != 0)
+            {
+                _events.push_back(
+                    { time, event.channel, event.command, event.data1, event.data2 }
+                );
             }
+        }
 
-            // Program Change
-            case 0xC0:
-                channel_info.setPreset(data1);
-                break;
+        _length = time;
 
-            // Pitch Bend
-            case 0xE0:
-                channel_info.setPitchBend(data1, data2);
+        return true;
+    }
 
-            default:
-                break;
-        }
 
-        return true;
+    /******************************* MIDI FILE SEQUENCER ********************************/
+
+    MidiFileSequencer::MidiFileSequencer(Synthesizer& synthesizer)
+    : _synthesizer(synthesizer)
+    {
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::noteOff(uint8_t channel, uint8_t key)
+    void MidiFileSequencer::play(const MidiFile& midi_file, bool loop)
     {
-        if (channel >= _channels.size())
-            return;
+        _midi_file = &midi_file;
+        _loop = loop;
 
-        auto& voices = _voices->voices();
-        for (int i = 0; i < _voices->nbActiveVoices(); ++i)
-        {
-            Voice* voice = voices[i];
-            if ((voice->channel() == channel) && (voice->key() == key))
-                voice->end();
-        }
+        _next_event = 0;
+        _start = 0;
+        _position = 0;
+
+        _synthesizer.reset();
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::noteOn(uint8_t channel, uint8_t key, uint8_t velocity)
+    void MidiFileSequencer::stop()
     {
-        if (velocity == 0)
-        {
-            noteOff(channel, key);
-            return;
-        }
-
-        if (channel >= _channels.size())
-            return;
+        _midi_file = nullptr;
+        _synthesizer.reset();
+    }
 
-        auto& channel_info = _channels[channel];
+    //-----------------------------------------------------------------------
 
-        sf::preset_id_t preset_id = { channel_info.bank(), channel_info.preset() };
+    void MidiFileSequencer::render(float* left, float* right, size_t size)
+    {
+        size_t nb_written = 0;
 
-        sf::key_info_t key_info;
-        if (!_soundfont.getKeyInfo(preset_id.bank, preset_id.number, key, velocity, key_info))
+        while (nb_written < size)
         {
-            // Try fallback to the GM sound set.
-            // Normally, the given preset number + the bank number 0 will work.
-            // For drums (bank number >= 128), it seems to be better to select the standard set (128:0).
-            if (channel_info.bank() < 128)
-            {
-                preset_id.bank = 0;
-            }
-            else
-            {
-                preset_id.bank = 128;
-                preset_id.number = 0;
-            }
+            size_t nb_events;
+            size_t chunk_size = collectEvents(size - nb_written, nb_events);
 
-            if (!_soundfont.getKeyInfo(preset_id.bank, preset_id.number, key, velocity, key_info))
-            {
-                // No corresponding preset was found. Use the default one.
-                _soundfont.getKeyInfo(_default_preset.bank, _default_preset.number, key, velocity, key_info);
-            }
-        }
+            _synthesizer.render(
+                left + nb_written, right + nb_written, chunk_size, _events, nb_events
+            );
 
-        Voice* voice = _voices->request(channel, key_info.left.generator(sf::GEN_TYPE_EXCLUSIVE_CLASS, { 0 }).uvalue);
-        voice->start(key_info, _soundfont.getBuffer(), channel, key, velocity);
+            nb_written += chunk_size;
+        }
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::allNotesOff(bool immediate)
+    void MidiFileSequencer::render(float* buffer, size_t size)
     {
-        if (immediate)
-        {
-            _voices->clear();
-        }
-        else
+        size_t nb_written = 0;
+
+        while (nb_written < size)
         {
-            auto& voices = _voices->voices();
-            for (int i = 0; i < _voices->nbActiveVoices(); ++i)
-                voices[i]->end();
+            size_t nb_events;
+            size_t chunk_size = collectEvents(size - nb_written, nb_events);
+
+            _synthesizer.render(buffer + nb_written, chunk_size, _events, nb_events);
+
+            nb_written += chunk_size;
         }
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::allNotesOff(uint8_t channel, bool immediate)
+    double MidiFileSequencer::position() const
     {
-        if (immediate)
-        {
-            auto& voices = _voices->voices();
-            for (int i = 0; i < _voices->nbActiveVoices(); ++i)
-            {
-                Voice* voice = voices[i];
-                if (voice->channel() == channel)
-                    voice->kill();
-            }
-        }
-        else
-        {
-            auto& voices = _voices->voices();
-            for (int i = 0; i < _voices->nbActiveVoices(); ++i)
-            {
-                Voice* voice = voices[i];
-                if (voice->channel() == channel)
-                    voice->end();
-            }
-        }
+        return double(_position - _start) / _synthesizer.settings().sampleRate();
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::resetAllControllers()
+    bool MidiFileSequencer::endOfSequence() const
     {
-        for (auto& channel : _channels)
-            channel.resetControllers();
+        if (!_midi_file)
+            return true;
+
+        return !_loop && (_next_event == _midi_file->events().size());
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::resetControllers(uint8_t channel)
+    bool MidiFileSequencer::snapshot(SynthesizerSnapshot& snapshot) const
     {
-        if (channel >= _channels.size())
-            return;
+        if (!_synthesizer.snapshot(snapshot))
+            return false;
 
-        _channels[channel].resetControllers();
+        snapshot._sequencer.valid = true;
+        snapshot._sequencer.midi_file = _midi_file;
+        snapshot._sequencer.loop = _loop;
+        snapshot._sequencer.next_event = _next_event;
+        snapshot._sequencer.start = _start;
+        snapshot._sequencer.position = _position;
+
+        return true;
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::reset()
+    bool MidiFileSequencer::restore(const SynthesizerSnapshot& snapshot)
     {
-        _voices->clear();
+        if (!snapshot._sequencer.valid || !_synthesizer.restore(snapshot))
+            return false;
 
-        for (auto& channel : _channels)
-            channel.reset();
-    
-        _blocks_offset = _settings.blockSize();
-        _nb_rendered_samples = 0;
+        _midi_file = snapshot._sequencer.midi_file;
+        _loop = snapshot._sequencer.loop;
+        _next_event = snapshot._sequencer.next_event;
+        _start = snapshot._sequencer.start;
+        _position = snapshot._sequencer.position;
+
+        return true;
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::render(float* left, float* right, size_t size)
+    size_t MidiFileSequencer::collectEvents(size_t max_size, size_t& nb_events)
     {
-        size_t nb_written = 0;
+        // The offsets of the events are 32-bits values
+        size_t size = std::min(max_size, size_t(0x7FFFFFFF));
 
-        while (nb_written < size)
+        nb_events = 0;
+
+        if (!_midi_file)
+            return size;
+
+        const auto& events = _midi_file->events();
+        const uint64_t length = toSamples(_midi_file->length());
+
+        while (true)
         {
-            if (_blocks_offset == _settings.blockSize())
+            if (_next_event == events.size())
             {
-                renderBlockStereo();
-                _blocks_offset = 0;
+                // Restart from the beginning if the end of the file is in this chunk
+                if (!_loop || (length == 0) || (_start + length >= _position + size))
+                    break;
+
+                _start = std::max(_start + length, _position);
+                _next_event = 0;
             }
 
-            size_t src_remainder = _settings.blockSize() - _blocks_offset;
-            size_t dst_remainder = size - nb_written;
-            size_t remainder = fmin(src_remainder, dst_remainder);
+            uint64_t event_position = _start + toSamples(events[_next_event].time);
+            uint64_t offset = (event_position > _position ? event_position - _position : 0);
+            if (offset >= size)
+                break;
 
-            for (int t = 0; t < remainder; ++t)
+            // Render up to this event, the next ones will be processed by the next call
+            if (nb_events == MAX_NB_EVENTS)
             {
-                left[nb_written + t] = _block_left[_blocks_offset + t];
-                right[nb_written + t] = _block_right[_blocks_offset + t];
+                size = offset;
+                break;
             }
 
-            _blocks_offset += remainder;
-            nb_written += remainder;
+            const midi_file_event_t& event = events[_next_event];
+
+            // The ports the synthesizer doesn't have are merged into the first one
+            uint8_t channel = event.channel;
+            if (channel >= _synthesizer.nbChannels())
+                channel &= 0x0F;
+
+            _events[nb_events] = {
+                uint32_t(offset), channel, event.command, event.data1, event.data2
+            };
+
+            ++nb_events;
+            ++_next_event;
         }
 
-        _nb_rendered_samples += nb_written;
+        _position += size;
+
+        return size;
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::render(float* buffer, size_t size)
+    uint64_t MidiFileSequencer::toSamples(double time) const
     {
-        size_t nb_written = 0;
+        return uint64_t(llround(time * _synthesizer.settings().sampleRate()));
+    }
 
-        while (nb_written < size)
-        {
-            if (_blocks_offset == _settings.blockSize())
-            {
-                renderBlockMono();
-                _blocks_offset = 0;
-            }
 
-            size_t src_remainder = _settings.blockSize() - _blocks_offset;
-            size_t dst_remainder = size - nb_written;
-            size_t remainder = fmin(src_remainder, dst_remainder);
+    /********************************* NOTE CLIP CACHE **********************************/
 
-            for (int t = 0; t < remainder; ++t)
-                buffer[nb_written + t] = _block_left[_blocks_offset + t];
+    NoteClipCache::NoteClipCache(size_t max_size)
+    : _clips(max_size)
+    {
+    }
 
-            _blocks_offset += remainder;
-            nb_written += remainder;
-        }
+    //-----------------------------------------------------------------------
 
-        _nb_rendered_samples += nb_written;
+    void NoteClipCache::setMaxSize(size_t max_size)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _clips.setMaxSize(max_size);
     }
 
     //-----------------------------------------------------------------------
 
-    uint16_t Synthesizer::nbActiveVoices() const
+    size_t NoteClipCache::maxSize() const
     {
-        return _voices->nbActiveVoices();
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _clips.maxSize();
     }
 
     //-----------------------------------------------------------------------
 
-    float Synthesizer::masterVolume() const
+    size_t NoteClipCache::usage() const
     {
-        return linear_to_decibels(_master_volume);
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _clips.usage();
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::setMasterVolume(float volume)
+    size_t NoteClipCache::nbClips() const
     {
-        _master_volume = decibels_to_linear(volume);
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _clips.count();
     }
 
     //-----------------------------------------------------------------------
 
-    bool Synthesizer::configureChannel(uint8_t channel, uint8_t bank, uint8_t preset)
+    uint64_t NoteClipCache::nbHits() const
     {
-        if (channel >= _channels.size())
-            return false;
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _nb_hits;
+    }
 
-        const sf::preset_t* p = _soundfont.getPreset(bank, preset);
-        if (!p)
-            return false;
+    //-----------------------------------------------------------------------
 
-        Channel& c = _channels[channel];
-        c.setBank(bank);
-        c.setPreset(preset);
+    uint64_t NoteClipCache::nbMisses() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _nb_misses;
+    }
 
-        return true;
+    //-----------------------------------------------------------------------
+
+    void NoteClipCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _clips.clear();
+        _soundfont = nullptr;
     }
 
     //-----------------------------------------------------------------------
 
-    std::map<sf::preset_id_t, std::string> Synthesizer::presetNames()
+    std::shared_ptr<const note_clip_t> NoteClipCache::find(
+        const std::shared_ptr<const sf::SoundFont>& soundfont, const key_t& key
+    )
     {
-        std::map<sf::preset_id_t, std::string> result;
+        std::lock_guard<std::mutex> lock(_mutex);
 
-        for (const auto& preset : _soundfont.getPresets())
-            result[preset.first] = preset.second.name;
+        if (soundfont == _soundfont)
+        {
+            const std::shared_ptr<const note_clip_t>* clip = _clips.find(key);
+            if (clip)
+            {
+                ++_nb_hits;
+                return *clip;
+            }
+        }
 
-        return result;
+        ++_nb_misses;
+        return nullptr;
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::renderBlockStereo()
+    void NoteClipCache::insert(
+        const std::shared_ptr<const sf::SoundFont>& soundfont, const key_t& key,
+        const std::shared_ptr<const note_clip_t>& clip
+    )
     {
-        _voices->process();
+        std::lock_guard<std::mutex> lock(_mutex);
 
-       memset((char*) _block_left, 0, _settings.blockSize() * sizeof(float));
-       memset((char*) _block_right, 0, _settings.blockSize() * sizeof(float));
+        if (soundfont != _soundfont)
+        {
+            _clips.clear();
+            _soundfont = soundfont;
+        }
 
-        auto& voices = _voices->voices();
-        for (int i = 0; i < _voices->nbActiveVoices(); ++i)
+        // If another thread rendered the same clip in the meantime, the first one is kept
+        const size_t size = clipSize(*clip);
+        if (size <= _clips.maxSize())
+            _clips.insert(key, clip, size);
+    }
+
+    //-----------------------------------------------------------------------
+
+    size_t NoteClipCache::clipSize(const note_clip_t& clip)
+    {
+        return (clip.left.size() + clip.right.size()) * sizeof(float);
+    }
+
+
+    /********************************* BATCH RENDERING **********************************/
+
+    // Runs 'worker' on 'nb_threads' threads, including the calling one (0 to use as many
+    // threads as there are CPU cores, but never more than the number of jobs). Each
+    // worker prepares its own state, then calls 'next_job(index)' to retrieve the index
+    // of the next job to do until it returns false, and returns false if it can't do
+    // its jobs (the other workers then stop taking new ones). Returns false if a worker
+    // failed.
+    template<typename WORKER>
+    bool run_parallel_jobs(size_t nb_jobs, uint16_t nb_threads, WORKER worker)
+    {
+        if (nb_threads == 0)
+            nb_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+        nb_threads = std::min(size_t(nb_threads), std::max(nb_jobs, size_t(1)));
+
+        std::atomic<size_t> next(0);
+        std::atomic<bool> failed(false);
+
+        auto next_job = [&](size_t& index)
         {
-            Voice* voice = voices[i];
+            index = next.fetch_add(1);
+            return (index < nb_jobs) && !failed;
+        };
 
-            float previous_gain_left = _master_volume * voice->previousMixGainLeft();
-            float current_gain_left = _master_volume * voice->currentMixGainLeft();
-            writeBlock(
-                previous_gain_left, current_gain_left, voice->block_left(), _block_left
-            );
+        auto run = [&]()
+        {
+            if (!worker(next_job))
+                failed = true;
+        };
 
-            float previous_gain_right = _master_volume * voice->previousMixGainRight();
-            float current_gain_right = _master_volume * voice->currentMixGainRight();
-            writeBlock(
-                previous_gain_right, current_gain_right,
-                voice->stereo() ? voice->block_right() : voice->block_left(),
-                _block_right
-            );
-        }
+        std::vector<std::thread> threads;
+        for (uint16_t i = 1; i < nb_threads; ++i)
+            threads.emplace_back(run);
+
+        run();
+
+        for (auto& thread : threads)
+            thread.join();
+
+        return !failed;
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::renderBlockMono()
+    bool renderMidiFiles(
+        const std::shared_ptr<const sf::SoundFont>& soundfont,
+        const SynthesizerSettings& settings, const midi_render_job_t* jobs, size_t nb_jobs,
+        uint16_t nb_threads
+    )
     {
-        _voices->process();
-
-       memset((char*) _block_left, 0, _settings.blockSize() * sizeof(float));
+        if (!soundfont || soundfont->getPresets().empty())
+            return false;
 
-        auto& voices = _voices->voices();
-        for (int i = 0; i < _voices->nbActiveVoices(); ++i)
+        return run_parallel_jobs(nb_jobs, nb_threads, [&](auto next_job)
         {
-            Voice* voice = voices[i];
+            Synthesizer synthesizer(settings);
+            if (!synthesizer.setSoundFont(soundfont))
+                return false;
 
-            if (voice->stereo())
-            {
-                float previous_gain_left = _master_volume * voice->previousMixGainLeft();
-                float current_gain_left = _master_volume * voice->currentMixGainLeft();
-                writeBlock(
-                    previous_gain_left, current_gain_left, voice->block_left(), _block_left
-                );
-    
-                float previous_gain_right = _master_volume * voice->previousMixGainRight();
-                float current_gain_right = _master_volume * voice->currentMixGainRight();
-                writeBlock(
-                    previous_gain_right, current_gain_right, voice->block_right(), _block_left
-                );
-            }
-            else
+            MidiFileSequencer sequencer(synthesizer);
+
+            size_t index;
+            while (next_job(index))
             {
-                float previous_gain = _master_volume * voice->previousMixGainLeft();
-                float current_gain = _master_volume * voice->currentMixGainLeft();
-                writeBlock(
-                    previous_gain, current_gain, voice->block_left(), _block_left
-                );
+                const midi_render_job_t& job = jobs[index];
+
+                sequencer.play(*job.midi_file);
+
+                if (job.right)
+                    sequencer.render(job.left, job.right, job.size);
+                else
+                    sequencer.render(job.left, job.size);
             }
-        }
+
+            return true;
+        });
     }
 
     //-----------------------------------------------------------------------
 
-    void Synthesizer::writeBlock(
-        float previous_gain, float current_gain, float* source, float* destination
+    bool renderNotes(
+        const std::shared_ptr<const sf::SoundFont>& soundfont,
+        const SynthesizerSettings& settings, note_render_job_t* jobs, size_t nb_jobs,
+        uint16_t nb_threads, NoteClipCache* cache
     )
     {
-        if (fmax(previous_gain, current_gain) < NON_AUDIBLE)
-            return;
+        if (!soundfont || soundfont->getPresets().empty())
+            return false;
 
-        if (fabs(current_gain - previous_gain) < 1.0e-3)
+        return run_parallel_jobs(nb_jobs, nb_threads, [&](auto next_job)
         {
-            for (int i = 0; i < _settings.blockSize(); ++i)
-                destination[i] += current_gain * source[i];
-        }
-        else
-        {
-            float step = _inverse_block_size * (current_gain - previous_gain);
-            float gain = previous_gain;
+            Synthesizer synthesizer(settings);
+            if (!synthesizer.setSoundFont(soundfont))
+                return false;
 
-            for (int i = 0; i < _settings.blockSize(); ++i)
+            size_t index;
+            while (next_job(index))
             {
-                destination[i] += gain * source[i];
-                gain += step;
+                note_render_job_t& job = jobs[index];
+
+                synthesizer.setMasterVolume(job.master_volume);
+                job.clip = synthesizer.renderNote(
+                    job.preset, job.key, job.velocity, job.duration, cache
+                );
             }
-        }
+
+            return true;
+        });
     }
 
 
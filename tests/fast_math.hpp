@@ -0,0 +1,57 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-FileContributor: Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+*/
+
+TEST_CASE("Fast math")
+{
+    SECTION("exp2")
+    {
+        for (float x = -120.0f; x < 120.0f; x += 0.0173f)
+        {
+            double reference = exp2(double(x));
+            REQUIRE(fabs(fast_exp2(x) - reference) / reference < 1e-6);
+        }
+    }
+
+    SECTION("Decibels to linear")
+    {
+        for (float x = -100.0f; x < 50.0f; x += 0.01f)
+        {
+            double reference = pow(10.0, 0.05 * x);
+            REQUIRE(fabs(fast_decibels_to_linear(x) - reference) / reference < 1e-6);
+        }
+    }
+
+    SECTION("Cents to multiplying factor")
+    {
+        for (float x = -12000.0f; x < 12000.0f; x += 0.7f)
+        {
+            double reference = pow(2.0, x / 1200.0);
+            REQUIRE(fabs(fast_cents_to_multiplying_factor(x) - reference) / reference < 1e-6);
+        }
+    }
+
+    SECTION("Exponential with cutoff")
+    {
+        REQUIRE(fast_exp_cutoff(LOG_NON_AUDIBLE - 0.01f) == 0.0f);
+
+        for (float x = LOG_NON_AUDIBLE; x < 0.0f; x += 0.0001f)
+        {
+            double reference = exp(double(x));
+            REQUIRE(fabs(fast_exp_cutoff(x) - reference) / reference < 1e-6);
+        }
+    }
+
+    SECTION("Sine and cosine")
+    {
+        for (float x = -M_PI_2; x <= M_PI_2; x += 0.0001f)
+            REQUIRE(fabs(fast_sin(x) - sin(double(x))) < 1e-6);
+
+        for (float x = 0.0f; x <= M_PI; x += 0.0001f)
+            REQUIRE(fabs(fast_cos(x) - cos(double(x))) < 1e-6);
+    }
+}
@@ -8,6 +8,9 @@
 
 TEST_CASE("Filter")
 {
+    // Run the tests with the exact and the fast mathematical functions
+    const bool fast_math = GENERATE(false, true);
+
     float buffer[101];
     
     for (int i = 0; i < 101; ++i)
@@ -32,6 +35,7 @@ TEST_CASE("Filter")
         };
 
         SynthesizerSettings setting(22050);
+        setting.enableFastMath(fast_math);
         BiQuadFilter filter(setting);
 
         filter.clearBuffer();
@@ -64,6 +68,7 @@ TEST_CASE("Filter")
         };
 
         SynthesizerSettings setting(22050);
+        setting.enableFastMath(fast_math);
         BiQuadFilter filter(setting);
 
         filter.clearBuffer();
@@ -95,6 +100,7 @@ TEST_CASE("Filter")
         };
 
         SynthesizerSettings setting(44100);
+        setting.enableFastMath(fast_math);
         BiQuadFilter filter(setting);
 
         filter.clearBuffer();
@@ -105,4 +111,128 @@ TEST_CASE("Filter")
         for (int i = 0; i < 101; ++i)
             REQUIRE(buffer[i] == Approx(ref[i]).margin(0.0001f));
     }
+
+    SECTION("Cutoff changes below one cent")
+    {
+        SynthesizerSettings setting(44100);
+        setting.enableFastMath(fast_math);
+        BiQuadFilter filter(setting);
+        BiQuadFilter filter2(setting);
+
+        filter.clearBuffer();
+        filter.setLowPassFilter(1000.0f, decibels_to_linear(6.0f));
+
+        filter2.clearBuffer();
+        filter2.setLowPassFilter(1000.0f, decibels_to_linear(6.0f));
+
+        float buffer2[101];
+        memcpy(buffer2, buffer, sizeof(buffer));
+
+        filter.process(buffer, 50);
+        filter2.process(buffer2, 50);
+
+        // Same coefficients
+        filter2.setLowPassFilter(1000.5f, decibels_to_linear(6.0f));
+
+        filter.process(buffer + 50, 51);
+        filter2.process(buffer2 + 50, 51);
+
+        for (int i = 0; i < 101; ++i)
+            REQUIRE(buffer2[i] == buffer[i]);
+    }
+
+    SECTION("Cutoff transition during a long block")
+    {
+        const size_t SIZE = 1024;
+
+        SynthesizerSettings setting(44100);
+        setting.enableFastMath(fast_math);
+        BiQuadFilter filter(setting);
+        BiQuadFilter filter2(setting);
+
+        std::vector<float> input(2 * SIZE);
+        for (size_t i = 0; i < input.size(); ++i)
+            input[i] = buffer[i % 101];
+
+        std::vector<float> output(input);
+        std::vector<float> output2(input);
+
+        filter.clearBuffer();
+        filter.setLowPassFilter(100.0f, decibels_to_linear(6.0f));
+        filter.process(output.data(), SIZE);
+
+        filter2.clearBuffer();
+        filter2.setLowPassFilter(100.0f, decibels_to_linear(6.0f));
+        filter2.process(output2.data(), SIZE);
+
+        // 4 octaves higher in one block, or in 16 blocks of 64 samples with intermediate
+        // cutoff frequencies (equally spaced in cents)
+        filter.setLowPassFilter(1600.0f, decibels_to_linear(6.0f));
+        filter.process(output.data() + SIZE, SIZE);
+
+        for (size_t j = 1; j <= 16; ++j)
+        {
+            filter2.setLowPassFilter(
+                100.0f * exp2f(float(j * 64) / float(SIZE) * log2f(16.0f)),
+                decibels_to_linear(6.0f)
+            );
+            filter2.process(output2.data() + SIZE + (j - 1) * 64, 64);
+        }
+
+        for (size_t i = 0; i < 2 * SIZE; ++i)
+            REQUIRE(output[i] == Approx(output2[i]).margin(0.0001f));
+    }
+
+    SECTION("Several filters at once")
+    {
+        const size_t NB_FILTERS = 11;
+        const size_t SIZE = 101;
+
+        SynthesizerSettings setting(44100);
+        setting.enableFastMath(fast_math);
+
+        std::vector<BiQuadFilter> filters(NB_FILTERS, BiQuadFilter(setting));
+        std::vector<BiQuadFilter> references(NB_FILTERS, BiQuadFilter(setting));
+
+        std::vector<float> blocks(NB_FILTERS * SIZE);
+        std::vector<float> expected(NB_FILTERS * SIZE);
+
+        BiQuadFilter* filter_pointers[NB_FILTERS];
+        float* block_pointers[NB_FILTERS];
+
+        for (size_t i = 0; i < NB_FILTERS; ++i)
+        {
+            filters[i].clearBuffer();
+            references[i].clearBuffer();
+
+            filter_pointers[i] = &filters[i];
+            block_pointers[i] = blocks.data() + i * SIZE;
+        }
+
+        for (int pass = 0; pass < 3; ++pass)
+        {
+            for (size_t i = 0; i < NB_FILTERS; ++i)
+            {
+                // Some cutoff changes (with a transition of the coefficients), and one
+                // inactive filter
+                float cutoff = (i == 5 ? 30000.0f : 200.0f * (i + 1) + (i % 2) * 300.0f * pass);
+
+                filters[i].setLowPassFilter(cutoff, decibels_to_linear(3.0f * i));
+                references[i].setLowPassFilter(cutoff, decibels_to_linear(3.0f * i));
+
+                for (size_t j = 0; j < SIZE; ++j)
+                {
+                    blocks[i * SIZE + j] = buffer[(j + 13 * i + pass) % 101];
+                    expected[i * SIZE + j] = blocks[i * SIZE + j];
+                }
+
+                references[i].process(expected.data() + i * SIZE, SIZE);
+            }
+
+            BiQuadFilter::process(filter_pointers, block_pointers, NB_FILTERS, SIZE);
+
+            for (size_t i = 0; i < NB_FILTERS * SIZE; ++i)
+                REQUIRE(blocks[i] == expected[i]);
+        }
+    }
 }
@@ -64,4 +64,30 @@ TEST_CASE("LFO")
             REQUIRE(lfo.value() == Approx(ref[i]).margin(0.0001f));
         }
     }
+
+    SECTION("Long notes")
+    {
+        SynthesizerSettings setting(44100);
+        Lfo lfo(setting);
+
+        lfo.start(0.0f, 5.3f);
+
+        // Ten minutes, compared with the phase computed from the number of samples
+        for (uint64_t n = 64; n <= 600 * 44100; n += 64)
+        {
+            lfo.process();
+
+            if (n % (64 * 1000) == 0)
+            {
+                double phase = double(n) * double(5.3f) / 44100.0;
+                phase -= floor(phase);
+
+                float expected = (phase < 0.25 ? 4.0 * phase :
+                                  phase < 0.75 ? 4.0 * (0.5 - phase) :
+                                  4.0 * (phase - 1.0));
+
+                REQUIRE(lfo.value() == Approx(expected).margin(0.0001f));
+            }
+        }
+    }
 }
@@ -20,11 +20,16 @@ using namespace knm::synth;
 #endif
 
 
+#include "fast_math.hpp"
 #include "filter.hpp"
 #include "lfo.hpp"
+#include "midi_file.hpp"
+#include "mixing.hpp"
+#include "modulators.hpp"
 #include "modulation_envelope.hpp"
 #include "sampler.hpp"
 #include "voice.hpp"
+#include "voice_collection.hpp"
 #include "synthesizer.hpp"
 #include "volume_envelope.hpp"
 
@@ -0,0 +1,335 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-FileContributor: Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+*/
+
+#include <string>
+#include <vector>
+
+
+// Build a MIDI file from the content of its tracks
+static std::string make_midi_file(
+    uint16_t format, uint16_t division, const std::vector<std::string>& tracks
+)
+{
+    auto write_big_endian = [](std::string& s, uint32_t value, int nb_bytes)
+    {
+        for (int i = nb_bytes - 1; i >= 0; --i)
+            s += char((value >> (8 * i)) & 0xFF);
+    };
+
+    std::string file = "MThd";
+    write_big_endian(file, 6, 4);
+    write_big_endian(file, format, 2);
+    write_big_endian(file, tracks.size(), 2);
+    write_big_endian(file, division, 2);
+
+    for (const auto& track : tracks)
+    {
+        file += "MTrk";
+        write_big_endian(file, track.size(), 4);
+        file += track;
+    }
+
+    return file;
+}
+
+
+TEST_CASE("MIDI file")
+{
+    MidiFile midi_file;
+
+    SECTION("Format 0, running status")
+    {
+        // 480 ticks per quarter note, at the default tempo (120 BPM)
+        std::string track(
+            "\x00\x90\x45\x64"      // Note on (A4)
+            "\x83\x60\x40\x50"      // +480 ticks, running status: note on (E4)
+            "\x00\x45\x00"          // Running status: note on (A4, velocity 0)
+            "\x00\xC1\x05"          // Program change
+            "\x81\x70\x80\x40\x00"  // +240 ticks, note off (E4)
+            "\x00\xFF\x2F\x00",     // End of track
+            23
+        );
+
+        std::string data = make_midi_file(0, 480, { track });
+        REQUIRE(midi_file.load(data.data(), data.size()));
+
+        const auto& events = midi_file.events();
+        REQUIRE(events.size() == 5);
+
+        REQUIRE(events[0].time == 0.0);
+        REQUIRE(events[0].command == 0x90);
+        REQUIRE(events[0].data1 == 69);
+        REQUIRE(events[0].data2 == 100);
+
+        REQUIRE(events[1].time == Approx(0.5));
+        REQUIRE(events[1].command == 0x90);
+        REQUIRE(events[1].data1 == 64);
+        REQUIRE(events[1].data2 == 80);
+
+        REQUIRE(events[2].time == Approx(0.5));
+        REQUIRE(events[2].command == 0x90);
+        REQUIRE(events[2].data1 == 69);
+        REQUIRE(events[2].data2 == 0);
+
+        REQUIRE(events[3].channel == 1);
+        REQUIRE(events[3].command == 0xC0);
+        REQUIRE(events[3].data1 == 5);
+
+        REQUIRE(events[4].time == Approx(0.75));
+        REQUIRE(events[4].command == 0x80);
+
+        REQUIRE(midi_file.length() == Approx(0.75));
+    }
+
+    SECTION("Format 1, tempo changes")
+    {
+        // Tempo track: 240 BPM, then 60 BPM after one quarter note
+        std::string tempo_track(
+            "\x00\xFF\x51\x03\x03\xD0\x90"  // Set tempo (250000 µs)
+            "\x00\xFF\x03\x02Hi"            // Track name (ignored)
+            "\x83\x60\xFF\x51\x03\x0F\x42\x40"  // +480 ticks, set tempo (1000000 µs)
+            "\x00\xFF\x2F\x00",             // End of track
+            25
+        );
+
+        std::string notes_track(
+            "\x00\xF0\x03\x7E\x09\xF7"      // System exclusive (ignored)
+            "\x83\x60\x92\x3C\x64"          // +480 ticks, note on (C4)
+            "\x83\x60\x82\x3C\x00"          // +480 ticks, note off (C4)
+            "\x00\xFF\x2F\x00",             // End of track
+            20
+        );
+
+        std::string data = make_midi_file(1, 480, { tempo_track, notes_track });
+        REQUIRE(midi_file.load(data.data(), data.size()));
+
+        const auto& events = midi_file.events();
+        REQUIRE(events.size() == 2);
+
+        REQUIRE(events[0].time == Approx(0.25));
+        REQUIRE(events[0].channel == 2);
+        REQUIRE(events[0].command == 0x90);
+
+        REQUIRE(events[1].time == Approx(1.25));
+        REQUIRE(events[1].channel == 2);
+        REQUIRE(events[1].command == 0x80);
+
+        REQUIRE(midi_file.length() == Approx(1.25));
+    }
+
+    SECTION("MIDI ports")
+    {
+        std::string track1(
+            "\x00\x91\x3C\x64"          // Note on (C4), port 0
+            "\x00\xFF\x2F\x00",         // End of track
+            8
+        );
+
+        std::string track2(
+            "\x00\xFF\x21\x01\x02"     // MIDI port 2
+            "\x0A\x91\x3C\x64"          // +10 ticks, note on (C4)
+            "\x00\xFF\x2F\x00",         // End of track
+            13
+        );
+
+        std::string data = make_midi_file(1, 480, { track1, track2 });
+        REQUIRE(midi_file.load(data.data(), data.size()));
+
+        const auto& events = midi_file.events();
+        REQUIRE(events.size() == 2);
+        REQUIRE(events[0].channel == 1);
+        REQUIRE(events[1].channel == 33);
+    }
+
+    SECTION("Invalid files")
+    {
+        std::string track("\x00\x90\x45\x64\x00\xFF\x2F\x00", 8);
+
+        std::string data = make_midi_file(2, 480, { track });
+        REQUIRE(!midi_file.load(data.data(), data.size()));
+
+        // Truncated track
+        data = make_midi_file(0, 480, { track.substr(0, 3) });
+        REQUIRE(!midi_file.load(data.data(), data.size()));
+
+        // Data byte without running status
+        data = make_midi_file(0, 480, { std::string("\x00\x45\x64\x00\xFF\x2F\x00", 7) });
+        REQUIRE(!midi_file.load(data.data(), data.size()));
+
+        data = "RIFF";
+        REQUIRE(!midi_file.load(data.data(), data.size()));
+
+        REQUIRE(!midi_file.load(DATA_DIR "440_16bits.sf2"));
+        REQUIRE(midi_file.events().empty());
+    }
+}
+
+
+TEST_CASE("MIDI file sequencer")
+{
+    SynthesizerSettings settings(22050);
+    settings.enableReverbAndChorus(false);
+
+    Synthesizer synthesizer(settings);
+    REQUIRE(synthesizer.loadSoundFont(DATA_DIR "440_16bits.sf2"));
+
+    MidiFileSequencer sequencer(synthesizer);
+
+    // Tempo of 1 ms per tick: the events aren't aligned on the blocks
+    std::string track(
+        "\x00\xFF\x51\x03\x07\xA1\x20"  // Set tempo (500000 µs)
+        "\x05\xC0\x01"                  // +5 ticks, program change (mono preset)
+        "\x00\x90\x45\x64"              // Note on (A4)
+        "\x0A\x90\x3C\x64"              // +10 ticks, note on (C4)
+        "\x0A\x80\x45\x00"              // +10 ticks, note off (A4)
+        "\x00\xFF\x2F\x00",             // End of track
+        26
+    );
+
+    std::string data = make_midi_file(0, 500, { track });
+
+    MidiFile midi_file;
+    REQUIRE(midi_file.load(data.data(), data.size()));
+
+    SECTION("Sample-accurate playback")
+    {
+        const size_t SIZE = 2000;
+
+        float buffer[SIZE];
+        sequencer.play(midi_file);
+        sequencer.render(buffer, 500);
+        sequencer.render(buffer + 500, SIZE - 500);
+
+        REQUIRE(sequencer.endOfSequence());
+        REQUIRE(sequencer.position() == Approx(SIZE / 22050.0));
+
+        // Same as giving the events to the synthesizer at their position in samples
+        Synthesizer synthesizer2(settings);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+
+        midi_event_t events[4];
+        for (size_t i = 0; i < 4; ++i)
+        {
+            const auto& event = midi_file.events()[i];
+            events[i] = {
+                uint32_t(llround(event.time * 22050)), event.channel, event.command,
+                event.data1, event.data2
+            };
+        }
+
+        REQUIRE(events[1].offset == 110);
+
+        float buffer2[SIZE];
+        synthesizer2.render(buffer2, SIZE, events, 4);
+
+        for (size_t i = 0; i < SIZE; ++i)
+            REQUIRE(buffer[i] == buffer2[i]);
+
+        for (size_t i = 0; i < 110; ++i)
+            REQUIRE(buffer[i] == 0.0f);
+
+        REQUIRE(buffer[111] != 0.0f);
+    }
+
+    SECTION("Looping")
+    {
+        float buffer[2000];
+        sequencer.play(midi_file, true);
+        sequencer.render(buffer, 2000);
+
+        REQUIRE(!sequencer.endOfSequence());
+        REQUIRE(sequencer.position() < midi_file.length());
+        REQUIRE(sequencer.position() == Approx(2000 / 22050.0 - 3 * midi_file.length()).margin(0.0001));
+    }
+
+    SECTION("Snapshots")
+    {
+        const size_t SIZE = 2000;
+
+        // The events split the blocks, so the buffers are rendered by chunks of the
+        // same sizes
+        float reference[SIZE];
+        sequencer.play(midi_file);
+        sequencer.render(reference, 150);
+        sequencer.render(reference + 150, SIZE - 150);
+
+        // Snapshot taken between the two notes on
+        float buffer[SIZE];
+        SynthesizerSnapshot snapshot(synthesizer);
+        sequencer.play(midi_file);
+        sequencer.render(buffer, 150);
+
+        REQUIRE(!sequencer.restore(snapshot));
+        REQUIRE(sequencer.snapshot(snapshot));
+
+        // Seek back to the snapshot
+        sequencer.render(buffer + 150, 500);
+        REQUIRE(sequencer.restore(snapshot));
+        REQUIRE(sequencer.position() == Approx(150 / 22050.0));
+
+        sequencer.render(buffer + 150, SIZE - 150);
+
+        for (size_t i = 0; i < SIZE; ++i)
+            REQUIRE(buffer[i] == reference[i]);
+
+        // The snapshot of the synthesizer alone doesn't contain the sequencer
+        REQUIRE(synthesizer.snapshot(snapshot));
+        REQUIRE(!sequencer.restore(snapshot));
+    }
+
+    SECTION("Stop")
+    {
+        float buffer[200];
+        sequencer.play(midi_file);
+        sequencer.render(buffer, 200);
+
+        REQUIRE(synthesizer.nbActiveVoices() == 1);
+
+        sequencer.stop();
+
+        REQUIRE(sequencer.endOfSequence());
+        REQUIRE(synthesizer.nbActiveVoices() == 0);
+    }
+
+    SECTION("Batch rendering")
+    {
+        const size_t SIZE = 3000;
+
+        std::vector<float> reference_left(SIZE);
+        std::vector<float> reference_right(SIZE);
+        sequencer.play(midi_file);
+        sequencer.render(reference_left.data(), reference_right.data(), SIZE);
+
+        std::vector<std::vector<float>> buffers(6, std::vector<float>(SIZE));
+
+        midi_render_job_t jobs[] = {
+            { &midi_file, buffers[0].data(), buffers[1].data(), SIZE },
+            { &midi_file, buffers[2].data(), buffers[3].data(), SIZE },
+            { &midi_file, buffers[4].data(), nullptr, SIZE },
+        };
+
+        REQUIRE(renderMidiFiles(synthesizer.sharedSoundFont(), settings, jobs, 3, 2));
+
+        for (size_t i = 0; i < SIZE; ++i)
+        {
+            REQUIRE(buffers[0][i] == reference_left[i]);
+            REQUIRE(buffers[1][i] == reference_right[i]);
+            REQUIRE(buffers[2][i] == reference_left[i]);
+            REQUIRE(buffers[3][i] == reference_right[i]);
+        }
+
+        // The third file was rendered in mono
+        sequencer.play(midi_file);
+        sequencer.render(reference_left.data(), SIZE);
+
+        for (size_t i = 0; i < SIZE; ++i)
+            REQUIRE(buffers[4][i] == reference_left[i]);
+
+        REQUIRE(!renderMidiFiles(nullptr, settings, jobs, 3, 2));
+    }
+}
@@ -0,0 +1,137 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-FileContributor: Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+*/
+
+TEST_CASE("Mixing kernels")
+{
+    // Odd size, to test the handling of the samples not processed by SIMD instructions
+    const uint32_t SIZE = 61;
+
+    float source[SIZE];
+    float left[SIZE];
+    float right[SIZE];
+
+    for (int i = 0; i < SIZE; ++i)
+    {
+        source[i] = sinf(0.1f * i);
+        left[i] = 0.5f;
+        right[i] = -0.5f;
+    }
+
+
+    SECTION("Constant gain")
+    {
+        mix_constant(left, source, 0.3f, SIZE);
+
+        for (int i = 0; i < SIZE; ++i)
+            REQUIRE(left[i] == Approx(0.5f + 0.3f * source[i]).margin(0.000001f));
+    }
+
+    SECTION("Gain ramp")
+    {
+        mix_ramp(left, source, 0.3f, 0.01f, SIZE);
+
+        for (int i = 0; i < SIZE; ++i)
+            REQUIRE(left[i] == Approx(0.5f + (0.3f + 0.01f * i) * source[i]).margin(0.000001f));
+    }
+
+    SECTION("Stereo gain ramps")
+    {
+        float left2[SIZE];
+        float right2[SIZE];
+
+        memcpy(left2, left, sizeof(left));
+        memcpy(right2, right, sizeof(right));
+
+        mix_ramp_stereo(left, right, source, 0.3f, 0.01f, 0.7f, 0.0f, SIZE);
+
+        mix_ramp(left2, source, 0.3f, 0.01f, SIZE);
+        mix_ramp(right2, source, 0.7f, 0.0f, SIZE);
+
+        for (int i = 0; i < SIZE; ++i)
+        {
+            REQUIRE(left[i] == left2[i]);
+            REQUIRE(right[i] == right2[i]);
+            REQUIRE(right[i] == Approx(-0.5f + 0.7f * source[i]).margin(0.000001f));
+        }
+    }
+}
+
+
+TEST_CASE("Conversion kernels")
+{
+    // Odd size, to test the handling of the samples not processed by SIMD instructions
+    const uint32_t SIZE = 61;
+
+    // Includes values out of [-1, 1] to test the clamping
+    float left[SIZE];
+    float right[SIZE];
+
+    for (int i = 0; i < SIZE; ++i)
+    {
+        left[i] = 1.2f * sinf(0.1f * i);
+        right[i] = -1.5f * cosf(0.07f * i);
+    }
+
+
+    SECTION("Interleaved floats")
+    {
+        float result[2 * SIZE];
+        interleave(result, left, right, SIZE);
+
+        for (int i = 0; i < SIZE; ++i)
+        {
+            REQUIRE(result[2 * i] == left[i]);
+            REQUIRE(result[2 * i + 1] == right[i]);
+        }
+    }
+
+    SECTION("Interleaved 16-bits integers")
+    {
+        int16_t result[2 * SIZE];
+        interleave_int16(result, left, right, nullptr, SIZE);
+
+        for (int i = 0; i < SIZE; ++i)
+        {
+            REQUIRE(result[2 * i] == int16_t(lrintf(fmin(fmax(left[i] * 32767.0f, -32768.0f), 32767.0f))));
+            REQUIRE(result[2 * i + 1] == int16_t(lrintf(fmin(fmax(right[i] * 32767.0f, -32768.0f), 32767.0f))));
+        }
+
+        REQUIRE(result[2 * 15] == 32767);
+    }
+
+    SECTION("Interleaved 16-bits integers, with noise")
+    {
+        float noise[2 * SIZE];
+        for (int i = 0; i < 2 * SIZE; ++i)
+            noise[i] = (i % 3) - 1.0f;
+
+        int16_t result[2 * SIZE];
+        interleave_int16(result, left, right, noise, SIZE);
+
+        for (int i = 0; i < SIZE; ++i)
+        {
+            REQUIRE(result[2 * i] == int16_t(lrintf(fmin(fmax(left[i] * 32767.0f + noise[2 * i], -32768.0f), 32767.0f))));
+            REQUIRE(result[2 * i + 1] == int16_t(lrintf(fmin(fmax(right[i] * 32767.0f + noise[2 * i + 1], -32768.0f), 32767.0f))));
+        }
+    }
+
+    SECTION("Interleaved 32-bits integers")
+    {
+        int32_t result[2 * SIZE];
+        interleave_int32(result, left, right, SIZE);
+
+        for (int i = 0; i < SIZE; ++i)
+        {
+            REQUIRE(result[2 * i] == int32_t(lrintf(fmin(fmax(left[i] * 2147483648.0f, -2147483648.0f), 2147483520.0f))));
+            REQUIRE(result[2 * i + 1] == int32_t(lrintf(fmin(fmax(right[i] * 2147483648.0f, -2147483648.0f), 2147483520.0f))));
+        }
+
+        REQUIRE(result[2 * 15] == 2147483520);
+        REQUIRE(result[1] == -2147483647 - 1);
+    }
+}
@@ -0,0 +1,109 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-FileContributor: Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+*/
+
+TEST_CASE("Modulators")
+{
+    SECTION("Curves")
+    {
+        const modulator_curves_t& curves = modulator_curves_t::instance();
+
+        const uint8_t LINEAR = knm::sf::MOD_SRC_TYPE_LINEAR * 4;
+        const uint8_t CONCAVE = knm::sf::MOD_SRC_TYPE_CONCAVE * 4;
+        const uint8_t CONVEX = knm::sf::MOD_SRC_TYPE_CONVEX * 4;
+        const uint8_t SWITCH = knm::sf::MOD_SRC_TYPE_SWITCH * 4;
+
+        REQUIRE(curves.get(LINEAR, 0.0f) == Approx(0.0f));
+        REQUIRE(curves.get(LINEAR, 63.5f) == Approx(0.5f));
+        REQUIRE(curves.get(LINEAR, 127.0f) == Approx(1.0f));
+
+        // Max to min
+        REQUIRE(curves.get(LINEAR + 2, 0.0f) == Approx(1.0f));
+        REQUIRE(curves.get(LINEAR + 2, 127.0f) == Approx(0.0f));
+
+        // Bipolar
+        REQUIRE(curves.get(LINEAR + 1, 0.0f) == Approx(-1.0f));
+        REQUIRE(curves.get(LINEAR + 1, 127.0f) == Approx(1.0f));
+
+        REQUIRE(curves.get(CONCAVE, 0.0f) == Approx(0.0f).margin(0.0001f));
+        REQUIRE(curves.get(CONCAVE, 64.0f) < 0.5f);
+        REQUIRE(curves.get(CONCAVE, 127.0f) == Approx(1.0f));
+
+        REQUIRE(curves.get(CONVEX, 0.0f) == Approx(0.0f));
+        REQUIRE(curves.get(CONVEX, 64.0f) > 0.5f);
+        REQUIRE(curves.get(CONVEX, 127.0f) == Approx(1.0f).margin(0.0001f));
+
+        REQUIRE(curves.get(SWITCH, 63.0f) == 0.0f);
+        REQUIRE(curves.get(SWITCH, 64.0f) == 1.0f);
+    }
+
+    SECTION("Compilation")
+    {
+        SynthesizerSettings settings(22050);
+        Synthesizer synthesizer(settings);
+
+        REQUIRE(synthesizer.loadSoundFont(DATA_DIR "440_16bits.sf2"));
+
+        const knm::sf::SoundFont& soundfont = synthesizer.soundfont();
+
+        Channel channel(false);
+        ModulatorSet modulators;
+
+        SECTION("High velocity")
+        {
+            knm::sf::key_info_t key_info;
+            REQUIRE(soundfont.getKeyInfo(0, 1, 69, 100, key_info));
+
+            knm::sf::generator_set_t generators = key_info.left.generators;
+            modulators.start(key_info.left, channel, 69, 100, generators);
+
+            // The default modulators don't change anything
+            for (int i = 0; i < MOD_PARAM_COUNT; ++i)
+                REQUIRE(modulators.value(modulated_parameter_t(i)) == 0.0f);
+
+            REQUIRE(!modulators.update(channel));
+        }
+
+        SECTION("Low velocity")
+        {
+            knm::sf::key_info_t key_info;
+            REQUIRE(soundfont.getKeyInfo(0, 1, 69, 32, key_info));
+
+            knm::sf::generator_set_t generators = key_info.left.generators;
+            modulators.start(key_info.left, channel, 69, 32, generators);
+
+            // Default modulator: MIDI Note-On Velocity to Filter Cutoff
+            REQUIRE(modulators.value(MOD_PARAM_INITIAL_FILTER_CUTOFF) ==
+                    Approx(-2400.0f * (1.0f - 32.0f / 127.0f)));
+        }
+
+        SECTION("Channel pressure")
+        {
+            knm::sf::key_info_t key_info;
+            REQUIRE(soundfont.getKeyInfo(0, 1, 69, 100, key_info));
+
+            knm::sf::generator_set_t generators = key_info.left.generators;
+            modulators.start(key_info.left, channel, 69, 100, generators);
+
+            REQUIRE(modulators.value(MOD_PARAM_VIBRATO_LFO_TO_PITCH) == 0.0f);
+
+            // Not updated until the controls of the channel are
+            channel.setChannelPressure(127);
+            REQUIRE(!modulators.update(channel));
+
+            // Default modulator: MIDI Channel Pressure to Vibrato LFO Pitch Depth
+            channel.updateControls();
+            REQUIRE(modulators.update(channel));
+            REQUIRE(modulators.value(MOD_PARAM_VIBRATO_LFO_TO_PITCH) == Approx(50.0f));
+
+            // Other controls don't change the modulations
+            channel.setVolumeCoarse(50);
+            channel.updateControls();
+            REQUIRE(!modulators.update(channel));
+        }
+    }
+}
@@ -8,6 +8,9 @@
 
 TEST_CASE("Sampler")
 {
+    // Run the tests with the exact and the fast mathematical functions
+    const bool fast_math = GENERATE(false, true);
+
     float buffer[101];
     
     for (int i = 0; i < 101; ++i)
@@ -34,7 +37,7 @@ TEST_CASE("Sampler")
             -0.56f, -0.54f, -0.52f, -0.50f, -0.48f, -0.46f,
         };
 
-        Sampler sampler(44100);
+        Sampler sampler(44100, INTERPOLATION_MODE_LINEAR, fast_math);
         sampler.start(buffer, 0, 101, LOOP_MODE_UNTIL_RELEASE, 0, 100, 44100, 69, 0, 0, 100);
 
         float result[64];
@@ -70,7 +73,7 @@ TEST_CASE("Sampler")
             -0.16f, -0.12f, -0.08f, -0.04f, 0.00f, 0.04f, 0.08f,
         };
 
-        Sampler sampler(22050);
+        Sampler sampler(22050, INTERPOLATION_MODE_LINEAR, fast_math);
         sampler.start(buffer, 0, 101, LOOP_MODE_UNTIL_RELEASE, 0, 100, 44100, 69, 0, 0, 100);
 
         float result[64];
@@ -106,7 +109,7 @@ TEST_CASE("Sampler")
             0.21f, 0.22f, 0.23f, 0.24f, 0.25f, 0.26f, 0.27f,
         };
 
-        Sampler sampler(44100);
+        Sampler sampler(44100, INTERPOLATION_MODE_LINEAR, fast_math);
         sampler.start(buffer, 0, 101, LOOP_MODE_UNTIL_RELEASE, 0, 100, 22050, 69, 0, 0, 100);
 
         float result[64];
@@ -145,7 +148,7 @@ TEST_CASE("Sampler")
             0.4389f, 0.4508f, 0.4627f, 0.4746f, 0.4865f, 0.4984f, 0.5103f,
         };
 
-        Sampler sampler(44100);
+        Sampler sampler(44100, INTERPOLATION_MODE_LINEAR, fast_math);
         sampler.start(buffer, 0, 101, LOOP_MODE_UNTIL_RELEASE, 0, 100, 44100, 69, 0, 0, 100);
 
         float result[64];
@@ -183,7 +186,7 @@ TEST_CASE("Sampler")
             -0.9637f, -0.9301f, -0.8964f, -0.8628f, -0.8292f, -0.7955f, -0.7619f, -0.7282f,
         };
 
-        Sampler sampler(44100);
+        Sampler sampler(44100, INTERPOLATION_MODE_LINEAR, fast_math);
         sampler.start(buffer, 0, 101, LOOP_MODE_UNTIL_RELEASE, 0, 100, 44100, 69, 0, 0, 100);
 
         float result[64];
@@ -221,7 +224,7 @@ TEST_CASE("Sampler")
             0.0073f, 0.0326f, 0.0578f, 0.0831f, 0.1084f, 0.1336f, 0.1589f, 0.1842f, 0.2095f,
         };
 
-        Sampler sampler(44100);
+        Sampler sampler(44100, INTERPOLATION_MODE_LINEAR, fast_math);
         sampler.start(buffer, 0, 101, LOOP_MODE_UNTIL_RELEASE, 0, 100, 44100, 69, 4, 5, 100);
 
         float result[64];
@@ -260,7 +263,7 @@ TEST_CASE("Sampler")
             0.9741f, -0.0090f, -0.9941f, -0.9782f,
         };
 
-        Sampler sampler(44100);
+        Sampler sampler(44100, INTERPOLATION_MODE_LINEAR, fast_math);
         sampler.start(buffer, 0, 101, LOOP_MODE_UNTIL_RELEASE, 0, 100, 44100, 69, -4, 5, 100);
 
         float result[64];
@@ -299,7 +302,7 @@ TEST_CASE("Sampler")
             0.8969f, 0.9123f, 0.9278f, 0.9432f, 0.9586f,
         };
 
-        Sampler sampler(44100);
+        Sampler sampler(44100, INTERPOLATION_MODE_LINEAR, fast_math);
         sampler.start(buffer, 0, 101, LOOP_MODE_UNTIL_RELEASE, 0, 100, 44100, 69, 0, 0, 50);
 
         float result[64];
@@ -337,7 +340,7 @@ TEST_CASE("Sampler")
             0.2959f, 0.3404f, 0.3849f, 0.4294f, 0.4739f, 0.5184f, 0.5630f, 0.6075f, 0.6520f,
         };
 
-        Sampler sampler(22050);
+        Sampler sampler(22050, INTERPOLATION_MODE_LINEAR, fast_math);
         sampler.start(buffer, 0, 101, LOOP_MODE_UNTIL_RELEASE, 0, 100, 48000, 69, 5, -12, 50);
 
         float result[64];
@@ -352,4 +355,118 @@ TEST_CASE("Sampler")
         for (int i = 0; i < 64; ++i)
             REQUIRE(result[i] == Approx(ref2[i]).margin(0.0001f));
     }
+
+    SECTION("16-bits and 24-bits audio data")
+    {
+        int16_t buffer16[101];
+        uint8_t buffer24[101];
+
+        for (int i = 0; i < 101; ++i)
+        {
+            buffer16[i] = int16_t(-32767 + 655 * i);
+            buffer24[i] = uint8_t(i);
+        }
+
+        Sampler sampler16(44100, INTERPOLATION_MODE_LINEAR, fast_math);
+        sampler16.start(knm::sf::sample_buffer_t(buffer16), 0, 101, LOOP_MODE_UNTIL_RELEASE, 0, 100, 48000, 69, 5, -12, 50);
+
+        Sampler sampler24(44100, INTERPOLATION_MODE_LINEAR, fast_math);
+        sampler24.start(knm::sf::sample_buffer_t(buffer16, buffer24), 0, 101, LOOP_MODE_UNTIL_RELEASE, 0, 100, 48000, 69, 5, -12, 50);
+
+        float result16[64];
+        float result24[64];
+
+        for (int j = 0; j < 2; ++j)
+        {
+            sampler16.process(result16, 64, 60);
+            sampler24.process(result24, 64, 60);
+
+            for (int i = 0; i < 64; ++i)
+            {
+                REQUIRE(result16[i] == Approx(result24[i]).margin(0.0001f));
+                REQUIRE(result16[i] >= -1.0f);
+                REQUIRE(result16[i] <= 1.0f);
+            }
+        }
+    }
+
+    SECTION("Interpolation modes")
+    {
+        // Compare the output with the analytical signal, on a sine wave played at a
+        // non-integer ratio
+        const int SIZE = 1000;
+        const float PERIOD = 50.0f;
+
+        float sine[SIZE + 46];
+        for (int i = 0; i < SIZE + 46; ++i)
+            sine[i] = (i < SIZE ? sinf(2.0f * M_PI * i / PERIOD) : 0.0f);
+
+        auto max_error = [&](interpolation_mode_t mode, loop_mode_t loop_mode)
+        {
+            // The loop contains exactly 2 periods, so the signal stays continuous
+            Sampler sampler(44100, mode);
+            sampler.start(sine, 0, SIZE, loop_mode, 200, 300, 48000, 69, 0, 0, 100);
+
+            float result[512];
+            REQUIRE(sampler.process(result, 512, 69));
+
+            const double ratio = 48000.0 / 44100.0;
+            float error = 0.0f;
+
+            for (int i = 4; i < 512; ++i)
+            {
+                float expected = sinf(2.0f * M_PI * float(i * ratio) / PERIOD);
+                error = fmax(error, fabs(result[i] - expected));
+            }
+
+            return error;
+        };
+
+        for (auto loop_mode : { LOOP_MODE_NONE, LOOP_MODE_CONTINUOUS })
+        {
+            float nearest = max_error(INTERPOLATION_MODE_NEAREST, loop_mode);
+            float linear = max_error(INTERPOLATION_MODE_LINEAR, loop_mode);
+            float cubic = max_error(INTERPOLATION_MODE_CUBIC, loop_mode);
+            float sinc = max_error(INTERPOLATION_MODE_SINC, loop_mode);
+
+            REQUIRE(nearest < 0.07f);
+            REQUIRE(linear < 0.0025f);
+            REQUIRE(cubic < 0.0001f);
+            REQUIRE(sinc < 0.0005f);
+        }
+    }
+
+    SECTION("Pitch changes")
+    {
+        // With a linear interpolation, the output is the position in the sample
+        float positions[1000];
+        for (int i = 0; i < 1000; ++i)
+            positions[i] = 0.001f * i;
+
+        Sampler sampler(44100, INTERPOLATION_MODE_LINEAR, fast_math);
+        sampler.start(positions, 0, 1000, LOOP_MODE_NONE, 0, 0, 44100, 69, 0, 0, 100);
+
+        float result[64];
+
+        // First block: no ramp from a previous pitch
+        REQUIRE(sampler.process(result, 64, 81));
+
+        for (int i = 0; i < 64; ++i)
+            REQUIRE(result[i] == Approx(0.002f * i).margin(0.0001f));
+
+        // One octave lower: the increment goes from 2 to 1 during the block
+        REQUIRE(sampler.process(result, 64, 69));
+
+        for (int i = 0; i < 64; ++i)
+        {
+            float position = 128.0f + 2.0f * i - i * (i + 1) / 128.0f;
+            REQUIRE(result[i] == Approx(0.001f * position).margin(0.0001f));
+        }
+
+        // Same pitch: constant increment
+        REQUIRE(sampler.process(result, 64, 69));
+
+        for (int i = 0; i < 64; ++i)
+            REQUIRE(result[i] == Approx(0.001f * (128.0f + 128.0f - 32.5f + i)).margin(0.0001f));
+    }
 }
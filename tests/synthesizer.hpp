@@ -8,7 +8,10 @@
 
 TEST_CASE("Synthesizer")
 {
+    // The reference signals are dry
     SynthesizerSettings settings(22050);
+    settings.enableReverbAndChorus(false);
+
     Synthesizer synthesizer(settings);
 
     REQUIRE(synthesizer.loadSoundFont(DATA_DIR "440_16bits.sf2"));
@@ -132,4 +135,1591 @@ TEST_CASE("Synthesizer")
             REQUIRE(right[i] == Approx(0.33722f * ref_C4[i]).margin(0.0001f));
         }
     }
+
+    SECTION("Shared SoundFont")
+    {
+        Synthesizer synthesizer2(settings);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+
+        REQUIRE(&synthesizer2.soundfont() == &synthesizer.soundfont());
+        REQUIRE(synthesizer2.soundfont().getBuffer() == synthesizer.soundfont().getBuffer());
+
+        synthesizer.configureChannel(0, 0, 1);
+        synthesizer.noteOn(0, 60, 100);
+
+        synthesizer2.configureChannel(0, 0, 1);
+        synthesizer2.noteOn(0, 60, 100);
+
+        float buffer[640];
+        float buffer2[640];
+        synthesizer.render(buffer, 640);
+        synthesizer2.render(buffer2, 640);
+
+        for (int i = 0; i < 640; ++i)
+        {
+            REQUIRE(buffer[i] == Approx(0.33726f * ref_C4[i]).margin(0.0001f));
+            REQUIRE(buffer2[i] == buffer[i]);
+        }
+    }
+
+    SECTION("Invalid shared SoundFont")
+    {
+        Synthesizer synthesizer2(settings);
+        REQUIRE(!synthesizer2.setSoundFont(nullptr));
+        REQUIRE(!synthesizer2.setSoundFont(std::make_shared<knm::sf::SoundFont>()));
+    }
+
+    SECTION("Memory-mapped SoundFont")
+    {
+        Synthesizer synthesizer2(settings);
+        REQUIRE(synthesizer2.loadSoundFont(DATA_DIR "440_16bits.sf2", knm::sf::LOAD_MODE_MEMORY_MAPPED));
+
+        REQUIRE(synthesizer2.soundfont().getBuffer() == nullptr);
+        REQUIRE(synthesizer2.soundfont().getSampleBuffer().format == knm::sf::SAMPLE_FORMAT_INT16);
+        REQUIRE(synthesizer2.soundfont().getBufferSize() == synthesizer.soundfont().getBufferSize());
+
+        synthesizer.configureChannel(0, 0, 0);
+        synthesizer.noteOn(0, 60, 100);
+
+        synthesizer2.configureChannel(0, 0, 0);
+        synthesizer2.noteOn(0, 60, 100);
+
+        float left[640];
+        float right[640];
+        float left2[640];
+        float right2[640];
+        synthesizer.render(left, right, 640);
+        synthesizer2.render(left2, right2, 640);
+
+        for (int i = 0; i < 640; ++i)
+        {
+            REQUIRE(left2[i] == left[i]);
+            REQUIRE(right2[i] == right[i]);
+        }
+    }
+
+    SECTION("Compressed samples")
+    {
+        // Turn the test file into a SF3 one, "compressed" with a fake codec: the
+        // compressed data is the original 16-bits audio data
+        std::ifstream file(DATA_DIR "440_16bits.sf2", std::ios::binary);
+        std::vector<char> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        auto find_chunk = [&content](const char* id) -> size_t
+        {
+            for (size_t i = 0; i + 4 <= content.size(); ++i)
+            {
+                if (memcmp(content.data() + i, id, 4) == 0)
+                    return i + 8;
+            }
+            return 0;
+        };
+
+        size_t ifil = find_chunk("ifil");
+        REQUIRE(ifil > 0);
+        content[ifil] = 3;
+
+        size_t shdr = find_chunk("shdr");
+        REQUIRE(shdr > 0);
+
+        uint32_t nb_samples = *reinterpret_cast<uint32_t*>(content.data() + shdr - 4) / 46 - 1;
+        for (uint32_t i = 0; i < nb_samples; ++i)
+        {
+            char* record = content.data() + shdr + i * 46;
+
+            uint32_t values[4];
+            memcpy(values, record + 20, sizeof(values));
+
+            values[2] -= values[0];     // Loop points relative to the start
+            values[3] -= values[0];
+            values[0] *= 2;             // Offsets in bytes
+            values[1] *= 2;
+
+            memcpy(record + 20, values, sizeof(values));
+            *reinterpret_cast<uint16_t*>(record + 44) |= knm::sf::SAMPLE_TYPE_COMPRESSED;
+        }
+
+        auto soundfont = std::make_shared<knm::sf::SoundFont>();
+        REQUIRE(soundfont->load(content.data(), content.size()));
+
+        REQUIRE(soundfont->hasCompressedSamples());
+        REQUIRE(soundfont->getBufferSize() == 0);
+        REQUIRE(soundfont->getSamples()[0].compressed);
+        REQUIRE(soundfont->getSamples()[0].sample_type == synthesizer.soundfont().getSamples()[0].sample_type);
+
+        {
+            std::filesystem::path path = std::filesystem::temp_directory_path() / "knm_synthesizer_sf3_cache.bin";
+            REQUIRE(soundfont->saveCache(path));
+
+            knm::sf::SoundFont cached;
+            REQUIRE(cached.loadCache(path));
+            REQUIRE(cached.hasCompressedSamples());
+            REQUIRE(cached.getSamples()[0].compressed);
+
+            std::filesystem::remove(path);
+        }
+
+        Synthesizer synthesizer2(settings);
+        REQUIRE(synthesizer2.setSoundFont(soundfont));
+
+        float left[640];
+        float right[640];
+        float left2[640];
+        float right2[640];
+
+        SECTION("Without decoder")
+        {
+            synthesizer2.configureChannel(0, 0, 0);
+            synthesizer2.noteOn(0, 60, 100);
+            synthesizer2.render(left2, right2, 640);
+
+            for (int i = 0; i < 640; ++i)
+            {
+                REQUIRE(left2[i] == 0.0f);
+                REQUIRE(right2[i] == 0.0f);
+            }
+
+            REQUIRE(soundfont->getDecodedSamplesCacheUsage() == 0);
+        }
+
+        SECTION("With decoder")
+        {
+            static int nb_decoded;
+            nb_decoded = 0;
+
+            soundfont->setSampleDecoder(
+                [](const uint8_t* data, size_t size, std::vector<float>& result, void* user_data)
+                {
+                    result.resize(size / 2);
+                    for (size_t i = 0; i < result.size(); ++i)
+                        result[i] = float(int16_t(data[2 * i] | (data[2 * i + 1] << 8))) / 32767.0f;
+
+                    ++nb_decoded;
+                    return true;
+                }
+            );
+
+            // With a prefetch callback, the audio data is released by
+            // 'releaseDecodedSamples()'
+            bool prefetching = false;
+
+            SECTION("On demand")
+            {
+                synthesizer2.configureChannel(0, 0, 0);
+            }
+
+            SECTION("Prefetched")
+            {
+                prefetching = true;
+
+                synthesizer2.setPrefetchCallback(
+                    [](const std::shared_ptr<const knm::sf::SoundFont>& soundfont, knm::sf::preset_id_t preset, void* user_data)
+                    {
+                        soundfont->prefetchPreset(preset.bank, preset.number);
+                    }
+                );
+
+                synthesizer2.configureChannel(0, 0, 0);
+                REQUIRE(nb_decoded == 2);
+            }
+
+            SECTION("Prefetched on program change")
+            {
+                prefetching = true;
+
+                static std::vector<knm::sf::preset_id_t> prefetched;
+                prefetched.clear();
+
+                synthesizer2.setPrefetchCallback(
+                    [](const std::shared_ptr<const knm::sf::SoundFont>& soundfont, knm::sf::preset_id_t preset, void* user_data)
+                    {
+                        prefetched.push_back(preset);
+                        soundfont->prefetchPreset(preset.bank, preset.number);
+                    }
+                );
+
+                synthesizer2.processMidiMessage(0, 0xC0, 1, 0);
+                REQUIRE(prefetched.size() == 1);
+                REQUIRE(prefetched[0].bank == 0);
+                REQUIRE(prefetched[0].number == 1);
+                REQUIRE(nb_decoded == 1);
+                nb_decoded = 0;
+
+                // Same preset played (fallback to the bank 0)
+                synthesizer2.processMidiMessage(0, 0xB0, 0x00, 5);
+                REQUIRE(prefetched.size() == 1);
+
+                synthesizer2.processMidiMessage(0, 0xC0, 0, 0);
+                REQUIRE(prefetched.size() == 2);
+                REQUIRE(prefetched[1].bank == 0);
+                REQUIRE(prefetched[1].number == 0);
+            }
+
+            SECTION("Not prefetched yet")
+            {
+                prefetching = true;
+
+                synthesizer2.setPrefetchCallback(
+                    [](const std::shared_ptr<const knm::sf::SoundFont>& soundfont, knm::sf::preset_id_t preset, void* user_data)
+                    {
+                    }
+                );
+
+                synthesizer2.configureChannel(0, 0, 0);
+
+                // The voices don't decode the samples themselves
+                synthesizer2.noteOn(0, 60, 100);
+                synthesizer2.render(left2, right2, 640);
+                REQUIRE(nb_decoded == 0);
+
+                for (int i = 0; i < 640; ++i)
+                {
+                    REQUIRE(left2[i] == 0.0f);
+                    REQUIRE(right2[i] == 0.0f);
+                }
+
+                synthesizer2.reset();
+                soundfont->prefetchPreset(0, 0);
+                REQUIRE(nb_decoded == 2);
+            }
+
+            synthesizer.configureChannel(0, 0, 0);
+            synthesizer.noteOn(0, 60, 100);
+            synthesizer2.noteOn(0, 60, 100);
+
+            synthesizer.render(left, right, 640);
+            synthesizer2.render(left2, right2, 640);
+
+            for (int i = 0; i < 640; ++i)
+            {
+                REQUIRE(left2[i] == left[i]);
+                REQUIRE(right2[i] == right[i]);
+            }
+
+            // Decoded once, then found in the cache
+            synthesizer2.noteOn(0, 60, 100);
+            REQUIRE(nb_decoded == 2);
+
+            // The voices release the audio data once they end
+            const knm::sf::sample_t* sample = &soundfont->getSamples()[0];
+            long nb_references = soundfont->getDecodedSample(sample).use_count();
+
+            synthesizer2.allNotesOff(0, true);
+            REQUIRE(synthesizer2.nbActiveVoices() > 0);
+
+            synthesizer2.render(left2, right2, 640);
+            REQUIRE(synthesizer2.nbActiveVoices() == 0);
+
+            if (prefetching)
+            {
+                REQUIRE(soundfont->getDecodedSample(sample).use_count() == nb_references);
+                synthesizer2.releaseDecodedSamples();
+            }
+
+            REQUIRE(soundfont->getDecodedSample(sample).use_count() < nb_references);
+
+            synthesizer2.noteOn(0, 60, 100);
+            std::weak_ptr<const std::vector<float>> data = soundfont->getDecodedSample(sample);
+
+            size_t usage = soundfont->getDecodedSamplesCacheUsage();
+            REQUIRE(usage > 0);
+
+            // Least recently used samples removed
+            soundfont->setDecodedSamplesCacheSize(usage - 1);
+            REQUIRE(soundfont->getDecodedSamplesCacheUsage() < usage);
+
+            soundfont->setDecodedSamplesCacheSize(0);
+            REQUIRE(soundfont->getDecodedSamplesCacheUsage() == 0);
+
+            // The playing voices keep their audio data
+            synthesizer2.render(left2, right2, 640);
+            REQUIRE(!data.expired());
+
+            // Last references, released by the audio thread only without prefetching
+            synthesizer2.allNotesOff(0, true);
+            synthesizer2.render(left2, right2, 640);
+            REQUIRE(synthesizer2.nbActiveVoices() == 0);
+            REQUIRE(data.expired() == !prefetching);
+
+            synthesizer2.releaseDecodedSamples();
+            REQUIRE(data.expired());
+        }
+    }
+
+    SECTION("Binary cache")
+    {
+        const knm::sf::SoundFont& reference = synthesizer.soundfont();
+
+        std::filesystem::path path = std::filesystem::temp_directory_path() / "knm_synthesizer_cache.bin";
+
+        for (bool float_samples : { true, false })
+        {
+            auto original = std::make_shared<knm::sf::SoundFont>();
+            REQUIRE(original->load(DATA_DIR "440_16bits.sf2", knm::sf::LOAD_MODE_MEMORY_MAPPED));
+            REQUIRE(original->saveCache(path, float_samples));
+
+            for (auto mode : { knm::sf::LOAD_MODE_FLOAT, knm::sf::LOAD_MODE_MEMORY_MAPPED })
+            {
+                auto soundfont = std::make_shared<knm::sf::SoundFont>();
+                REQUIRE(soundfont->loadCache(path, mode));
+
+                REQUIRE(soundfont->getInformation().name == reference.getInformation().name);
+                REQUIRE(soundfont->nbPresets() == reference.nbPresets());
+                REQUIRE(soundfont->nbInstruments() == reference.nbInstruments());
+                REQUIRE(soundfont->nbSamples() == reference.nbSamples());
+                REQUIRE(soundfont->getBufferSize() == reference.getBufferSize());
+                REQUIRE(soundfont->getPreset(0, 0)->name == reference.getPreset(0, 0)->name);
+                REQUIRE(soundfont->getPreset(0, 0)->zones[0].generators.size() ==
+                        reference.getPreset(0, 0)->zones[0].generators.size());
+                REQUIRE(soundfont->getInstruments()[0].zones[0].modulators.size() ==
+                        reference.getInstruments()[0].zones[0].modulators.size());
+
+                if (float_samples || (mode == knm::sf::LOAD_MODE_FLOAT))
+                    REQUIRE(soundfont->getBuffer() != nullptr);
+                else
+                    REQUIRE(soundfont->getSampleBuffer().format == knm::sf::SAMPLE_FORMAT_INT16);
+
+                Synthesizer synthesizer2(settings);
+                REQUIRE(synthesizer2.setSoundFont(soundfont));
+
+                synthesizer.reset();
+                synthesizer.configureChannel(0, 0, 0);
+                synthesizer.noteOn(0, 60, 100);
+
+                synthesizer2.configureChannel(0, 0, 0);
+                synthesizer2.noteOn(0, 60, 100);
+
+                float left[640];
+                float right[640];
+                float left2[640];
+                float right2[640];
+                synthesizer.render(left, right, 640);
+                synthesizer2.render(left2, right2, 640);
+
+                for (int i = 0; i < 640; ++i)
+                {
+                    REQUIRE(left2[i] == left[i]);
+                    REQUIRE(right2[i] == right[i]);
+                }
+            }
+        }
+
+        // Invalid cache files
+        knm::sf::SoundFont soundfont;
+        REQUIRE(!soundfont.loadCache(DATA_DIR "440_16bits.sf2"));
+        REQUIRE(!soundfont.loadCache(path.parent_path() / "knm_synthesizer_missing.bin"));
+
+        std::filesystem::remove(path);
+    }
+
+    SECTION("Worker threads")
+    {
+        SynthesizerSettings settings2(22050);
+        settings2.enableReverbAndChorus(false);
+        settings2.setNbWorkerThreads(3);
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+
+        synthesizer.configureChannel(0, 0, 0);
+        synthesizer.configureChannel(1, 0, 1);
+        synthesizer2.configureChannel(0, 0, 0);
+        synthesizer2.configureChannel(1, 0, 1);
+
+        for (int key = 40; key < 80; ++key)
+        {
+            synthesizer.noteOn(key % 2, key, 60 + key);
+            synthesizer2.noteOn(key % 2, key, 60 + key);
+        }
+
+        float left[640];
+        float right[640];
+        float left2[640];
+        float right2[640];
+
+        for (int j = 0; j < 4; ++j)
+        {
+            if (j == 2)
+            {
+                for (int key = 40; key < 60; ++key)
+                {
+                    synthesizer.noteOff(key % 2, key);
+                    synthesizer2.noteOff(key % 2, key);
+                }
+            }
+
+            synthesizer.render(left, right, 640);
+            synthesizer2.render(left2, right2, 640);
+
+            for (int i = 0; i < 640; ++i)
+            {
+                REQUIRE(left2[i] == left[i]);
+                REQUIRE(right2[i] == right[i]);
+            }
+        }
+    }
+
+    SECTION("Timestamped MIDI events")
+    {
+        synthesizer.configureChannel(0, 0, 1);
+
+        // The offset isn't a multiple of the block size, the note must still start
+        // exactly there
+        midi_event_t events[] = {
+            { 100, 0, 0x90, 69, 100 },
+            { 700, 0, 0x80, 69, 0 },
+        };
+
+        float buffer[640];
+        synthesizer.render(buffer, 640, events, 2);
+
+        for (int i = 0; i < 100; ++i)
+            REQUIRE(buffer[i] == 0.0f);
+
+        for (int i = 100; i < 640; ++i)
+            REQUIRE(buffer[i] == Approx(0.33726f * ref_A4[i - 100]).margin(0.0001f));
+
+        // Events past the end of the buffer are processed after the rendering
+        REQUIRE(synthesizer.nbActiveVoices() == 1);
+        REQUIRE(synthesizer.nbRenderedSamples() == 640);
+    }
+
+    SECTION("Timestamped MIDI events, stereo")
+    {
+        Synthesizer synthesizer2(settings);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+
+        synthesizer.configureChannel(0, 0, 0);
+        synthesizer2.configureChannel(0, 0, 0);
+
+        midi_event_t events[] = {
+            { 10, 0, 0x90, 60, 100 },
+            { 10, 0, 0x90, 64, 100 },
+            { 333, 0, 0x80, 60, 0 },
+        };
+
+        float left[640];
+        float right[640];
+        synthesizer.render(left, right, 640, events, 3);
+
+        // Same as splitting the rendering at each event
+        float left2[640];
+        float right2[640];
+        synthesizer2.render(left2, right2, 10, nullptr, 0);
+        synthesizer2.noteOn(0, 60, 100);
+        synthesizer2.noteOn(0, 64, 100);
+        synthesizer2.render(left2 + 10, right2 + 10, 323, nullptr, 0);
+        synthesizer2.noteOff(0, 60);
+        synthesizer2.render(left2 + 333, right2 + 333, 307, nullptr, 0);
+
+        for (int i = 0; i < 640; ++i)
+        {
+            REQUIRE(left2[i] == left[i]);
+            REQUIRE(right2[i] == right[i]);
+        }
+
+        for (int i = 0; i < 10; ++i)
+            REQUIRE(left[i] == 0.0f);
+
+        float peak = 0.0f;
+        for (int i = 10; i < 40; ++i)
+            peak = std::max(peak, std::abs(left[i]));
+
+        REQUIRE(peak > 0.01f);
+    }
+
+    SECTION("Reverb and chorus")
+    {
+        SynthesizerSettings settings2(22050);
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+
+        synthesizer.configureChannel(0, 0, 0);
+        synthesizer2.configureChannel(0, 0, 0);
+        synthesizer2.getChannel(0).setChorusSend(64);
+
+        synthesizer.noteOn(0, 69, 100);
+        synthesizer2.noteOn(0, 69, 100);
+
+        float left[640];
+        float right[640];
+        float left2[640];
+        float right2[640];
+
+        synthesizer.render(left, right, 640);
+        synthesizer2.render(left2, right2, 640);
+
+        float difference = 0.0f;
+        for (int i = 0; i < 640; ++i)
+            difference = std::max(difference, std::abs(left2[i] - left[i]));
+
+        REQUIRE(difference > 0.001f);
+
+        // The tail of the reverb continues after the end of the note
+        synthesizer.allNotesOff(true);
+        synthesizer2.allNotesOff(true);
+
+        synthesizer.render(left, right, 640);
+        synthesizer2.render(left2, right2, 640);
+
+        float peak = 0.0f;
+        for (int i = 0; i < 640; ++i)
+        {
+            REQUIRE(left[i] == 0.0f);
+            peak = std::max(peak, std::abs(left2[i]));
+        }
+
+        REQUIRE(peak > 0.0001f);
+
+        // Until it completely fades out
+        for (int j = 0; j < 200; ++j)
+            synthesizer2.render(left2, right2, 640);
+
+        for (int i = 0; i < 640; ++i)
+        {
+            REQUIRE(left2[i] == 0.0f);
+            REQUIRE(right2[i] == 0.0f);
+        }
+    }
+
+    SECTION("Reverb and chorus without sends")
+    {
+        SynthesizerSettings settings2(22050);
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+
+        synthesizer.configureChannel(0, 0, 0);
+        synthesizer2.configureChannel(0, 0, 0);
+        synthesizer2.getChannel(0).setReverbSend(0);
+        synthesizer2.getChannel(0).setChorusSend(0);
+
+        synthesizer.noteOn(0, 69, 100);
+        synthesizer2.noteOn(0, 69, 100);
+
+        float left[640];
+        float right[640];
+        float left2[640];
+        float right2[640];
+
+        synthesizer.render(left, right, 640);
+        synthesizer2.render(left2, right2, 640);
+
+        for (int i = 0; i < 640; ++i)
+        {
+            REQUIRE(left2[i] == left[i]);
+            REQUIRE(right2[i] == right[i]);
+        }
+    }
+
+    SECTION("Statistics")
+    {
+        SynthesizerSettings settings2(22050);
+        settings2.setMaximumPolyphony(8);
+        settings2.enableStatistics(true);
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+        synthesizer2.configureChannel(0, 0, 1);
+
+        size_t nb_calls = 0;
+        synthesizer2.setStatisticsCallback(
+            [](const block_statistics_t& block, void* user_data)
+            {
+                REQUIRE(block.size == 64);
+                REQUIRE(block.nb_active_voices == 8);
+                ++(*static_cast<size_t*>(user_data));
+            },
+            &nb_calls
+        );
+
+        for (int key = 60; key < 70; ++key)
+            synthesizer2.noteOn(0, key, 100);
+
+        float left[640];
+        float right[640];
+        synthesizer2.render(left, right, 640);
+
+        statistics_t statistics = synthesizer2.getStatistics();
+        REQUIRE(statistics.nb_blocks == 10);
+        REQUIRE(statistics.nb_voice_steals == 2);
+        REQUIRE(statistics.peak_polyphony == 8);
+        REQUIRE(statistics.nb_dropped_notes == 0);
+        REQUIRE(statistics.voices_time > 0.0);
+        REQUIRE(statistics.max_block_time > 0.0);
+        REQUIRE(nb_calls == 10);
+
+        uint64_t nb_blocks = 0;
+        for (int i = 0; i < statistics_t::HISTOGRAM_SIZE; ++i)
+            nb_blocks += statistics.block_time_histogram[i];
+
+        REQUIRE(nb_blocks == 10);
+
+        synthesizer2.resetStatistics();
+        statistics = synthesizer2.getStatistics();
+        REQUIRE(statistics.nb_blocks == 0);
+        REQUIRE(statistics.nb_voice_steals == 0);
+        REQUIRE(statistics.peak_polyphony == 0);
+    }
+
+    SECTION("Statistics disabled")
+    {
+        size_t nb_calls = 0;
+        synthesizer.setStatisticsCallback(
+            [](const block_statistics_t& block, void* user_data)
+            {
+                ++(*static_cast<size_t*>(user_data));
+            },
+            &nb_calls
+        );
+
+        synthesizer.noteOn(0, 60, 100);
+
+        float left[640];
+        float right[640];
+        synthesizer.render(left, right, 640);
+
+        statistics_t statistics = synthesizer.getStatistics();
+        REQUIRE(statistics.nb_blocks == 0);
+        REQUIRE(statistics.voices_time == 0.0);
+        REQUIRE(statistics.peak_polyphony > 0);
+        REQUIRE(nb_calls == 0);
+    }
+
+    SECTION("Posted MIDI messages")
+    {
+        synthesizer.configureChannel(0, 0, 1);
+
+        REQUIRE(synthesizer.postMidiMessage(0, 0x90, 69, 100));
+        REQUIRE(synthesizer.nbActiveVoices() == 0);
+
+        // The message is processed before the first block
+        float buffer[640];
+        synthesizer.render(buffer, 640);
+
+        for (int i = 0; i < 640; ++i)
+            REQUIRE(buffer[i] == Approx(0.33726f * ref_A4[i]).margin(0.0001f));
+    }
+
+    SECTION("Posted MIDI messages, full queue")
+    {
+        SynthesizerSettings settings2(22050);
+        settings2.setMidiQueueSize(16);
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+
+        for (int i = 0; i < 16; ++i)
+            REQUIRE(synthesizer2.postMidiMessage(0, 0x90, 40 + i, 100));
+
+        REQUIRE(!synthesizer2.postMidiMessage(0, 0x90, 60, 100));
+
+        float left[64];
+        float right[64];
+        synthesizer2.render(left, right, 64);
+
+        REQUIRE(synthesizer2.nbActiveVoices() == 16);
+        REQUIRE(synthesizer2.postMidiMessage(0, 0x90, 60, 100));
+    }
+
+    SECTION("Posted MIDI messages, from another thread")
+    {
+        synthesizer.configureChannel(0, 0, 1);
+
+        std::atomic<bool> done = false;
+
+        std::thread producer([&]()
+        {
+            for (int i = 0; i < 2000; ++i)
+            {
+                uint8_t key = 40 + i % 40;
+                while (!synthesizer.postMidiMessage(0, (i % 2 ? 0x80 : 0x90), key, 100))
+                    std::this_thread::yield();
+            }
+
+            // Release all the keys: the last message processed
+            while (!synthesizer.postMidiMessage(0, 0xB0, 0x7B, 0))
+                std::this_thread::yield();
+
+            done = true;
+        });
+
+        float left[64];
+        float right[64];
+
+        while (!done)
+            synthesizer.render(left, right, 64);
+
+        producer.join();
+
+        // Process the remaining messages, then let the released notes fade out
+        for (int i = 0; i < 2000; ++i)
+            synthesizer.render(left, right, 64);
+
+        REQUIRE(synthesizer.nbActiveVoices() == 0);
+    }
+
+    SECTION("Interleaved outputs")
+    {
+        Synthesizer synthesizer2(settings);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+
+        synthesizer.configureChannel(0, 0, 0);
+        synthesizer2.configureChannel(0, 0, 0);
+
+        synthesizer.noteOn(0, 60, 100);
+        synthesizer2.noteOn(0, 60, 100);
+
+        // Sizes not multiple of the block size
+        float left[100];
+        float right[100];
+        float interleaved[200];
+        int16_t interleaved16[200];
+        int32_t interleaved32[200];
+        int16_t dithered[200];
+
+        for (int j = 0; j < 3; ++j)
+        {
+            synthesizer.render(left, right, 100);
+            synthesizer2.renderInterleaved(interleaved, 100);
+
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE(interleaved[2 * i] == left[i]);
+                REQUIRE(interleaved[2 * i + 1] == right[i]);
+            }
+
+            synthesizer.render(left, right, 100);
+            synthesizer2.renderInterleaved(interleaved16, 100);
+
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE(interleaved16[2 * i] == int16_t(lrintf(left[i] * 32767.0f)));
+                REQUIRE(interleaved16[2 * i + 1] == int16_t(lrintf(right[i] * 32767.0f)));
+            }
+
+            synthesizer.render(left, right, 100);
+            synthesizer2.renderInterleaved(interleaved32, 100);
+
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE(interleaved32[2 * i] == int32_t(lrintf(left[i] * 2147483648.0f)));
+                REQUIRE(interleaved32[2 * i + 1] == int32_t(lrintf(right[i] * 2147483648.0f)));
+            }
+
+            // The dither never changes a sample by more than 1 LSB
+            synthesizer.render(left, right, 100);
+            synthesizer2.renderInterleaved(dithered, 100, true);
+
+            for (int i = 0; i < 100; ++i)
+            {
+                REQUIRE(std::abs(dithered[2 * i] - left[i] * 32767.0f) <= 1.5f);
+                REQUIRE(std::abs(dithered[2 * i + 1] - right[i] * 32767.0f) <= 1.5f);
+            }
+        }
+
+        REQUIRE(synthesizer2.nbRenderedSamples() == 1200);
+    }
+
+    SECTION("Silence skipping with events")
+    {
+        SynthesizerSettings settings2(22050);
+        settings2.enableReverbAndChorus(false);
+        settings2.enableStatistics(true);
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+
+        synthesizer.configureChannel(0, 0, 0);
+        synthesizer2.configureChannel(0, 0, 0);
+
+        // A short note, then a long silence before the next one
+        midi_event_t events[] = {
+            { 1000, 0, 0x90, 69, 100 },
+            { 1100, 0, 0x80, 69, 0 },
+            { 20000, 0, 0x90, 60, 100 },
+        };
+
+        std::vector<float> left(22050);
+        std::vector<float> right(22050);
+        synthesizer.render(left.data(), right.data(), 22050, events, 3);
+
+        std::vector<float> left2(22050);
+        std::vector<float> right2(22050);
+        synthesizer2.render(left2.data(), right2.data(), 22050, events, 3);
+
+        for (int i = 0; i < 22050; ++i)
+        {
+            REQUIRE(left2[i] == left[i]);
+            REQUIRE(right2[i] == right[i]);
+        }
+
+        REQUIRE(synthesizer2.nbRenderedSamples() == 22050);
+
+        // Less blocks rendered than needed to cover the whole buffer
+        REQUIRE(synthesizer2.getStatistics().nb_blocks < 22050 / settings2.blockSize());
+    }
+
+    SECTION("Voice stealing")
+    {
+        SynthesizerSettings settings2(22050);
+        settings2.setMaximumPolyphony(8);
+        settings2.enableReverbAndChorus(false);
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+        synthesizer2.configureChannel(0, 0, 1);
+
+        for (int key = 60; key < 68; ++key)
+            synthesizer2.noteOn(0, key, 100);
+
+        std::vector<float> buffer(22050);
+        synthesizer2.render(buffer.data(), 640);
+
+        // The released voice has the lowest priority, it must be the one stopped
+        synthesizer2.noteOff(0, 63);
+        synthesizer2.render(buffer.data(), 64);
+
+        synthesizer2.noteOn(0, 70, 100);
+        REQUIRE(synthesizer2.getStatistics().nb_voice_steals == 1);
+
+        // All the remaining voices are held: none of them ends
+        synthesizer2.render(buffer.data(), 22050);
+        REQUIRE(synthesizer2.nbActiveVoices() == 8);
+
+        // Without the new note, the released voice ends
+        synthesizer2.noteOff(0, 70);
+        synthesizer2.render(buffer.data(), 22050);
+        REQUIRE(synthesizer2.nbActiveVoices() == 7);
+    }
+
+    SECTION("Voice stealing, killed voices")
+    {
+        SynthesizerSettings settings2(22050);
+        settings2.setMaximumPolyphony(8);
+        settings2.enableReverbAndChorus(false);
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+        synthesizer2.configureChannel(0, 0, 1);
+        synthesizer2.configureChannel(1, 0, 1);
+
+        for (int key = 60; key < 64; ++key)
+        {
+            synthesizer2.noteOn(0, key, 100);
+            synthesizer2.noteOn(1, key, 100);
+        }
+
+        std::vector<float> buffer(22050);
+        synthesizer2.render(buffer.data(), 640);
+
+        // The killed voices have the lowest priority, they must be the ones stopped
+        // (without any block rendered in between)
+        synthesizer2.allNotesOff(1, true);
+
+        for (int key = 70; key < 74; ++key)
+            synthesizer2.noteOn(1, key, 100);
+
+        REQUIRE(synthesizer2.getStatistics().nb_voice_steals == 4);
+
+        // The voices of the first channel are still there
+        synthesizer2.allNotesOff(1, true);
+        synthesizer2.render(buffer.data(), 640);
+        REQUIRE(synthesizer2.nbActiveVoices() == 4);
+    }
+
+    SECTION("Exclusive classes")
+    {
+        // The same SoundFont, with all its instrument zones in the same exclusive class
+        struct ExclusiveSoundFont : public knm::sf::SoundFont
+        {
+            void setExclusiveClass(uint16_t exclusive_class)
+            {
+                for (auto& instrument : instruments)
+                {
+                    for (auto& zone : instrument.zones)
+                        zone.generator_set.set(knm::sf::GEN_TYPE_EXCLUSIVE_CLASS, { .uvalue=exclusive_class });
+                }
+            }
+        };
+
+        auto soundfont = std::make_shared<ExclusiveSoundFont>();
+        REQUIRE(soundfont->load(std::filesystem::path(DATA_DIR "440_16bits.sf2")));
+        soundfont->setExclusiveClass(5);
+
+        Synthesizer synthesizer2(settings);
+        REQUIRE(synthesizer2.setSoundFont(soundfont));
+        synthesizer2.configureChannel(0, 0, 1);
+        synthesizer2.configureChannel(1, 0, 1);
+
+        synthesizer2.noteOn(0, 60, 100);
+        REQUIRE(synthesizer2.nbActiveVoices() == 1);
+
+        // A second note of the same class on the same channel stops the first one...
+        synthesizer2.noteOn(0, 64, 100);
+        REQUIRE(synthesizer2.nbActiveVoices() == 1);
+
+        // ... but not on another channel
+        synthesizer2.noteOn(1, 60, 100);
+        REQUIRE(synthesizer2.nbActiveVoices() == 2);
+
+        float left[640];
+        float right[640];
+        synthesizer2.render(left, right, 640);
+
+        synthesizer2.noteOn(1, 67, 100);
+        REQUIRE(synthesizer2.nbActiveVoices() == 2);
+
+        // Once the voice of the class ended, a new one is used
+        synthesizer2.allNotesOff(0, true);
+        synthesizer2.render(left, right, 640);
+        REQUIRE(synthesizer2.nbActiveVoices() == 1);
+
+        synthesizer2.noteOn(0, 60, 100);
+        REQUIRE(synthesizer2.nbActiveVoices() == 2);
+    }
+
+    SECTION("Note off, by channel and key")
+    {
+        SynthesizerSettings settings2(22050);
+        settings2.setMaximumPolyphony(8);
+        settings2.enableReverbAndChorus(false);
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+        synthesizer2.configureChannel(0, 0, 1);
+        synthesizer2.configureChannel(1, 0, 1);
+
+        synthesizer2.noteOn(0, 60, 100);
+        synthesizer2.noteOn(0, 60, 100);
+        synthesizer2.noteOn(0, 62, 100);
+        synthesizer2.noteOn(1, 60, 100);
+        synthesizer2.noteOn(1, 64, 100);
+        synthesizer2.noteOn(1, 65, 100);
+
+        std::vector<float> buffer(22050);
+        synthesizer2.render(buffer.data(), 640);
+        REQUIRE(synthesizer2.nbActiveVoices() == 6);
+
+        // Both voices of the key are released, not the ones of the other channel
+        synthesizer2.noteOff(0, 60);
+        synthesizer2.render(buffer.data(), 22050);
+        REQUIRE(synthesizer2.nbActiveVoices() == 4);
+
+        synthesizer2.allNotesOff(1, true);
+        synthesizer2.render(buffer.data(), 640);
+        REQUIRE(synthesizer2.nbActiveVoices() == 1);
+
+        // Reuse the voices that ended
+        synthesizer2.noteOn(1, 64, 100);
+        synthesizer2.noteOn(0, 60, 100);
+        synthesizer2.render(buffer.data(), 640);
+        REQUIRE(synthesizer2.nbActiveVoices() == 3);
+
+        synthesizer2.allNotesOff(0, false);
+        synthesizer2.render(buffer.data(), 22050);
+        REQUIRE(synthesizer2.nbActiveVoices() == 1);
+
+        synthesizer2.noteOff(1, 64);
+        synthesizer2.render(buffer.data(), 22050);
+        REQUIRE(synthesizer2.nbActiveVoices() == 0);
+    }
+
+    SECTION("Fast math")
+    {
+        SynthesizerSettings settings2(22050);
+        settings2.enableReverbAndChorus(false);
+        settings2.enableFastMath(true);
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+        synthesizer2.configureChannel(0, 0, 1);
+
+        synthesizer2.noteOn(0, 69, 100);
+        synthesizer2.noteOn(0, 60, 100);
+
+        float buffer[640];
+        synthesizer2.render(buffer, 640);
+
+        // Same results than with the exact functions
+        for (int i = 0; i < 640; ++i)
+            REQUIRE(buffer[i] == Approx(0.33726f * (ref_A4[i] + ref_C4[i])).margin(0.0002f));
+    }
+
+    SECTION("Channel controls")
+    {
+        synthesizer.configureChannel(0, 0, 1);
+
+        // Volume and expression: ((100 << 7) / 16383)^2 * ((64 << 7) / 16383)
+        synthesizer.processMidiMessage(0, 0xB0, 0x0B, 64);
+
+        // Pitch bend: a whole tone up
+        synthesizer.processMidiMessage(0, 0xE0, 0x7F, 0x7F);
+
+        // Pan: fully on the left
+        synthesizer.processMidiMessage(0, 0xB0, 0x0A, 0);
+
+        // Not updated until the next block
+        const Channel& channel = synthesizer.getChannel(0);
+        REQUIRE(channel.controls().pan == Approx(0.0f).margin(0.01f));
+
+        float buffer[64];
+        synthesizer.render(buffer, 64);
+
+        const channel_controls_t& controls = channel.controls();
+        REQUIRE(controls.gain == Approx(channel.volumeGain() * channel.expression()));
+        REQUIRE(controls.gain == Approx(0.30525f).margin(0.0001f));
+        REQUIRE(controls.pitch == Approx(2.0f).margin(0.001f));
+        REQUIRE(controls.pan == Approx(-50.0f));
+        REQUIRE(!controls.pan_law);
+
+        // Centered
+        synthesizer.processMidiMessage(0, 0xB0, 0x0A, 64);
+        synthesizer.render(buffer, 64);
+
+        REQUIRE(controls.pan == Approx(0.0f).margin(0.01f));
+        REQUIRE(controls.pan_law);
+        REQUIRE(controls.pan_gain_left == Approx(0.70711f).margin(0.001f));
+        REQUIRE(controls.pan_gain_right == Approx(0.70711f).margin(0.001f));
+    }
+
+    SECTION("Stems")
+    {
+        SynthesizerSettings settings2(22050);
+        settings2.enableReverbAndChorus(false);
+        settings2.setNbStems(2);
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.loadSoundFont(DATA_DIR "440_16bits.sf2"));
+
+        REQUIRE(synthesizer2.channelStem(0) == 0);
+        REQUIRE(synthesizer2.channelStem(1) == 1);
+        REQUIRE(synthesizer2.channelStem(2) == 0);
+        REQUIRE(!synthesizer2.setChannelStem(0, 2));
+        REQUIRE(!synthesizer.setChannelStem(0, 0));
+
+        synthesizer2.configureChannel(0, 0, 0);
+        synthesizer2.configureChannel(1, 0, 1);
+        synthesizer2.noteOn(0, 60, 100);
+        synthesizer2.noteOn(1, 69, 100);
+
+        float stem_left[2][640];
+        float stem_right[2][640];
+        float master_left[640];
+        float master_right[640];
+
+        float* lefts[2] = { stem_left[0], stem_left[1] };
+        float* rights[2] = { stem_right[0], stem_right[1] };
+
+        // Not aligned on the blocks
+        for (int offset = 0; offset < 640; offset += 160)
+        {
+            float* lefts2[2] = { lefts[0] + offset, lefts[1] + offset };
+            float* rights2[2] = { rights[0] + offset, rights[1] + offset };
+            synthesizer2.renderStems(lefts2, rights2, 160, master_left + offset, master_right + offset);
+        }
+
+        // Each stem is identical to the channel rendered alone
+        for (int channel = 0; channel < 2; ++channel)
+        {
+            Synthesizer synthesizer3(settings);
+            REQUIRE(synthesizer3.loadSoundFont(DATA_DIR "440_16bits.sf2"));
+
+            synthesizer3.configureChannel(channel, 0, channel);
+            synthesizer3.noteOn(channel, (channel == 0 ? 60 : 69), 100);
+
+            float left[640];
+            float right[640];
+            synthesizer3.render(left, right, 640);
+
+            for (int i = 0; i < 640; ++i)
+            {
+                REQUIRE(stem_left[channel][i] == left[i]);
+                REQUIRE(stem_right[channel][i] == right[i]);
+            }
+        }
+
+        // The master mix is the same than the one of 'render()'
+        synthesizer.configureChannel(0, 0, 0);
+        synthesizer.configureChannel(1, 0, 1);
+        synthesizer.noteOn(0, 60, 100);
+        synthesizer.noteOn(1, 69, 100);
+
+        float left[640];
+        float right[640];
+        synthesizer.render(left, right, 640);
+
+        for (int i = 0; i < 640; ++i)
+        {
+            REQUIRE(master_left[i] == Approx(left[i]).margin(0.00001f));
+            REQUIRE(master_right[i] == Approx(right[i]).margin(0.00001f));
+        }
+
+        // Both channels in the same stem
+        REQUIRE(synthesizer2.setChannelStem(1, 0));
+        synthesizer2.renderStems(lefts, rights, 64, master_left, master_right);
+
+        for (int i = 0; i < 64; ++i)
+        {
+            REQUIRE(stem_left[0][i] == master_left[i]);
+            REQUIRE(stem_right[0][i] == master_right[i]);
+            REQUIRE(stem_left[1][i] == 0.0f);
+            REQUIRE(stem_right[1][i] == 0.0f);
+        }
+
+        // The silent blocks are skipped, and all the buffers cleared
+        synthesizer2.allNotesOff(true);
+        synthesizer2.renderStems(lefts, rights, 640, master_left, master_right);
+
+        std::fill(stem_left[0], stem_left[0] + 640, 1.0f);
+        std::fill(stem_right[1], stem_right[1] + 640, 1.0f);
+        std::fill(master_left, master_left + 640, 1.0f);
+
+        knm::synth::silent_ranges_t silence = synthesizer2.renderStems(
+            lefts, rights, 640, master_left, master_right
+        );
+        REQUIRE(silence.silent());
+        REQUIRE(silence.size == 640);
+
+        for (int i = 0; i < 640; ++i)
+        {
+            REQUIRE(stem_left[0][i] == 0.0f);
+            REQUIRE(stem_right[1][i] == 0.0f);
+            REQUIRE(master_left[i] == 0.0f);
+        }
+    }
+
+    SECTION("Several ports")
+    {
+        REQUIRE(synthesizer.nbChannels() == 16);
+        REQUIRE(synthesizer.nbPorts() == 1);
+        REQUIRE(!synthesizer.processMidiMessage(1, 0, 0x90, 60, 100));
+
+        SynthesizerSettings settings2(22050);
+        settings2.enableReverbAndChorus(false);
+        settings2.setNbChannels(48);
+
+        REQUIRE_THROWS(settings2.setNbChannels(40));
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+
+        REQUIRE(synthesizer2.nbChannels() == 48);
+        REQUIRE(synthesizer2.nbPorts() == 3);
+        REQUIRE(synthesizer2.getChannel(9).percussion());
+        REQUIRE(synthesizer2.getChannel(25).percussion());
+        REQUIRE(synthesizer2.getChannel(41).percussion());
+        REQUIRE(!synthesizer2.getChannel(16).percussion());
+
+        REQUIRE(synthesizer2.setPercussionChannel(41, false));
+        REQUIRE(!synthesizer2.getChannel(41).percussion());
+        REQUIRE(synthesizer2.getChannel(41).bank() == 0);
+        REQUIRE(!synthesizer2.setPercussionChannel(48, true));
+
+        REQUIRE(!synthesizer2.processMidiMessage(3, 0, 0x90, 60, 100));
+        REQUIRE(!synthesizer2.processMidiMessage(1, 16, 0x90, 60, 100));
+
+        // The channel 2 of the port 2 plays like the channel 2 of a single port
+        synthesizer.configureChannel(2, 0, 1);
+        synthesizer.noteOn(2, 69, 100);
+
+        REQUIRE(synthesizer2.processMidiMessage(2, 2, 0xC0, 1, 0));
+        REQUIRE(synthesizer2.processMidiMessage(2, 2, 0x90, 69, 100));
+        REQUIRE(synthesizer2.getChannel(34).preset() == 1);
+
+        float buffer[640];
+        float buffer2[640];
+        synthesizer.render(buffer, 640);
+        synthesizer2.render(buffer2, 640);
+
+        for (int i = 0; i < 640; ++i)
+            REQUIRE(buffer2[i] == buffer[i]);
+
+        // With 256 channels, all the channel indices are valid, but not the ports
+        // after the 16th one
+        settings2.setNbChannels(256);
+
+        Synthesizer synthesizer3(settings2);
+        REQUIRE(synthesizer3.setSoundFont(synthesizer.sharedSoundFont()));
+        REQUIRE(synthesizer3.nbPorts() == 16);
+
+        REQUIRE(!synthesizer3.processMidiMessage(16, 15, 0x90, 60, 100));
+        REQUIRE(!synthesizer3.postMidiMessage(16, 15, 0x90, 60, 100));
+        REQUIRE(!synthesizer3.processMidiMessage(255, 15, 0x90, 60, 100));
+        synthesizer3.render(buffer, 640);
+        REQUIRE(synthesizer3.nbActiveVoices() == 0);
+
+        REQUIRE(synthesizer3.processMidiMessage(15, 15, 0x90, 60, 100));
+        REQUIRE(synthesizer3.nbActiveVoices() == 1);
+        REQUIRE(synthesizer3.postMidiMessage(15, 15, 0x90, 64, 100));
+        synthesizer3.render(buffer, 640);
+        REQUIRE(synthesizer3.nbActiveVoices() == 2);
+    }
+
+    SECTION("Snapshots")
+    {
+        // With the effects and a block size not dividing the buffers, so the state of
+        // the reverb, of the chorus and of the current block is saved too
+        SynthesizerSettings settings2(22050);
+        settings2.setBlockSize(48);
+        settings2.setMaximumPolyphony(8);
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+
+        SynthesizerSnapshot snapshot(synthesizer2);
+        REQUIRE(!snapshot.valid());
+        REQUIRE(!synthesizer2.restore(snapshot));
+
+        synthesizer2.configureChannel(0, 0, 0);
+        synthesizer2.configureChannel(1, 0, 1);
+        synthesizer2.getChannel(0).setChorusSend(64);
+        synthesizer2.noteOn(0, 69, 100);
+        synthesizer2.noteOn(1, 60, 100);
+        synthesizer2.noteOn(1, 64, 100);
+
+        float left[1000];
+        float right[1000];
+        synthesizer2.render(left, right, 1000);
+
+        REQUIRE(synthesizer2.snapshot(snapshot));
+        REQUIRE(snapshot.valid());
+        REQUIRE(snapshot.nbRenderedSamples() == 1000);
+
+        // Steal some voices and release another one
+        auto play_events = [](Synthesizer& synthesizer) {
+            for (uint8_t key = 70; key < 76; ++key)
+                synthesizer.noteOn(0, key, 100);
+
+            synthesizer.noteOff(1, 60);
+            synthesizer.getChannel(1).setPitchBend(0x00, 0x60);
+        };
+
+        play_events(synthesizer2);
+        REQUIRE(synthesizer2.nbActiveVoices() == 8);
+
+        float reference_left[3000];
+        float reference_right[3000];
+        synthesizer2.render(reference_left, reference_right, 3000);
+
+        // Restored in the same synthesizer
+        REQUIRE(synthesizer2.restore(snapshot));
+        REQUIRE(synthesizer2.nbActiveVoices() == 3);
+        REQUIRE(synthesizer2.nbRenderedSamples() == 1000);
+
+        play_events(synthesizer2);
+
+        float left2[3000];
+        float right2[3000];
+        synthesizer2.render(left2, right2, 3000);
+
+        for (int i = 0; i < 3000; ++i)
+        {
+            REQUIRE(left2[i] == reference_left[i]);
+            REQUIRE(right2[i] == reference_right[i]);
+        }
+
+        // Restored in another synthesizer with the same settings
+        Synthesizer synthesizer3(settings2);
+        REQUIRE(synthesizer3.setSoundFont(synthesizer.sharedSoundFont()));
+        REQUIRE(synthesizer3.restore(snapshot));
+        REQUIRE(synthesizer3.getChannel(0).chorusSend() == Approx(64 / 127.0f));
+
+        play_events(synthesizer3);
+
+        synthesizer3.render(left2, right2, 3000);
+
+        for (int i = 0; i < 3000; ++i)
+        {
+            REQUIRE(left2[i] == reference_left[i]);
+            REQUIRE(right2[i] == reference_right[i]);
+        }
+
+        // But not in a synthesizer with other settings or another SoundFont
+        REQUIRE(!synthesizer.restore(snapshot));
+        REQUIRE(!synthesizer.snapshot(snapshot));
+
+        Synthesizer synthesizer4(settings2);
+        REQUIRE(synthesizer4.loadSoundFont(DATA_DIR "440_16bits.sf2"));
+        REQUIRE(!synthesizer4.restore(snapshot));
+    }
+
+    SECTION("Note clips")
+    {
+        synthesizer.setMasterVolume(3.0f);
+
+        // Reference: the same note played on a channel
+        synthesizer.configureChannel(0, 0, 1);
+        synthesizer.noteOn(0, 60, 100);
+
+        float reference_left[1000];
+        float reference_right[1000];
+        synthesizer.render(reference_left, reference_right, 500, nullptr, 0);
+        synthesizer.noteOff(0, 60);
+        synthesizer.render(reference_left + 500, reference_right + 500, 500, nullptr, 0);
+
+        synthesizer.setPercussionChannel(0, true);
+
+        NoteClipCache cache;
+
+        auto clip = synthesizer.renderNote({ 0, 1 }, 60, 100, 500, &cache);
+        REQUIRE(clip);
+        REQUIRE(clip->size() > 500);
+        REQUIRE(clip->size() < 1000);
+        REQUIRE(clip->right.size() == clip->size());
+
+        // The clip ends with the release
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            REQUIRE(reference_left[i] == (i < clip->size() ? clip->left[i] : 0.0f));
+            REQUIRE(reference_right[i] == (i < clip->size() ? clip->right[i] : 0.0f));
+        }
+
+        // The synthesizer was reset, but the percussion channels were kept
+        REQUIRE(synthesizer.nbActiveVoices() == 0);
+        REQUIRE(synthesizer.getChannel(0).percussion());
+
+        REQUIRE(cache.nbClips() == 1);
+        REQUIRE(cache.usage() == 2 * clip->size() * sizeof(float));
+        REQUIRE(cache.nbMisses() == 1);
+        REQUIRE(cache.nbHits() == 0);
+
+        // Hit: the synthesizer isn't used
+        synthesizer.noteOn(1, 69, 100);
+        REQUIRE(synthesizer.renderNote({ 0, 1 }, 60, 100, 500, &cache) == clip);
+        REQUIRE(synthesizer.nbActiveVoices() == 1);
+        REQUIRE(cache.nbHits() == 1);
+
+        // Any difference in the key is a miss
+        REQUIRE(synthesizer.renderNote({ 0, 1 }, 60, 90, 500, &cache) != clip);
+        REQUIRE(cache.nbClips() == 2);
+
+        synthesizer.setMasterVolume(0.0f);
+        REQUIRE(synthesizer.renderNote({ 0, 1 }, 60, 100, 500, &cache) != clip);
+        REQUIRE(cache.nbClips() == 3);
+        REQUIRE(cache.nbMisses() == 3);
+
+        // The least recently used clips are removed
+        cache.setMaxSize(cache.usage() - 1);
+        REQUIRE(cache.nbClips() == 2);
+        REQUIRE(cache.usage() <= cache.maxSize());
+
+        cache.setMaxSize(16);
+        REQUIRE(cache.nbClips() == 0);
+        REQUIRE(cache.usage() == 0);
+
+        REQUIRE(!synthesizer.renderNote({ 5, 5 }, 60, 100, 500, &cache));
+
+        // Batch
+        note_render_job_t jobs[] = {
+            { { 0, 1 }, 60, 100, 500, 3.0f, nullptr },
+            { { 0, 0 }, 69, 80, 200, 0.0f, nullptr },
+            { { 0, 1 }, 60, 100, 500, 3.0f, nullptr },
+            { { 5, 5 }, 60, 100, 500, 0.0f, nullptr },
+        };
+
+        NoteClipCache cache2;
+        REQUIRE(renderNotes(synthesizer.sharedSoundFont(), settings, jobs, 4, 2, &cache2));
+
+        REQUIRE(jobs[0].clip);
+        REQUIRE(jobs[1].clip);
+        REQUIRE(jobs[2].clip);
+        REQUIRE(!jobs[3].clip);
+
+        REQUIRE(jobs[0].clip->size() == clip->size());
+        REQUIRE(jobs[2].clip->size() == clip->size());
+
+        for (size_t i = 0; i < clip->size(); ++i)
+        {
+            REQUIRE(jobs[0].clip->left[i] == clip->left[i]);
+            REQUIRE(jobs[2].clip->right[i] == clip->right[i]);
+        }
+
+        REQUIRE(cache2.nbClips() == 2);
+
+        REQUIRE(!renderNotes(nullptr, settings, jobs, 4, 2));
+    }
+
+    SECTION("Silent blocks")
+    {
+        SynthesizerSettings settings2(22050);
+        settings2.enableStatistics(true);
+
+        Synthesizer synthesizer2(settings2);
+        REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+        synthesizer2.configureChannel(0, 0, 1);
+
+        float left[1000];
+        float right[1000];
+        std::fill(left, left + 1000, 1.0f);
+        std::fill(right, right + 1000, 1.0f);
+
+        // Nothing is playing: the complete blocks aren't rendered
+        silent_ranges_t silence = synthesizer2.render(left, right, 1000);
+        REQUIRE(silence.silent());
+        REQUIRE(silence.leading == 1000);
+        REQUIRE(silence.trailing == 1000);
+        REQUIRE(silence.size == 1000);
+        REQUIRE(synthesizer2.getStatistics().nb_blocks == 1);
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            REQUIRE(left[i] == 0.0f);
+            REQUIRE(right[i] == 0.0f);
+        }
+
+        // The remainder of the last block is silent too
+        REQUIRE(synthesizer2.render(left, right, 10).silent());
+
+        // Only the remainder of the last silent block is output before the note
+        synthesizer2.noteOn(0, 69, 100);
+        silence = synthesizer2.render(left, right, 1000);
+        REQUIRE(!silence.silent());
+        REQUIRE(silence.leading == settings2.blockSize() - 1010 % settings2.blockSize());
+        REQUIRE(silence.trailing == 0);
+
+        int32_t interleaved[2000];
+        REQUIRE(!synthesizer2.renderInterleaved(interleaved, 1000).silent());
+
+        synthesizer2.noteOff(0, 69);
+
+        size_t nb_samples = 0;
+        while (!synthesizer2.render(left, right, 1000).silent())
+        {
+            nb_samples += 1000;
+            REQUIRE(nb_samples < 10 * settings2.sampleRate());
+        }
+
+        REQUIRE(synthesizer2.nbActiveVoices() == 0);
+        REQUIRE(synthesizer2.render(left, 1000).silent());
+        REQUIRE(synthesizer2.renderInterleaved(interleaved, 1000).silent());
+
+        int16_t interleaved16[2000];
+        REQUIRE(synthesizer2.renderInterleaved(interleaved16, 1000).silent());
+
+        silence = synthesizer2.renderInterleaved(interleaved16, 1000, true);
+        REQUIRE(silence.leading == 0);
+        REQUIRE(silence.trailing == 0);
+
+        // The note starts in the middle of the buffers: only the samples before it are
+        // silent
+        midi_event_t events[] = {
+            { 500, 0, 0x90, 69, 100 },
+        };
+
+        const size_t nb_blocks = synthesizer2.getStatistics().nb_blocks;
+
+        REQUIRE(synthesizer2.render(left, right, 500, nullptr, 0).silent());
+        silence = synthesizer2.render(left, right, 1000, events, 1);
+        REQUIRE(silence.leading == 500);
+        REQUIRE(silence.trailing == 0);
+        REQUIRE(silence.size == 1000);
+        REQUIRE(left[499] == 0.0f);
+        REQUIRE(left[501] != 0.0f);
+
+        // The complete blocks before the note aren't rendered
+        REQUIRE(synthesizer2.getStatistics().nb_blocks - nb_blocks < 1000 / settings2.blockSize());
+
+        // Then the note is released: only the samples after its end are silent
+        synthesizer2.noteOff(0, 69);
+
+        nb_samples = 0;
+        do
+        {
+            silence = synthesizer2.render(left, right, 1000);
+            nb_samples += 1000;
+            REQUIRE(nb_samples < 10 * settings2.sampleRate());
+        }
+        while (silence.trailing == 0);
+
+        REQUIRE(silence.leading == 0);
+        REQUIRE(silence.trailing < 1000);
+
+        for (size_t i = 1000 - silence.trailing; i < 1000; ++i)
+            REQUIRE(left[i] == 0.0f);
+    }
+
+    SECTION("Inaudible level")
+    {
+        auto release_length = [&](float level)
+        {
+            SynthesizerSettings settings2(22050);
+            settings2.enableReverbAndChorus(false);
+            settings2.setInaudibleLevel(level);
+
+            Synthesizer synthesizer2(settings2);
+            REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+            synthesizer2.configureChannel(0, 0, 1);
+
+            float buffer[64];
+
+            synthesizer2.noteOn(0, 69, 100);
+            synthesizer2.render(buffer, 64);
+            synthesizer2.noteOff(0, 69);
+
+            size_t length = 0;
+            while (synthesizer2.nbActiveVoices() > 0)
+            {
+                synthesizer2.render(buffer, 64);
+                length += 64;
+            }
+
+            return length;
+        };
+
+        REQUIRE(release_length(-60.0f) == release_length(settings.inaudibleLevel()));
+        REQUIRE(release_length(-30.0f) < release_length(-60.0f));
+        REQUIRE(release_length(-90.0f) > release_length(-60.0f));
+
+        REQUIRE_THROWS(settings.setInaudibleLevel(-10.0f));
+        REQUIRE_THROWS(settings.setInaudibleLevel(-110.0f));
+    }
+
+    SECTION("Denormals flushing")
+    {
+        auto flushed = []()
+        {
+            volatile float x = 1.0e-30f;
+            volatile float y = 1.0e-10f;
+            return (x * y == 0.0f);
+        };
+
+        // Only during the rendering
+        REQUIRE(!flushed());
+
+        for (int i = 0; i < 2; ++i)
+        {
+            SynthesizerSettings settings2(22050);
+            settings2.enableStatistics(true);
+            settings2.enableDenormalsFlushing(i == 0);
+
+            Synthesizer synthesizer2(settings2);
+            REQUIRE(synthesizer2.setSoundFont(synthesizer.sharedSoundFont()));
+            synthesizer2.configureChannel(0, 0, 1);
+
+            // The statistics callback is called from the rendering of the block
+            bool result = false;
+            synthesizer2.setStatisticsCallback(
+                [](const block_statistics_t& block, void* user_data)
+                {
+                    volatile float x = 1.0e-30f;
+                    volatile float y = 1.0e-10f;
+                    *static_cast<bool*>(user_data) = (x * y == 0.0f);
+                },
+                &result
+            );
+
+            synthesizer2.noteOn(0, 69, 100);
+
+            float buffer[64];
+            synthesizer2.render(buffer, 64);
+
+#if defined(KNM_SYNTHESIZER_SSE) || defined(KNM_SYNTHESIZER_SSE2) || \
+    (defined(KNM_SYNTHESIZER_NEON) && defined(__aarch64__) && defined(__GNUC__))
+            REQUIRE(result == (i == 0));
+#else
+            REQUIRE(!result);
+#endif
+            REQUIRE(!flushed());
+        }
+    }
 }
@@ -175,7 +175,11 @@ static float ref_C4[] = {
 
 TEST_CASE("Voice")
 {
+    // Run the tests with the exact and the fast mathematical functions
+    const bool fast_math = GENERATE(false, true);
+
     SynthesizerSettings settings(22050);
+    settings.enableFastMath(fast_math);
     Synthesizer synthesizer(settings);
 
     REQUIRE(synthesizer.loadSoundFont(DATA_DIR "440_16bits.sf2"));
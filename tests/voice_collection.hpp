@@ -0,0 +1,117 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-FileContributor: Philip Abbet <philip.abbet@gmail.com>
+ *
+ * SPDX-License-Identifier: MIT
+*/
+
+
+// Returns the index of each voice of a collection in its storage (the voices are all
+// allocated in one array, so the first one in memory is the start of the storage)
+static std::vector<size_t> storageIndices(VoiceCollection& voices)
+{
+    Voice* storage = *std::min_element(voices.voices().begin(), voices.voices().end());
+
+    std::vector<size_t> indices;
+    for (Voice* voice : voices.voices())
+        indices.push_back(voice - storage);
+
+    return indices;
+}
+
+
+TEST_CASE("VoiceCollection")
+{
+    SynthesizerSettings settings(22050);
+    settings.setMaximumPolyphony(8);
+    Synthesizer synthesizer(settings);
+
+    REQUIRE(synthesizer.loadSoundFont(DATA_DIR "440_16bits.sf2"));
+
+    const knm::sf::SoundFont& soundfont = synthesizer.soundfont();
+
+    knm::sf::key_info_t key_info;
+    REQUIRE(soundfont.getKeyInfo(0, 1, 69, 100, key_info));
+
+    VoiceCollection voices(&synthesizer);
+
+    auto start = [&](uint8_t key)
+    {
+        Voice* voice = voices.request(0, key, 0);
+        voice->start(key_info, soundfont.getBuffer(), 0, key, 100);
+        voices.started(voice);
+        return voice;
+    };
+
+
+    SECTION("Contiguous storage")
+    {
+        // The voices fill one array, in their initial order
+        std::vector<size_t> indices = storageIndices(voices);
+        REQUIRE(indices.size() == 8);
+
+        for (size_t i = 0; i < indices.size(); ++i)
+            REQUIRE(indices[i] == i);
+
+        // The blocks fill one arena, each of them starting on a cache line
+        const size_t block_size = aligned_block_size(settings.blockSize());
+        const float* blocks = voices.voices()[0]->block_left();
+
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            Voice* voice = voices.voices()[i];
+
+            REQUIRE(reinterpret_cast<uintptr_t>(voice->block_left()) % BLOCK_ALIGNMENT == 0);
+            REQUIRE(reinterpret_cast<uintptr_t>(voice->block_right()) % BLOCK_ALIGNMENT == 0);
+            REQUIRE(voice->block_left() == blocks + 2 * i * block_size);
+            REQUIRE(voice->block_right() == voice->block_left() + block_size);
+        }
+    }
+
+    SECTION("Reordered voices")
+    {
+        Voice* started[4];
+        for (int i = 0; i < 4; ++i)
+            started[i] = start(60 + i);
+
+        REQUIRE(voices.nbActiveVoices() == 4);
+
+        // A finished voice is swapped with the last active one, the other active voices
+        // stay first, in the same order
+        started[1]->kill();
+        voices.updatePriority(started[1]);
+        voices.process(settings.blockSize());
+
+        REQUIRE(voices.nbActiveVoices() == 3);
+        REQUIRE(voices.voices()[0] == started[0]);
+        REQUIRE(voices.voices()[1] == started[3]);
+        REQUIRE(voices.voices()[2] == started[2]);
+        REQUIRE(voices.voices()[3] == started[1]);
+
+        // The finished voice is reused first, from its place in the storage
+        Voice* voice = start(64);
+        REQUIRE(voice == started[1]);
+        REQUIRE(voices.voices()[3] == started[1]);
+
+        // No voice is lost or duplicated by the reordering
+        std::vector<size_t> indices = storageIndices(voices);
+        std::sort(indices.begin(), indices.end());
+
+        for (size_t i = 0; i < indices.size(); ++i)
+            REQUIRE(indices[i] == i);
+
+        // A copy of the state keeps the same order, in its own storage
+        VoiceCollection state(&synthesizer, true);
+        state.copyState(voices);
+
+        REQUIRE(state.nbActiveVoices() == 4);
+        REQUIRE(storageIndices(state) == storageIndices(voices));
+
+        for (size_t i = 0; i < 4; ++i)
+        {
+            REQUIRE(state.voices()[i]->key() == voices.voices()[i]->key());
+            REQUIRE(state.firstVoiceOfKey(0, voices.voices()[i]->key()) == state.voices()[i]);
+        }
+    }
+}
@@ -8,6 +8,9 @@
 
 TEST_CASE("VolumeEnvelope")
 {
+    // Run the tests with the exact and the fast mathematical functions
+    const bool fast_math = GENERATE(false, true);
+
     float ref[] = {
         0.0000f, 0.0000f, 0.0000f, 0.0805f, 0.2256f, 0.3707f, 0.5159f, 0.6610f, 0.8061f, 0.9512f,
         1.0000f, 1.0000f, 1.0000f, 1.0000f, 1.0000f, 0.9357f, 0.8185f, 0.7159f, 0.6262f, 0.5477f,
@@ -25,7 +28,7 @@ TEST_CASE("VolumeEnvelope")
         0.0018f, 0.0014f, 0.0011f,
     };
 
-    VolumeEnvelope envelope(22050);
+    VolumeEnvelope envelope(22050, fast_math);
 
     envelope.start(0.01f, 0.02f, 0.015f, 0.2f, 0.5f, 0.1f);
 
@@ -46,3 +49,31 @@ TEST_CASE("VolumeEnvelope")
         ++i;
     }
 }
+
+TEST_CASE("VolumeEnvelope, long notes")
+{
+    const bool fast_math = GENERATE(false, true);
+
+    VolumeEnvelope envelope(44100, fast_math);
+
+    // Decay after ten minutes
+    envelope.start(0.0f, 0.01f, 600.0f, 0.5f, 0.0f, 0.1f);
+
+    const double decay_start = double(0.01f) + double(600.0f);
+
+    uint64_t n = 0;
+    while (n < decay_start * 44100)
+    {
+        envelope.process(64);
+        n += 64;
+    }
+
+    for (int i = 0; i < 100; ++i)
+    {
+        envelope.process(64);
+        n += 64;
+
+        double elapsed = double(n) / 44100.0 - decay_start;
+        REQUIRE(envelope.getValue() == Approx(exp(-9.226 / 0.5 * elapsed)).margin(0.0001f));
+    }
+}